@@ -37,6 +37,7 @@
 #include "libavcodec/opt.h"
 #include "libavcodec/audioconvert.h"
 #include "libavcore/audioconvert.h"
+#include "libavcore/framepool.h"
 #include "libavcore/parseutils.h"
 #include "libavcore/samplefmt.h"
 #include "libavutil/colorspace.h"
@@ -53,6 +54,10 @@
 # include "libavfilter/vsrc_buffer.h"
 #endif
 
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #if HAVE_SYS_RESOURCE_H
 #include <sys/types.h>
 #include <sys/time.h>
@@ -176,8 +181,10 @@ static int loop_output = AVFMT_NOOUTPUTLOOP;
 static int qp_hist = 0;
 #if CONFIG_AVFILTER
 static char *vfilters = NULL;
+static int filter_threads = 1;
 AVFilterGraph *graph = NULL;
 #endif
+static AVFramePool *frame_pool = NULL;
 
 static int intra_only = 0;
 static int audio_sample_rate = 44100;
@@ -236,6 +243,10 @@ static int exit_on_error = 0;
 static int using_stdin = 0;
 static int verbose = 1;
 static int thread_count= 1;
+#if HAVE_PTHREADS
+static int use_pipeline = 0;
+static int pipeline_queue_size = 8;
+#endif
 static int q_pressed = 0;
 static int64_t video_size = 0;
 static int64_t audio_size = 0;
@@ -307,6 +318,8 @@ typedef struct AVOutputStream {
     AVAudioConvert *reformat_ctx;
     AVFifoBuffer *fifo;     /* for compression: one audio fifo per codec */
     FILE *logfile;
+
+    struct PipelineStage *encode_stage; /* thread encoding the stream with -pipeline */
 } AVOutputStream;
 
 static AVOutputStream **output_streams_for_file[MAX_FILES] = { NULL };
@@ -328,6 +341,7 @@ typedef struct AVInputStream {
     int is_start;            /* is 1 at the start and after a discontinuity */
     int showed_multi_packet_warning;
     int is_past_recording_time;
+    int repeat_pict;         /* repeat_pict of the parser after the last packet, -1 without parser */
 #if CONFIG_AVFILTER
     AVFilterContext *output_video_filter;
     AVFilterContext *input_video_filter;
@@ -344,6 +358,11 @@ typedef struct AVInputFile {
     int nb_streams;       /* nb streams we are aware of */
 } AVInputFile;
 
+typedef struct InputPacket {
+    AVPacket pkt;
+    int repeat_pict;      /* repeat_pict of the parser after reading pkt, -1 without parser */
+} InputPacket;
+
 #if HAVE_TERMIOS_H
 
 /* init terminal so that we can grab keys */
@@ -367,6 +386,7 @@ static int configure_filters(AVInputStream *ist, AVOutputStream *ost)
     int ret;
 
     graph = avfilter_graph_alloc();
+    graph->nb_threads = filter_threads;
 
     snprintf(args, 255, "%d:%d:%d:%d:%d", ist->st->codec->width,
              ist->st->codec->height, ist->st->codec->pix_fmt, 1, AV_TIME_BASE);
@@ -507,10 +527,429 @@ static int decode_interrupt_cb(void)
     return q_pressed || (q_pressed = read_key() == 'q');
 }
 
+static int read_input_packet(AVFormatContext *is, InputPacket *ipkt)
+{
+    int ret = av_read_frame(is, &ipkt->pkt);
+
+    if (ret >= 0) {
+        AVCodecParserContext *parser = is->streams[ipkt->pkt.stream_index]->parser;
+        ipkt->repeat_pict = parser ? parser->repeat_pict : -1;
+    }
+    return ret;
+}
+
+#if HAVE_PTHREADS
+/**
+ * Bounded FIFO of fixed size elements, passed between the threads of
+ * -pipeline.
+ */
+typedef struct ThreadQueue {
+    AVFifoBuffer *fifo;
+    int elem_size;
+    void (*free_elem)(void *elem);
+
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    int eof;                    ///< The sender closed the queue.
+    int abort;                  ///< The receiver is told to stop, nothing more is passed.
+    int idle;                   ///< The sender has nothing to send for now.
+
+    /* statistics, shown with -benchmark */
+    int64_t nb_elems;           ///< elements sent
+    int64_t depth_sum;          ///< sum of the number of elements queued after each send
+    int max_depth;
+    int64_t send_stall;         ///< microseconds the senders waited for room
+    int64_t recv_stall;         ///< microseconds the receiver waited for elements
+} ThreadQueue;
+
+/**
+ * A thread of -pipeline: the demuxer of an input file, the encoder of a
+ * video stream or the muxer of an output file.
+ */
+typedef struct PipelineStage {
+    char name[32];
+    pthread_t thread;
+    int running;                ///< The thread was started and not joined yet.
+    ThreadQueue *in;            ///< what the thread is given, NULL for a demuxer
+    ThreadQueue *out;           ///< what the thread produces, NULL for a muxer
+    int file_index;
+    AVOutputStream *ost;        ///< stream of an encoder
+    int flushed;                ///< The main thread told the encoder to flush.
+
+    pthread_mutex_t lock;       ///< Protects the fields below, updated by the thread.
+    int64_t size;               ///< bytes coded by an encoder, position in the file of a muxer
+    int64_t *pts;               ///< AVStream.pts.val of each stream of a muxer
+    AVFrame coded_frame;        ///< last coded_frame of an encoder
+} PipelineStage;
+
+/**
+ * Packet for a muxer thread, or the place of the packets of an encoder
+ * thread among the other packets, which is where the main thread writes
+ * them without -pipeline.
+ */
+typedef struct MuxPacket {
+    AVPacket pkt;
+    AVCodecContext *avctx;
+    AVBitStreamFilterContext *bsfc;
+    PipelineStage *encoder;     ///< Take the next packet, possibly empty, of this encoder instead.
+    int flush;                  ///< Take all the remaining packets of the encoder.
+} MuxPacket;
+
+typedef struct EncodeFrame {
+    AVFrame picture;
+    AVFrameBuffer *buf;         ///< data of picture
+} EncodeFrame;
+
+static PipelineStage *demux_stages[MAX_FILES];
+static PipelineStage *mux_stages[MAX_FILES];
+static PipelineStage **encode_stages;
+static int nb_encode_stages;
+static volatile int pipeline_error; ///< set by the threads which failed
+
+static ThreadQueue *tq_alloc(int elem_size, int nb_elems, void (*free_elem)(void *))
+{
+    ThreadQueue *q = av_mallocz(sizeof(*q));
+
+    if (!q)
+        return NULL;
+    if (!(q->fifo = av_fifo_alloc(elem_size * nb_elems))) {
+        av_free(q);
+        return NULL;
+    }
+    q->elem_size = elem_size;
+    q->free_elem = free_elem;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return q;
+}
+
+static void tq_free(ThreadQueue *q)
+{
+    uint8_t *elem;
+
+    if (!q)
+        return;
+    if (q->free_elem && (elem = av_malloc(q->elem_size))) {
+        while (av_fifo_size(q->fifo) >= q->elem_size) {
+            av_fifo_generic_read(q->fifo, elem, q->elem_size, NULL);
+            q->free_elem(elem);
+        }
+        av_free(elem);
+    }
+    av_fifo_free(q->fifo);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    av_free(q);
+}
+
+/**
+ * Add a copy of elem to the queue, waiting for room if it is full.
+ *
+ * @return 0, or AVERROR(EINTR) if the receiver was told to stop, in which
+ *         case elem was not added
+ */
+static int tq_send(ThreadQueue *q, void *elem)
+{
+    int depth, ret = 0;
+
+    pthread_mutex_lock(&q->lock);
+    if (av_fifo_space(q->fifo) < q->elem_size && !q->abort) {
+        int64_t t = av_gettime();
+        while (av_fifo_space(q->fifo) < q->elem_size && !q->abort)
+            pthread_cond_wait(&q->not_full, &q->lock);
+        q->send_stall += av_gettime() - t;
+    }
+    if (q->abort) {
+        ret = AVERROR(EINTR);
+    } else {
+        av_fifo_generic_write(q->fifo, elem, q->elem_size, NULL);
+        depth = av_fifo_size(q->fifo) / q->elem_size;
+        q->nb_elems++;
+        q->depth_sum += depth;
+        q->max_depth  = FFMAX(q->max_depth, depth);
+        q->idle = 0;
+        pthread_cond_signal(&q->not_empty);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+/**
+ * Take the oldest element of the queue, waiting for one if it is empty,
+ * unless the sender is idle.
+ *
+ * @return 0, AVERROR(EAGAIN) if the sender is idle, AVERROR_EOF once the
+ *         queue is closed and empty, or AVERROR(EINTR) if the receiver was
+ *         told to stop
+ */
+static int tq_recv(ThreadQueue *q, void *elem)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&q->lock);
+    if (!av_fifo_size(q->fifo) && !q->eof && !q->abort && !q->idle) {
+        int64_t t = av_gettime();
+        while (!av_fifo_size(q->fifo) && !q->eof && !q->abort && !q->idle)
+            pthread_cond_wait(&q->not_empty, &q->lock);
+        q->recv_stall += av_gettime() - t;
+    }
+    if (q->abort) {
+        ret = AVERROR(EINTR);
+    } else if (av_fifo_size(q->fifo)) {
+        av_fifo_generic_read(q->fifo, elem, q->elem_size, NULL);
+        pthread_cond_signal(&q->not_full);
+    } else {
+        ret = q->eof ? AVERROR_EOF : AVERROR(EAGAIN);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+/**
+ * Tell the receiver not to wait for an element until the next one is sent.
+ *
+ * @return 0, or AVERROR(EINTR) if the receiver was told to stop
+ */
+static int tq_idle(ThreadQueue *q)
+{
+    int ret;
+
+    pthread_mutex_lock(&q->lock);
+    q->idle = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    ret = q->abort ? AVERROR(EINTR) : 0;
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+/** Mark the end of the elements sent. */
+static void tq_close(ThreadQueue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->eof = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/** Tell the receiver to stop, and the senders to send nothing more. */
+static void tq_abort(ThreadQueue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->abort = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* allocate a stage, with an input and an output queue of elements of the
+   given size, or none if the size is 0 */
+static PipelineStage *alloc_stage(int in_size, void (*free_in)(void *),
+                                  int out_size, void (*free_out)(void *))
+{
+    PipelineStage *stage = av_mallocz(sizeof(*stage));
+    int nb_elems = FFMAX(pipeline_queue_size, 1);
+
+    if (!stage)
+        return NULL;
+    pthread_mutex_init(&stage->lock, NULL);
+    if ((in_size  && !(stage->in  = tq_alloc(in_size,  nb_elems, free_in))) ||
+        (out_size && !(stage->out = tq_alloc(out_size, nb_elems, free_out)))) {
+        tq_free(stage->in);
+        pthread_mutex_destroy(&stage->lock);
+        av_freep(&stage);
+    }
+    return stage;
+}
+
+static int start_stage(PipelineStage *stage, void *(*thread_func)(void *))
+{
+    if (pthread_create(&stage->thread, NULL, thread_func, stage))
+        return AVERROR(ENOMEM);
+    stage->running = 1;
+    return 0;
+}
+
+static void join_stage(PipelineStage *stage)
+{
+    if (stage && stage->running) {
+        pthread_join(stage->thread, NULL);
+        stage->running = 0;
+    }
+}
+
+/** Wait for the thread to handle everything it was given. */
+static void finish_stage(PipelineStage *stage)
+{
+    if (stage) {
+        tq_close(stage->in);
+        join_stage(stage);
+    }
+}
+
+/** Stop the thread, dropping what it was not done with. */
+static void stop_stage(PipelineStage *stage)
+{
+    if (stage) {
+        if (stage->in)
+            tq_abort(stage->in);
+        if (stage->out)
+            tq_abort(stage->out);
+        join_stage(stage);
+    }
+}
+
+static void free_stage(PipelineStage **stage)
+{
+    if (*stage) {
+        tq_free((*stage)->in);
+        tq_free((*stage)->out);
+        pthread_mutex_destroy(&(*stage)->lock);
+        av_free((*stage)->pts);
+        av_freep(stage);
+    }
+}
+
+static void free_pipeline(void)
+{
+    int i;
+
+    /* the muxers may wait for packets of the encoders, so all the threads
+       stop before any queue is freed */
+    for (i = 0; i < MAX_FILES; i++)
+        stop_stage(demux_stages[i]);
+    for (i = 0; i < nb_encode_stages; i++)
+        stop_stage(encode_stages[i]);
+    for (i = 0; i < MAX_FILES; i++)
+        stop_stage(mux_stages[i]);
+
+    for (i = 0; i < MAX_FILES; i++) {
+        free_stage(&demux_stages[i]);
+        free_stage(&mux_stages[i]);
+    }
+    for (i = 0; i < nb_encode_stages; i++)
+        free_stage(&encode_stages[i]);
+    av_freep(&encode_stages);
+    nb_encode_stages = 0;
+}
+
+static void free_input_packet(void *elem)
+{
+    av_free_packet(&((InputPacket *)elem)->pkt);
+}
+
+static void free_mux_packet(void *elem)
+{
+    av_free_packet(&((MuxPacket *)elem)->pkt);
+}
+
+static void free_encode_frame(void *elem)
+{
+    av_frame_buffer_unref(&((EncodeFrame *)elem)->buf);
+}
+
+static void *demux_thread(void *arg)
+{
+    PipelineStage *stage = arg;
+    AVFormatContext *is = input_files[stage->file_index];
+    InputPacket ipkt;
+    int ret;
+
+    for (;;) {
+        ret = read_input_packet(is, &ipkt);
+        if (ret == AVERROR(EAGAIN)) {
+            /* let the main thread go on with the other inputs meanwhile */
+            if (tq_idle(stage->out) < 0)
+                break;
+#ifdef _MSC_VER
+            Sleep(10);
+#else
+            usleep(10000);
+#endif
+            continue;
+        }
+        if (ret < 0)
+            break;
+        /* the data may belong to the demuxer until the next read */
+        if (av_dup_packet(&ipkt.pkt) < 0 || tq_send(stage->out, &ipkt) < 0) {
+            av_free_packet(&ipkt.pkt);
+            break;
+        }
+    }
+    tq_close(stage->out);
+    return NULL;
+}
+
+static void print_queue_stats(const char *name, const char *queue_name, ThreadQueue *q)
+{
+    if (!q)
+        return;
+    printf("bench: %s %s: %"PRId64" queued, depth avg %.1f max %d, "
+           "sender stalled %0.3fs, receiver stalled %0.3fs\n",
+           name, queue_name, q->nb_elems,
+           q->nb_elems ? (double)q->depth_sum / q->nb_elems : 0.0, q->max_depth,
+           q->send_stall / 1000000.0, q->recv_stall / 1000000.0);
+}
+
+static void print_stage_stats(PipelineStage *stage)
+{
+    if (stage) {
+        print_queue_stats(stage->name, "input",  stage->in);
+        print_queue_stats(stage->name, "output", stage->out);
+    }
+}
+
+static void print_pipeline_stats(void)
+{
+    int i;
+
+    for (i = 0; i < nb_input_files; i++)
+        print_stage_stats(demux_stages[i]);
+    for (i = 0; i < nb_encode_stages; i++)
+        print_stage_stats(encode_stages[i]);
+    for (i = 0; i < nb_output_files; i++)
+        print_stage_stats(mux_stages[i]);
+}
+#endif
+
+/* read the next packet of an input file, from its demuxer thread with -pipeline */
+static int get_input_packet(int file_index, InputPacket *ipkt)
+{
+#if HAVE_PTHREADS
+    if (demux_stages[file_index])
+        return tq_recv(demux_stages[file_index]->out, ipkt);
+#endif
+    return read_input_packet(input_files[file_index], ipkt);
+}
+
+/* position in an output file, as of the last packet written by its muxer
+   thread with -pipeline */
+static int64_t get_output_file_pos(int file_index)
+{
+#if HAVE_PTHREADS
+    PipelineStage *stage = mux_stages[file_index];
+
+    if (stage) {
+        int64_t pos;
+        pthread_mutex_lock(&stage->lock);
+        pos = stage->size;
+        pthread_mutex_unlock(&stage->lock);
+        return pos;
+    }
+#endif
+    return url_ftell(output_files[file_index]->pb);
+}
+
 static int ffmpeg_exit(int ret)
 {
     int i;
 
+#if HAVE_PTHREADS
+    free_pipeline();
+#endif
+
     /* close files */
     for(i=0;i<nb_output_files;i++) {
         /* maybe av_close_output_file ??? */
@@ -565,6 +1004,7 @@ static int ffmpeg_exit(int ret)
     allocated_audio_buf_size= allocated_audio_out_size= 0;
     av_free(samples);
 
+    av_frame_pool_free(&frame_pool);
 #if CONFIG_AVFILTER
     avfilter_uninit();
 #endif
@@ -753,9 +1193,26 @@ get_sync_ipts(const AVOutputStream *ost)
     return (double)(ist->pts - start_time)/AV_TIME_BASE;
 }
 
-static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc){
-    int ret;
+/* pts of ost in its muxer in seconds, as of the last packet written by the
+   muxer thread with -pipeline */
+static double get_output_pts(AVOutputStream *ost)
+{
+    int64_t pts = ost->st->pts.val;
+#if HAVE_PTHREADS
+    PipelineStage *stage = mux_stages[ost->file_index];
+
+    if (stage) {
+        pthread_mutex_lock(&stage->lock);
+        pts = stage->pts[ost->index];
+        pthread_mutex_unlock(&stage->lock);
+    }
+#endif
+    return pts * av_q2d(ost->st->time_base);
+}
 
+/* returns < 0 if a filter failed and -xerror was given */
+static int apply_bitstream_filters(AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc)
+{
     while(bsfc){
         AVPacket new_pkt= *pkt;
         int a= av_bitstream_filter_filter(bsfc, avctx, NULL,
@@ -771,12 +1228,88 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx
                     avctx->codec ? avctx->codec->name : "copy");
             print_error("", a);
             if (exit_on_error)
-                ffmpeg_exit(1);
+                return a;
         }
         *pkt= new_pkt;
 
         bsfc= bsfc->next;
     }
+    return 0;
+}
+
+#if HAVE_PTHREADS
+/* write a packet in a muxer thread, or only drop it after a failure, until
+   the main thread notices it and exits */
+static void mux_packet(PipelineStage *stage, MuxPacket *mpkt, int *failed)
+{
+    AVFormatContext *s = output_files[stage->file_index];
+    int ret, stream_index = mpkt->pkt.stream_index;
+
+    if (!*failed) {
+        ret = apply_bitstream_filters(&mpkt->pkt, mpkt->avctx, mpkt->bsfc);
+        if (ret >= 0 && (ret = av_interleaved_write_frame(s, &mpkt->pkt)) < 0)
+            print_error("av_interleaved_write_frame()", ret);
+        if (ret < 0) {
+            pipeline_error = 1;
+            *failed = 1;
+        }
+
+        pthread_mutex_lock(&stage->lock);
+        stage->size = s->pb ? url_ftell(s->pb) : 0;
+        stage->pts[stream_index] = s->streams[stream_index]->pts.val;
+        pthread_mutex_unlock(&stage->lock);
+    }
+    av_free_packet(&mpkt->pkt);
+}
+
+static void *mux_thread(void *arg)
+{
+    PipelineStage *stage = arg;
+    MuxPacket mpkt, coded;
+    int failed = 0;
+
+    while (tq_recv(stage->in, &mpkt) >= 0) {
+        if (!mpkt.encoder) {
+            mux_packet(stage, &mpkt, &failed);
+            continue;
+        }
+        do {
+            if (tq_recv(mpkt.encoder->out, &coded) < 0)
+                break;
+            if (coded.pkt.size)
+                mux_packet(stage, &coded, &failed);
+        } while (mpkt.flush);
+    }
+    return NULL;
+}
+#endif
+
+static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc){
+    int ret;
+#if HAVE_PTHREADS
+    PipelineStage *stage = NULL;
+    int i;
+
+    for (i = 0; i < nb_output_files; i++)
+        if (output_files[i] == s)
+            stage = mux_stages[i];
+    if (stage) {
+        MuxPacket mpkt = { *pkt, avctx, bsfc, NULL };
+
+        /* pkt stays with the caller, the muxer thread gets a copy */
+        mpkt.pkt.destruct = NULL;
+        if (av_dup_packet(&mpkt.pkt) < 0) {
+            fprintf(stderr, "Could not alloc packet for the muxer\n");
+            pipeline_error = 1;
+        } else if (tq_send(stage->in, &mpkt) < 0) {
+            av_free_packet(&mpkt.pkt);
+        }
+        return;
+    }
+#endif
+
+    if (apply_bitstream_filters(pkt, avctx, bsfc) < 0)
+        ffmpeg_exit(1);
 
     ret= av_interleaved_write_frame(s, pkt);
     if(ret < 0){
@@ -1144,6 +1677,165 @@ static void do_subtitle_out(AVFormatContext *s,
 static int bit_buffer_size= 1024*256;
 static uint8_t *bit_buffer= NULL;
 
+/* encode picture into buf, or flush the encoder if picture is NULL, and
+   set pkt to the packet, which is empty if the encoder output nothing
+   returns the size of the packet, or < 0 if the encoding failed */
+static int encode_video_frame(AVOutputStream *ost, AVFrame *picture, AVPacket *pkt,
+                              uint8_t *buf, int buf_size)
+{
+    AVCodecContext *enc = ost->st->codec;
+    int ret;
+
+    ret = avcodec_encode_video(enc, buf, buf_size, picture);
+    if (ret < 0)
+        return ret;
+
+    av_init_packet(pkt);
+    pkt->stream_index= ost->index;
+    pkt->data= ret > 0 ? buf : NULL;
+    pkt->size= ret;
+    if(ret>0){
+        if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
+            pkt->pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
+/*av_log(NULL, AV_LOG_DEBUG, "encoder -> %"PRId64"/%"PRId64"\n",
+   pkt->pts != AV_NOPTS_VALUE ? av_rescale(pkt->pts, enc->time_base.den, AV_TIME_BASE*(int64_t)enc->time_base.num) : -1,
+   pkt->dts != AV_NOPTS_VALUE ? av_rescale(pkt->dts, enc->time_base.den, AV_TIME_BASE*(int64_t)enc->time_base.num) : -1);*/
+
+        if(enc->coded_frame && enc->coded_frame->key_frame)
+            pkt->flags |= AV_PKT_FLAG_KEY;
+        //fprintf(stderr,"\nFrame: %3d size: %5d type: %d",
+        //        enc->frame_number-1, ret, enc->pict_type);
+    }
+    /* if two pass, output log (when flushing even without packet, like
+       output_packet() does) */
+    if (ost->logfile && enc->stats_out && (ret > 0 || !picture)) {
+        fprintf(ost->logfile, "%s", enc->stats_out);
+    }
+    return ret;
+}
+
+#if HAVE_PTHREADS
+/* pass a copy of picture to the encoder thread of ost, and tell the muxer
+   thread to write the packet the encoder makes of it at this point */
+static int send_frame_to_encoder(AVOutputStream *ost, const AVFrame *picture)
+{
+    AVCodecContext *enc = ost->st->codec;
+    PipelineStage *stage = ost->encode_stage;
+    MuxPacket mpkt = { { 0 } };
+    EncodeFrame frame;
+    int size = avpicture_get_size(enc->pix_fmt, enc->width, enc->height);
+
+    if (size < 0 || !(frame.buf = av_frame_pool_get(frame_pool, size))) {
+        fprintf(stderr, "Could not alloc frame for the encoder\n");
+        return AVERROR(ENOMEM);
+    }
+    /* only the fields the encoders use, the others may point to data of
+       the decoder or of the filters, which is gone by the time the frame
+       is encoded */
+    avcodec_get_frame_defaults(&frame.picture);
+    frame.picture.pts              = picture->pts;
+    frame.picture.quality          = picture->quality;
+    frame.picture.pict_type        = picture->pict_type;
+    frame.picture.interlaced_frame = picture->interlaced_frame;
+    frame.picture.top_field_first  = picture->top_field_first;
+    avpicture_fill((AVPicture *)&frame.picture, frame.buf->data,
+                   enc->pix_fmt, enc->width, enc->height);
+    av_picture_copy((AVPicture *)&frame.picture, (const AVPicture *)picture,
+                    enc->pix_fmt, enc->width, enc->height);
+
+    /* the encoder thread aborts its input when it fails, after saying so */
+    if (tq_send(stage->in, &frame) < 0) {
+        av_frame_buffer_unref(&frame.buf);
+        return AVERROR(EINTR);
+    }
+    mpkt.encoder = stage;
+    tq_send(mux_stages[ost->file_index]->in, &mpkt);
+    return 0;
+}
+
+/* let the encoder thread of ost flush the encoder, and the muxer thread
+   write the packets at this point */
+static void flush_encoder_stage(PipelineStage *stage)
+{
+    MuxPacket mpkt = { { 0 } };
+
+    if (stage->flushed)
+        return;
+    stage->flushed = 1;
+    tq_close(stage->in);
+    mpkt.encoder = stage;
+    mpkt.flush   = 1;
+    tq_send(mux_stages[stage->ost->file_index]->in, &mpkt);
+}
+
+/* pass a packet coded by an encoder thread, possibly empty, to the muxer thread */
+static int send_coded_packet(PipelineStage *stage, AVPacket *pkt)
+{
+    AVOutputStream *ost = stage->ost;
+    MuxPacket mpkt = { *pkt, ost->st->codec, ost->bitstream_filters, NULL };
+    int ret;
+
+    pthread_mutex_lock(&stage->lock);
+    stage->size += pkt->size;
+    if (ost->st->codec->coded_frame)
+        stage->coded_frame = *ost->st->codec->coded_frame;
+    pthread_mutex_unlock(&stage->lock);
+
+    /* the data is in the buffer of the encoder thread */
+    if ((ret = av_dup_packet(&mpkt.pkt)) < 0) {
+        fprintf(stderr, "Could not alloc packet for the muxer\n");
+        return ret;
+    }
+    if ((ret = tq_send(stage->out, &mpkt)) < 0)
+        av_free_packet(&mpkt.pkt);
+    return ret;
+}
+
+static void *encode_thread(void *arg)
+{
+    PipelineStage *stage = arg;
+    AVOutputStream *ost = stage->ost;
+    int buf_size = bit_buffer_size;
+    uint8_t *buf = av_malloc(buf_size);
+    EncodeFrame frame;
+    AVPacket pkt;
+    int ret = AVERROR(ENOMEM);
+
+    if (!buf)
+        goto fail;
+
+    /* a packet, possibly empty, for each frame */
+    while ((ret = tq_recv(stage->in, &frame)) >= 0) {
+        ret = encode_video_frame(ost, &frame.picture, &pkt, buf, buf_size);
+        av_frame_buffer_unref(&frame.buf);
+        if (ret < 0)
+            goto fail;
+        if ((ret = send_coded_packet(stage, &pkt)) < 0)
+            goto end;
+    }
+    if (ret == AVERROR_EOF) {
+        /* then the packets the encoder still has */
+        while ((ret = encode_video_frame(ost, NULL, &pkt, buf, buf_size)) > 0)
+            if ((ret = send_coded_packet(stage, &pkt)) < 0)
+                goto end;
+        if (ret < 0)
+            goto fail;
+    }
+    goto end;
+
+fail:
+    fprintf(stderr, "Video encoding failed\n");
+end:
+    if (ret < 0 && ret != AVERROR(EINTR)) {
+        pipeline_error = 1;
+        tq_abort(stage->in);
+    }
+    tq_close(stage->out);
+    av_free(buf);
+    return NULL;
+}
+#endif
+
 static void do_video_out(AVFormatContext *s,
                          AVOutputStream *ost,
                          AVInputStream *ist,
@@ -1284,34 +1976,23 @@ static void do_video_out(AVFormatContext *s,
                 big_picture.pict_type = FF_I_TYPE;
                 ost->forced_kf_index++;
             }
-            ret = avcodec_encode_video(enc,
-                                       bit_buffer, bit_buffer_size,
-                                       &big_picture);
-            if (ret < 0) {
-                fprintf(stderr, "Video encoding failed\n");
-                ffmpeg_exit(1);
-            }
-
-            if(ret>0){
-                pkt.data= bit_buffer;
-                pkt.size= ret;
-                if(enc->coded_frame->pts != AV_NOPTS_VALUE)
-                    pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
-/*av_log(NULL, AV_LOG_DEBUG, "encoder -> %"PRId64"/%"PRId64"\n",
-   pkt.pts != AV_NOPTS_VALUE ? av_rescale(pkt.pts, enc->time_base.den, AV_TIME_BASE*(int64_t)enc->time_base.num) : -1,
-   pkt.dts != AV_NOPTS_VALUE ? av_rescale(pkt.dts, enc->time_base.den, AV_TIME_BASE*(int64_t)enc->time_base.num) : -1);*/
-
-                if(enc->coded_frame->key_frame)
-                    pkt.flags |= AV_PKT_FLAG_KEY;
-                write_frame(s, &pkt, ost->st->codec, ost->bitstream_filters);
+#if HAVE_PTHREADS
+            if (ost->encode_stage) {
+                if (send_frame_to_encoder(ost, &big_picture) < 0)
+                    ffmpeg_exit(1);
+            } else
+#endif
+            {
+                ret = encode_video_frame(ost, &big_picture, &pkt,
+                                         bit_buffer, bit_buffer_size);
+                if (ret < 0) {
+                    fprintf(stderr, "Video encoding failed\n");
+                    ffmpeg_exit(1);
+                }
+                if (ret > 0)
+                    write_frame(s, &pkt, ost->st->codec, ost->bitstream_filters);
                 *frame_size = ret;
                 video_size += ret;
-                //fprintf(stderr,"\nFrame: %3d size: %5d type: %d",
-                //        enc->frame_number-1, ret, enc->pict_type);
-                /* if two pass, output log */
-                if (ost->logfile && enc->stats_out) {
-                    fprintf(ost->logfile, "%s", enc->stats_out);
-                }
             }
         }
         ost->sync_opts++;
@@ -1369,6 +2050,10 @@ static void print_report(AVFormatContext **output_files,
     AVFormatContext *oc;
     int64_t total_size;
     AVCodecContext *enc;
+    AVFrame *coded_frame;
+#if HAVE_PTHREADS
+    AVFrame coded_frame_copy;
+#endif
     int frame_number, vid, i;
     double bitrate, ti1, pts;
     static int64_t last_time = -1;
@@ -1390,9 +2075,16 @@ static void print_report(AVFormatContext **output_files,
 
     oc = output_files[0];
 
+#if HAVE_PTHREADS
+    if (mux_stages[0] && !is_last_report)
+        total_size = get_output_file_pos(0);
+    else
+#endif
+    {
     total_size = url_fsize(oc->pb);
     if(total_size<0) // FIXME improve url_fsize() so it works with non seekable output too
         total_size= url_ftell(oc->pb);
+    }
 
     buf[0] = '\0';
     ti1 = 1e10;
@@ -1400,10 +2092,19 @@ static void print_report(AVFormatContext **output_files,
     for(i=0;i<nb_ostreams;i++) {
         ost = ost_table[i];
         enc = ost->st->codec;
+        coded_frame = enc->coded_frame;
+#if HAVE_PTHREADS
+        if (ost->encode_stage) {
+            coded_frame = &coded_frame_copy;
+            pthread_mutex_lock(&ost->encode_stage->lock);
+            coded_frame_copy = ost->encode_stage->coded_frame;
+            pthread_mutex_unlock(&ost->encode_stage->lock);
+        }
+#endif
         if (vid && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "q=%2.1f ",
                      !ost->st->stream_copy ?
-                     enc->coded_frame->quality/(float)FF_QP2LAMBDA : -1);
+                     coded_frame->quality/(float)FF_QP2LAMBDA : -1);
         }
         if (!vid && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
             float t = (av_gettime()-timer_start) / 1000000.0;
@@ -1412,12 +2113,12 @@ static void print_report(AVFormatContext **output_files,
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "frame=%5d fps=%3d q=%3.1f ",
                      frame_number, (t>1)?(int)(frame_number/t+0.5) : 0,
                      !ost->st->stream_copy ?
-                     enc->coded_frame->quality/(float)FF_QP2LAMBDA : -1);
+                     coded_frame->quality/(float)FF_QP2LAMBDA : -1);
             if(is_last_report)
                 snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "L");
             if(qp_hist){
                 int j;
-                int qp= lrintf(enc->coded_frame->quality/(float)FF_QP2LAMBDA);
+                int qp= lrintf(coded_frame->quality/(float)FF_QP2LAMBDA);
                 if(qp>=0 && qp<FF_ARRAY_ELEMS(qp_histogram))
                     qp_histogram[qp]++;
                 for(j=0; j<32; j++)
@@ -1434,7 +2135,7 @@ static void print_report(AVFormatContext **output_files,
                         error= enc->error[j];
                         scale= enc->width*enc->height*255.0*255.0*frame_number;
                     }else{
-                        error= enc->coded_frame->error[j];
+                        error= coded_frame->error[j];
                         scale= enc->width*enc->height*255.0*255.0;
                     }
                     if(j) scale/=4;
@@ -1447,7 +2148,7 @@ static void print_report(AVFormatContext **output_files,
             vid = 1;
         }
         /* compute min output value */
-        pts = (double)ost->st->pts.val * av_q2d(ost->st->time_base);
+        pts = get_output_pts(ost);
         if ((pts < ti1) && (pts > 0))
             ti1 = pts;
     }
@@ -1587,7 +2288,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
                     }
                     ist->next_pts = ist->pts = guess_correct_pts(&ist->pts_ctx, picture.reordered_opaque, ist->pts);
                     if (ist->st->codec->time_base.num != 0) {
-                        int ticks= ist->st->parser ? ist->st->parser->repeat_pict+1 : ist->st->codec->ticks_per_frame;
+                        int ticks= ist->repeat_pict >= 0 ? ist->repeat_pict+1 : ist->st->codec->ticks_per_frame;
                         ist->next_pts += ((int64_t)AV_TIME_BASE *
                                           ist->st->codec->time_base.num * ticks) /
                             ist->st->codec->time_base.den;
@@ -1616,7 +2317,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
                 break;
             case AVMEDIA_TYPE_VIDEO:
                 if (ist->st->codec->time_base.num != 0) {
-                    int ticks= ist->st->parser ? ist->st->parser->repeat_pict+1 : ist->st->codec->ticks_per_frame;
+                    int ticks= ist->repeat_pict >= 0 ? ist->repeat_pict+1 : ist->st->codec->ticks_per_frame;
                     ist->next_pts += ((int64_t)AV_TIME_BASE *
                                       ist->st->codec->time_base.num * ticks) /
                         ist->st->codec->time_base.den;
@@ -1802,6 +2503,12 @@ static int output_packet(AVInputStream *ist, int ist_index,
                 if(ost->st->codec->codec_type == AVMEDIA_TYPE_VIDEO && (os->oformat->flags & AVFMT_RAWPICTURE))
                     continue;
 
+#if HAVE_PTHREADS
+                if (ost->encode_stage) {
+                    flush_encoder_stage(ost->encode_stage);
+                    continue;
+                }
+#endif
                 if (ost->encoding_needed) {
                     for(;;) {
                         AVPacket pkt;
@@ -1953,6 +2660,67 @@ static void parse_forced_key_frames(char *kf, AVOutputStream *ost,
 /*
  * The following code is the main loop of the file converter
  */
+#if HAVE_PTHREADS
+/* start a demuxer thread for each input file, a muxer thread for each
+   output file, and an encoder thread for each encoded video stream */
+static int start_pipeline(AVOutputStream **ost_table, int nb_ostreams)
+{
+    PipelineStage *stage;
+    int i, j, ret;
+
+    for (i = 0; i < nb_input_files; i++) {
+        if (!(stage = demux_stages[i] = alloc_stage(0, NULL, sizeof(InputPacket), free_input_packet)))
+            return AVERROR(ENOMEM);
+        snprintf(stage->name, sizeof(stage->name), "demux #%d", i);
+        stage->file_index = i;
+        if ((ret = start_stage(stage, demux_thread)) < 0)
+            return ret;
+    }
+
+    for (i = 0; i < nb_output_files; i++) {
+        AVFormatContext *os = output_files[i];
+
+        /* raw pictures are written as AVPicture structures pointing to
+           the frames, which change before a muxer thread would get them */
+        if (os->oformat->flags & AVFMT_RAWPICTURE)
+            continue;
+        if (!(stage = mux_stages[i] = alloc_stage(sizeof(MuxPacket), free_mux_packet, 0, NULL)) ||
+            !(stage->pts = av_malloc(os->nb_streams * sizeof(*stage->pts))))
+            return AVERROR(ENOMEM);
+        snprintf(stage->name, sizeof(stage->name), "mux #%d", i);
+        stage->file_index = i;
+        stage->size = os->pb ? url_ftell(os->pb) : 0;
+        for (j = 0; j < os->nb_streams; j++)
+            stage->pts[j] = os->streams[j]->pts.val;
+        if ((ret = start_stage(stage, mux_thread)) < 0)
+            return ret;
+    }
+
+    if (!frame_pool && !(frame_pool = av_frame_pool_alloc()))
+        return AVERROR(ENOMEM);
+    if (!(encode_stages = av_mallocz(nb_ostreams * sizeof(*encode_stages))))
+        return AVERROR(ENOMEM);
+    for (i = 0; i < nb_ostreams; i++) {
+        AVOutputStream *ost = ost_table[i];
+
+        /* -vstats and -me_threshold need the encoder or the decoded frame
+           as they are when the frame is passed to the encoder */
+        if (!ost->encoding_needed || ost->st->codec->codec_type != AVMEDIA_TYPE_VIDEO ||
+            !mux_stages[ost->file_index] || vstats_filename || me_threshold)
+            continue;
+        if (!(stage = encode_stages[nb_encode_stages++] = alloc_stage(sizeof(EncodeFrame), free_encode_frame,
+                                                                     sizeof(MuxPacket), free_mux_packet)))
+            return AVERROR(ENOMEM);
+        snprintf(stage->name, sizeof(stage->name), "encode #%d.%d", ost->file_index, ost->index);
+        stage->ost = ost;
+        if ((ret = start_stage(stage, encode_thread)) < 0)
+            return ret;
+        ost->encode_stage = stage;
+    }
+    return 0;
+}
+#endif
+
 static int transcode(AVFormatContext **output_files,
                      int nb_output_files,
                      AVFormatContext **input_files,
@@ -2374,6 +3142,20 @@ static int transcode(AVFormatContext **output_files,
                 ret = AVERROR(EINVAL);
                 goto dump_format;
             }
+#if CONFIG_AVFILTER
+            /* decode the video into pool buffers, which are passed to the
+             * filters without copying them */
+            if (ist->st->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
+                codec->capabilities & CODEC_CAP_DR1) {
+                if (!frame_pool && !(frame_pool = av_frame_pool_alloc())) {
+                    ret = AVERROR(ENOMEM);
+                    goto fail;
+                }
+                ist->st->codec->frame_pool     = frame_pool;
+                ist->st->codec->get_buffer     = avcodec_pool_get_buffer;
+                ist->st->codec->release_buffer = avcodec_pool_release_buffer;
+            }
+#endif
             if (avcodec_open(ist->st->codec, codec) < 0) {
                 snprintf(error, sizeof(error), "Error while opening decoder for input stream #%d.%d",
                         ist->file_index, ist->index);
@@ -2394,6 +3176,7 @@ static int transcode(AVFormatContext **output_files,
         ist->next_pts = AV_NOPTS_VALUE;
         init_pts_correction(&ist->pts_ctx);
         ist->is_start = 1;
+        ist->repeat_pict = -1;
     }
 
     /* set meta data information from input file if required */
@@ -2538,10 +3321,18 @@ static int transcode(AVFormatContext **output_files,
     }
     term_init();
 
+#if HAVE_PTHREADS
+    if (use_pipeline && (ret = start_pipeline(ost_table, nb_ostreams)) < 0) {
+        fprintf(stderr, "Could not start the threads of the pipeline\n");
+        goto fail;
+    }
+#endif
+
     timer_start = av_gettime();
 
     for(; received_sigterm == 0;) {
         int file_index, ist_index;
+        InputPacket ipkt;
         AVPacket pkt;
         double ipts_min;
         double opts_min;
@@ -2549,6 +3340,10 @@ static int transcode(AVFormatContext **output_files,
     redo:
         ipts_min= 1e100;
         opts_min= 1e100;
+#if HAVE_PTHREADS
+        if (pipeline_error)
+            ffmpeg_exit(1);
+#endif
         /* if 'q' pressed, exits */
         if (!using_stdin) {
             if (q_pressed)
@@ -2569,7 +3364,7 @@ static int transcode(AVFormatContext **output_files,
             ist = ist_table[ost->source_index];
             if(ist->is_past_recording_time || no_packet[ist->file_index])
                 continue;
-                opts = ost->st->pts.val * av_q2d(ost->st->time_base);
+                opts = get_output_pts(ost);
             ipts = (double)ist->pts;
             if (!file_table[ist->file_index].eof_reached){
                 if(ipts < ipts_min) {
@@ -2602,12 +3397,12 @@ static int transcode(AVFormatContext **output_files,
         }
 
         /* finish if limit size exhausted */
-        if (limit_filesize != 0 && limit_filesize <= url_ftell(output_files[0]->pb))
+        if (limit_filesize != 0 && limit_filesize <= get_output_file_pos(0))
             break;
 
         /* read a frame from it and output it in the fifo */
         is = input_files[file_index];
-        ret= av_read_frame(is, &pkt);
+        ret= get_input_packet(file_index, &ipkt);
         if(ret == AVERROR(EAGAIN)){
             no_packet[file_index]=1;
             no_packet_count++;
@@ -2620,6 +3415,7 @@ static int transcode(AVFormatContext **output_files,
             else
                 continue;
         }
+        pkt = ipkt.pkt;
 
         no_packet_count=0;
         memset(no_packet, 0, sizeof(no_packet));
@@ -2635,6 +3431,7 @@ static int transcode(AVFormatContext **output_files,
         ist = ist_table[ist_index];
         if (ist->discard)
             goto discard_packet;
+        ist->repeat_pict = ipkt.repeat_pict;
 
         if (pkt.dts != AV_NOPTS_VALUE)
             pkt.dts += av_rescale_q(input_files_ts_offset[ist->file_index], AV_TIME_BASE_Q, ist->st->time_base);
@@ -2694,6 +3491,11 @@ static int transcode(AVFormatContext **output_files,
         print_report(output_files, ost_table, nb_ostreams, 0);
     }
 
+#if HAVE_PTHREADS
+    for (i = 0; i < nb_input_files; i++)
+        stop_stage(demux_stages[i]);
+#endif
+
     /* at the end of stream, we must flush the decoder buffers */
     for(i=0;i<nb_istreams;i++) {
         ist = ist_table[i];
@@ -2702,6 +3504,19 @@ static int transcode(AVFormatContext **output_files,
         }
     }
 
+#if HAVE_PTHREADS
+    /* let the encoders, then the muxers write what they were given */
+    for (i = 0; i < nb_encode_stages; i++) {
+        flush_encoder_stage(encode_stages[i]);
+        join_stage(encode_stages[i]);
+        video_size += encode_stages[i]->size;
+    }
+    for (i = 0; i < nb_output_files; i++)
+        finish_stage(mux_stages[i]);
+    if (pipeline_error)
+        ffmpeg_exit(1);
+#endif
+
     term_exit();
 
     /* write the trailer if needed and close file */
@@ -2731,15 +3546,28 @@ static int transcode(AVFormatContext **output_files,
     }
 #if CONFIG_AVFILTER
     if (graph) {
+        if (do_benchmark) {
+            AVFramePoolStats pool_stats;
+            avfilter_graph_get_pool_stats(graph, &pool_stats);
+            printf("bench: filter buffers: %"PRIu64" reused, %"PRIu64" allocated\n",
+                   pool_stats.nb_hits, pool_stats.nb_misses);
+        }
         avfilter_graph_free(graph);
         av_freep(&graph);
     }
 #endif
+#if HAVE_PTHREADS
+    if (do_benchmark)
+        print_pipeline_stats();
+#endif
 
     /* finished ! */
     ret = 0;
 
  fail:
+#if HAVE_PTHREADS
+    free_pipeline();
+#endif
     av_freep(&bit_buffer);
     av_free(file_table);
 
@@ -4263,6 +5091,10 @@ static const OptionDef options[] = {
     { "v", HAS_ARG | OPT_FUNC2, {(void*)opt_verbose}, "set ffmpeg verbosity level", "number" },
     { "target", HAS_ARG, {(void*)opt_target}, "specify target file type (\"vcd\", \"svcd\", \"dvd\", \"dv\", \"dv50\", \"pal-vcd\", \"ntsc-svcd\", ...)", "type" },
     { "threads", OPT_FUNC2 | HAS_ARG | OPT_EXPERT, {(void*)opt_thread_count}, "thread count", "count" },
+#if HAVE_PTHREADS
+    { "pipeline", OPT_BOOL | OPT_EXPERT, {(void*)&use_pipeline}, "run the demuxers, video encoders and muxers in threads of their own" },
+    { "pipeline_queue_size", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&pipeline_queue_size}, "number of packets or frames queued between two threads of the pipeline", "count" },
+#endif
     { "vsync", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&video_sync_method}, "video sync method", "" },
     { "async", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&audio_sync_method}, "audio sync method", "" },
     { "adrift_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT, {(void*)&audio_drift_threshold}, "audio drift threshold", "threshold" },
@@ -4310,6 +5142,7 @@ static const OptionDef options[] = {
     { "vstats_file", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_vstats_file}, "dump video coding statistics to file", "file" },
 #if CONFIG_AVFILTER
     { "vf", OPT_STRING | HAS_ARG, {(void*)&vfilters}, "video filters", "filter list" },
+    { "filter_threads", OPT_INT | HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)&filter_threads}, "number of threads used by the video filters", "count" },
 #endif
     { "intra_matrix", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_intra_matrix}, "specify intra matrix coeffs", "matrix" },
     { "inter_matrix", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_inter_matrix}, "specify inter matrix coeffs", "matrix" },
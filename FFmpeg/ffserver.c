@@ -29,11 +29,13 @@
 #include <strings.h>
 #include <stdlib.h>
 #include "libavformat/avformat.h"
+#include "libavformat/ffm.h"
 #include "libavformat/network.h"
 #include "libavformat/os_support.h"
 #include "libavformat/rtpdec.h"
 #include "libavformat/rtsp.h"
 #include "libavutil/avstring.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/lfg.h"
 #include "libavutil/random_seed.h"
 #include "libavcore/parseutils.h"
@@ -45,6 +47,15 @@
 #if HAVE_POLL_H
 #include <poll.h>
 #endif
+#if HAVE_EPOLL_CREATE
+#include <sys/epoll.h>
+#endif
+#if HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 #include <errno.h>
 #include <sys/time.h>
 #include <time.h>
@@ -119,7 +130,12 @@ typedef struct HTTPContext {
     enum HTTPState state;
     int fd; /* socket file descriptor */
     struct sockaddr_in from_addr; /* origin */
-    struct pollfd *poll_entry; /* used when polling */
+    int events; /* events the socket is watched for, 0 if it is not */
+    int revents; /* events which occurred on the socket */
+    int event_index; /* entry of the socket in the poll table */
+    struct HTTPWorker *worker; /* thread handling the connection, NULL for the main thread */
+    int timed; /* true if the connection is on the timer list of the main thread */
+    struct HTTPContext *next_timed;
     int64_t timeout;
     uint8_t *buffer_ptr, *buffer_end;
     int http_error;
@@ -131,8 +147,12 @@ typedef struct HTTPContext {
     int64_t data_count;
     /* feed input */
     int feed_fd;
+    unsigned feed_ends; /* feed_ends of the feed when we started waiting for it */
     /* input format handling */
     AVFormatContext *fmt_in;
+    int send_feed_file;         /* if true, the packets of the feed file are sent as they are */
+    int64_t feed_file_pos;      /* position in the feed file of the next byte to send */
+    int feed_file_synced;       /* true once a packet in which a frame starts was found */
     int64_t start_time;            /* In milliseconds - this wraps fairly often */
     int64_t first_pts;            /* initial pts value */
     int64_t cur_pts;             /* current pts value from the stream in us */
@@ -238,6 +258,7 @@ typedef struct FFStream {
 
     /* feed specific */
     int feed_opened;     /* true if someone is writing to the feed */
+    unsigned feed_ends;  /* number of times the feeder stopped sending */
     int is_feed;         /* true if it is a feed */
     int readonly;        /* True if writing is prohibited to the file */
     int truncate;        /* True if feeder connection truncate the feed file */
@@ -254,16 +275,61 @@ typedef struct FeedData {
     float avg_frame_size;   /* frame size averaged over last frames with exponential mean */
 } FeedData;
 
+/* sockets a thread waits for events on */
+typedef struct EventSet {
+#if HAVE_EPOLL_CREATE
+    int epoll_fd;
+    struct epoll_event *events;
+#else
+    struct pollfd *poll_table;
+    HTTPContext **poll_ctx;   /* connection of each entry, NULL for the other sockets */
+    int nb_entries;
+#endif
+    int size;
+    int fds[2];               /* listening sockets or wakeup pipe */
+    int fd_revents[2];
+    int nb_fds;
+    HTTPContext **ready;      /* connections events occurred on during the last wait */
+    int nb_ready;
+} EventSet;
+
+#if HAVE_PTHREADS
+/* thread sending the data of some of the HTTP connections */
+typedef struct HTTPWorker {
+    pthread_t thread;
+    EventSet events;
+    int wakeup_pipe[2];
+    int64_t cur_time;           /* time of the last wakeup in ms */
+    int nb_connections;         /* protected by server_lock */
+
+    /* protects the list of connections, which the worker holds
+       while handling them */
+    pthread_mutex_t lock;
+    HTTPContext *first_ctx;
+
+    pthread_mutex_t queue_lock; /* protects the fields below */
+    HTTPContext *new_ctx;       /* connections handed over by the main thread */
+    int feed_written;           /* feeds were written to or stopped */
+    int woken;                  /* a byte is waiting in the wakeup pipe */
+
+    int failed;                 /* stopped on an error, protected by server_lock */
+} HTTPWorker;
+#endif
+
 static struct sockaddr_in my_http_addr;
 static struct sockaddr_in my_rtsp_addr;
 
 static char logfilename[1024];
 static HTTPContext *first_http_ctx;
+/* the connections of the main thread which must be handled without waiting
+   for an event on their socket: packetized ones, and ones with a timeout */
+static HTTPContext *first_timed_ctx;
 static FFStream *first_feed;   /* contains only feeds */
 static FFStream *first_stream; /* contains all streams, including feeds */
 
 static void new_connection(int server_fd, int is_rtsp);
 static void close_connection(HTTPContext *c);
+static void update_connection(HTTPContext *c);
 
 /* HTTP handling */
 static int handle_connection(HTTPContext *c);
@@ -319,6 +385,60 @@ static AVLFG random_state;
 
 static FILE *logfile = NULL;
 
+static EventSet http_events; /* sockets of the main thread */
+
+#if HAVE_PTHREADS
+static int nb_workers;
+static HTTPWorker *workers;
+
+/* Protects what the workers share with the main thread: the connection
+   count and bandwidth in use, the bytes served by each stream, and the
+   write index, size, end count and stream parameters of the feeds. */
+static pthread_mutex_t server_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t log_lock;
+#endif
+
+static void lock_server(void)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&server_lock);
+#endif
+}
+
+static void unlock_server(void)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_unlock(&server_lock);
+#endif
+}
+
+/* the log lock only exists once the workers are started */
+static void lock_log(void)
+{
+#if HAVE_PTHREADS
+    if (workers)
+        pthread_mutex_lock(&log_lock);
+#endif
+}
+
+static void unlock_log(void)
+{
+#if HAVE_PTHREADS
+    if (workers)
+        pthread_mutex_unlock(&log_lock);
+#endif
+}
+
+/* return the time at which the thread handling a connection woke up, in ms */
+static int64_t get_connection_time(HTTPContext *c)
+{
+#if HAVE_PTHREADS
+    if (c->worker)
+        return c->worker->cur_time;
+#endif
+    return cur_time;
+}
+
 /* FIXME: make ffserver work with IPv6 */
 /* resolve host with also IP address parsing */
 static int resolve_host(struct in_addr *sin_addr, const char *hostname)
@@ -361,8 +481,7 @@ static char *ctime1(char *buf2)
     char *p;
 
     ti = time(NULL);
-    p = ctime(&ti);
-    strcpy(buf2, p);
+    p = ctime_r(&ti, buf2);
     p = buf2 + strlen(p) - 1;
     if (*p == '\n')
         *p = '\0';
@@ -373,6 +492,7 @@ static void http_vlog(const char *fmt, va_list vargs)
 {
     static int print_prefix = 1;
     if (logfile) {
+        lock_log();
         if (print_prefix) {
             char buf[32];
             ctime1(buf);
@@ -381,6 +501,7 @@ static void http_vlog(const char *fmt, va_list vargs)
         print_prefix = strstr(fmt, "\n") != NULL;
         vfprintf(logfile, fmt, vargs);
         fflush(logfile);
+        unlock_log();
     }
 }
 
@@ -398,10 +519,12 @@ static void http_av_log(void *ptr, int level, const char *fmt, va_list vargs)
     AVClass *avc = ptr ? *(AVClass**)ptr : NULL;
     if (level > av_log_get_level())
         return;
+    lock_log();
     if (print_prefix && avc)
         http_log("[%s @ %p]", avc->item_name(ptr), ptr);
     print_prefix = strstr(fmt, "\n") != NULL;
     http_vlog(fmt, vargs);
+    unlock_log();
 }
 
 static void log_connection(HTTPContext *c)
@@ -409,24 +532,33 @@ static void log_connection(HTTPContext *c)
     if (c->suppress_log)
         return;
 
+    lock_log();
     http_log("%s - - [%s] \"%s %s\" %d %"PRId64"\n",
              inet_ntoa(c->from_addr.sin_addr), c->method, c->url,
              c->protocol, (c->http_error ? c->http_error : 200), c->data_count);
+    unlock_log();
 }
 
-static void update_datarate(DataRateData *drd, int64_t count)
+static void update_datarate(DataRateData *drd, int64_t count, int64_t time)
 {
     if (!drd->time1 && !drd->count1) {
-        drd->time1 = drd->time2 = cur_time;
+        drd->time1 = drd->time2 = time;
         drd->count1 = drd->count2 = count;
-    } else if (cur_time - drd->time2 > 5000) {
+    } else if (time - drd->time2 > 5000) {
         drd->time1 = drd->time2;
         drd->count1 = drd->count2;
-        drd->time2 = cur_time;
+        drd->time2 = time;
         drd->count2 = count;
     }
 }
 
+static void add_bytes_served(FFStream *stream, int len)
+{
+    lock_server();
+    stream->bytes_served += len;
+    unlock_server();
+}
+
 /* In bytes per second */
 static int compute_datarate(DataRateData *drd, int64_t count)
 {
@@ -582,19 +714,504 @@ static void start_multicast(void)
 
             /* change state to send data */
             rtp_c->state = HTTPSTATE_SEND_DATA;
+            update_connection(rtp_c);
+        }
+    }
+}
+
+#if HAVE_EPOLL_CREATE
+static uint32_t epoll_events(int events)
+{
+    return (events & POLLIN  ? EPOLLIN  : 0) |
+           (events & POLLOUT ? EPOLLOUT : 0);
+}
+
+static int poll_events(uint32_t events)
+{
+    return (events & EPOLLIN  ? POLLIN  : 0) |
+           (events & EPOLLOUT ? POLLOUT : 0) |
+           (events & EPOLLERR ? POLLERR : 0) |
+           (events & EPOLLHUP ? POLLHUP : 0);
+}
+#endif
+
+/* size is the maximum number of sockets in the set */
+static int eventset_init(EventSet *es, int size)
+{
+    memset(es, 0, sizeof(*es));
+    es->size = size;
+    es->ready = av_malloc(size * sizeof(*es->ready));
+#if HAVE_EPOLL_CREATE
+    es->events = av_malloc(size * sizeof(*es->events));
+    es->epoll_fd = epoll_create(size);
+    if (!es->ready || !es->events || es->epoll_fd < 0)
+        return -1;
+#else
+    es->poll_table = av_mallocz(size * sizeof(*es->poll_table));
+    es->poll_ctx = av_mallocz(size * sizeof(*es->poll_ctx));
+    if (!es->ready || !es->poll_table || !es->poll_ctx)
+        return -1;
+#endif
+    return 0;
+}
+
+/* watch a socket which is not a connection for incoming data */
+static int eventset_add_fd(EventSet *es, int fd)
+{
+    int i = es->nb_fds++;
+#if HAVE_EPOLL_CREATE
+    struct epoll_event ev;
+#endif
+
+    es->fds[i] = fd;
+#if HAVE_EPOLL_CREATE
+    ev.events = EPOLLIN;
+    ev.data.ptr = &es->fds[i];
+    return epoll_ctl(es->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+#else
+    es->poll_table[es->nb_entries].fd = fd;
+    es->poll_table[es->nb_entries].events = POLLIN;
+    es->nb_entries++;
+    return 0;
+#endif
+}
+
+/* change the events the socket of a connection is watched for, 0 to stop
+   watching it */
+static void eventset_watch(EventSet *es, HTTPContext *c, int events)
+{
+#if HAVE_EPOLL_CREATE
+    struct epoll_event ev;
+    int op;
+#else
+    int last;
+#endif
+
+    if (c->fd < 0 || c->events == events)
+        return;
+#if HAVE_EPOLL_CREATE
+    if (!c->events)
+        op = EPOLL_CTL_ADD;
+    else if (events)
+        op = EPOLL_CTL_MOD;
+    else
+        op = EPOLL_CTL_DEL;
+    ev.events = epoll_events(events);
+    ev.data.ptr = c;
+    if (epoll_ctl(es->epoll_fd, op, c->fd, &ev) < 0) {
+        http_log("epoll_ctl failed on fd %d: %s\n", c->fd, strerror(errno));
+        return;
+    }
+#else
+    if (!c->events) {
+        c->event_index = es->nb_entries++;
+        es->poll_table[c->event_index].fd = c->fd;
+        es->poll_ctx[c->event_index] = c;
+    } else if (!events) {
+        /* move the last entry into the hole */
+        last = --es->nb_entries;
+        es->poll_table[c->event_index] = es->poll_table[last];
+        es->poll_ctx[c->event_index] = es->poll_ctx[last];
+        if (es->poll_ctx[c->event_index])
+            es->poll_ctx[c->event_index]->event_index = c->event_index;
+    }
+    if (events)
+        es->poll_table[c->event_index].events = events;
+#endif
+    c->events = events;
+}
+
+/* wait for events for at most delay ms (forever if negative) and store the
+   connections they occurred on in es->ready */
+static int eventset_wait(EventSet *es, int delay)
+{
+    int i, ret;
+
+    es->nb_ready = 0;
+    for (i = 0; i < es->nb_fds; i++)
+        es->fd_revents[i] = 0;
+#if HAVE_EPOLL_CREATE
+    ret = epoll_wait(es->epoll_fd, es->events, es->size, delay);
+    for (i = 0; i < ret; i++) {
+        void *ptr = es->events[i].data.ptr;
+        int revents = poll_events(es->events[i].events);
+        if (ptr >= (void *)es->fds && ptr < (void *)(es->fds + es->nb_fds)) {
+            es->fd_revents[(int *)ptr - es->fds] = revents;
+        } else {
+            HTTPContext *c = ptr;
+            c->revents = revents;
+            es->ready[es->nb_ready++] = c;
+        }
+    }
+#else
+    ret = poll(es->poll_table, es->nb_entries, delay);
+    for (i = 0; ret > 0 && i < es->nb_entries; i++) {
+        if (!es->poll_table[i].revents)
+            continue;
+        if (i < es->nb_fds) {
+            es->fd_revents[i] = es->poll_table[i].revents;
+        } else {
+            HTTPContext *c = es->poll_ctx[i];
+            c->revents = es->poll_table[i].revents;
+            es->ready[es->nb_ready++] = c;
+        }
+    }
+#endif
+    return ret;
+}
+
+/* return the events the socket of a connection must be watched for, and
+   lower *delay if the connection must be handled sooner (delay may be NULL
+   for connections which are not packetized) */
+static int connection_events(HTTPContext *c, int *delay)
+{
+    switch(c->state) {
+    case HTTPSTATE_SEND_HEADER:
+    case RTSPSTATE_SEND_REPLY:
+    case RTSPSTATE_SEND_PACKET:
+        return POLLOUT;
+    case HTTPSTATE_SEND_DATA_HEADER:
+    case HTTPSTATE_SEND_DATA:
+    case HTTPSTATE_SEND_DATA_TRAILER:
+        if (!c->is_packetized) {
+            /* for TCP, we output as much as we can (may need to put a limit) */
+            return POLLOUT;
+        }
+        /* when ffserver is doing the timing, we work by
+           looking at which packet need to be sent every
+           10 ms */
+        if (delay && *delay > 10)
+            *delay = 10; /* one tick wait XXX: 10 ms assumed */
+        return 0;
+    case HTTPSTATE_WAIT_REQUEST:
+    case HTTPSTATE_RECEIVE_DATA:
+    case HTTPSTATE_WAIT_FEED:
+    case RTSPSTATE_WAIT_REQUEST:
+        /* need to catch errors */
+        return POLLIN; /* Maybe this will work */
+    default:
+        return 0;
+    }
+}
+
+/* return true if a connection must be handled on every wakeup of its
+   thread, and not only when an event occurs on its socket */
+static int connection_is_timed(HTTPContext *c)
+{
+    switch(c->state) {
+    case HTTPSTATE_WAIT_REQUEST:
+    case RTSPSTATE_WAIT_REQUEST:
+        return 1; /* to check the timeout */
+    case HTTPSTATE_SEND_DATA_HEADER:
+    case HTTPSTATE_SEND_DATA:
+    case HTTPSTATE_SEND_DATA_TRAILER:
+        return c->is_packetized;
+    default:
+        return 0;
+    }
+}
+
+/* update the events the socket of a connection of the main thread is
+   watched for, and whether it is on the timer list, after its state may
+   have changed */
+static void update_connection(HTTPContext *c)
+{
+    HTTPContext **cp;
+    int timed = connection_is_timed(c);
+
+    eventset_watch(&http_events, c, connection_events(c, NULL));
+    if (timed == c->timed)
+        return;
+    if (timed) {
+        c->next_timed = first_timed_ctx;
+        first_timed_ctx = c;
+    } else {
+        for (cp = &first_timed_ctx; *cp != c; cp = &(*cp)->next_timed);
+        *cp = c->next_timed;
+    }
+    c->timed = timed;
+}
+
+#if HAVE_PTHREADS
+static int lock_codecs(void **mutex, enum AVLockOp op)
+{
+    switch(op) {
+    case AV_LOCK_CREATE:
+        *mutex = av_malloc(sizeof(pthread_mutex_t));
+        if (!*mutex)
+            return 1;
+        return !!pthread_mutex_init(*mutex, NULL);
+    case AV_LOCK_OBTAIN:
+        return !!pthread_mutex_lock(*mutex);
+    case AV_LOCK_RELEASE:
+        return !!pthread_mutex_unlock(*mutex);
+    case AV_LOCK_DESTROY:
+        pthread_mutex_destroy(*mutex);
+        av_freep(mutex);
+        return 0;
+    }
+    return 1;
+}
+
+static void log_lock_acquire(void)
+{
+    pthread_mutex_lock(&log_lock);
+}
+
+static void log_lock_release(void)
+{
+    pthread_mutex_unlock(&log_lock);
+}
+
+/* must be called with w->queue_lock held */
+static void wake_worker(HTTPWorker *w)
+{
+    int ret;
+
+    if (w->woken)
+        return;
+    do {
+        ret = write(w->wakeup_pipe[1], "", 1);
+    } while (ret < 0 && errno == EINTR);
+    /* a full pipe already holds a wakeup; on another error, the next
+       call tries again */
+    if (ret < 0 && errno != EAGAIN) {
+        http_log("Could not wake up a worker thread: %s\n", strerror(errno));
+        return;
+    }
+    w->woken = 1;
+}
+
+/* empty the wakeup pipe of a worker, called with w->queue_lock held */
+static void clear_wakeup(HTTPWorker *w)
+{
+    char buf[64];
+    int ret;
+
+    do {
+        ret = read(w->wakeup_pipe[0], buf, sizeof(buf));
+    } while (ret > 0 || (ret < 0 && errno == EINTR));
+    if (ret == 0 || errno != EAGAIN)
+        http_log("Could not read the wakeup pipe of a worker thread: %s\n",
+                 ret ? strerror(errno) : "end of file");
+    w->woken = 0;
+}
+
+/* only connections which send a live stream over HTTP are handed over to
+   the workers, the others stay in the main thread */
+static int can_hand_over(HTTPContext *c)
+{
+    return c->state == HTTPSTATE_SEND_HEADER && !c->http_error &&
+           c->stream && c->stream->stream_type == STREAM_TYPE_LIVE &&
+           !c->post && !c->wmp_client_id && !c->is_packetized;
+}
+
+/* move a connection of the main thread to the least loaded worker; it
+   stays in the main thread if all the workers have stopped */
+static void hand_over_connection(HTTPContext *c)
+{
+    HTTPContext **cp;
+    HTTPWorker *w = NULL;
+    int i;
+
+    lock_server();
+    for (i = 0; i < nb_workers; i++)
+        if (!workers[i].failed &&
+            (!w || workers[i].nb_connections < w->nb_connections))
+            w = &workers[i];
+    if (!w) {
+        unlock_server();
+        return;
+    }
+    w->nb_connections++;
+
+    eventset_watch(&http_events, c, 0);
+    for (cp = &first_http_ctx; *cp != c; cp = &(*cp)->next);
+    *cp = c->next;
+
+    /* queued before unlocking, so that a worker which stops finds it */
+    c->worker = w;
+    pthread_mutex_lock(&w->queue_lock);
+    c->next = w->new_ctx;
+    w->new_ctx = c;
+    wake_worker(w);
+    pthread_mutex_unlock(&w->queue_lock);
+    unlock_server();
+}
+
+/* resume the connections of a worker waiting for their feed */
+static void wake_up_feed_waiters(HTTPWorker *w)
+{
+    HTTPContext *c;
+
+    lock_server();
+    for (c = w->first_ctx; c != NULL; c = c->next) {
+        if (c->state == HTTPSTATE_WAIT_FEED) {
+            /* the feeder is gone if the feed ended since we started waiting */
+            if (c->feed_ends != c->stream->feed->feed_ends)
+                c->state = HTTPSTATE_SEND_DATA_TRAILER;
+            else
+                c->state = HTTPSTATE_SEND_DATA;
+            eventset_watch(&w->events, c, connection_events(c, NULL));
+        }
+    }
+    unlock_server();
+}
+
+/* close all the connections of a worker which cannot go on, and stop
+   handing it new ones */
+static void stop_worker(HTTPWorker *w)
+{
+    HTTPContext *c, *c_next;
+
+    lock_server();
+    w->failed = 1;
+    unlock_server();
+
+    pthread_mutex_lock(&w->lock);
+    while ((c = w->first_ctx) != NULL) {
+        log_connection(c);
+        close_connection(c);
+    }
+    /* connections handed over since the last wakeup */
+    pthread_mutex_lock(&w->queue_lock);
+    c = w->new_ctx;
+    w->new_ctx = NULL;
+    pthread_mutex_unlock(&w->queue_lock);
+    for (; c != NULL; c = c_next) {
+        c_next = c->next;
+        log_connection(c);
+        close_connection(c);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void *http_worker(void *arg)
+{
+    HTTPWorker *w = arg;
+    HTTPContext *c, *c_next;
+    int i, ret, feed_written;
+
+    for (;;) {
+        ret = eventset_wait(&w->events, -1);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+            http_log("Worker thread failed to wait for events: %s\n", strerror(errno));
+            stop_worker(w);
+            break;
+        }
+        w->cur_time = av_gettime() / 1000;
+
+        pthread_mutex_lock(&w->lock);
+        for (i = 0; i < w->events.nb_ready; i++) {
+            c = w->events.ready[i];
+            if (handle_connection(c) < 0) {
+                log_connection(c);
+                close_connection(c);
+            } else {
+                c->revents = 0;
+                eventset_watch(&w->events, c, connection_events(c, NULL));
+            }
+        }
+
+        if (w->events.fd_revents[0] & POLLIN) {
+            pthread_mutex_lock(&w->queue_lock);
+            clear_wakeup(w);
+            c = w->new_ctx;
+            w->new_ctx = NULL;
+            feed_written = w->feed_written;
+            w->feed_written = 0;
+            pthread_mutex_unlock(&w->queue_lock);
+
+            for (; c != NULL; c = c_next) {
+                c_next = c->next;
+                c->next = w->first_ctx;
+                w->first_ctx = c;
+                eventset_watch(&w->events, c, connection_events(c, NULL));
+            }
+            if (feed_written)
+                wake_up_feed_waiters(w);
+        }
+        pthread_mutex_unlock(&w->lock);
+    }
+    return NULL;
+}
+
+static int start_workers(void)
+{
+    pthread_mutexattr_t attr;
+    sigset_t set, oldset;
+    int i;
+
+    if (!nb_workers)
+        return 0;
+    workers = av_mallocz(nb_workers * sizeof(*workers));
+    if (!workers)
+        return -1;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&log_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    /* the launched feeders log before exec() */
+    pthread_atfork(log_lock_acquire, log_lock_release, log_lock_release);
+
+    if (av_lockmgr_register(lock_codecs))
+        return -1;
+
+    for (i = 0; i < nb_workers; i++) {
+        HTTPWorker *w = &workers[i];
+        if (eventset_init(&w->events, nb_max_http_connections + 1) < 0 ||
+            pipe(w->wakeup_pipe) < 0 ||
+            eventset_add_fd(&w->events, w->wakeup_pipe[0]) < 0)
+            return -1;
+        ff_socket_nonblock(w->wakeup_pipe[0], 1);
+        ff_socket_nonblock(w->wakeup_pipe[1], 1);
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_mutex_init(&w->queue_lock, NULL);
+    }
+
+    /* SIGCHLD is for the main thread, which restarts the feeders */
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &set, &oldset);
+    for (i = 0; i < nb_workers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, http_worker, &workers[i])) {
+            http_log("Could not start worker thread %d\n", i);
+            exit(1);
         }
     }
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+    http_log("%d worker threads started.\n", nb_workers);
+    return 0;
+}
+#endif
+
+/* wake up the connections of the workers waiting for a feed */
+static void wake_workers(void)
+{
+#if HAVE_PTHREADS
+    int i;
+
+    for (i = 0; i < nb_workers; i++) {
+        pthread_mutex_lock(&workers[i].queue_lock);
+        workers[i].feed_written = 1;
+        wake_worker(&workers[i]);
+        pthread_mutex_unlock(&workers[i].queue_lock);
+    }
+#endif
 }
 
 /* main loop of the http server */
 static int http_server(void)
 {
     int server_fd = 0, rtsp_server_fd = 0;
-    int ret, delay, delay1;
-    struct pollfd *poll_table, *poll_entry;
+    int ret, delay, i;
     HTTPContext *c, *c_next;
 
-    if(!(poll_table = av_mallocz((nb_max_http_connections + 2)*sizeof(*poll_table)))) {
+    if (eventset_init(&http_events, nb_max_http_connections + 2) < 0) {
         http_log("Impossible to allocate a poll table handling %d connections.\n", nb_max_http_connections);
         return -1;
     }
@@ -603,12 +1220,14 @@ static int http_server(void)
         server_fd = socket_open_listen(&my_http_addr);
         if (server_fd < 0)
             return -1;
+        eventset_add_fd(&http_events, server_fd);
     }
 
     if (my_rtsp_addr.sin_port) {
         rtsp_server_fd = socket_open_listen(&my_rtsp_addr);
         if (rtsp_server_fd < 0)
             return -1;
+        eventset_add_fd(&http_events, rtsp_server_fd);
     }
 
     if (!rtsp_server_fd && !server_fd) {
@@ -622,73 +1241,25 @@ static int http_server(void)
 
     start_multicast();
 
-    for(;;) {
-        poll_entry = poll_table;
-        if (server_fd) {
-            poll_entry->fd = server_fd;
-            poll_entry->events = POLLIN;
-            poll_entry++;
-        }
-        if (rtsp_server_fd) {
-            poll_entry->fd = rtsp_server_fd;
-            poll_entry->events = POLLIN;
-            poll_entry++;
-        }
+#if HAVE_PTHREADS
+    if (start_workers() < 0) {
+        http_log("Could not start the worker threads.\n");
+        return -1;
+    }
+#endif
 
-        /* wait for events on each HTTP handle */
-        c = first_http_ctx;
+    for(;;) {
+        /* the sockets stay registered as long as the state of their
+           connection does not change, so only the timed connections are
+           looked at before waiting */
         delay = 1000;
-        while (c != NULL) {
-            int fd;
-            fd = c->fd;
-            switch(c->state) {
-            case HTTPSTATE_SEND_HEADER:
-            case RTSPSTATE_SEND_REPLY:
-            case RTSPSTATE_SEND_PACKET:
-                c->poll_entry = poll_entry;
-                poll_entry->fd = fd;
-                poll_entry->events = POLLOUT;
-                poll_entry++;
-                break;
-            case HTTPSTATE_SEND_DATA_HEADER:
-            case HTTPSTATE_SEND_DATA:
-            case HTTPSTATE_SEND_DATA_TRAILER:
-                if (!c->is_packetized) {
-                    /* for TCP, we output as much as we can (may need to put a limit) */
-                    c->poll_entry = poll_entry;
-                    poll_entry->fd = fd;
-                    poll_entry->events = POLLOUT;
-                    poll_entry++;
-                } else {
-                    /* when ffserver is doing the timing, we work by
-                       looking at which packet need to be sent every
-                       10 ms */
-                    delay1 = 10; /* one tick wait XXX: 10 ms assumed */
-                    if (delay1 < delay)
-                        delay = delay1;
-                }
-                break;
-            case HTTPSTATE_WAIT_REQUEST:
-            case HTTPSTATE_RECEIVE_DATA:
-            case HTTPSTATE_WAIT_FEED:
-            case RTSPSTATE_WAIT_REQUEST:
-                /* need to catch errors */
-                c->poll_entry = poll_entry;
-                poll_entry->fd = fd;
-                poll_entry->events = POLLIN;/* Maybe this will work */
-                poll_entry++;
-                break;
-            default:
-                c->poll_entry = NULL;
-                break;
-            }
-            c = c->next;
-        }
+        for(c = first_timed_ctx; c != NULL; c = c->next_timed)
+            connection_events(c, &delay);
 
         /* wait for an event on one connection. We poll at least every
            second to handle timeouts */
         do {
-            ret = poll(poll_table, poll_entry - poll_table, delay);
+            ret = eventset_wait(&http_events, delay);
             if (ret < 0 && ff_neterrno() != FF_NETERROR(EAGAIN) &&
                 ff_neterrno() != FF_NETERROR(EINTR))
                 return -1;
@@ -702,26 +1273,38 @@ static int http_server(void)
         }
 
         /* now handle the events */
-        for(c = first_http_ctx; c != NULL; c = c_next) {
-            c_next = c->next;
+        for (i = 0; i < http_events.nb_ready; i++) {
+            c = http_events.ready[i];
             if (handle_connection(c) < 0) {
                 /* close and free the connection */
                 log_connection(c);
                 close_connection(c);
+                continue;
             }
+            c->revents = 0;
+            update_connection(c);
+#if HAVE_PTHREADS
+            if (nb_workers && can_hand_over(c))
+                hand_over_connection(c);
+#endif
         }
 
-        poll_entry = poll_table;
-        if (server_fd) {
-            /* new HTTP connection request ? */
-            if (poll_entry->revents & POLLIN)
-                new_connection(server_fd, 0);
-            poll_entry++;
+        /* then send the packets which are due and check the timeouts */
+        for(c = first_timed_ctx; c != NULL; c = c_next) {
+            c_next = c->next_timed;
+            if (handle_connection(c) < 0) {
+                log_connection(c);
+                close_connection(c);
+                continue;
+            }
+            update_connection(c);
         }
-        if (rtsp_server_fd) {
-            /* new RTSP connection request ? */
-            if (poll_entry->revents & POLLIN)
-                new_connection(rtsp_server_fd, 1);
+
+        for (i = 0; i < http_events.nb_fds; i++) {
+            /* new HTTP or RTSP connection request ? */
+            if (http_events.fd_revents[i] & POLLIN)
+                new_connection(http_events.fds[i],
+                               http_events.fds[i] == rtsp_server_fd);
         }
     }
 }
@@ -741,7 +1324,7 @@ static void start_wait_request(HTTPContext *c, int is_rtsp)
     }
 }
 
-static void http_send_too_busy_reply(int fd)
+static void http_send_too_busy_reply(int fd, unsigned int connections)
 {
     char buffer[300];
     int len = snprintf(buffer, sizeof(buffer),
@@ -752,7 +1335,7 @@ static void http_send_too_busy_reply(int fd)
                        "<p>The server is too busy to serve your request at this time.</p>\r\n"
                        "<p>The number of current connections is %d, and this exceeds the limit of %d.</p>\r\n"
                        "</body></html>\r\n",
-                       nb_connections, nb_max_connections);
+                       connections, nb_max_connections);
     send(fd, buffer, len, 0);
 }
 
@@ -761,6 +1344,7 @@ static void new_connection(int server_fd, int is_rtsp)
 {
     struct sockaddr_in from_addr;
     int fd, len;
+    unsigned int connections;
     HTTPContext *c = NULL;
 
     len = sizeof(from_addr);
@@ -772,8 +1356,11 @@ static void new_connection(int server_fd, int is_rtsp)
     }
     ff_socket_nonblock(fd, 1);
 
-    if (nb_connections >= nb_max_connections) {
-        http_send_too_busy_reply(fd);
+    lock_server();
+    connections = nb_connections;
+    unlock_server();
+    if (connections >= nb_max_connections) {
+        http_send_too_busy_reply(fd, connections);
         goto fail;
     }
 
@@ -783,7 +1370,6 @@ static void new_connection(int server_fd, int is_rtsp)
         goto fail;
 
     c->fd = fd;
-    c->poll_entry = NULL;
     c->from_addr = from_addr;
     c->buffer_size = IOBUFFER_INIT_SIZE;
     c->buffer = av_malloc(c->buffer_size);
@@ -792,9 +1378,12 @@ static void new_connection(int server_fd, int is_rtsp)
 
     c->next = first_http_ctx;
     first_http_ctx = c;
+    lock_server();
     nb_connections++;
+    unlock_server();
 
     start_wait_request(c, is_rtsp);
+    update_connection(c);
 
     return;
 
@@ -806,6 +1395,22 @@ static void new_connection(int server_fd, int is_rtsp)
     closesocket(fd);
 }
 
+/* free a stream of the output context of a connection */
+static void free_stream_copy(AVStream *st)
+{
+    if (!st)
+        return;
+    if (st->codec) {
+        av_freep(&st->codec->extradata);
+        av_freep(&st->codec->rc_eq);
+        av_freep(&st->codec->intra_matrix);
+        av_freep(&st->codec->inter_matrix);
+        av_freep(&st->codec->rc_override);
+        av_free(st->codec);
+    }
+    av_free(st);
+}
+
 static void close_connection(HTTPContext *c)
 {
     HTTPContext **cp, *c1;
@@ -815,6 +1420,11 @@ static void close_connection(HTTPContext *c)
     AVStream *st;
 
     /* remove connection from list */
+#if HAVE_PTHREADS
+    if (c->worker)
+        cp = &c->worker->first_ctx;
+    else
+#endif
     cp = &first_http_ctx;
     while ((*cp) != NULL) {
         c1 = *cp;
@@ -825,14 +1435,27 @@ static void close_connection(HTTPContext *c)
     }
 
     /* remove references, if any (XXX: do it faster) */
-    for(c1 = first_http_ctx; c1 != NULL; c1 = c1->next) {
-        if (c1->rtsp_c == c)
-            c1->rtsp_c = NULL;
+    if (!c->worker) {
+        for(c1 = first_http_ctx; c1 != NULL; c1 = c1->next) {
+            if (c1->rtsp_c == c)
+                c1->rtsp_c = NULL;
+        }
+        if (c->timed) {
+            for (cp = &first_timed_ctx; *cp != c; cp = &(*cp)->next_timed);
+            *cp = c->next_timed;
+        }
     }
 
     /* remove connection associated resources */
-    if (c->fd >= 0)
+    if (c->fd >= 0) {
+#if HAVE_PTHREADS
+        if (c->worker)
+            eventset_watch(&c->worker->events, c, 0);
+        else
+#endif
+        eventset_watch(&http_events, c, 0);
         closesocket(c->fd);
+    }
     if (c->fmt_in) {
         /* close each frame parser */
         for(i=0;i<c->fmt_in->nb_streams;i++) {
@@ -875,10 +1498,17 @@ static void close_connection(HTTPContext *c)
     }
 
     for(i=0; i<ctx->nb_streams; i++)
-        av_free(ctx->streams[i]);
+        free_stream_copy(ctx->streams[i]);
 
+    lock_server();
     if (c->stream && !c->post && c->stream->stream_type == STREAM_TYPE_LIVE)
         current_bandwidth -= c->stream->bandwidth;
+    nb_connections--;
+#if HAVE_PTHREADS
+    if (c->worker)
+        c->worker->nb_connections--;
+#endif
+    unlock_server();
 
     /* signal that there is no feed if we are the feeder socket */
     if (c->state == HTTPSTATE_RECEIVE_DATA && c->stream) {
@@ -890,7 +1520,6 @@ static void close_connection(HTTPContext *c)
     av_freep(&c->packet_buffer);
     av_free(c->buffer);
     av_free(c);
-    nb_connections--;
 }
 
 static int handle_connection(HTTPContext *c)
@@ -903,11 +1532,11 @@ static int handle_connection(HTTPContext *c)
         /* timeout ? */
         if ((c->timeout - cur_time) < 0)
             return -1;
-        if (c->poll_entry->revents & (POLLERR | POLLHUP))
+        if (c->revents & (POLLERR | POLLHUP))
             return -1;
 
         /* no need to read if no events */
-        if (!(c->poll_entry->revents & POLLIN))
+        if (!(c->revents & POLLIN))
             return 0;
         /* read the data */
     read_loop:
@@ -941,11 +1570,11 @@ static int handle_connection(HTTPContext *c)
         break;
 
     case HTTPSTATE_SEND_HEADER:
-        if (c->poll_entry->revents & (POLLERR | POLLHUP))
+        if (c->revents & (POLLERR | POLLHUP))
             return -1;
 
         /* no need to write if no events */
-        if (!(c->poll_entry->revents & POLLOUT))
+        if (!(c->revents & POLLOUT))
             return 0;
         len = send(c->fd, c->buffer_ptr, c->buffer_end - c->buffer_ptr, 0);
         if (len < 0) {
@@ -958,7 +1587,7 @@ static int handle_connection(HTTPContext *c)
         } else {
             c->buffer_ptr += len;
             if (c->stream)
-                c->stream->bytes_served += len;
+                add_bytes_served(c->stream, len);
             c->data_count += len;
             if (c->buffer_ptr >= c->buffer_end) {
                 av_freep(&c->pb_buffer);
@@ -979,11 +1608,11 @@ static int handle_connection(HTTPContext *c)
            input streams sets the speed). It may be better to verify
            that we do not rely too much on the kernel queues */
         if (!c->is_packetized) {
-            if (c->poll_entry->revents & (POLLERR | POLLHUP))
+            if (c->revents & (POLLERR | POLLHUP))
                 return -1;
 
             /* no need to read if no events */
-            if (!(c->poll_entry->revents & POLLOUT))
+            if (!(c->revents & POLLOUT))
                 return 0;
         }
         if (http_send_data(c) < 0)
@@ -994,28 +1623,28 @@ static int handle_connection(HTTPContext *c)
         break;
     case HTTPSTATE_RECEIVE_DATA:
         /* no need to read if no events */
-        if (c->poll_entry->revents & (POLLERR | POLLHUP))
+        if (c->revents & (POLLERR | POLLHUP))
             return -1;
-        if (!(c->poll_entry->revents & POLLIN))
+        if (!(c->revents & POLLIN))
             return 0;
         if (http_receive_data(c) < 0)
             return -1;
         break;
     case HTTPSTATE_WAIT_FEED:
         /* no need to read if no events */
-        if (c->poll_entry->revents & (POLLIN | POLLERR | POLLHUP))
+        if (c->revents & (POLLIN | POLLERR | POLLHUP))
             return -1;
 
         /* nothing to do, we'll be waken up by incoming feed packets */
         break;
 
     case RTSPSTATE_SEND_REPLY:
-        if (c->poll_entry->revents & (POLLERR | POLLHUP)) {
+        if (c->revents & (POLLERR | POLLHUP)) {
             av_freep(&c->pb_buffer);
             return -1;
         }
         /* no need to write if no events */
-        if (!(c->poll_entry->revents & POLLOUT))
+        if (!(c->revents & POLLOUT))
             return 0;
         len = send(c->fd, c->buffer_ptr, c->buffer_end - c->buffer_ptr, 0);
         if (len < 0) {
@@ -1036,12 +1665,12 @@ static int handle_connection(HTTPContext *c)
         }
         break;
     case RTSPSTATE_SEND_PACKET:
-        if (c->poll_entry->revents & (POLLERR | POLLHUP)) {
+        if (c->revents & (POLLERR | POLLHUP)) {
             av_freep(&c->packet_buffer);
             return -1;
         }
         /* no need to write if no events */
-        if (!(c->poll_entry->revents & POLLOUT))
+        if (!(c->revents & POLLOUT))
             return 0;
         len = send(c->fd, c->packet_buffer_ptr,
                     c->packet_buffer_end - c->packet_buffer_ptr, 0);
@@ -1468,6 +2097,7 @@ static int http_parse_request(HTTPContext *c)
     int i;
     char ratebuf[32];
     char *useragent = 0;
+    uint64_t bandwidth;
 
     p = c->buffer;
     get_word(cmd, sizeof(cmd), (const char **)&p);
@@ -1583,8 +2213,11 @@ static int http_parse_request(HTTPContext *c)
         }
     }
 
+    lock_server();
     if (c->post == 0 && stream->stream_type == STREAM_TYPE_LIVE)
         current_bandwidth += stream->bandwidth;
+    bandwidth = current_bandwidth;
+    unlock_server();
 
     /* If already streaming this feed, do not let start another feeder. */
     if (stream->feed_opened) {
@@ -1593,7 +2226,7 @@ static int http_parse_request(HTTPContext *c)
         goto send_error;
     }
 
-    if (c->post == 0 && max_bandwidth < current_bandwidth) {
+    if (c->post == 0 && max_bandwidth < bandwidth) {
         c->http_error = 503;
         q = c->buffer;
         q += snprintf(q, c->buffer_size,
@@ -1604,7 +2237,7 @@ static int http_parse_request(HTTPContext *c)
                       "<p>The server is too busy to serve your request at this time.</p>\r\n"
                       "<p>The bandwidth being served (including your stream) is %"PRIu64"kbit/sec, "
                       "and this exceeds the limit of %"PRIu64"kbit/sec.</p>\r\n"
-                      "</body></html>\r\n", current_bandwidth, max_bandwidth);
+                      "</body></html>\r\n", bandwidth, max_bandwidth);
         /* prepare output buffer */
         c->buffer_ptr = c->buffer;
         c->buffer_end = q;
@@ -1874,6 +2507,36 @@ static void fmt_bytecount(ByteIOContext *pb, int64_t count)
     url_fprintf(pb, "%"PRId64"%c", count, *s);
 }
 
+static void print_connection(ByteIOContext *pb, HTTPContext *c1, int i)
+{
+    int bitrate;
+    int j;
+
+    bitrate = 0;
+    if (c1->stream) {
+        for (j = 0; j < c1->stream->nb_streams; j++) {
+            if (!c1->stream->feed)
+                bitrate += c1->stream->streams[j]->codec->bit_rate;
+            else if (c1->feed_streams[j] >= 0)
+                bitrate += c1->stream->feed->streams[c1->feed_streams[j]]->codec->bit_rate;
+        }
+    }
+
+    url_fprintf(pb, "<tr><td><b>%d</b><td>%s%s<td>%s<td>%s<td>%s<td align=right>",
+                i,
+                c1->stream ? c1->stream->filename : "",
+                c1->state == HTTPSTATE_RECEIVE_DATA ? "(input)" : "",
+                inet_ntoa(c1->from_addr.sin_addr),
+                c1->protocol,
+                http_state[c1->state]);
+    fmt_bytecount(pb, bitrate);
+    url_fprintf(pb, "<td align=right>");
+    fmt_bytecount(pb, compute_datarate(&c1->datarate, c1->data_count) * 8);
+    url_fprintf(pb, "<td align=right>");
+    fmt_bytecount(pb, c1->data_count);
+    url_fprintf(pb, "\n");
+}
+
 static void compute_status(HTTPContext *c)
 {
     HTTPContext *c1;
@@ -1882,6 +2545,9 @@ static void compute_status(HTTPContext *c)
     time_t ti;
     int i, len;
     ByteIOContext *pb;
+    int64_t bytes_served;
+    unsigned int connections;
+    uint64_t bandwidth;
 
     if (url_open_dyn_buf(&pb) < 0) {
         /* XXX: return an error ? */
@@ -1935,7 +2601,10 @@ static void compute_status(HTTPContext *c)
                          sfilename, stream->filename);
             url_fprintf(pb, "<td align=right> %d <td align=right> ",
                         stream->conns_served);
-            fmt_bytecount(pb, stream->bytes_served);
+            lock_server();
+            bytes_served = stream->bytes_served;
+            unlock_server();
+            fmt_bytecount(pb, bytes_served);
             switch(stream->stream_type) {
             case STREAM_TYPE_LIVE: {
                     int audio_bit_rate = 0;
@@ -2062,47 +2731,34 @@ static void compute_status(HTTPContext *c)
     /* connection status */
     url_fprintf(pb, "<h2>Connection Status</h2>\n");
 
+    lock_server();
+    connections = nb_connections;
+    bandwidth = current_bandwidth;
+    unlock_server();
+
     url_fprintf(pb, "Number of connections: %d / %d<br>\n",
-                 nb_connections, nb_max_connections);
+                 connections, nb_max_connections);
 
     url_fprintf(pb, "Bandwidth in use: %"PRIu64"k / %"PRIu64"k<br>\n",
-                 current_bandwidth, max_bandwidth);
+                 bandwidth, max_bandwidth);
 
     url_fprintf(pb, "<table>\n");
     url_fprintf(pb, "<tr><th>#<th>File<th>IP<th>Proto<th>State<th>Target bits/sec<th>Actual bits/sec<th>Bytes transferred\n");
-    c1 = first_http_ctx;
     i = 0;
-    while (c1 != NULL) {
-        int bitrate;
+    for (c1 = first_http_ctx; c1 != NULL; c1 = c1->next)
+        print_connection(pb, c1, ++i);
+#if HAVE_PTHREADS
+    {
         int j;
-
-        bitrate = 0;
-        if (c1->stream) {
-            for (j = 0; j < c1->stream->nb_streams; j++) {
-                if (!c1->stream->feed)
-                    bitrate += c1->stream->streams[j]->codec->bit_rate;
-                else if (c1->feed_streams[j] >= 0)
-                    bitrate += c1->stream->feed->streams[c1->feed_streams[j]]->codec->bit_rate;
-            }
+        /* the connections of a worker are left alone while we hold its lock */
+        for (j = 0; j < nb_workers; j++) {
+            pthread_mutex_lock(&workers[j].lock);
+            for (c1 = workers[j].first_ctx; c1 != NULL; c1 = c1->next)
+                print_connection(pb, c1, ++i);
+            pthread_mutex_unlock(&workers[j].lock);
         }
-
-        i++;
-        p = inet_ntoa(c1->from_addr.sin_addr);
-        url_fprintf(pb, "<tr><td><b>%d</b><td>%s%s<td>%s<td>%s<td>%s<td align=right>",
-                    i,
-                    c1->stream ? c1->stream->filename : "",
-                    c1->state == HTTPSTATE_RECEIVE_DATA ? "(input)" : "",
-                    p,
-                    c1->protocol,
-                    http_state[c1->state]);
-        fmt_bytecount(pb, bitrate);
-        url_fprintf(pb, "<td align=right>");
-        fmt_bytecount(pb, compute_datarate(&c1->datarate, c1->data_count) * 8);
-        url_fprintf(pb, "<td align=right>");
-        fmt_bytecount(pb, c1->data_count);
-        url_fprintf(pb, "\n");
-        c1 = c1->next;
     }
+#endif
     url_fprintf(pb, "</table>\n");
 
     /* date */
@@ -2132,6 +2788,27 @@ static void open_parser(AVFormatContext *s, int i)
     }
 }
 
+#if HAVE_SENDFILE
+/* return true if the stream sends all the streams of its feed in ffm
+   format, so that the packets of the feed file can be sent as they are */
+static int can_send_feed_file(HTTPContext *c)
+{
+    FFStream *stream = c->stream;
+    int i;
+
+    if (!stream->feed || !stream->fmt || strcmp(stream->fmt->name, "ffm") ||
+        stream->send_on_key || c->switch_pending ||
+        stream->nb_streams != stream->feed->nb_streams)
+        return 0;
+    if (stream->feed != stream) {
+        for (i = 0; i < stream->nb_streams; i++)
+            if (c->feed_streams[i] != i)
+                return 0;
+    }
+    return 1;
+}
+#endif
+
 static int open_input_stream(HTTPContext *c, const char *info)
 {
     char buf[128];
@@ -2199,9 +2876,17 @@ static int open_input_stream(HTTPContext *c, const char *info)
 #if 1
     if (c->fmt_in->iformat->read_seek)
         av_seek_frame(c->fmt_in, -1, stream_pos, 0);
+#endif
+#if HAVE_SENDFILE
+    /* the packets of the feed file are sent from where the seek left us */
+    if (c->stream->feed && !c->is_packetized && can_send_feed_file(c)) {
+        c->send_feed_file = 1;
+        c->feed_file_pos = url_ftell(s->pb);
+        c->feed_file_synced = 0;
+    }
 #endif
     /* set the start time (needed for maxtime and RTP packet timing) */
-    c->start_time = cur_time;
+    c->start_time = get_connection_time(c);
     c->first_pts = AV_NOPTS_VALUE;
     return 0;
 }
@@ -2233,6 +2918,7 @@ static int64_t get_packet_send_clock(HTTPContext *c)
 static int http_prepare_data(HTTPContext *c)
 {
     int i, len, ret;
+    unsigned feed_ends = 0;
     AVFormatContext *ctx;
 
     av_freep(&c->pb_buffer);
@@ -2244,11 +2930,20 @@ static int http_prepare_data(HTTPContext *c)
         av_metadata_set2(&c->fmt_ctx.metadata, "copyright", c->stream->copyright, 0);
         av_metadata_set2(&c->fmt_ctx.metadata, "title"    , c->stream->title    , 0);
 
+        /* each connection gets its own copy of the codec parameters, the
+           feeder may change them and the muxers write to them */
+        ret = 0;
+        lock_server();
         for(i=0;i<c->stream->nb_streams;i++) {
             AVStream *st;
             AVStream *src;
             st = av_mallocz(sizeof(AVStream));
+            if (!st) {
+                ret = -1;
+                break;
+            }
             c->fmt_ctx.streams[i] = st;
+            c->fmt_ctx.nb_streams = i + 1;
             /* if file or feed, then just take streams from FFStream struct */
             if (!c->stream->feed ||
                 c->stream->feed == c->stream)
@@ -2258,12 +2953,19 @@ static int http_prepare_data(HTTPContext *c)
 
             *st = *src;
             st->priv_data = 0;
+            st->codec = avcodec_alloc_context();
+            if (!st->codec || avcodec_copy_context(st->codec, src->codec) < 0) {
+                ret = -1;
+                break;
+            }
             st->codec->frame_number = 0; /* XXX: should be done in
                                            AVStream, not in codec */
         }
+        unlock_server();
+        if (ret < 0)
+            return -1;
         /* set output format parameters */
         c->fmt_ctx.oformat = c->stream->fmt;
-        c->fmt_ctx.nb_streams = c->stream->nb_streams;
 
         c->got_key_frame = 0;
 
@@ -2299,13 +3001,17 @@ static int http_prepare_data(HTTPContext *c)
     case HTTPSTATE_SEND_DATA:
         /* find a new packet */
         /* read a packet from the input stream */
-        if (c->stream->feed)
+        if (c->stream->feed) {
+            lock_server();
             ffm_set_write_index(c->fmt_in,
                                 c->stream->feed->feed_write_index,
                                 c->stream->feed->feed_size);
+            feed_ends = c->stream->feed->feed_ends;
+            unlock_server();
+        }
 
         if (c->stream->max_time &&
-            c->stream->max_time + c->start_time - cur_time < 0)
+            c->stream->max_time + c->start_time - get_connection_time(c) < 0)
             /* We have timed out */
             c->state = HTTPSTATE_SEND_DATA_TRAILER;
         else {
@@ -2317,6 +3023,7 @@ static int http_prepare_data(HTTPContext *c)
                     /* if coming from feed, it means we reached the end of the
                        ffm file, so must wait for more data */
                     c->state = HTTPSTATE_WAIT_FEED;
+                    c->feed_ends = feed_ends;
                     return 1; /* state changed */
                 } else if (ret == AVERROR(EAGAIN)) {
                     /* input not ready, come back later */
@@ -2339,7 +3046,7 @@ static int http_prepare_data(HTTPContext *c)
                 /* update first pts if needed */
                 if (c->first_pts == AV_NOPTS_VALUE) {
                     c->first_pts = av_rescale_q(pkt.dts, c->fmt_in->streams[pkt.stream_index]->time_base, AV_TIME_BASE_Q);
-                    c->start_time = cur_time;
+                    c->start_time = get_connection_time(c);
                 }
                 /* send it to the appropriate stream */
                 if (c->stream->feed) {
@@ -2460,6 +3167,68 @@ static int http_prepare_data(HTTPContext *c)
     return 0;
 }
 
+#if HAVE_SENDFILE
+/* send the packets of the feed file with sendfile(), starting at
+   c->feed_file_pos. Return 1 if nothing more can be sent for now, 0 if
+   the trailer must be sent and -1 on error. */
+static int http_send_feed_file(HTTPContext *c)
+{
+    FFStream *feed = c->stream->feed;
+    int64_t write_index, feed_size, end;
+    unsigned feed_ends;
+    uint8_t header[FFM_HEADER_SIZE];
+    off_t offset;
+    int fd, len;
+
+    if (c->stream->max_time &&
+        c->stream->max_time + c->start_time - get_connection_time(c) < 0) {
+        c->state = HTTPSTATE_SEND_DATA_TRAILER;
+        return 0;
+    }
+
+    lock_server();
+    write_index = feed->feed_write_index;
+    feed_size   = feed->feed_size;
+    feed_ends   = feed->feed_ends;
+    unlock_server();
+
+    fd = url_get_file_handle(url_fileno(c->fmt_in->pb));
+    for (;;) {
+        if (c->feed_file_pos == write_index) {
+            c->state = HTTPSTATE_WAIT_FEED;
+            c->feed_ends = feed_ends;
+            return 1;
+        }
+        if (c->feed_file_pos >= feed_size)
+            c->feed_file_pos = FFM_PACKET_SIZE;
+        if (c->feed_file_synced)
+            break;
+        /* the client must start with a packet in which a frame starts */
+        if (pread(fd, header, sizeof(header), c->feed_file_pos) != sizeof(header))
+            return -1;
+        if (AV_RB16(header + 12)) {
+            c->feed_file_synced = 1;
+            break;
+        }
+        c->feed_file_pos += FFM_PACKET_SIZE;
+    }
+
+    end = write_index > c->feed_file_pos ? write_index : feed_size;
+    offset = c->feed_file_pos;
+    len = sendfile(c->fd, fd, &offset, end - c->feed_file_pos);
+    if (len < 0) {
+        if (errno != EAGAIN && errno != EINTR)
+            return -1;
+        return 1;
+    }
+    c->feed_file_pos += len;
+    c->data_count += len;
+    update_datarate(&c->datarate, c->data_count, get_connection_time(c));
+    add_bytes_served(c->stream, len);
+    return 1;
+}
+#endif
+
 /* should convert the format at the same time */
 /* send data starting at c->buffer_ptr to the output connection
    (either UDP or TCP connection) */
@@ -2469,6 +3238,16 @@ static int http_send_data(HTTPContext *c)
 
     for(;;) {
         if (c->buffer_ptr >= c->buffer_end) {
+#if HAVE_SENDFILE
+            if (c->send_feed_file && c->state == HTTPSTATE_SEND_DATA) {
+                ret = http_send_feed_file(c);
+                if (ret < 0)
+                    return -1;
+                else if (ret != 0)
+                    break;
+                continue;
+            }
+#endif
             ret = http_prepare_data(c);
             if (ret < 0)
                 return -1;
@@ -2497,9 +3276,9 @@ static int http_send_data(HTTPContext *c)
                 }
 
                 c->data_count += len;
-                update_datarate(&c->datarate, c->data_count);
+                update_datarate(&c->datarate, c->data_count, get_connection_time(c));
                 if (c->stream)
-                    c->stream->bytes_served += len;
+                    add_bytes_served(c->stream, len);
 
                 if (c->rtp_protocol == RTSP_LOWER_TRANSPORT_TCP) {
                     /* RTP packets are sent inside the RTSP TCP connection */
@@ -2546,6 +3325,7 @@ static int http_send_data(HTTPContext *c)
                            send it later, so a new state is needed to
                            "lock" the RTSP TCP connection */
                         rtsp_c->state = RTSPSTATE_SEND_PACKET;
+                        update_connection(rtsp_c);
                         break;
                     } else
                         /* all data has been sent */
@@ -2572,9 +3352,9 @@ static int http_send_data(HTTPContext *c)
                     c->buffer_ptr += len;
 
                 c->data_count += len;
-                update_datarate(&c->datarate, c->data_count);
+                update_datarate(&c->datarate, c->data_count, get_connection_time(c));
                 if (c->stream)
-                    c->stream->bytes_served += len;
+                    add_bytes_served(c->stream, len);
                 break;
             }
         }
@@ -2606,15 +3386,15 @@ static int http_start_receive_data(HTTPContext *c)
         ffm_write_write_index(c->feed_fd, FFM_PACKET_SIZE);
         ftruncate(c->feed_fd, FFM_PACKET_SIZE);
         http_log("Truncating feed file '%s'\n", c->stream->feed_filename);
-    } else {
-        if ((c->stream->feed_write_index = ffm_read_write_index(fd)) < 0) {
-            http_log("Error reading write index from feed file: %s\n", strerror(errno));
-            return -1;
-        }
+    } else if (ffm_read_write_index(fd) < 0) {
+        http_log("Error reading write index from feed file: %s\n", strerror(errno));
+        return -1;
     }
 
+    lock_server();
     c->stream->feed_write_index = FFMAX(ffm_read_write_index(fd), FFM_PACKET_SIZE);
     c->stream->feed_size = lseek(fd, 0, SEEK_END);
+    unlock_server();
     lseek(fd, 0, SEEK_SET);
 
     /* init buffer input */
@@ -2674,7 +3454,7 @@ static int http_receive_data(HTTPContext *c)
             c->chunk_size -= len;
             c->buffer_ptr += len;
             c->data_count += len;
-            update_datarate(&c->datarate, c->data_count);
+            update_datarate(&c->datarate, c->data_count, cur_time);
         }
     }
 
@@ -2700,6 +3480,7 @@ static int http_receive_data(HTTPContext *c)
                 goto fail;
             }
 
+            lock_server();
             feed->feed_write_index += FFM_PACKET_SIZE;
             /* update file size */
             if (feed->feed_write_index > c->stream->feed_size)
@@ -2708,6 +3489,7 @@ static int http_receive_data(HTTPContext *c)
             /* handle wrap around if max file size reached */
             if (c->stream->feed_max_size && feed->feed_write_index >= c->stream->feed_max_size)
                 feed->feed_write_index = FFM_PACKET_SIZE;
+            unlock_server();
 
             /* write index */
             if (ffm_write_write_index(c->feed_fd, feed->feed_write_index) < 0) {
@@ -2718,9 +3500,12 @@ static int http_receive_data(HTTPContext *c)
             /* wake up any waiting connections */
             for(c1 = first_http_ctx; c1 != NULL; c1 = c1->next) {
                 if (c1->state == HTTPSTATE_WAIT_FEED &&
-                    c1->stream->feed == c->stream->feed)
+                    c1->stream->feed == c->stream->feed) {
                     c1->state = HTTPSTATE_SEND_DATA;
+                    update_connection(c1);
+                }
             }
+            wake_workers();
         } else {
             /* We have a header in our hands that contains useful data */
             AVFormatContext *s = NULL;
@@ -2750,11 +3535,13 @@ static int http_receive_data(HTTPContext *c)
                 goto fail;
             }
 
+            lock_server();
             for (i = 0; i < s->nb_streams; i++) {
                 AVStream *fst = feed->streams[i];
                 AVStream *st = s->streams[i];
                 avcodec_copy_context(fst->codec, st->codec);
             }
+            unlock_server();
 
             av_close_input_stream(s);
             av_free(pb);
@@ -2769,9 +3556,15 @@ static int http_receive_data(HTTPContext *c)
     /* wake up any waiting connections to stop waiting for feed */
     for(c1 = first_http_ctx; c1 != NULL; c1 = c1->next) {
         if (c1->state == HTTPSTATE_WAIT_FEED &&
-            c1->stream->feed == c->stream->feed)
+            c1->stream->feed == c->stream->feed) {
             c1->state = HTTPSTATE_SEND_DATA_TRAILER;
+            update_connection(c1);
+        }
     }
+    lock_server();
+    c->stream->feed_ends++;
+    unlock_server();
+    wake_workers();
     return -1;
 }
 
@@ -3252,6 +4045,7 @@ static void rtsp_cmd_play(HTTPContext *c, const char *url, RTSPMessageHeader *h)
     }
 
     rtp_c->state = HTTPSTATE_SEND_DATA;
+    update_connection(rtp_c);
 
     /* now everything is OK, so we can send the connection parameters */
     rtsp_reply_header(c, RTSP_STATUS_OK);
@@ -3277,6 +4071,7 @@ static void rtsp_cmd_pause(HTTPContext *c, const char *url, RTSPMessageHeader *h
     }
 
     rtp_c->state = HTTPSTATE_READY;
+    update_connection(rtp_c);
     rtp_c->first_pts = AV_NOPTS_VALUE;
     /* now everything is OK, so we can send the connection parameters */
     rtsp_reply_header(c, RTSP_STATUS_OK);
@@ -3330,13 +4125,14 @@ static HTTPContext *rtp_new_connection(struct sockaddr_in *from_addr,
         goto fail;
 
     c->fd = -1;
-    c->poll_entry = NULL;
     c->from_addr = *from_addr;
     c->buffer_size = IOBUFFER_INIT_SIZE;
     c->buffer = av_malloc(c->buffer_size);
     if (!c->buffer)
         goto fail;
+    lock_server();
     nb_connections++;
+    unlock_server();
     c->stream = stream;
     av_strlcpy(c->session_id, session_id, sizeof(c->session_id));
     c->state = HTTPSTATE_READY;
@@ -3361,7 +4157,9 @@ static HTTPContext *rtp_new_connection(struct sockaddr_in *from_addr,
     av_strlcpy(c->protocol, "RTP/", sizeof(c->protocol));
     av_strlcat(c->protocol, proto_str, sizeof(c->protocol));
 
+    lock_server();
     current_bandwidth += stream->bandwidth;
+    unlock_server();
 
     c->next = first_http_ctx;
     first_http_ctx = c;
@@ -4133,6 +4931,18 @@ static int parse_ffconfig(const char *filename)
                 ERROR("Invalid MaxBandwidth: %s\n", arg);
             } else
                 max_bandwidth = llval;
+        } else if (!strcasecmp(cmd, "WorkerThreads")) {
+            get_arg(arg, sizeof(arg), &p);
+            val = atoi(arg);
+#if HAVE_PTHREADS
+            if (val < 0 || val > 64) {
+                ERROR("Invalid WorkerThreads: %s\n", arg);
+            } else
+                nb_workers = val;
+#else
+            if (val)
+                ERROR("WorkerThreads: threads are not supported by this build\n");
+#endif
         } else if (!strcasecmp(cmd, "CustomLog")) {
             if (!ffserver_debug)
                 get_arg(logfilename, sizeof(logfilename), &p);
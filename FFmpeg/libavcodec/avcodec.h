@@ -32,7 +32,7 @@
 #include "libavutil/cpu.h"
 
 #define LIBAVCODEC_VERSION_MAJOR 52
-#define LIBAVCODEC_VERSION_MINOR 108
+#define LIBAVCODEC_VERSION_MINOR 111
 #define LIBAVCODEC_VERSION_MICRO  0
 
 #define LIBAVCODEC_VERSION_INT  AV_VERSION_INT(LIBAVCODEC_VERSION_MAJOR, \
@@ -726,6 +726,10 @@ typedef struct RcOverride{
  * Codec is able to deal with negative linesizes
  */
 #define CODEC_CAP_NEG_LINESIZES    0x0800
+/**
+ * Codec supports frame-level multithreading.
+ */
+#define CODEC_CAP_FRAME_THREADS    0x1000
 
 //The following defines may change, don't expect compatibility if you use them.
 #define MB_TYPE_INTRA4x4   0x0001
@@ -1025,6 +1029,29 @@ typedef struct AVPanScan{
      * - decoding: Read by user.\
      */\
     int64_t pkt_dts;\
+\
+    /**\
+     * frame-threading private data, such as the decoding progress\
+     * - encoding: unused\
+     * - decoding: Set by libavcodec\
+     */\
+    void *thread_opaque;\
+\
+    /**\
+     * the AVCodecContext which ff_thread_get_buffer() was last called on\
+     * - encoding: unused\
+     * - decoding: Set by libavcodec\
+     */\
+    struct AVCodecContext *owner;\
+\
+    /**\
+     * pool buffer holding the planes, if the frame was allocated by\
+     * avcodec_pool_get_buffer(); take a reference to it with\
+     * av_frame_buffer_ref() to keep the picture after it is released\
+     * - encoding: unused\
+     * - decoding: Set by libavcodec, read by user.\
+     */\
+    struct AVFrameBuffer *pool_buf;\
 
 
 #define FF_QSCALE_TYPE_MPEG1 0
@@ -1802,6 +1829,7 @@ typedef struct AVCodecContext {
 #define FF_DEBUG_VIS_QP      0x00002000
 #define FF_DEBUG_VIS_MB_TYPE 0x00004000
 #define FF_DEBUG_BUFFERS     0x00008000
+#define FF_DEBUG_THREADS     0x00010000
 
     /**
      * debug
@@ -2817,6 +2845,52 @@ typedef struct AVCodecContext {
      * - encoding: unused
      */
     AVPacket *pkt;
+
+    /**
+     * Whether this is a copy of the context which had init() called on it.
+     * This is used by multithreading - shared tables and picture pointers
+     * should be freed from the original context only.
+     * - encoding: Set by libavcodec.
+     * - decoding: Set by libavcodec.
+     */
+    int is_copy;
+
+    /**
+     * Which multithreading methods to use.
+     * Use of FF_THREAD_FRAME will increase decoding delay by one frame per thread,
+     * so clients which cannot provide future frames should not use it.
+     *
+     * - encoding: Set by user, otherwise the default is used.
+     * - decoding: Set by user, otherwise the default is used.
+     */
+    int thread_type;
+#define FF_THREAD_FRAME   1 ///< Decode more than one frame at once
+#define FF_THREAD_SLICE   2 ///< Decode more than one part of a single frame at once
+
+    /**
+     * Which multithreading methods are in use by the codec.
+     * - encoding: Set by libavcodec.
+     * - decoding: Set by libavcodec.
+     */
+    int active_thread_type;
+
+    /**
+     * Set by the client if its custom get_buffer() callback can be called
+     * from another thread, which allows faster multithreaded decoding.
+     * draw_horiz_band() will be called from other threads regardless of this setting.
+     * Ignored if the default get_buffer() is used.
+     * - encoding: Set by user.
+     * - decoding: Set by user.
+     */
+    int thread_safe_callbacks;
+
+    /**
+     * buffer pool used by avcodec_pool_get_buffer()
+     * It may be shared by several codec contexts.
+     * - encoding: unused
+     * - decoding: Set by user.
+     */
+    struct AVFramePool *frame_pool;
 } AVCodecContext;
 
 /**
@@ -2869,6 +2943,26 @@ typedef struct AVCodec {
     uint8_t max_lowres;                     ///< maximum value for lowres supported by the decoder
     AVClass *priv_class;                    ///< AVClass for the private context
     const AVProfile *profiles;              ///< array of recognized profiles, or NULL if unknown, array is terminated by {FF_PROFILE_UNKNOWN}
+
+    /**
+     * @defgroup framethreading Frame-level threading support functions.
+     * @{
+     */
+    /**
+     * If defined, called on thread contexts when they are created.
+     * If the codec allocates writable tables in init(), re-allocate them here.
+     * priv_data will be set to a copy of the original.
+     */
+    int (*init_thread_copy)(AVCodecContext *);
+    /**
+     * Copy necessary context variables from a previous thread context to the current one.
+     * If not defined, the next thread will start automatically; otherwise, the codec
+     * must call ff_thread_finish_setup().
+     *
+     * dst and src will (rarely) point to the same context, in which case memcpy should be skipped.
+     */
+    int (*update_thread_context)(AVCodecContext *dst, const AVCodecContext *src);
+    /** @} */
 } AVCodec;
 
 /**
@@ -3502,6 +3596,23 @@ int avcodec_default_get_buffer(AVCodecContext *s, AVFrame *pic);
 void avcodec_default_release_buffer(AVCodecContext *s, AVFrame *pic);
 int avcodec_default_reget_buffer(AVCodecContext *s, AVFrame *pic);
 
+/**
+ * get_buffer() callback allocating the frames from AVCodecContext.frame_pool.
+ * The planes of a frame are in one reference-counted pool buffer, set in
+ * AVFrame.pool_buf. A consumer which wants to keep a decoded picture, for
+ * display, recording or filtering, takes a reference to that buffer with
+ * av_frame_buffer_ref() instead of copying the picture: the buffer is not
+ * reused until the decoder and all the consumers have dropped their
+ * references. avcodec_default_reget_buffer() copies a frame whose buffer
+ * is still referenced by somebody else before the codec updates it.
+ *
+ * Set get_buffer to this, and release_buffer to
+ * avcodec_pool_release_buffer(). Without a frame_pool, they behave like
+ * the default callbacks.
+ */
+int avcodec_pool_get_buffer(AVCodecContext *s, AVFrame *pic);
+void avcodec_pool_release_buffer(AVCodecContext *s, AVFrame *pic);
+
 /**
  * Return the amount of padding in pixels which the get_buffer callback must
  * provide around the edge of the image for codecs which do not have the
@@ -3544,6 +3655,29 @@ enum PixelFormat avcodec_default_get_format(struct AVCodecContext *s, const enum
 
 int avcodec_thread_init(AVCodecContext *s, int thread_count);
 void avcodec_thread_free(AVCodecContext *s);
+
+/**
+ * Start a process-wide pool of worker threads.
+ * Codec contexts using slice threading which are opened while the pool
+ * exists run their execute() and execute2() jobs on it instead of
+ * starting thread_count threads of their own, so the number of decoding
+ * threads stays bounded however many contexts are open. Their
+ * thread_count still sets how many jobs of one context may run at once.
+ * Frame threading is not used while the pool exists.
+ *
+ * Must not be called concurrently with avcodec_open() or avcodec_close().
+ *
+ * @param thread_count number of worker threads in the pool
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int avcodec_thread_pool_init(int thread_count);
+
+/**
+ * Stop the worker threads started by avcodec_thread_pool_init().
+ * All the codec contexts attached to the pool must have been closed.
+ */
+void avcodec_thread_pool_free(void);
+
 int avcodec_default_execute(AVCodecContext *c, int (*func)(AVCodecContext *c2, void *arg2),void *arg, int *ret, int count, int size);
 int avcodec_default_execute2(AVCodecContext *c, int (*func)(AVCodecContext *c2, void *arg2, int, int),void *arg, int *ret, int count);
 //FIXME func typedef
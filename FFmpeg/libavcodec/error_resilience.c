@@ -32,6 +32,7 @@
 #include "mpegvideo.h"
 #include "h264.h"
 #include "rectangle.h"
+#include "thread.h"
 
 /*
  * H264 redefines mb_intra so it is not mistakely used (its uninitialized in h264)
@@ -752,6 +753,19 @@ void ff_er_add_slice(MpegEncContext *s, int startx, int starty, int endx, int en
     }
 }
 
+/**
+ * Wait for a reference picture to be completely decoded by its frame thread,
+ * the concealment may read any part of it.
+ */
+static void await_reference(MpegEncContext *s, Picture *pic){
+    if(!pic || !pic->data[0] || pic->data[0] == s->current_picture.data[0])
+        return;
+
+    ff_thread_await_progress((AVFrame*)pic, INT_MAX, 0);
+    if(pic->field_picture)
+        ff_thread_await_progress((AVFrame*)pic, INT_MAX, 1);
+}
+
 void ff_er_frame_end(MpegEncContext *s){
     int i, mb_x, mb_y, error, error_type, dc_error, mv_error, ac_error;
     int distance;
@@ -767,6 +781,11 @@ void ff_er_frame_end(MpegEncContext *s){
        s->picture_structure != PICT_FRAME || // we dont support ER of field pictures yet, though it should not crash if enabled
        s->error_count==3*s->mb_width*(s->avctx->skip_top + s->avctx->skip_bottom)) return;
 
+    if(s->avctx->active_thread_type&FF_THREAD_FRAME){
+        await_reference(s, s->last_picture_ptr);
+        await_reference(s, s->next_picture_ptr);
+    }
+
     if(s->current_picture.motion_val[0] == NULL){
         av_log(s->avctx, AV_LOG_ERROR, "Warning MVs not available\n");
 
@@ -39,6 +39,7 @@
 #include "rectangle.h"
 #include "vdpau_internal.h"
 #include "libavutil/avassert.h"
+#include "thread.h"
 
 #include "cabac.h"
 
@@ -439,6 +440,48 @@ static inline void prefetch_motion(H264Context *h, int list){
     }
 }
 
+/**
+ * Wait until the reference rows used by the motion compensation of the
+ * current macroblock have been decoded by the other frame threads.
+ */
+static void await_references(H264Context *h){
+    MpegEncContext * const s = &h->s;
+    int list, i;
+
+    for(list=0; list<h->list_count; list++){
+        for(i=0; i<4; i++){
+            const int ref_n= h->ref_cache[list][ scan8[4*i] ];
+            Picture *ref;
+            int ref_field, ref_field_picture, pic_height, my, row;
+
+            if(ref_n < 0)
+                continue;
+
+            ref               = &h->ref_list[list][ref_n];
+            ref_field         = ref->reference - 1;
+            ref_field_picture = ref->field_picture;
+            pic_height        = 16*s->mb_height >> ref_field_picture;
+
+            my= FFMAX(FFMAX(h->mv_cache[list][ scan8[4*i  ] ][1], h->mv_cache[list][ scan8[4*i+1] ][1]),
+                      FFMAX(h->mv_cache[list][ scan8[4*i+2] ][1], h->mv_cache[list][ scan8[4*i+3] ][1]));
+            /* bottom row of the 8x8 block, plus the 6-tap filter taps and
+             * a margin for the chroma rounding and field parity offset */
+            row= 16*(s->mb_y >> MB_FIELD) + 8*(i>>1) + 7 + (my>>2) + 3 + 2;
+
+            if(!MB_FIELD && ref_field_picture){ // frame referencing two fields
+                ff_thread_await_progress((AVFrame*)ref, av_clip((row>>1) - !(row&1), 0, pic_height-1), 1);
+                ff_thread_await_progress((AVFrame*)ref, av_clip( row>>1,             0, pic_height-1), 0);
+            }else if(MB_FIELD && !ref_field_picture){ // field referencing one field of a frame
+                ff_thread_await_progress((AVFrame*)ref, av_clip(2*row + ref_field, 0, pic_height-1), 0);
+            }else if(MB_FIELD){
+                ff_thread_await_progress((AVFrame*)ref, av_clip(row, 0, pic_height-1), ref_field);
+            }else{
+                ff_thread_await_progress((AVFrame*)ref, av_clip(row, 0, pic_height-1), 0);
+            }
+        }
+    }
+}
+
 static void hl_motion(H264Context *h, uint8_t *dest_y, uint8_t *dest_cb, uint8_t *dest_cr,
                       qpel_mc_func (*qpix_put)[16], h264_chroma_mc_func (*chroma_put),
                       qpel_mc_func (*qpix_avg)[16], h264_chroma_mc_func (*chroma_avg),
@@ -449,6 +492,8 @@ static void hl_motion(H264Context *h, uint8_t *dest_y, uint8_t *dest_cb, uint8_t
 
     assert(IS_INTER(mb_type));
 
+    if(HAVE_PTHREADS && (s->avctx->active_thread_type&FF_THREAD_FRAME))
+        await_references(h);
     prefetch_motion(h, 0);
 
     if(IS_16X16(mb_type)){
@@ -818,6 +863,149 @@ av_cold int ff_h264_decode_init(AVCodecContext *avctx){
     return 0;
 }
 
+static void copy_picture_range(Picture **to, Picture **from, int count, MpegEncContext *new_base, MpegEncContext *old_base)
+{
+    int i;
+
+    for (i=0; i<count; i++)
+        to[i] = REBASE_PICTURE(from[i], new_base, old_base);
+}
+
+static int copy_parameter_set(void **to, void **from, int count, int size)
+{
+    int i;
+
+    for (i=0; i<count; i++){
+        if (to[i] && !from[i]) av_freep(&to[i]);
+        else if (from[i] && !to[i]) {
+            to[i] = av_malloc(size);
+            if (!to[i])
+                return AVERROR(ENOMEM);
+        }
+
+        if (from[i]) memcpy(to[i], from[i], size);
+    }
+
+    return 0;
+}
+
+static int decode_init_thread_copy(AVCodecContext *avctx){
+    H264Context *h= avctx->priv_data;
+
+    if (!avctx->is_copy) return 0;
+
+    /* the context was copied from the first thread, do not share its buffers */
+    memset(h->sps_buffers, 0, sizeof(h->sps_buffers));
+    memset(h->pps_buffers, 0, sizeof(h->pps_buffers));
+    memset(h->rbsp_buffer, 0, sizeof(h->rbsp_buffer));
+    memset(h->rbsp_buffer_size, 0, sizeof(h->rbsp_buffer_size));
+
+    h->s.avctx = avctx;
+    h->thread_context[0] = h;
+
+    return 0;
+}
+
+#define copy_fields(to, from, start_field, end_field) memcpy(&to->start_field, &from->start_field, (char*)&to->end_field - (char*)&to->start_field)
+static int decode_update_thread_context(AVCodecContext *dst, const AVCodecContext *src){
+    H264Context *h= dst->priv_data, *h1= src->priv_data;
+    MpegEncContext * const s = &h->s, * const s1 = &h1->s;
+    int inited = s->context_initialized, err;
+    int i;
+
+    if(dst == src) return 0;
+
+    if(s1->context_initialized){
+        err = ff_mpeg_update_thread_context(dst, src);
+        if(err) return err;
+
+        //FIXME handle width/height changing
+        if(!inited){
+            for(i = 0; i < MAX_SPS_COUNT; i++)
+                av_freep(h->sps_buffers + i);
+
+            for(i = 0; i < MAX_PPS_COUNT; i++)
+                av_freep(h->pps_buffers + i);
+
+            memcpy(&h->s + 1, &h1->s + 1, sizeof(H264Context) - sizeof(MpegEncContext)); //copy all fields after MpegEnc
+            memset(h->sps_buffers, 0, sizeof(h->sps_buffers));
+            memset(h->pps_buffers, 0, sizeof(h->pps_buffers));
+            memset(h->thread_context, 0, sizeof(h->thread_context));
+            h->thread_context[0] = h;
+
+            if (ff_h264_alloc_tables(h) < 0 || context_init(h) < 0)
+                return AVERROR(ENOMEM);
+
+            for(i=0; i<2; i++){
+                h->rbsp_buffer[i] = NULL;
+                h->rbsp_buffer_size[i] = 0;
+            }
+
+            // frame_start may not be called for the next thread (if it's decoding a bottom field)
+            // so this has to be allocated here
+            h->s.obmc_scratchpad = av_malloc(16*2*s->linesize + 8*2*s->uvlinesize);
+
+            s->dsp.clear_blocks(h->mb);
+        }
+    }
+
+    //extradata/NAL handling
+    h->is_avc          = h1->is_avc;
+    h->nal_length_size = h1->nal_length_size;
+    h->x264_build      = h1->x264_build;
+
+    //SPS/PPS
+    if ((err = copy_parameter_set((void**)h->sps_buffers, (void**)h1->sps_buffers, MAX_SPS_COUNT, sizeof(SPS))) < 0)
+        return err;
+    h->sps = h1->sps;
+    if ((err = copy_parameter_set((void**)h->pps_buffers, (void**)h1->pps_buffers, MAX_PPS_COUNT, sizeof(PPS))) < 0)
+        return err;
+    h->pps = h1->pps;
+
+    if(!s1->context_initialized) return 0;
+
+    //Dequantization matrices
+    //FIXME these are big - can they be only copied when PPS changes?
+    copy_fields(h, h1, dequant4_buffer, dequant4_coeff);
+
+    for(i=0; i<6; i++)
+        h->dequant4_coeff[i] = h->dequant4_buffer[0] + (h1->dequant4_coeff[i] - h1->dequant4_buffer[0]);
+
+    for(i=0; i<2; i++)
+        h->dequant8_coeff[i] = h->dequant8_buffer[0] + (h1->dequant8_coeff[i] - h1->dequant8_buffer[0]);
+
+    h->dequant_coeff_pps = h1->dequant_coeff_pps;
+
+    //POC timing
+    copy_fields(h, h1, poc_lsb, redundant_pic_count);
+
+    //reference lists
+    copy_fields(h, h1, ref_count, list_count);
+    copy_fields(h, h1, ref_list,  intra_gb);
+    copy_fields(h, h1, short_ref, cabac_init_idc);
+
+    copy_picture_range(h->short_ref,   h1->short_ref,   32, s, s1);
+    copy_picture_range(h->long_ref,    h1->long_ref,    32, s, s1);
+    copy_picture_range(h->delayed_pic, h1->delayed_pic, MAX_DELAYED_PIC_COUNT+2, s, s1);
+
+    h->last_slice_type       = h1->last_slice_type;
+    h->prev_interlaced_frame = h1->prev_interlaced_frame;
+
+    if(!s->current_picture_ptr) return 0;
+
+    /* the reference picture marking of the previous frame was left to us,
+     * see field_end() */
+    if(!s->dropable) {
+        ff_h264_execute_ref_pic_marking(h, h->mmco, h->mmco_index);
+        h->prev_poc_msb = h->poc_msb;
+        h->prev_poc_lsb = h->poc_lsb;
+    }
+    h->prev_frame_num_offset = h->frame_num_offset;
+    h->prev_frame_num        = h->frame_num;
+
+    return 0;
+}
+
 int ff_h264_frame_start(H264Context *h){
     MpegEncContext * const s = &h->s;
     int i;
@@ -833,6 +1021,7 @@ int ff_h264_frame_start(H264Context *h){
      */
     s->current_picture_ptr->key_frame= 0;
     s->current_picture_ptr->mmco_reset= 0;
+    s->current_picture_ptr->field_picture= s->picture_structure != PICT_FRAME;
 
     assert(s->linesize && s->uvlinesize);
 
@@ -1513,7 +1702,7 @@ static void init_scan_tables(H264Context *h){
     }
 }
 
-static void field_end(H264Context *h){
+static void field_end(H264Context *h, int in_setup){
     MpegEncContext * const s = &h->s;
     AVCodecContext * const avctx= s->avctx;
     s->mb_y= 0;
@@ -1526,13 +1715,17 @@ static void field_end(H264Context *h){
         ff_vdpau_h264_set_reference_frames(s);
 #endif
 
-    if(!s->dropable) {
-        ff_h264_execute_ref_pic_marking(h, h->mmco, h->mmco_index);
-        h->prev_poc_msb= h->poc_msb;
-        h->prev_poc_lsb= h->poc_lsb;
+    /* With frame threads the next thread has already copied our state once
+     * setup is finished, it runs the marking itself in update_thread_context. */
+    if (in_setup || !(avctx->active_thread_type&FF_THREAD_FRAME)) {
+        if(!s->dropable) {
+            ff_h264_execute_ref_pic_marking(h, h->mmco, h->mmco_index);
+            h->prev_poc_msb= h->poc_msb;
+            h->prev_poc_lsb= h->poc_lsb;
+        }
+        h->prev_frame_num_offset= h->frame_num_offset;
+        h->prev_frame_num= h->frame_num;
     }
-    h->prev_frame_num_offset= h->frame_num_offset;
-    h->prev_frame_num= h->frame_num;
 
     if (avctx->hwaccel) {
         if (avctx->hwaccel->end_frame(avctx) < 0)
@@ -1561,9 +1754,192 @@ static void field_end(H264Context *h){
 
     MPV_frame_end(s);
 
+    if (!s->dropable)
+        ff_thread_report_progress((AVFrame*)s->current_picture_ptr, INT_MAX,
+                                  s->picture_structure==PICT_BOTTOM_FIELD);
+
     h->current_slice=0;
 }
 
+/**
+ * Run the setup operations which only depend on the first slice header of
+ * a picture: sort it into display order and pick the picture to output.
+ *
+ * @param h h264 master context
+ * @param setup_finished enough NAL units have been read that the next frame
+ *                       thread can be started with ff_thread_finish_setup()
+ */
+static void decode_postinit(H264Context *h, int setup_finished){
+    MpegEncContext * const s = &h->s;
+    Picture *out = s->current_picture_ptr;
+    Picture *cur = s->current_picture_ptr;
+    int i, pics, out_of_order, out_idx;
+    int mmco_reset = 0, poc = 0, field_poc[2] = {0, 0};
+
+    s->current_picture_ptr->qscale_type= FF_QSCALE_TYPE_H264;
+    s->current_picture_ptr->pict_type= s->pict_type;
+
+    if (h->next_output_pic) return;
+
+    if (cur->field_poc[0]==INT_MAX || cur->field_poc[1]==INT_MAX) {
+        /* Wait for the second field. It may be in the same packet, so the
+         * next frame thread is only started once the packet is decoded. */
+        return;
+    }
+
+    /* The reference picture marking of this picture is executed when it is
+     * finished; apply the effect of a memory management reset on its POC now
+     * so that it is output in the same order. */
+    if (!s->dropable) {
+        for (i = 0; i < h->mmco_index; i++)
+            if (h->mmco[i].opcode == MMCO_RESET)
+                mmco_reset = 1;
+    }
+    if (mmco_reset) {
+        poc          = cur->poc;
+        field_poc[0] = cur->field_poc[0];
+        field_poc[1] = cur->field_poc[1];
+        cur->poc          =
+        cur->field_poc[0] =
+        cur->field_poc[1] = 0;
+        cur->mmco_reset   = 1;
+    }
+
+    cur->interlaced_frame = 0;
+    cur->repeat_pict = 0;
+
+    /* Signal interlacing information externally. */
+    /* Prioritize picture timing SEI information over used decoding process if it exists. */
+
+    if(h->sps.pic_struct_present_flag){
+        switch (h->sei_pic_struct)
+        {
+        case SEI_PIC_STRUCT_FRAME:
+            break;
+        case SEI_PIC_STRUCT_TOP_FIELD:
+        case SEI_PIC_STRUCT_BOTTOM_FIELD:
+            cur->interlaced_frame = 1;
+            break;
+        case SEI_PIC_STRUCT_TOP_BOTTOM:
+        case SEI_PIC_STRUCT_BOTTOM_TOP:
+            if (FIELD_OR_MBAFF_PICTURE)
+                cur->interlaced_frame = 1;
+            else
+                // try to flag soft telecine progressive
+                cur->interlaced_frame = h->prev_interlaced_frame;
+            break;
+        case SEI_PIC_STRUCT_TOP_BOTTOM_TOP:
+        case SEI_PIC_STRUCT_BOTTOM_TOP_BOTTOM:
+            // Signal the possibility of telecined film externally (pic_struct 5,6)
+            // From these hints, let the applications decide if they apply deinterlacing.
+            cur->repeat_pict = 1;
+            break;
+        case SEI_PIC_STRUCT_FRAME_DOUBLING:
+            // Force progressive here, as doubling interlaced frame is a bad idea.
+            cur->repeat_pict = 2;
+            break;
+        case SEI_PIC_STRUCT_FRAME_TRIPLING:
+            cur->repeat_pict = 4;
+            break;
+        }
+
+        if ((h->sei_ct_type & 3) && h->sei_pic_struct <= SEI_PIC_STRUCT_BOTTOM_TOP)
+            cur->interlaced_frame = (h->sei_ct_type & (1<<1)) != 0;
+    }else{
+        /* Derive interlacing flag from used decoding process. */
+        cur->interlaced_frame = FIELD_OR_MBAFF_PICTURE;
+    }
+    h->prev_interlaced_frame = cur->interlaced_frame;
+
+    if (cur->field_poc[0] != cur->field_poc[1]){
+        /* Derive top_field_first from field pocs. */
+        cur->top_field_first = cur->field_poc[0] < cur->field_poc[1];
+    }else{
+        if(cur->interlaced_frame || h->sps.pic_struct_present_flag){
+            /* Use picture timing SEI information. Even if it is a information of a past frame, better than nothing. */
+            if(h->sei_pic_struct == SEI_PIC_STRUCT_TOP_BOTTOM
+              || h->sei_pic_struct == SEI_PIC_STRUCT_TOP_BOTTOM_TOP)
+                cur->top_field_first = 1;
+            else
+                cur->top_field_first = 0;
+        }else{
+            /* Most likely progressive */
+            cur->top_field_first = 0;
+        }
+    }
+
+    //FIXME do something with unavailable reference frames
+
+    /* Sort B-frames into display order */
+
+    if(h->sps.bitstream_restriction_flag
+       && s->avctx->has_b_frames < h->sps.num_reorder_frames){
+        s->avctx->has_b_frames = h->sps.num_reorder_frames;
+        s->low_delay = 0;
+    }
+
+    if(   s->avctx->strict_std_compliance >= FF_COMPLIANCE_STRICT
+       && !h->sps.bitstream_restriction_flag){
+        s->avctx->has_b_frames= MAX_DELAYED_PIC_COUNT;
+        s->low_delay= 0;
+    }
+
+    pics = 0;
+    while(h->delayed_pic[pics]) pics++;
+
+    assert(pics <= MAX_DELAYED_PIC_COUNT);
+
+    h->delayed_pic[pics++] = cur;
+    if(cur->reference == 0)
+        cur->reference = DELAYED_PIC_REF;
+
+    out = h->delayed_pic[0];
+    out_idx = 0;
+    for(i=1; h->delayed_pic[i] && !h->delayed_pic[i]->key_frame && !h->delayed_pic[i]->mmco_reset; i++)
+        if(h->delayed_pic[i]->poc < out->poc){
+            out = h->delayed_pic[i];
+            out_idx = i;
+        }
+    if(s->avctx->has_b_frames == 0 && (h->delayed_pic[0]->key_frame || h->delayed_pic[0]->mmco_reset))
+        h->outputed_poc= INT_MIN;
+    out_of_order = out->poc < h->outputed_poc;
+
+    if(h->sps.bitstream_restriction_flag && s->avctx->has_b_frames >= h->sps.num_reorder_frames)
+        { }
+    else if((out_of_order && pics-1 == s->avctx->has_b_frames && s->avctx->has_b_frames < MAX_DELAYED_PIC_COUNT)
+       || (s->low_delay &&
+        ((h->outputed_poc != INT_MIN && out->poc > h->outputed_poc + 2)
+         || cur->pict_type == FF_B_TYPE)))
+    {
+        s->low_delay = 0;
+        s->avctx->has_b_frames++;
+    }
+
+    if(out_of_order || pics > s->avctx->has_b_frames){
+        out->reference &= ~DELAYED_PIC_REF;
+        for(i=out_idx; h->delayed_pic[i]; i++)
+            h->delayed_pic[i] = h->delayed_pic[i+1];
+    }
+    if(!out_of_order && pics > s->avctx->has_b_frames){
+        h->next_output_pic = out;
+        if(out_idx==0 && h->delayed_pic[0] && (h->delayed_pic[0]->key_frame || h->delayed_pic[0]->mmco_reset)) {
+            h->outputed_poc = INT_MIN;
+        } else
+            h->outputed_poc = out->poc;
+    }else{
+        av_log(s->avctx, AV_LOG_DEBUG, "no picture\n");
+    }
+
+    if (mmco_reset) {
+        cur->poc          = poc;
+        cur->field_poc[0] = field_poc[0];
+        cur->field_poc[1] = field_poc[1];
+    }
+
+    if (setup_finished)
+        ff_thread_finish_setup(s->avctx);
+}
+
 /**
  * Replicate H264 "master" context to thread contexts.
  */
@@ -1608,8 +1984,9 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
     int num_ref_idx_active_override_flag;
     unsigned int slice_type, tmp, i, j;
     int default_ref_list_done = 0;
-    int last_pic_structure;
+    int last_pic_structure, last_pic_dropable;
 
+    last_pic_dropable = s0->dropable;
     s->dropable= h->nal_ref_idc == 0;
 
     if((s->avctx->flags2 & CODEC_FLAG2_FAST) && !h->nal_ref_idc){
@@ -1624,7 +2001,7 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
 
     if(first_mb_in_slice == 0){ //FIXME better field boundary detection
         if(h0->current_slice && FIELD_PICTURE){
-            field_end(h);
+            field_end(h, 1);
         }
 
         h0->current_slice = 0;
@@ -1693,8 +2070,10 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
     if (s->context_initialized
         && (   s->width != s->avctx->width || s->height != s->avctx->height
             || av_cmp_q(h->sps.sar, s->avctx->sample_aspect_ratio))) {
-        if(h != h0)
+        if(h != h0 || (HAVE_THREADS && s->avctx->active_thread_type&FF_THREAD_FRAME)) {
+            av_log_missing_feature(s->avctx, "Width/height changing with threads is", 0);
             return -1;   // width / height changed during parallelized decoding
+        }
         free_tables(h);
         flush_dpb(s->avctx);
         MPV_common_end(s);
@@ -1739,21 +2118,26 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
         init_scan_tables(h);
         ff_h264_alloc_tables(h);
 
-        for(i = 1; i < s->avctx->thread_count; i++) {
-            H264Context *c;
-            c = h->thread_context[i] = av_malloc(sizeof(H264Context));
-            memcpy(c, h->s.thread_context[i], sizeof(MpegEncContext));
-            memset(&c->s + 1, 0, sizeof(H264Context) - sizeof(MpegEncContext));
-            c->h264dsp = h->h264dsp;
-            c->sps = h->sps;
-            c->pps = h->pps;
-            init_scan_tables(c);
-            clone_tables(c, h, i);
-        }
-
-        for(i = 0; i < s->avctx->thread_count; i++)
-            if(context_init(h->thread_context[i]) < 0)
+        if (!HAVE_THREADS || !(s->avctx->active_thread_type&FF_THREAD_SLICE)) {
+            if (context_init(h) < 0)
                 return -1;
+        } else {
+            for(i = 1; i < s->avctx->thread_count; i++) {
+                H264Context *c;
+                c = h->thread_context[i] = av_malloc(sizeof(H264Context));
+                memcpy(c, h->s.thread_context[i], sizeof(MpegEncContext));
+                memset(&c->s + 1, 0, sizeof(H264Context) - sizeof(MpegEncContext));
+                c->h264dsp = h->h264dsp;
+                c->sps = h->sps;
+                c->pps = h->pps;
+                init_scan_tables(c);
+                clone_tables(c, h, i);
+            }
+
+            for(i = 0; i < s->avctx->thread_count; i++)
+                if(context_init(h->thread_context[i]) < 0)
+                    return -1;
+        }
     }
 
     h->frame_num= get_bits(&s->gb, h->sps.log2_max_frame_num);
@@ -1793,6 +2177,9 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
              * be fixed. */
             if (h->short_ref_count) {
                 if (prev) {
+                    ff_thread_await_progress((AVFrame*)prev, INT_MAX, 0);
+                    if (prev->field_picture)
+                        ff_thread_await_progress((AVFrame*)prev, INT_MAX, 1);
                     av_image_copy(h->short_ref[0]->data, h->short_ref[0]->linesize,
                                   (const uint8_t**)prev->data, prev->linesize,
                                   s->avctx->pix_fmt, s->mb_width*16, s->mb_height*16);
@@ -1800,6 +2187,9 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
                 }
                 h->short_ref[0]->frame_num = h->prev_frame_num;
             }
+            /* the gap frame is complete, it is never decoded */
+            ff_thread_report_progress((AVFrame*)s->current_picture_ptr, INT_MAX, 0);
+            ff_thread_report_progress((AVFrame*)s->current_picture_ptr, INT_MAX, 1);
         }
 
         /* See if we have a decoded first field looking for a pair... */
@@ -1814,6 +2204,10 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
                  * Previous field is unmatched. Don't display it, but let it
                  * remain for reference if marked as such.
                  */
+                if (!last_pic_dropable && last_pic_structure != PICT_FRAME) {
+                    ff_thread_report_progress((AVFrame*)s0->current_picture_ptr, INT_MAX,
+                                              last_pic_structure == PICT_TOP_FIELD);
+                }
                 s0->current_picture_ptr = NULL;
                 s0->first_field = FIELD_PICTURE;
 
@@ -1827,6 +2221,10 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
                      * pair. Throw away previous field except for reference
                      * purposes.
                      */
+                    if (!last_pic_dropable && last_pic_structure != PICT_FRAME) {
+                        ff_thread_report_progress((AVFrame*)s0->current_picture_ptr, INT_MAX,
+                                                  last_pic_structure == PICT_TOP_FIELD);
+                    }
                     s0->first_field = 1;
                     s0->current_picture_ptr = NULL;
 
@@ -2087,7 +2485,7 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
                           +(h->ref_list[j][i].reference&3);
     }
 
-    h->emu_edge_width= (s->flags&CODEC_FLAG_EMU_EDGE) ? 0 : 16;
+    h->emu_edge_width= (s->flags&CODEC_FLAG_EMU_EDGE || (HAVE_THREADS && s->avctx->active_thread_type&FF_THREAD_FRAME)) ? 0 : 16;
     h->emu_edge_height= (FRAME_MBAFF || FIELD_PICTURE) ? 0 : h->emu_edge_width;
 
     if(s->avctx->debug&FF_DEBUG_PICT_INFO){
@@ -2408,6 +2806,24 @@ static void predict_field_decoding_flag(H264Context *h){
     h->mb_mbaff = h->mb_field_decoding_flag = IS_INTERLACED(mb_type) ? 1 : 0;
 }
 
+/**
+ * Draw the last decoded MB row and report it to the other frame threads.
+ */
+static void decode_finish_row(H264Context *h){
+    MpegEncContext * const s = &h->s;
+    int top    = 16*(s->mb_y >> FIELD_PICTURE);
+    int height = 16 << FRAME_MBAFF;
+    /* rows which the deblocking of the next MB row may still change */
+    int deblock_border = 3 << FRAME_MBAFF;
+
+    ff_draw_horiz_band(s, 16*s->mb_y, 16);
+
+    if (s->dropable) return;
+
+    ff_thread_report_progress((AVFrame*)s->current_picture_ptr, top + height - 1 - deblock_border,
+                              s->picture_structure==PICT_BOTTOM_FIELD);
+}
+
 static int decode_slice(struct AVCodecContext *avctx, void *arg){
     H264Context *h = *(void**)arg;
     MpegEncContext * const s = &h->s;
@@ -2461,7 +2877,7 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg){
             if( ++s->mb_x >= s->mb_width ) {
                 s->mb_x = 0;
                 loop_filter(h);
-                ff_draw_horiz_band(s, 16*s->mb_y, 16);
+                decode_finish_row(h);
                 ++s->mb_y;
                 if(FIELD_OR_MBAFF_PICTURE) {
                     ++s->mb_y;
@@ -2501,7 +2917,7 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg){
             if(++s->mb_x >= s->mb_width){
                 s->mb_x=0;
                 loop_filter(h);
-                ff_draw_horiz_band(s, 16*s->mb_y, 16);
+                decode_finish_row(h);
                 ++s->mb_y;
                 if(FIELD_OR_MBAFF_PICTURE) {
                     ++s->mb_y;
@@ -2626,6 +3042,59 @@ static void execute_decode_slices(H264Context *h, int context_count){
 }
 
 
+/**
+ * Count the NAL units of the packet which must be decoded before the next
+ * frame thread can copy the decoder state: up to the last parameter set or
+ * the first slice of the last field or frame.
+ * The NAL units are only split, not unescaped.
+ */
+static int get_nals_needed(H264Context *h, const uint8_t *buf, int buf_size){
+    int buf_index = 0, nal_index = 0, nals_needed = 0;
+    int next_avc = h->is_avc ? 0 : buf_size;
+
+    for(;;){
+        int i, nalsize = 0;
+
+        if(buf_index >= next_avc) {
+            if(buf_index >= buf_size) break;
+            for(i = 0; i < h->nal_length_size; i++)
+                nalsize = (nalsize << 8) | buf[buf_index++];
+            if(nalsize <= 0 || nalsize > buf_size - buf_index)
+                break;
+            next_avc= buf_index + nalsize;
+        } else {
+            for(; buf_index + 3 < next_avc; buf_index++){
+                if(buf[buf_index] == 0 && buf[buf_index+1] == 0 && buf[buf_index+2] == 1)
+                    break;
+            }
+
+            if(buf_index+3 >= buf_size) break;
+
+            buf_index+=3;
+            if(buf_index >= next_avc) continue;
+        }
+
+        nal_index++;
+        switch(buf[buf_index] & 0x1F){
+        case NAL_SPS:
+        case NAL_PPS:
+            nals_needed = nal_index;
+            break;
+        case NAL_IDR_SLICE:
+        case NAL_SLICE:
+        case NAL_DPA:
+            /* first_mb_in_slice == 0 is coded as a single set bit */
+            if(buf_index + 1 < next_avc && (buf[buf_index+1] & 0x80))
+                nals_needed = nal_index;
+            break;
+        }
+
+        buf_index = h->is_avc ? next_avc : buf_index + 1;
+    }
+
+    return nals_needed;
+}
+
 static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
     MpegEncContext * const s = &h->s;
     AVCodecContext * const avctx= s->avctx;
@@ -2633,8 +3102,9 @@ static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
     H264Context *hx; ///< thread context
     int context_count = 0;
     int next_avc= h->is_avc ? 0 : buf_size;
+    int nal_index = 0, nals_needed = 0;
 
-    h->max_contexts = avctx->thread_count;
+    h->max_contexts = (HAVE_THREADS && (avctx->active_thread_type&FF_THREAD_SLICE)) ? avctx->thread_count : 1;
 #if 0
     int i;
     for(i=0; i<50; i++){
@@ -2647,6 +3117,10 @@ static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
             s->current_picture_ptr= NULL;
         ff_h264_reset_sei(h);
     }
+    h->next_output_pic = NULL;
+
+    if(HAVE_THREADS && (avctx->active_thread_type&FF_THREAD_FRAME))
+        nals_needed = get_nals_needed(h, buf, buf_size);
 
     for(;;){
         int consumed;
@@ -2706,6 +3180,7 @@ static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
         }
 
         buf_index += consumed;
+        nal_index++;
 
         if(  (s->hurry_up == 1 && h->nal_ref_idc  == 0) //FIXME do not discard SEI id
            ||(avctx->skip_frame >= AVDISCARD_NONREF && h->nal_ref_idc  == 0))
@@ -2741,6 +3216,9 @@ static int decode_nal_units(H264Context *h, const uint8_t *buf, int buf_size){
             s->current_picture_ptr->key_frame |=
                     (hx->nal_unit_type == NAL_IDR_SLICE) ||
                     (h->sei_recovery_frame_cnt >= 0);
+
+            if (h->current_slice == 1 && !(s->flags2 & CODEC_FLAG2_CHUNKS))
+                decode_postinit(h, nal_index >= nals_needed);
             if(hx->redundant_pic_count==0 && hx->s.hurry_up < 5
                && (avctx->skip_frame < AVDISCARD_NONREF || hx->nal_ref_idc)
                && (avctx->skip_frame < AVDISCARD_BIDIR  || hx->slice_type_nos!=FF_B_TYPE)
@@ -2872,6 +3350,10 @@ static int decode_frame(AVCodecContext *avctx,
         Picture *out;
         int i, out_idx;
 
+        /* the picture has already been marked; a later frame thread must
+         * not run the deferred marking for it a second time */
+        s->current_picture_ptr = NULL;
+
 //FIXME factorize this with the output code below
         out = h->delayed_pic[0];
         out_idx = 0;
@@ -2893,8 +3375,14 @@ static int decode_frame(AVCodecContext *avctx,
     }
 
     buf_index=decode_nal_units(h, buf, buf_size);
-    if(buf_index < 0)
+    if(buf_index < 0) {
+        /* do not let later frame threads wait for a picture which will not be finished */
+        if (s->current_picture_ptr) {
+            ff_thread_report_progress((AVFrame*)s->current_picture_ptr, INT_MAX, 0);
+            ff_thread_report_progress((AVFrame*)s->current_picture_ptr, INT_MAX, 1);
+        }
         return -1;
+    }
 
     if (!s->current_picture_ptr && h->nal_unit_type == NAL_END_SEQUENCE) {
         buf_size = 0;
@@ -2908,143 +3396,18 @@ static int decode_frame(AVCodecContext *avctx,
     }
 
     if(!(s->flags2 & CODEC_FLAG2_CHUNKS) || (s->mb_y >= s->mb_height && s->mb_height)){
-        Picture *out = s->current_picture_ptr;
-        Picture *cur = s->current_picture_ptr;
-        int i, pics, out_of_order, out_idx;
 
-        field_end(h);
+        if(s->flags2 & CODEC_FLAG2_CHUNKS) decode_postinit(h, 1);
 
-        if (cur->field_poc[0]==INT_MAX || cur->field_poc[1]==INT_MAX) {
+        field_end(h, 0);
+
+        if (!h->next_output_pic) {
             /* Wait for second field. */
             *data_size = 0;
 
         } else {
-            cur->interlaced_frame = 0;
-            cur->repeat_pict = 0;
-
-            /* Signal interlacing information externally. */
-            /* Prioritize picture timing SEI information over used decoding process if it exists. */
-
-            if(h->sps.pic_struct_present_flag){
-                switch (h->sei_pic_struct)
-                {
-                case SEI_PIC_STRUCT_FRAME:
-                    break;
-                case SEI_PIC_STRUCT_TOP_FIELD:
-                case SEI_PIC_STRUCT_BOTTOM_FIELD:
-                    cur->interlaced_frame = 1;
-                    break;
-                case SEI_PIC_STRUCT_TOP_BOTTOM:
-                case SEI_PIC_STRUCT_BOTTOM_TOP:
-                    if (FIELD_OR_MBAFF_PICTURE)
-                        cur->interlaced_frame = 1;
-                    else
-                        // try to flag soft telecine progressive
-                        cur->interlaced_frame = h->prev_interlaced_frame;
-                    break;
-                case SEI_PIC_STRUCT_TOP_BOTTOM_TOP:
-                case SEI_PIC_STRUCT_BOTTOM_TOP_BOTTOM:
-                    // Signal the possibility of telecined film externally (pic_struct 5,6)
-                    // From these hints, let the applications decide if they apply deinterlacing.
-                    cur->repeat_pict = 1;
-                    break;
-                case SEI_PIC_STRUCT_FRAME_DOUBLING:
-                    // Force progressive here, as doubling interlaced frame is a bad idea.
-                    cur->repeat_pict = 2;
-                    break;
-                case SEI_PIC_STRUCT_FRAME_TRIPLING:
-                    cur->repeat_pict = 4;
-                    break;
-                }
-
-                if ((h->sei_ct_type & 3) && h->sei_pic_struct <= SEI_PIC_STRUCT_BOTTOM_TOP)
-                    cur->interlaced_frame = (h->sei_ct_type & (1<<1)) != 0;
-            }else{
-                /* Derive interlacing flag from used decoding process. */
-                cur->interlaced_frame = FIELD_OR_MBAFF_PICTURE;
-            }
-            h->prev_interlaced_frame = cur->interlaced_frame;
-
-            if (cur->field_poc[0] != cur->field_poc[1]){
-                /* Derive top_field_first from field pocs. */
-                cur->top_field_first = cur->field_poc[0] < cur->field_poc[1];
-            }else{
-                if(cur->interlaced_frame || h->sps.pic_struct_present_flag){
-                    /* Use picture timing SEI information. Even if it is a information of a past frame, better than nothing. */
-                    if(h->sei_pic_struct == SEI_PIC_STRUCT_TOP_BOTTOM
-                      || h->sei_pic_struct == SEI_PIC_STRUCT_TOP_BOTTOM_TOP)
-                        cur->top_field_first = 1;
-                    else
-                        cur->top_field_first = 0;
-                }else{
-                    /* Most likely progressive */
-                    cur->top_field_first = 0;
-                }
-            }
-
-        //FIXME do something with unavailable reference frames
-
-            /* Sort B-frames into display order */
-
-            if(h->sps.bitstream_restriction_flag
-               && s->avctx->has_b_frames < h->sps.num_reorder_frames){
-                s->avctx->has_b_frames = h->sps.num_reorder_frames;
-                s->low_delay = 0;
-            }
-
-            if(   s->avctx->strict_std_compliance >= FF_COMPLIANCE_STRICT
-               && !h->sps.bitstream_restriction_flag){
-                s->avctx->has_b_frames= MAX_DELAYED_PIC_COUNT;
-                s->low_delay= 0;
-            }
-
-            pics = 0;
-            while(h->delayed_pic[pics]) pics++;
-
-            assert(pics <= MAX_DELAYED_PIC_COUNT);
-
-            h->delayed_pic[pics++] = cur;
-            if(cur->reference == 0)
-                cur->reference = DELAYED_PIC_REF;
-
-            out = h->delayed_pic[0];
-            out_idx = 0;
-            for(i=1; h->delayed_pic[i] && !h->delayed_pic[i]->key_frame && !h->delayed_pic[i]->mmco_reset; i++)
-                if(h->delayed_pic[i]->poc < out->poc){
-                    out = h->delayed_pic[i];
-                    out_idx = i;
-                }
-            if(s->avctx->has_b_frames == 0 && (h->delayed_pic[0]->key_frame || h->delayed_pic[0]->mmco_reset))
-                h->outputed_poc= INT_MIN;
-            out_of_order = out->poc < h->outputed_poc;
-
-            if(h->sps.bitstream_restriction_flag && s->avctx->has_b_frames >= h->sps.num_reorder_frames)
-                { }
-            else if((out_of_order && pics-1 == s->avctx->has_b_frames && s->avctx->has_b_frames < MAX_DELAYED_PIC_COUNT)
-               || (s->low_delay &&
-                ((h->outputed_poc != INT_MIN && out->poc > h->outputed_poc + 2)
-                 || cur->pict_type == FF_B_TYPE)))
-            {
-                s->low_delay = 0;
-                s->avctx->has_b_frames++;
-            }
-
-            if(out_of_order || pics > s->avctx->has_b_frames){
-                out->reference &= ~DELAYED_PIC_REF;
-                for(i=out_idx; h->delayed_pic[i]; i++)
-                    h->delayed_pic[i] = h->delayed_pic[i+1];
-            }
-            if(!out_of_order && pics > s->avctx->has_b_frames){
-                *data_size = sizeof(AVFrame);
-
-                if(out_idx==0 && h->delayed_pic[0] && (h->delayed_pic[0]->key_frame || h->delayed_pic[0]->mmco_reset)) {
-                    h->outputed_poc = INT_MIN;
-                } else
-                    h->outputed_poc = out->poc;
-                *pict= *(AVFrame*)out;
-            }else{
-                av_log(avctx, AV_LOG_DEBUG, "no picture\n");
-            }
+            *data_size = sizeof(AVFrame);
+            *pict = *(AVFrame*)h->next_output_pic;
         }
     }
 
@@ -3287,16 +3650,26 @@ AVCodec h264_decoder = {
     NULL,
     ff_h264_decode_end,
     decode_frame,
-    /*CODEC_CAP_DRAW_HORIZ_BAND |*/ CODEC_CAP_DR1 | CODEC_CAP_DELAY,
+    /*CODEC_CAP_DRAW_HORIZ_BAND |*/ CODEC_CAP_DR1 | CODEC_CAP_DELAY | CODEC_CAP_FRAME_THREADS,
 #ifdef _MSC_VER
 	NULL,
 	flush_dpb,
 	NULL,
 	NULL,
     NULL_IF_CONFIG_SMALL("H.264 / AVC / MPEG-4 AVC / MPEG-4 part 10"),
+	NULL,
+	NULL,
+	NULL,
+	0,
+	NULL,
+	NULL,
+	decode_init_thread_copy,
+	decode_update_thread_context,
 #else
     .flush= flush_dpb,
     .long_name = NULL_IF_CONFIG_SMALL("H.264 / AVC / MPEG-4 AVC / MPEG-4 part 10"),
+    .init_thread_copy = decode_init_thread_copy,
+    .update_thread_context = decode_update_thread_context,
 #endif
 };
 
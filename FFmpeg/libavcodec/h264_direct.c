@@ -31,6 +31,7 @@
 #include "mpegvideo.h"
 #include "h264.h"
 #include "rectangle.h"
+#include "thread.h"
 
 //#undef NDEBUG
 #include <assert.h>
@@ -581,7 +582,36 @@ single_col:
     }
 }
 
+/**
+ * Wait until the co-located macroblocks of the current macroblock have been
+ * decoded by the frame thread decoding ref_list[1][0].
+ */
+static void await_colocated(H264Context * const h){
+    MpegEncContext * const s = &h->s;
+    Picture *ref = &h->ref_list[1][0];
+    int ref_field_picture = ref->field_picture;
+    int ref_height = 16*s->mb_height >> ref_field_picture;
+    /* the co-located MB pair in frame MB rows; field and MBAFF pictures
+     * may use either MB of the pair */
+    int mb_y = s->mb_y | 1;
+    int row = FFMIN(16*(mb_y >> ref_field_picture) + 15, ref_height - 1);
+
+    //FIXME it can be safe to access mb stuff
+    //even if pixels aren't deblocked yet
+
+    if(FIELD_PICTURE && ref_field_picture){
+        ff_thread_await_progress((AVFrame*)ref, row, ref->reference == PICT_BOTTOM_FIELD);
+    }else{
+        ff_thread_await_progress((AVFrame*)ref, row, 0);
+        if(ref_field_picture)
+            ff_thread_await_progress((AVFrame*)ref, row, 1);
+    }
+}
+
 void ff_h264_pred_direct_motion(H264Context * const h, int *mb_type){
+    if(HAVE_PTHREADS && (h->s.avctx->active_thread_type&FF_THREAD_FRAME))
+        await_colocated(h);
+
     if(h->direct_spatial_mv_pred){
         pred_spatial_direct_motion(h, mb_type);
     }else{
@@ -131,6 +131,8 @@ typedef struct Picture{
     uint8_t *mb_mean;           ///< Table for MB luminance
     int32_t *mb_cmp_score;      ///< Table for MB cmp scores, for mb decision FIXME remove
     int b_frame_score;          /* */
+    int field_picture;          ///< whether or not the picture was encoded in separate fields
+    struct MpegEncContext *owner2; ///< the context which allocated this picture; only it may reuse or release the buffer
 } Picture;
 
 struct MpegEncContext;
@@ -244,6 +246,7 @@ typedef struct MpegEncContext {
     int linesize;              ///< line size, in bytes, may be different from width
     int uvlinesize;            ///< line size, for chroma in bytes, may be different from width
     Picture *picture;          ///< main picture buffer
+    int picture_count;         ///< number of allocated pictures (MAX_PICTURE_COUNT * avctx->thread_count)
     Picture **input_picture;   ///< next pictures on display order for encoding
     Picture **reordered_input_picture; ///< pointer to the next pictures in codedorder for encoding
 
@@ -676,6 +679,16 @@ typedef struct MpegEncContext {
     void (*denoise_dct)(struct MpegEncContext *s, DCTELEM *block);
 } MpegEncContext;
 
+/**
+ * Translate a Picture pointer of one frame thread context into the matching
+ * pointer of another context: pointers into the picture array are mapped by
+ * index, other pointers (e.g. into the codec private context) by offset.
+ */
+#define REBASE_PICTURE(pic, new_ctx, old_ctx) (!(pic) ? NULL :\
+    (pic) >= (old_ctx)->picture && (pic) < (old_ctx)->picture + (old_ctx)->picture_count ?\
+    &(new_ctx)->picture[(pic) - (old_ctx)->picture] :\
+    (Picture*)((uint8_t*)(new_ctx) + ((uint8_t*)(pic) - (uint8_t*)(old_ctx))))
+
 
 void MPV_decode_defaults(MpegEncContext *s);
 int MPV_common_init(MpegEncContext *s);
@@ -696,6 +709,7 @@ void MPV_common_init_bfin(MpegEncContext *s);
 void ff_clean_intra_table_entries(MpegEncContext *s);
 void ff_draw_horiz_band(MpegEncContext *s, int y, int h);
 void ff_mpeg_flush(AVCodecContext *avctx);
+int ff_mpeg_update_thread_context(AVCodecContext *dst, const AVCodecContext *src);
 void ff_print_debug_info(MpegEncContext *s, AVFrame *pict);
 void ff_write_quant_matrix(PutBitContext *pb, uint16_t *matrix);
 int ff_find_unused_picture(MpegEncContext *s, int shared);
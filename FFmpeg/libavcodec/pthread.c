@@ -21,13 +21,25 @@
  * License along with FFmpeg; if not, write to the Free Software
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
+
+/**
+ * @file
+ * Multithreading support functions
+ * @see doc/multithreading.txt
+ */
+
 #include <pthread.h>
 
 #include "avcodec.h"
+#include "thread.h"
 
 typedef int (action_func)(AVCodecContext *c, void *arg);
 typedef int (action_func2)(AVCodecContext *c, void *arg, int jobnr, int threadnr);
 
+/**
+ * Context stored in the client AVCodecContext thread_opaque when slice
+ * threading is used.
+ */
 typedef struct ThreadContext {
     pthread_t *workers;
     action_func *func;
@@ -43,8 +55,103 @@ typedef struct ThreadContext {
     pthread_mutex_t current_job_lock;
     int current_job;
     int done;
+
+    /* only used by contexts attached to the shared thread pool */
+    AVCodecContext *avctx;
+    struct ThreadPool *pool;
+    struct ThreadContext *next_pending; ///< Next context in the pool's list of contexts with jobs to start.
+    int queued;                         ///< Set while the context is in the pool's pending list.
+    int jobs_finished;                  ///< Number of jobs of the current execute() call which have returned.
+    int *free_slots;                    ///< Stack of threadnr values not used by a running job.
+    int nb_free_slots;
 } ThreadContext;
 
+/**
+ * Process-wide pool of worker threads, see avcodec_thread_pool_init().
+ * Slice-threaded contexts opened while it exists do not start threads
+ * of their own; their execute() jobs are run by the pool workers and by
+ * the calling thread. Workers take jobs from the pending contexts in
+ * turn, so an idle worker steals jobs from whichever context has some left.
+ */
+typedef struct ThreadPool {
+    pthread_t *workers;
+    int nb_workers;
+    int nb_users;                  ///< Number of contexts attached to the pool.
+
+    pthread_mutex_t lock;          ///< Protects the pool and the job state of the attached contexts.
+    pthread_cond_t  work_cond;     ///< Signalled when jobs are queued or the workers have to exit.
+    ThreadContext  *pending;       ///< Head of the list of contexts with jobs left to start.
+    ThreadContext  *pending_tail;
+    int die;
+} ThreadPool;
+
+static ThreadPool *thread_pool;
+
+/**
+ * Context used by codec threads and stored in their AVCodecContext thread_opaque.
+ */
+typedef struct PerThreadContext {
+    struct FrameThreadContext *parent;
+
+    pthread_t      thread;
+    int            thread_init;     ///< Set once the thread has been created.
+    pthread_cond_t input_cond;      ///< Used to wait for a new packet from the main thread.
+    pthread_cond_t progress_cond;   ///< Used by child threads to wait for progress to change.
+    pthread_cond_t output_cond;     ///< Used by the main thread to wait for frames to finish.
+
+    pthread_mutex_t mutex;          ///< Mutex used to protect the contents of the PerThreadContext.
+    pthread_mutex_t progress_mutex; ///< Mutex used to protect frame progress values and progress_cond.
+
+    AVCodecContext *avctx;          ///< Context used to decode packets passed to this thread.
+
+    AVPacket       avpkt;           ///< Input packet (for decoding).
+    unsigned int   allocated_buf_size; ///< Size allocated for avpkt.data
+
+    AVFrame frame;                  ///< Output frame (for decoding).
+    int     got_frame;              ///< The output of got_picture_ptr from the last avcodec_decode_video() call.
+    int     result;                 ///< The result of the last codec decode() call.
+
+    enum {
+        STATE_INPUT_READY,          ///< Set when the thread is awaiting a packet.
+        STATE_SETTING_UP,           ///< Set before the codec has called ff_thread_finish_setup().
+        STATE_GET_BUFFER,           /**<
+                                     * Set when the codec calls get_buffer().
+                                     * State is returned to STATE_SETTING_UP afterwards.
+                                     */
+        STATE_SETUP_FINISHED        ///< Set after the codec has called ff_thread_finish_setup().
+    } state;
+
+    /**
+     * Array of frames passed to ff_thread_release_buffer().
+     * Frames are released after all threads referencing them are finished.
+     */
+    AVFrame *released_buffers;
+    int  num_released_buffers;
+    unsigned int released_buffers_size;
+
+    AVFrame *requested_frame;       ///< AVFrame the codec passed to get_buffer()
+} PerThreadContext;
+
+/**
+ * Context stored in the client AVCodecContext thread_opaque.
+ */
+typedef struct FrameThreadContext {
+    PerThreadContext *threads;     ///< The contexts for each thread.
+    PerThreadContext *prev_thread; ///< The last thread submit_packet() was called on.
+
+    pthread_mutex_t buffer_mutex;  ///< Mutex used to protect get/release_buffer().
+
+    int next_decoding;             ///< The next context to submit a packet to.
+    int next_finished;             ///< The next context to return output from.
+
+    int delaying;                  /**<
+                                    * Set for the first N packets, where N is the number of threads.
+                                    * While it is set, ff_thread_decode_frame() won't return any results.
+                                    */
+
+    int die;                       ///< Set when threads should exit.
+} FrameThreadContext;
+
 static void* attribute_align_arg worker(void *v)
 {
     AVCodecContext *avctx = v;
@@ -84,11 +191,22 @@ static av_always_inline void avcodec_thread_park_workers(ThreadContext *c, int t
     pthread_mutex_unlock(&c->current_job_lock);
 }
 
-void avcodec_thread_free(AVCodecContext *avctx)
+static void thread_free(AVCodecContext *avctx)
 {
     ThreadContext *c = avctx->thread_opaque;
     int i;
 
+    if (c->pool) {
+        pthread_mutex_lock(&c->pool->lock);
+        c->pool->nb_users--;
+        pthread_mutex_unlock(&c->pool->lock);
+
+        pthread_cond_destroy(&c->last_job_cond);
+        av_free(c->free_slots);
+        av_freep(&avctx->thread_opaque);
+        return;
+    }
+
     pthread_mutex_lock(&c->current_job_lock);
     c->done = 1;
     pthread_cond_broadcast(&c->current_job_cond);
@@ -140,16 +258,260 @@ static int avcodec_thread_execute2(AVCodecContext *avctx, action_func2* func2, v
     return avcodec_thread_execute(avctx, NULL, arg, ret, job_count, 0);
 }
 
-int avcodec_thread_init(AVCodecContext *avctx, int thread_count)
+static int pool_job_ready(ThreadContext *c)
+{
+    return c->current_job < c->job_count && c->nb_free_slots;
+}
+
+static void pool_queue(ThreadPool *pool, ThreadContext *c)
+{
+    c->next_pending = NULL;
+    if (pool->pending_tail)
+        pool->pending_tail->next_pending = c;
+    else
+        pool->pending = c;
+    pool->pending_tail = c;
+    c->queued = 1;
+}
+
+static void pool_unqueue(ThreadPool *pool, ThreadContext *c)
+{
+    ThreadContext **p = &pool->pending, *prev = NULL;
+
+    while (*p != c) {
+        prev = *p;
+        p = &prev->next_pending;
+    }
+    *p = c->next_pending;
+    if (pool->pending_tail == c)
+        pool->pending_tail = prev;
+    c->queued = 0;
+}
+
+/**
+ * Run the next job of a context.
+ * Must be called with the pool lock held and pool_job_ready(c) true;
+ * the lock is released while the job runs.
+ */
+static void pool_run_job(ThreadPool *pool, ThreadContext *c)
+{
+    int job  = c->current_job++;
+    int slot = c->free_slots[--c->nb_free_slots];
+    int ret;
+
+    /* let another worker pick up the remaining jobs */
+    if (pool_job_ready(c) && !c->queued) {
+        pool_queue(pool, c);
+        pthread_cond_signal(&pool->work_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    ret = c->func ? c->func(c->avctx, (char*)c->args + job*c->job_size):
+                    c->func2(c->avctx, c->args, job, slot);
+
+    pthread_mutex_lock(&pool->lock);
+    c->rets[job%c->rets_count] = ret;
+    c->free_slots[c->nb_free_slots++] = slot;
+    c->jobs_finished++;
+    if (pool_job_ready(c) && !c->queued) {
+        pool_queue(pool, c);
+        pthread_cond_signal(&pool->work_cond);
+    }
+    pthread_cond_signal(&c->last_job_cond);
+}
+
+static void* attribute_align_arg pool_worker(void *v)
+{
+    ThreadPool *pool = v;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->die) {
+        ThreadContext *c = pool->pending;
+
+        if (!c) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+            continue;
+        }
+
+        pool->pending = c->next_pending;
+        if (!pool->pending)
+            pool->pending_tail = NULL;
+        c->queued = 0;
+
+        if (pool_job_ready(c))
+            pool_run_job(pool, c);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static int pool_execute(AVCodecContext *avctx, action_func* func, void *arg, int *ret, int job_count, int job_size)
+{
+    ThreadContext *c = avctx->thread_opaque;
+    ThreadPool *pool = c->pool;
+    int dummy_ret;
+
+    if (job_count <= 0)
+        return 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    c->current_job   = 0;
+    c->jobs_finished = 0;
+    c->job_count = job_count;
+    c->job_size  = job_size;
+    c->args = arg;
+    c->func = func;
+    if (ret) {
+        c->rets = ret;
+        c->rets_count = job_count;
+    } else {
+        c->rets = &dummy_ret;
+        c->rets_count = 1;
+    }
+
+    if (!c->queued) {
+        pool_queue(pool, c);
+        pthread_cond_signal(&pool->work_cond);
+    }
+
+    /* the calling thread works on its own jobs as well */
+    while (c->jobs_finished < c->job_count) {
+        if (pool_job_ready(c))
+            pool_run_job(pool, c);
+        else
+            pthread_cond_wait(&c->last_job_cond, &pool->lock);
+    }
+
+    /* the jobs a worker was woken up for may have been run by us */
+    if (c->queued)
+        pool_unqueue(pool, c);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+static int pool_execute2(AVCodecContext *avctx, action_func2* func2, void *arg, int *ret, int job_count)
+{
+    ThreadContext *c = avctx->thread_opaque;
+    c->func2 = func2;
+    return pool_execute(avctx, NULL, arg, ret, job_count, 0);
+}
+
+static int pool_attach(AVCodecContext *avctx, ThreadPool *pool)
 {
-    int i;
     ThreadContext *c;
+    int i;
+
+    c = av_mallocz(sizeof(ThreadContext));
+    if (!c)
+        return -1;
+
+    /* threadnr stays below thread_count, as codecs size their
+     * per-thread buffers from it */
+    c->free_slots = av_malloc(sizeof(int)*avctx->thread_count);
+    if (!c->free_slots) {
+        av_free(c);
+        return -1;
+    }
+    for (i = 0; i < avctx->thread_count; i++)
+        c->free_slots[i] = avctx->thread_count - 1 - i;
+    c->nb_free_slots = avctx->thread_count;
+
+    c->avctx = avctx;
+    c->pool  = pool;
+    pthread_cond_init(&c->last_job_cond, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->nb_users++;
+    pthread_mutex_unlock(&pool->lock);
+
+    avctx->thread_opaque = c;
+    avctx->execute  = pool_execute;
+    avctx->execute2 = pool_execute2;
+    return 0;
+}
+
+static void pool_stop_workers(ThreadPool *pool, int nb_workers)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->die = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < nb_workers; i++)
+        pthread_join(pool->workers[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    av_free(pool->workers);
+    av_free(pool);
+}
+
+int avcodec_thread_pool_init(int thread_count)
+{
+    ThreadPool *pool;
+    int i;
+
+    if (thread_pool || thread_count < 1)
+        return AVERROR(EINVAL);
+
+    pool = av_mallocz(sizeof(ThreadPool));
+    if (!pool)
+        return AVERROR(ENOMEM);
+
+    pool->workers = av_mallocz(sizeof(pthread_t)*thread_count);
+    if (!pool->workers) {
+        av_free(pool);
+        return AVERROR(ENOMEM);
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+
+    for (i = 0; i < thread_count; i++) {
+        if (pthread_create(&pool->workers[i], NULL, pool_worker, pool)) {
+            pool_stop_workers(pool, i);
+            return AVERROR(ENOMEM);
+        }
+    }
+    pool->nb_workers = thread_count;
 
-    avctx->thread_count = thread_count;
+    thread_pool = pool;
+    return 0;
+}
+
+void avcodec_thread_pool_free(void)
+{
+    if (!thread_pool)
+        return;
+
+    if (thread_pool->nb_users) {
+        av_log(NULL, AV_LOG_ERROR, "%d codec contexts still use the thread pool\n",
+               thread_pool->nb_users);
+        return;
+    }
+
+    pool_stop_workers(thread_pool, thread_pool->nb_workers);
+    thread_pool = NULL;
+}
+
+static int thread_init(AVCodecContext *avctx)
+{
+    int i;
+    ThreadContext *c;
+    int thread_count = avctx->thread_count;
 
     if (thread_count <= 1)
         return 0;
 
+    if (thread_pool)
+        return pool_attach(avctx, thread_pool);
+
     c = av_mallocz(sizeof(ThreadContext));
     if (!c)
         return -1;
@@ -173,7 +535,7 @@ int avcodec_thread_init(AVCodecContext *avctx, int thread_count)
         if(pthread_create(&c->workers[i], NULL, worker, avctx)) {
            avctx->thread_count = i;
            pthread_mutex_unlock(&c->current_job_lock);
-           avcodec_thread_free(avctx);
+           thread_free(avctx);
            return -1;
         }
     }
@@ -184,3 +546,651 @@ int avcodec_thread_init(AVCodecContext *avctx, int thread_count)
     avctx->execute2 = avcodec_thread_execute2;
     return 0;
 }
+
+/**
+ * Codec worker thread.
+ *
+ * Automatically calls ff_thread_finish_setup() if the codec does
+ * not provide an update_thread_context method, or if the codec returns
+ * before calling it.
+ */
+static attribute_align_arg void *frame_worker_thread(void *arg)
+{
+    PerThreadContext *p = arg;
+    FrameThreadContext *fctx = p->parent;
+    AVCodecContext *avctx = p->avctx;
+    AVCodec *codec = avctx->codec;
+
+    pthread_mutex_lock(&p->mutex);
+    for (;;) {
+        while (p->state == STATE_INPUT_READY && !fctx->die)
+            pthread_cond_wait(&p->input_cond, &p->mutex);
+
+        if (fctx->die) break;
+
+        if (!codec->update_thread_context && avctx->thread_safe_callbacks)
+            ff_thread_finish_setup(avctx);
+
+        avcodec_get_frame_defaults(&p->frame);
+        p->got_frame = 0;
+        p->result = codec->decode(avctx, &p->frame, &p->got_frame, &p->avpkt);
+
+        if (p->state == STATE_SETTING_UP) ff_thread_finish_setup(avctx);
+
+        pthread_mutex_lock(&p->progress_mutex);
+        p->state = STATE_INPUT_READY;
+        pthread_cond_signal(&p->output_cond);
+        pthread_mutex_unlock(&p->progress_mutex);
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    return NULL;
+}
+
+/**
+ * Update the next thread's AVCodecContext with values from the reference thread's context.
+ *
+ * @param dst The destination context.
+ * @param src The source context.
+ * @param for_user 0 if the destination is a codec thread, 1 if the destination is the user's thread
+ */
+static int update_context_from_thread(AVCodecContext *dst, AVCodecContext *src, int for_user)
+{
+    int err = 0;
+
+    if (dst != src) {
+        dst->sub_id    = src->sub_id;
+        dst->time_base = src->time_base;
+        dst->width     = src->width;
+        dst->height    = src->height;
+        dst->pix_fmt   = src->pix_fmt;
+
+        dst->coded_width  = src->coded_width;
+        dst->coded_height = src->coded_height;
+
+        dst->has_b_frames = src->has_b_frames;
+        dst->idct_algo    = src->idct_algo;
+        dst->slice_count  = src->slice_count;
+
+        dst->bits_per_coded_sample = src->bits_per_coded_sample;
+        dst->sample_aspect_ratio   = src->sample_aspect_ratio;
+        dst->dtg_active_format     = src->dtg_active_format;
+
+        dst->profile = src->profile;
+        dst->level   = src->level;
+        dst->refs    = src->refs;
+
+        dst->bits_per_raw_sample = src->bits_per_raw_sample;
+        dst->ticks_per_frame     = src->ticks_per_frame;
+        dst->color_primaries     = src->color_primaries;
+
+        dst->color_trc   = src->color_trc;
+        dst->colorspace  = src->colorspace;
+        dst->color_range = src->color_range;
+        dst->chroma_sample_location = src->chroma_sample_location;
+    }
+
+    if (for_user) {
+        dst->coded_frame = src->coded_frame;
+        dst->has_b_frames += src->thread_count - 1;
+    } else {
+        if (dst->codec->update_thread_context)
+            err = dst->codec->update_thread_context(dst, src);
+    }
+
+    return err;
+}
+
+/**
+ * Update the next thread's AVCodecContext with values set by the user.
+ *
+ * @param dst The destination context.
+ * @param src The source context.
+ */
+static void update_context_from_user(AVCodecContext *dst, AVCodecContext *src)
+{
+#define copy_fields(s, e) memcpy(&dst->s, &src->s, (char*)&dst->e - (char*)&dst->s);
+    dst->flags          = src->flags;
+
+    dst->draw_horiz_band= src->draw_horiz_band;
+    dst->get_buffer     = src->get_buffer;
+    dst->release_buffer = src->release_buffer;
+
+    dst->opaque   = src->opaque;
+    dst->hurry_up = src->hurry_up;
+    dst->dsp_mask = src->dsp_mask;
+    dst->debug    = src->debug;
+    dst->debug_mv = src->debug_mv;
+
+    dst->slice_flags = src->slice_flags;
+    dst->flags2      = src->flags2;
+
+    copy_fields(skip_loop_filter, bidir_refine);
+
+    dst->frame_number     = src->frame_number;
+    dst->reordered_opaque = src->reordered_opaque;
+#undef copy_fields
+}
+
+/**
+ * Release the buffers that this decoding thread was the last user of.
+ */
+static void release_delayed_buffers(PerThreadContext *p)
+{
+    FrameThreadContext *fctx = p->parent;
+
+    while (p->num_released_buffers > 0) {
+        AVFrame *f = &p->released_buffers[--p->num_released_buffers];
+
+        pthread_mutex_lock(&fctx->buffer_mutex);
+        av_freep(&f->thread_opaque);
+        f->owner->release_buffer(f->owner, f);
+        pthread_mutex_unlock(&fctx->buffer_mutex);
+    }
+}
+
+static int submit_packet(PerThreadContext *p, AVPacket *avpkt)
+{
+    FrameThreadContext *fctx = p->parent;
+    PerThreadContext *prev_thread = fctx->prev_thread;
+    AVCodec *codec = p->avctx->codec;
+    uint8_t *buf = p->avpkt.data;
+
+    if (!avpkt->size && !(codec->capabilities & CODEC_CAP_DELAY)) return 0;
+
+    pthread_mutex_lock(&p->mutex);
+
+    release_delayed_buffers(p);
+
+    if (prev_thread) {
+        int err;
+
+        pthread_mutex_lock(&prev_thread->progress_mutex);
+        while (prev_thread->state == STATE_SETTING_UP)
+            pthread_cond_wait(&prev_thread->progress_cond, &prev_thread->progress_mutex);
+        pthread_mutex_unlock(&prev_thread->progress_mutex);
+
+        err = update_context_from_thread(p->avctx, prev_thread->avctx, 0);
+        if (err) {
+            pthread_mutex_unlock(&p->mutex);
+            return err;
+        }
+    }
+
+    av_fast_malloc(&buf, &p->allocated_buf_size, avpkt->size + FF_INPUT_BUFFER_PADDING_SIZE);
+    if (!buf) {
+        p->avpkt.data = NULL;
+        pthread_mutex_unlock(&p->mutex);
+        return AVERROR(ENOMEM);
+    }
+    p->avpkt = *avpkt;
+    p->avpkt.data = buf;
+    memcpy(buf, avpkt->data, avpkt->size);
+    memset(buf + avpkt->size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+
+    p->state = STATE_SETTING_UP;
+    pthread_cond_signal(&p->input_cond);
+    pthread_mutex_unlock(&p->mutex);
+
+    /*
+     * If the client doesn't have a thread-safe get_buffer(),
+     * then decoding threads call back to the main thread,
+     * and it calls back to the client here.
+     */
+
+    if (!p->avctx->thread_safe_callbacks &&
+         p->avctx->get_buffer != avcodec_default_get_buffer) {
+        pthread_mutex_lock(&p->progress_mutex);
+        while (p->state != STATE_SETUP_FINISHED && p->state != STATE_INPUT_READY) {
+            while (p->state == STATE_SETTING_UP)
+                pthread_cond_wait(&p->progress_cond, &p->progress_mutex);
+
+            if (p->state == STATE_GET_BUFFER) {
+                p->result = p->avctx->get_buffer(p->avctx, p->requested_frame);
+                p->state  = STATE_SETTING_UP;
+                pthread_cond_broadcast(&p->progress_cond);
+            }
+        }
+        pthread_mutex_unlock(&p->progress_mutex);
+    }
+
+    fctx->prev_thread = p;
+
+    return 0;
+}
+
+int ff_thread_decode_frame(AVCodecContext *avctx,
+                           AVFrame *picture, int *got_picture_ptr,
+                           AVPacket *avpkt)
+{
+    FrameThreadContext *fctx = avctx->thread_opaque;
+    int finished = fctx->next_finished;
+    PerThreadContext *p;
+    int err;
+
+    /*
+     * Submit a packet to the next decoding thread.
+     */
+
+    p = &fctx->threads[fctx->next_decoding];
+    update_context_from_user(p->avctx, avctx);
+    err = submit_packet(p, avpkt);
+    if (err) return err;
+
+    fctx->next_decoding++;
+
+    /*
+     * If we're still receiving the initial packets, don't return a frame.
+     */
+
+    if (fctx->delaying && avpkt->size) {
+        if (fctx->next_decoding >= (avctx->thread_count-1)) fctx->delaying = 0;
+
+        *got_picture_ptr=0;
+        return avpkt->size;
+    }
+
+    /*
+     * Return the next available frame from the oldest thread.
+     * If we're at the end of the stream, then we have to skip threads that
+     * didn't output a frame, because we don't want to accidentally signal
+     * EOF (avpkt->size == 0 && *got_picture_ptr == 0).
+     */
+
+    do {
+        p = &fctx->threads[finished++];
+
+        pthread_mutex_lock(&p->progress_mutex);
+        while (p->state != STATE_INPUT_READY)
+            pthread_cond_wait(&p->output_cond, &p->progress_mutex);
+        pthread_mutex_unlock(&p->progress_mutex);
+
+        *picture = p->frame;
+        *got_picture_ptr = p->got_frame;
+        picture->pkt_dts = p->avpkt.dts;
+
+        /*
+         * A later call with avkpt->size == 0 may loop over all threads,
+         * including this one, searching for a frame to return before being
+         * stopped by the "finished != fctx->next_finished" condition.
+         * Make sure we don't mistakenly return the same frame again.
+         */
+        p->got_frame = 0;
+
+        if (finished >= avctx->thread_count) finished = 0;
+    } while (!avpkt->size && !*got_picture_ptr && finished != fctx->next_finished);
+
+    update_context_from_thread(avctx, p->avctx, 1);
+
+    if (fctx->next_decoding >= avctx->thread_count) fctx->next_decoding = 0;
+
+    fctx->next_finished = finished;
+
+    /* return the size of the consumed packet if no error occurred */
+    return (p->result >= 0) ? avpkt->size : p->result;
+}
+
+void ff_thread_report_progress(AVFrame *f, int n, int field)
+{
+    PerThreadContext *p;
+    int *progress = f->thread_opaque;
+
+    if (!progress || progress[field] >= n) return;
+
+    p = f->owner->thread_opaque;
+
+    if (f->owner->debug&FF_DEBUG_THREADS)
+        av_log(f->owner, AV_LOG_DEBUG, "%p finished %d field %d\n", progress, n, field);
+
+    pthread_mutex_lock(&p->progress_mutex);
+    progress[field] = n;
+    pthread_cond_broadcast(&p->progress_cond);
+    pthread_mutex_unlock(&p->progress_mutex);
+}
+
+void ff_thread_await_progress(AVFrame *f, int n, int field)
+{
+    PerThreadContext *p;
+    int *progress = f->thread_opaque;
+
+    if (!progress || progress[field] >= n) return;
+
+    p = f->owner->thread_opaque;
+
+    if (f->owner->debug&FF_DEBUG_THREADS)
+        av_log(f->owner, AV_LOG_DEBUG, "thread awaiting %d field %d from %p\n", n, field, progress);
+
+    pthread_mutex_lock(&p->progress_mutex);
+    while (progress[field] < n)
+        pthread_cond_wait(&p->progress_cond, &p->progress_mutex);
+    pthread_mutex_unlock(&p->progress_mutex);
+}
+
+void ff_thread_finish_setup(AVCodecContext *avctx) {
+    PerThreadContext *p = avctx->thread_opaque;
+
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME)) return;
+
+    pthread_mutex_lock(&p->progress_mutex);
+    p->state = STATE_SETUP_FINISHED;
+    pthread_cond_broadcast(&p->progress_cond);
+    pthread_mutex_unlock(&p->progress_mutex);
+}
+
+/// Waits for all threads to finish.
+static void park_frame_worker_threads(FrameThreadContext *fctx, int thread_count)
+{
+    int i;
+
+    for (i = 0; i < thread_count; i++) {
+        PerThreadContext *p = &fctx->threads[i];
+
+        pthread_mutex_lock(&p->progress_mutex);
+        while (p->state != STATE_INPUT_READY)
+            pthread_cond_wait(&p->output_cond, &p->progress_mutex);
+        pthread_mutex_unlock(&p->progress_mutex);
+    }
+}
+
+static void frame_thread_free(AVCodecContext *avctx, int thread_count)
+{
+    FrameThreadContext *fctx = avctx->thread_opaque;
+    AVCodec *codec = avctx->codec;
+    int i;
+
+    park_frame_worker_threads(fctx, thread_count);
+
+    if (fctx->prev_thread && fctx->prev_thread != fctx->threads)
+        update_context_from_thread(fctx->threads->avctx, fctx->prev_thread->avctx, 0);
+
+    fctx->die = 1;
+
+    for (i = 0; i < thread_count; i++) {
+        PerThreadContext *p = &fctx->threads[i];
+
+        if (!p->thread_init)
+            continue;
+
+        pthread_mutex_lock(&p->mutex);
+        pthread_cond_signal(&p->input_cond);
+        pthread_mutex_unlock(&p->mutex);
+
+        pthread_join(p->thread, NULL);
+
+        if (codec->close)
+            codec->close(p->avctx);
+
+        release_delayed_buffers(p);
+    }
+
+    /* the codec contexts have been closed by the threads */
+    avctx->codec = NULL;
+
+    for (i = 0; i < thread_count; i++) {
+        PerThreadContext *p = &fctx->threads[i];
+
+        pthread_mutex_destroy(&p->mutex);
+        pthread_mutex_destroy(&p->progress_mutex);
+        pthread_cond_destroy(&p->input_cond);
+        pthread_cond_destroy(&p->progress_cond);
+        pthread_cond_destroy(&p->output_cond);
+        av_freep(&p->avpkt.data);
+        av_freep(&p->released_buffers);
+
+        if (!p->avctx)
+            continue;
+
+        avcodec_default_free_buffers(p->avctx);
+
+        if (i)
+            av_freep(&p->avctx->priv_data);
+
+        av_freep(&p->avctx);
+    }
+
+    av_freep(&fctx->threads);
+    pthread_mutex_destroy(&fctx->buffer_mutex);
+    av_freep(&avctx->thread_opaque);
+}
+
+static int frame_thread_init(AVCodecContext *avctx)
+{
+    int thread_count = avctx->thread_count;
+    AVCodec *codec   = avctx->codec;
+    AVCodecContext *src = avctx;
+    FrameThreadContext *fctx;
+    int i, err = 0;
+
+    avctx->thread_opaque = fctx = av_mallocz(sizeof(FrameThreadContext));
+    if (!fctx)
+        return AVERROR(ENOMEM);
+
+    fctx->threads = av_mallocz(sizeof(PerThreadContext) * thread_count);
+    if (!fctx->threads) {
+        av_freep(&avctx->thread_opaque);
+        return AVERROR(ENOMEM);
+    }
+
+    pthread_mutex_init(&fctx->buffer_mutex, NULL);
+    fctx->delaying = 1;
+
+    for (i = 0; i < thread_count; i++) {
+        AVCodecContext *copy = av_malloc(sizeof(AVCodecContext));
+        PerThreadContext *p  = &fctx->threads[i];
+
+        pthread_mutex_init(&p->mutex, NULL);
+        pthread_mutex_init(&p->progress_mutex, NULL);
+        pthread_cond_init(&p->input_cond, NULL);
+        pthread_cond_init(&p->progress_cond, NULL);
+        pthread_cond_init(&p->output_cond, NULL);
+
+        p->parent = fctx;
+        p->avctx  = copy;
+
+        if (!copy) {
+            err = AVERROR(ENOMEM);
+            goto error;
+        }
+
+        *copy = *src;
+        copy->thread_opaque = p;
+        copy->pkt = &p->avpkt;
+
+        if (!i) {
+            src = copy;
+
+            if (codec->init)
+                err = codec->init(copy);
+
+            update_context_from_thread(avctx, copy, 1);
+        } else {
+            copy->is_copy   = 1;
+            copy->priv_data = av_malloc(codec->priv_data_size);
+            if (!copy->priv_data) {
+                err = AVERROR(ENOMEM);
+                goto error;
+            }
+            memcpy(copy->priv_data, src->priv_data, codec->priv_data_size);
+
+            if (codec->init_thread_copy)
+                err = codec->init_thread_copy(copy);
+        }
+
+        if (err) goto error;
+
+        if (pthread_create(&p->thread, NULL, frame_worker_thread, p)) {
+            err = -1;
+            if (codec->close)
+                codec->close(copy);
+            goto error;
+        }
+        p->thread_init = 1;
+    }
+
+    return 0;
+
+error:
+    if (!i && fctx->threads->avctx)
+        fctx->threads->avctx->priv_data = NULL; /* freed by avcodec_open() */
+    frame_thread_free(avctx, i+1);
+
+    return err;
+}
+
+void ff_thread_flush(AVCodecContext *avctx)
+{
+    FrameThreadContext *fctx = avctx->thread_opaque;
+    int i;
+
+    if (!avctx->thread_opaque) return;
+
+    park_frame_worker_threads(fctx, avctx->thread_count);
+
+    if (fctx->prev_thread && fctx->prev_thread != fctx->threads)
+        update_context_from_thread(fctx->threads->avctx, fctx->prev_thread->avctx, 0);
+
+    if (avctx->codec->flush)
+        avctx->codec->flush(fctx->threads->avctx);
+
+    fctx->next_decoding = fctx->next_finished = 0;
+    fctx->delaying = 1;
+    fctx->prev_thread = NULL;
+
+    for (i = 0; i < avctx->thread_count; i++) {
+        PerThreadContext *p = &fctx->threads[i];
+
+        p->got_frame = 0;
+        release_delayed_buffers(p);
+    }
+}
+
+int ff_thread_get_buffer(AVCodecContext *avctx, AVFrame *f)
+{
+    PerThreadContext *p = avctx->thread_opaque;
+    int *progress, err;
+
+    f->owner = avctx;
+
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME)) {
+        f->thread_opaque = NULL;
+        return avctx->get_buffer(avctx, f);
+    }
+
+    if (p->state != STATE_SETTING_UP) {
+        av_log(avctx, AV_LOG_ERROR, "get_buffer() cannot be called after ff_thread_finish_setup()\n");
+        return -1;
+    }
+
+    f->thread_opaque = progress = av_malloc(2 * sizeof(int));
+    if (!progress)
+        return AVERROR(ENOMEM);
+    progress[0] = progress[1] = -1;
+
+    if (avctx->thread_safe_callbacks ||
+        avctx->get_buffer == avcodec_default_get_buffer) {
+        pthread_mutex_lock(&p->parent->buffer_mutex);
+        err = avctx->get_buffer(avctx, f);
+        pthread_mutex_unlock(&p->parent->buffer_mutex);
+    } else {
+        pthread_mutex_lock(&p->progress_mutex);
+        p->requested_frame = f;
+        p->state = STATE_GET_BUFFER;
+        pthread_cond_broadcast(&p->progress_cond);
+
+        while (p->state != STATE_SETTING_UP)
+            pthread_cond_wait(&p->progress_cond, &p->progress_mutex);
+
+        err = p->result;
+        pthread_mutex_unlock(&p->progress_mutex);
+    }
+
+    if (err)
+        av_freep(&f->thread_opaque);
+
+    return err;
+}
+
+void ff_thread_release_buffer(AVCodecContext *avctx, AVFrame *f)
+{
+    PerThreadContext *p = avctx->thread_opaque;
+    AVFrame *dst;
+
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME)) {
+        avctx->release_buffer(avctx, f);
+        return;
+    }
+
+    dst = av_fast_realloc(p->released_buffers, &p->released_buffers_size,
+                          (p->num_released_buffers + 1) * sizeof(AVFrame));
+    if (!dst) {
+        av_log(avctx, AV_LOG_ERROR, "could not queue buffer for release\n");
+        return;
+    }
+    p->released_buffers = dst;
+
+    if (avctx->debug & FF_DEBUG_BUFFERS)
+        av_log(avctx, AV_LOG_DEBUG, "thread_release_buffer called on pic %p\n", f);
+
+    dst = &p->released_buffers[p->num_released_buffers++];
+    *dst = *f;
+    memset(f->data, 0, sizeof(f->data));
+    f->thread_opaque = NULL;
+}
+
+/**
+ * Set the threading algorithms used.
+ *
+ * Threading requires more than one thread.
+ * Frame threading requires entire frames to be passed to the codec,
+ * and introduces extra decoding delay, so is incompatible with low_delay.
+ *
+ * @param avctx The context.
+ */
+static void validate_thread_parameters(AVCodecContext *avctx)
+{
+    int frame_threading_supported = (avctx->codec->capabilities & CODEC_CAP_FRAME_THREADS)
+                                && !(avctx->flags & CODEC_FLAG_TRUNCATED)
+                                && !(avctx->flags & CODEC_FLAG_LOW_DELAY)
+                                && !(avctx->flags2 & CODEC_FLAG2_CHUNKS);
+    /* frame threads belong to a single context and would not
+     * count against the thread cap of the shared pool */
+    if (thread_pool)
+        frame_threading_supported = 0;
+
+    if (avctx->thread_count <= 1) {
+        avctx->active_thread_type = 0;
+    } else if (frame_threading_supported && (avctx->thread_type & FF_THREAD_FRAME)) {
+        avctx->active_thread_type = FF_THREAD_FRAME;
+    } else if (avctx->thread_type & FF_THREAD_SLICE) {
+        avctx->active_thread_type = FF_THREAD_SLICE;
+    } else {
+        avctx->active_thread_type = 0;
+    }
+}
+
+int ff_thread_init(AVCodecContext *avctx)
+{
+    if (avctx->thread_opaque) {
+        av_log(avctx, AV_LOG_ERROR, "avcodec_thread_init is ignored after avcodec_open\n");
+        return -1;
+    }
+
+    if (avctx->codec) {
+        validate_thread_parameters(avctx);
+
+        if (avctx->active_thread_type&FF_THREAD_SLICE)
+            return thread_init(avctx);
+        else if (avctx->active_thread_type&FF_THREAD_FRAME)
+            return frame_thread_init(avctx);
+    }
+
+    return 0;
+}
+
+void ff_thread_free(AVCodecContext *avctx)
+{
+    if (avctx->active_thread_type&FF_THREAD_FRAME)
+        frame_thread_free(avctx, avctx->thread_count);
+    else
+        thread_free(avctx);
+}
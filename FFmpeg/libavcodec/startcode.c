@@ -0,0 +1,79 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * start code scanning shared by the MPEG-1/2/4 and H.264 parsers
+ */
+
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/intreadwrite.h"
+#include "startcode.h"
+
+int ff_startcode_find_candidate_c(const uint8_t *buf, int size)
+{
+    int i = 0;
+
+    while (i < size) {
+#if HAVE_FAST_UNALIGNED
+        /* skip the words without two zero bytes in a row or a zero last
+         * byte; OR-ing each byte with the next one leaves zero bytes
+         * only there */
+#   if HAVE_FAST_64BIT
+        while (i + 8 <= size) {
+            uint64_t x = AV_RL64(buf + i);
+            x |= x >> 8;
+            if ((x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL)
+                break;
+            i += 8;
+        }
+#   else
+        while (i + 4 <= size) {
+            uint32_t x = AV_RL32(buf + i);
+            x |= x >> 8;
+            if ((x - 0x01010101U) & ~x & 0x80808080U)
+                break;
+            i += 4;
+        }
+#   endif
+#endif
+        while (i < size && buf[i])
+            i++;
+        if (i + 1 >= size || !buf[i + 1])
+            return FFMIN(i, size);
+        /* a lone zero byte; no prefix can begin with the byte after it */
+        i += 2;
+    }
+    return size;
+}
+
+int ff_startcode_find_candidate(const uint8_t *buf, int size)
+{
+    static int (*find_candidate)(const uint8_t *buf, int size);
+
+    if (!find_candidate) {
+        int (*fn)(const uint8_t *buf, int size) = ff_startcode_find_candidate_c;
+#if HAVE_MMX
+        if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+            fn = ff_startcode_find_candidate_sse2;
+#endif
+        find_candidate = fn;
+    }
+    return find_candidate(buf, size);
+}
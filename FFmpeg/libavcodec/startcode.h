@@ -0,0 +1,42 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * start code scanning shared by the MPEG-1/2/4 and H.264 parsers
+ */
+
+#ifndef AVCODEC_STARTCODE_H
+#define AVCODEC_STARTCODE_H
+
+#include <stdint.h>
+
+/**
+ * Find the first byte of buf which may begin a start code prefix
+ * (0x000001), that is the first of two zero bytes in a row, or a zero
+ * last byte which the next buffer may continue.
+ * The fastest version supported by the CPU is used.
+ *
+ * @return the offset of that byte, or size if there is none
+ */
+int ff_startcode_find_candidate(const uint8_t *buf, int size);
+
+int ff_startcode_find_candidate_c(const uint8_t *buf, int size);
+int ff_startcode_find_candidate_sse2(const uint8_t *buf, int size);
+
+#endif /* AVCODEC_STARTCODE_H */
@@ -30,6 +30,7 @@
 #include "libavutil/crc.h"
 #include "libavutil/pixdesc.h"
 #include "libavcore/audioconvert.h"
+#include "libavcore/framepool.h"
 #include "libavcore/imgutils.h"
 #include "libavcore/internal.h"
 #include "libavcore/samplefmt.h"
@@ -39,6 +40,7 @@
 #include "imgconvert.h"
 #include "audioconvert.h"
 #include "internal.h"
+#include "thread.h"
 #include <stdlib.h>
 #include <stdarg.h>
 #include <limits.h>
@@ -226,6 +228,66 @@ int avcodec_check_dimensions(void *av_log_ctx, unsigned int w, unsigned int h){
 }
 #endif
 
+/**
+ * Compute the linesizes and plane sizes of a buffer for the frames of s,
+ * and the offsets of the pictures in the planes, which skip the edges.
+ */
+static int video_get_buffer_layout(AVCodecContext *s, int linesize[4],
+                                   int size[4], int offset[4]){
+    int i;
+    int w= s->width;
+    int h= s->height;
+    int h_chroma_shift, v_chroma_shift;
+    int tmpsize;
+    int unaligned;
+    AVPicture picture;
+    int stride_align[4];
+
+    avcodec_get_chroma_sub_sample(s->pix_fmt, &h_chroma_shift, &v_chroma_shift);
+
+    avcodec_align_dimensions2(s, &w, &h, stride_align);
+
+    if(!(s->flags&CODEC_FLAG_EMU_EDGE)){
+        w+= EDGE_WIDTH*2;
+        h+= EDGE_WIDTH*2;
+    }
+
+    do {
+        // NOTE: do not align linesizes individually, this breaks e.g. assumptions
+        // that linesize[0] == 2*linesize[1] in the MPEG-encoder for 4:2:2
+        av_image_fill_linesizes(picture.linesize, s->pix_fmt, w);
+        // increase alignment of w for next try (rhs gives the lowest bit set in w)
+        w += w & ~(w-1);
+
+        unaligned = 0;
+        for (i=0; i<4; i++){
+            unaligned |= picture.linesize[i] % stride_align[i];
+        }
+    } while (unaligned);
+
+    tmpsize = av_image_fill_pointers(picture.data, s->pix_fmt, h, NULL, picture.linesize);
+    if (tmpsize < 0)
+        return -1;
+
+    memset(size, 0, 4*sizeof(size[0]));
+    for (i=0; i<3 && picture.data[i+1]; i++)
+        size[i] = picture.data[i+1] - picture.data[i];
+    size[i] = tmpsize - (picture.data[i] - picture.data[0]);
+
+    for(i=0; i<4; i++){
+        const int h_shift= i==0 ? 0 : h_chroma_shift;
+        const int v_shift= i==0 ? 0 : v_chroma_shift;
+
+        linesize[i]= picture.linesize[i];
+        // no edge if EDGE EMU or not planar YUV
+        if(!size[i] || (s->flags&CODEC_FLAG_EMU_EDGE) || !size[2])
+            offset[i]= 0;
+        else
+            offset[i]= FFALIGN((linesize[i]*EDGE_WIDTH>>v_shift) + (EDGE_WIDTH>>h_shift), stride_align[i]);
+    }
+    return 0;
+}
+
 int avcodec_default_get_buffer(AVCodecContext *s, AVFrame *pic){
     int i;
     int w= s->width;
@@ -271,62 +333,23 @@ int avcodec_default_get_buffer(AVCodecContext *s, AVFrame *pic){
         pic->age= *picture_number - buf->last_pic_num;
         buf->last_pic_num= *picture_number;
     }else{
-        int h_chroma_shift, v_chroma_shift;
-        int size[4] = {0};
-        int tmpsize;
-        int unaligned;
-        AVPicture picture;
-        int stride_align[4];
+        int linesize[4], size[4], offset[4];
 
-        avcodec_get_chroma_sub_sample(s->pix_fmt, &h_chroma_shift, &v_chroma_shift);
-
-        avcodec_align_dimensions2(s, &w, &h, stride_align);
-
-        if(!(s->flags&CODEC_FLAG_EMU_EDGE)){
-            w+= EDGE_WIDTH*2;
-            h+= EDGE_WIDTH*2;
-        }
-
-        do {
-            // NOTE: do not align linesizes individually, this breaks e.g. assumptions
-            // that linesize[0] == 2*linesize[1] in the MPEG-encoder for 4:2:2
-            av_image_fill_linesizes(picture.linesize, s->pix_fmt, w);
-            // increase alignment of w for next try (rhs gives the lowest bit set in w)
-            w += w & ~(w-1);
-
-            unaligned = 0;
-            for (i=0; i<4; i++){
-                unaligned |= picture.linesize[i] % stride_align[i];
-            }
-        } while (unaligned);
-
-        tmpsize = av_image_fill_pointers(picture.data, s->pix_fmt, h, NULL, picture.linesize);
-        if (tmpsize < 0)
+        if (video_get_buffer_layout(s, linesize, size, offset) < 0)
             return -1;
 
-        for (i=0; i<3 && picture.data[i+1]; i++)
-            size[i] = picture.data[i+1] - picture.data[i];
-        size[i] = tmpsize - (picture.data[i] - picture.data[0]);
-
         buf->last_pic_num= -256*256*256*64;
         memset(buf->base, 0, sizeof(buf->base));
         memset(buf->data, 0, sizeof(buf->data));
 
         for(i=0; i<4 && size[i]; i++){
-            const int h_shift= i==0 ? 0 : h_chroma_shift;
-            const int v_shift= i==0 ? 0 : v_chroma_shift;
-
-            buf->linesize[i]= picture.linesize[i];
+            buf->linesize[i]= linesize[i];
 
             buf->base[i]= av_malloc(size[i]+16); //FIXME 16
             if(buf->base[i]==NULL) return -1;
             memset(buf->base[i], 128, size[i]);
 
-            // no edge if EDGE EMU or not planar YUV
-            if((s->flags&CODEC_FLAG_EMU_EDGE) || !size[2])
-                buf->data[i] = buf->base[i];
-            else
-                buf->data[i] = buf->base[i] + FFALIGN((buf->linesize[i]*EDGE_WIDTH>>v_shift) + (EDGE_WIDTH>>h_shift), stride_align[i]);
+            buf->data[i] = buf->base[i] + offset[i];
         }
         if(size[1] && !size[2])
             ff_set_systematic_pal2((uint32_t*)buf->data[1], s->pix_fmt);
@@ -383,6 +406,77 @@ void avcodec_default_release_buffer(AVCodecContext *s, AVFrame *pic){
         av_log(s, AV_LOG_DEBUG, "default_release_buffer called on pic %p, %d buffers used\n", pic, s->internal_buffer_count);
 }
 
+int avcodec_pool_get_buffer(AVCodecContext *s, AVFrame *pic){
+    int i;
+    int linesize[4], size[4], offset[4];
+    unsigned int total_size = 0;
+    AVFrameBuffer *buf;
+    uint8_t *ptr;
+
+    if(!s->frame_pool)
+        return avcodec_default_get_buffer(s, pic);
+
+    if(pic->data[0]!=NULL) {
+        av_log(s, AV_LOG_ERROR, "pic->data[0]!=NULL in avcodec_pool_get_buffer\n");
+        return -1;
+    }
+    if(av_image_check_size(s->width, s->height, 0, s) ||
+       video_get_buffer_layout(s, linesize, size, offset) < 0)
+        return -1;
+
+    /* all the planes in one buffer, each aligned like av_malloc() would */
+    for(i=0; i<4 && size[i]; i++)
+        total_size += FFALIGN(size[i]+16, 32); //FIXME 16
+    buf= av_frame_pool_get(s->frame_pool, total_size);
+    if(!buf)
+        return AVERROR(ENOMEM);
+
+    memset(pic->base, 0, sizeof(pic->base));
+    memset(pic->data, 0, sizeof(pic->data));
+    ptr= buf->data;
+    for(i=0; i<4 && size[i]; i++){
+        pic->base[i]= ptr;
+        pic->data[i]= ptr + offset[i];
+        ptr += FFALIGN(size[i]+16, 32);
+    }
+    for(i=0; i<4; i++)
+        pic->linesize[i]= linesize[i];
+    if(size[1] && !size[2])
+        ff_set_systematic_pal2((uint32_t*)pic->data[1], s->pix_fmt);
+
+    /* the buffer may have been used by any context, so nothing in it can be
+     * assumed to be left from an earlier frame */
+    pic->age= 256*256*256*64;
+    pic->type= FF_BUFFER_TYPE_USER;
+    pic->pool_buf= buf;
+
+    if(s->pkt) pic->pkt_pts= s->pkt->pts;
+    else       pic->pkt_pts= AV_NOPTS_VALUE;
+    pic->reordered_opaque= s->reordered_opaque;
+
+    if(s->debug&FF_DEBUG_BUFFERS)
+        av_log(s, AV_LOG_DEBUG, "pool_get_buffer called on pic %p, buffer %p\n", pic, buf);
+
+    return 0;
+}
+
+void avcodec_pool_release_buffer(AVCodecContext *s, AVFrame *pic){
+    int i;
+
+    if(pic->type == FF_BUFFER_TYPE_INTERNAL) {
+        avcodec_default_release_buffer(s, pic);
+        return;
+    }
+    assert(pic->pool_buf);
+
+    if(s->debug&FF_DEBUG_BUFFERS)
+        av_log(s, AV_LOG_DEBUG, "pool_release_buffer called on pic %p, buffer %p\n", pic, pic->pool_buf);
+
+    av_frame_buffer_unref(&pic->pool_buf);
+    for(i=0; i<4; i++)
+        pic->data[i]= NULL;
+}
+
 int avcodec_default_reget_buffer(AVCodecContext *s, AVFrame *pic){
     AVFrame temp_pic;
     int i;
@@ -400,6 +494,13 @@ int avcodec_default_reget_buffer(AVCodecContext *s, AVFrame *pic){
         return 0;
     }
 
+    /* A pool buffer can be updated in place unless somebody else uses it */
+    if(s->get_buffer == avcodec_pool_get_buffer && pic->pool_buf &&
+       av_frame_buffer_is_writable(pic->pool_buf)) {
+        pic->reordered_opaque= s->reordered_opaque;
+        return 0;
+    }
+
     /*
      * Not internal type and reget_buffer not overridden, emulate cr buffer
      */
@@ -536,7 +637,15 @@ int attribute_align_arg avcodec_open(AVCodecContext *avctx, AVCodec *codec)
         goto free_and_end;
     }
 
-    if(avctx->codec->init){
+    if (HAVE_THREADS && !avctx->thread_opaque) {
+        ret = ff_thread_init(avctx);
+        if (ret < 0) {
+            goto free_and_end;
+        }
+    }
+
+    /* frame threads initialize the codec themselves */
+    if(avctx->codec->init && !(avctx->active_thread_type&FF_THREAD_FRAME)){
         ret = avctx->codec->init(avctx);
         if (ret < 0) {
             goto free_and_end;
@@ -635,13 +744,17 @@ int attribute_align_arg avcodec_decode_video2(AVCodecContext *avctx, AVFrame *pi
     avctx->pkt = avpkt;
 
     if((avctx->codec->capabilities & CODEC_CAP_DELAY) || avpkt->size){
-        ret = avctx->codec->decode(avctx, picture, got_picture_ptr,
-                                avpkt);
+        if (HAVE_PTHREADS && avctx->active_thread_type&FF_THREAD_FRAME)
+             ret = ff_thread_decode_frame(avctx, picture, got_picture_ptr,
+                                          avpkt);
+        else {
+            ret = avctx->codec->decode(avctx, picture, got_picture_ptr,
+                              avpkt);
+            picture->pkt_dts= avpkt->dts;
+        }
 
         emms_c(); //needed to avoid an emms_c() call before every return;
 
-        picture->pkt_dts= avpkt->dts;
-
         if (*got_picture_ptr)
             avctx->frame_number++;
     }else
@@ -757,7 +870,7 @@ av_cold int avcodec_close(AVCodecContext *avctx)
     }
 
     if (HAVE_THREADS && avctx->thread_opaque)
-        avcodec_thread_free(avctx);
+        ff_thread_free(avctx);
     if (avctx->codec && avctx->codec->close)
         avctx->codec->close(avctx);
     avcodec_default_free_buffers(avctx);
@@ -1027,7 +1140,9 @@ void avcodec_init(void)
 
 void avcodec_flush_buffers(AVCodecContext *avctx)
 {
-    if(avctx->codec->flush)
+    if(HAVE_PTHREADS && avctx->active_thread_type&FF_THREAD_FRAME)
+        ff_thread_flush(avctx);
+    else if(avctx->codec->flush)
         avctx->codec->flush(avctx);
 }
 
@@ -1114,13 +1229,72 @@ int av_get_bits_per_sample_format(enum AVSampleFormat sample_fmt) {
 }
 #endif
 
-#if !HAVE_THREADS
+#if HAVE_THREADS
+int avcodec_thread_init(AVCodecContext *s, int thread_count)
+{
+    int thread_type, ret;
+
+    s->thread_count = thread_count;
+
+    /* the threads are started by avcodec_open() once the codec is known */
+    if (!s->codec)
+        return 0;
+
+    /* the codec is already initialized, so only slice threads can be added */
+    thread_type = s->thread_type;
+    s->thread_type &= ~FF_THREAD_FRAME;
+    ret = ff_thread_init(s);
+    s->thread_type = thread_type;
+    return ret;
+}
+
+void avcodec_thread_free(AVCodecContext *s)
+{
+    ff_thread_free(s);
+}
+#else
 int avcodec_thread_init(AVCodecContext *s, int thread_count){
     s->thread_count = thread_count;
     return -1;
 }
 #endif
 
+#if !HAVE_PTHREADS
+int avcodec_thread_pool_init(int thread_count)
+{
+    return AVERROR(ENOSYS);
+}
+
+void avcodec_thread_pool_free(void)
+{
+}
+#endif
+
+#if !HAVE_PTHREADS
+int ff_thread_get_buffer(AVCodecContext *avctx, AVFrame *f)
+{
+    f->owner = avctx;
+    return avctx->get_buffer(avctx, f);
+}
+
+void ff_thread_release_buffer(AVCodecContext *avctx, AVFrame *f)
+{
+    f->owner->release_buffer(f->owner, f);
+}
+
+void ff_thread_finish_setup(AVCodecContext *avctx)
+{
+}
+
+void ff_thread_report_progress(AVFrame *f, int progress, int field)
+{
+}
+
+void ff_thread_await_progress(AVFrame *f, int progress, int field)
+{
+}
+#endif
+
 unsigned int av_xiphlacing(unsigned char *s, unsigned int v)
 {
     unsigned int n = 0;
@@ -20,6 +20,7 @@
 //#define DEBUG
 
 #include "avcodec.h"
+#include "thread.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -69,10 +70,10 @@ static unsigned WINAPI attribute_align_arg thread_func(void *v){
 }
 
 /**
- * Free what has been allocated by avcodec_thread_init().
+ * Free what has been allocated by ff_thread_init().
  * Must be called after decoding has finished, especially do not call while avcodec_thread_execute() is running.
  */
-void avcodec_thread_free(AVCodecContext *s){
+void ff_thread_free(AVCodecContext *s){
     ThreadContext *c= s->thread_opaque;
     int i;
 
@@ -124,17 +125,24 @@ static int avcodec_thread_execute2(AVCodecContext *s, int (*func)(AVCodecContext
     avcodec_thread_execute(s, NULL, arg, ret, count, 0);
 }
 
-int avcodec_thread_init(AVCodecContext *s, int thread_count){
+int ff_thread_init(AVCodecContext *s){
     int i;
     ThreadContext *c;
     uint32_t threadid;
+    int thread_count= s->thread_count;
 
-    s->thread_count= thread_count;
+    if(!s->codec)
+        return 0;
 
-    if (thread_count <= 1)
+    /* only slice threading is supported */
+    s->active_thread_type= thread_count > 1 && s->thread_type & FF_THREAD_SLICE ? FF_THREAD_SLICE : 0;
+    if (!s->active_thread_type)
         return 0;
 
-    assert(!s->thread_opaque);
+    if(s->thread_opaque){
+        av_log(s, AV_LOG_ERROR, "avcodec_thread_init is ignored after avcodec_open\n");
+        return -1;
+    }
     c= av_mallocz(sizeof(ThreadContext)*thread_count);
     s->thread_opaque= c;
     if(!(c[0].work_sem = CreateSemaphore(NULL, 0, INT_MAX, NULL)))
@@ -163,6 +171,6 @@ int avcodec_thread_init(AVCodecContext *s, int thread_count){
 
     return 0;
 fail:
-    avcodec_thread_free(s);
+    ff_thread_free(s);
     return -1;
 }
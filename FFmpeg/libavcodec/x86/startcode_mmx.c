@@ -0,0 +1,55 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/x86_cpu.h"
+#include "libavcodec/startcode.h"
+
+int ff_startcode_find_candidate_sse2(const uint8_t *buf, int size)
+{
+    x86_reg i = 0;
+
+    /* look for two zero bytes in a row 32 positions at a time; the C
+     * version finds the exact position within the block which contains
+     * them, and handles the tail */
+    if (size >= 33) {
+        __asm__ volatile(
+            "pxor      %%xmm0, %%xmm0   \n\t"
+            "1:                         \n\t"
+            "movdqu    (%1,%0), %%xmm1  \n\t"
+            "movdqu   1(%1,%0), %%xmm2  \n\t"
+            "movdqu  16(%1,%0), %%xmm3  \n\t"
+            "movdqu  17(%1,%0), %%xmm4  \n\t"
+            "por       %%xmm2, %%xmm1   \n\t"
+            "por       %%xmm4, %%xmm3   \n\t"
+            "pcmpeqb   %%xmm0, %%xmm1   \n\t"
+            "pcmpeqb   %%xmm0, %%xmm3   \n\t"
+            "por       %%xmm3, %%xmm1   \n\t"
+            "pmovmskb  %%xmm1, %%eax    \n\t"
+            "test      %%eax, %%eax     \n\t"
+            "jnz       2f               \n\t"
+            "add       $32, %0          \n\t"
+            "cmp       %2, %0           \n\t"
+            "jle       1b               \n\t"
+            "2:                         \n\t"
+            : "+r"(i)
+            : "r"(buf), "r"((x86_reg)size - 33)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4",) "%eax", "memory"
+        );
+    }
+    return i + ff_startcode_find_candidate_c(buf + i, size - i);
+}
@@ -0,0 +1,242 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * reference-counted buffers drawn from a size-bucketed pool
+ */
+
+#include "config.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include <windows.h>
+#endif
+
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+#include "framepool.h"
+
+/* Sizes are rounded up to 4 steps per power of two, so a buffer wastes
+ * at most a quarter of its size, and one bucket holds one size. */
+#define POOL_BUCKETS  (33 * 4)
+#define POOL_MIN_SIZE 16
+#define POOL_MAX_IDLE 8     ///< idle buffers kept in each bucket
+
+struct AVFramePool {
+#if HAVE_PTHREADS
+    pthread_mutex_t lock;
+#elif HAVE_W32THREADS
+    CRITICAL_SECTION lock;
+#endif
+    AVFrameBuffer *idle[POOL_BUCKETS];
+    int nb_idle[POOL_BUCKETS];
+    int nb_used;            ///< buffers which are referenced
+    int64_t idle_size;      ///< total size of the idle buffers
+    uint64_t nb_hits, nb_misses;
+    int closed;             ///< set by av_frame_pool_free()
+};
+
+#if HAVE_PTHREADS
+#define LOCK(pool)   pthread_mutex_lock(&(pool)->lock)
+#define UNLOCK(pool) pthread_mutex_unlock(&(pool)->lock)
+#elif HAVE_W32THREADS
+#define LOCK(pool)   EnterCriticalSection(&(pool)->lock)
+#define UNLOCK(pool) LeaveCriticalSection(&(pool)->lock)
+#else
+/* without thread support, a pool is only used by one thread (see framepool.h) */
+#define LOCK(pool)
+#define UNLOCK(pool)
+#endif
+
+static int size_bucket(unsigned int size, unsigned int *bucket_size)
+{
+    int log2, shift;
+    unsigned int steps;
+
+    size  = FFMAX(size, POOL_MIN_SIZE);
+    log2  = av_log2(size);
+    shift = log2 - 2;
+    steps = (size + (1U << shift) - 1) >> shift;
+
+    /* 8 steps is the first size of the next power of two */
+    *bucket_size = steps << shift;
+    return (log2 << 2) + steps - 4;
+}
+
+static void pool_destroy(AVFramePool *pool)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_destroy(&pool->lock);
+#elif HAVE_W32THREADS
+    DeleteCriticalSection(&pool->lock);
+#endif
+    av_free(pool);
+}
+
+AVFramePool *av_frame_pool_alloc(void)
+{
+    AVFramePool *pool = av_mallocz(sizeof(AVFramePool));
+
+    if (!pool)
+        return NULL;
+#if HAVE_PTHREADS
+    if (pthread_mutex_init(&pool->lock, NULL)) {
+        av_free(pool);
+        return NULL;
+    }
+#elif HAVE_W32THREADS
+    InitializeCriticalSection(&pool->lock);
+#endif
+    return pool;
+}
+
+void av_frame_pool_free(AVFramePool **poolp)
+{
+    AVFramePool *pool = *poolp;
+    int i, destroy;
+
+    if (!pool)
+        return;
+    *poolp = NULL;
+
+    LOCK(pool);
+    for (i = 0; i < POOL_BUCKETS; i++) {
+        while (pool->idle[i]) {
+            AVFrameBuffer *buf = pool->idle[i];
+            pool->idle[i] = buf->next;
+            av_free(buf->data);
+            av_free(buf);
+        }
+        pool->nb_idle[i] = 0;
+    }
+    pool->idle_size = 0;
+    pool->closed = 1;
+    destroy = !pool->nb_used;
+    UNLOCK(pool);
+
+    if (destroy)
+        pool_destroy(pool);
+}
+
+AVFrameBuffer *av_frame_pool_get(AVFramePool *pool, unsigned int size)
+{
+    AVFrameBuffer *buf;
+    unsigned int bucket_size;
+    int bucket;
+
+    if (size > INT_MAX - POOL_MIN_SIZE)
+        return NULL;
+    bucket = size_bucket(size, &bucket_size);
+
+    LOCK(pool);
+    if ((buf = pool->idle[bucket])) {
+        pool->idle[bucket] = buf->next;
+        pool->nb_idle[bucket]--;
+        pool->idle_size -= buf->size;
+        pool->nb_hits++;
+    } else
+        pool->nb_misses++;
+    pool->nb_used++;
+    UNLOCK(pool);
+
+    if (!buf) {
+        buf = av_mallocz(sizeof(AVFrameBuffer));
+        if (!buf || !(buf->data = av_malloc(bucket_size))) {
+            av_free(buf);
+            LOCK(pool);
+            pool->nb_used--;
+            UNLOCK(pool);
+            return NULL;
+        }
+        buf->size   = bucket_size;
+        buf->pool   = pool;
+        buf->bucket = bucket;
+    }
+    buf->refcount = 1;
+    buf->next     = NULL;
+    return buf;
+}
+
+AVFrameBuffer *av_frame_buffer_ref(AVFrameBuffer *buf)
+{
+    LOCK(buf->pool);
+    buf->refcount++;
+    UNLOCK(buf->pool);
+    return buf;
+}
+
+void av_frame_buffer_unref(AVFrameBuffer **bufp)
+{
+    AVFrameBuffer *buf = *bufp;
+    AVFramePool *pool;
+    int destroy = 0;
+
+    if (!buf)
+        return;
+    *bufp = NULL;
+    pool  = buf->pool;
+
+    LOCK(pool);
+    if (--buf->refcount) {
+        UNLOCK(pool);
+        return;
+    }
+    pool->nb_used--;
+    if (!pool->closed && pool->nb_idle[buf->bucket] < POOL_MAX_IDLE) {
+        buf->next = pool->idle[buf->bucket];
+        pool->idle[buf->bucket] = buf;
+        pool->nb_idle[buf->bucket]++;
+        pool->idle_size += buf->size;
+        buf = NULL;
+    }
+    destroy = pool->closed && !pool->nb_used;
+    UNLOCK(pool);
+
+    if (buf) {
+        av_free(buf->data);
+        av_free(buf);
+    }
+    if (destroy)
+        pool_destroy(pool);
+}
+
+void av_frame_pool_get_stats(AVFramePool *pool, AVFramePoolStats *stats)
+{
+    int i;
+
+    LOCK(pool);
+    stats->nb_hits   = pool->nb_hits;
+    stats->nb_misses = pool->nb_misses;
+    stats->nb_used   = pool->nb_used;
+    stats->nb_idle   = 0;
+    for (i = 0; i < POOL_BUCKETS; i++)
+        stats->nb_idle += pool->nb_idle[i];
+    stats->idle_size = pool->idle_size;
+    UNLOCK(pool);
+}
+
+int av_frame_buffer_is_writable(AVFrameBuffer *buf)
+{
+    int writable;
+
+    LOCK(buf->pool);
+    writable = buf->refcount == 1;
+    UNLOCK(buf->pool);
+    return writable;
+}
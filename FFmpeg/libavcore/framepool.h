@@ -0,0 +1,108 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCORE_FRAMEPOOL_H
+#define AVCORE_FRAMEPOOL_H
+
+/**
+ * @file
+ * reference-counted buffers drawn from a pool
+ *
+ * A pool keeps the buffers which are no longer referenced on free lists
+ * bucketed by size, and hands them out again instead of allocating new
+ * ones. The buffers of one pool may be used by several codec contexts and
+ * filter graphs at once, from different threads. This needs thread support
+ * (pthreads or w32threads); in a build without it, a pool and its buffers
+ * must only be used from one thread.
+ */
+
+#include <stdint.h>
+#include "avcore.h"
+
+typedef struct AVFramePool AVFramePool;
+
+typedef struct AVFrameBuffer {
+    uint8_t *data;          ///< start of the buffer, aligned like av_malloc()
+    unsigned int size;      ///< size of data in bytes, at least the requested size
+
+    /* The following fields are private to libavcore. */
+    AVFramePool *pool;
+    int refcount;
+    int bucket;
+    struct AVFrameBuffer *next;
+} AVFrameBuffer;
+
+/**
+ * Counters of a pool, see av_frame_pool_get_stats().
+ */
+typedef struct AVFramePoolStats {
+    uint64_t nb_hits;       ///< buffers handed out again from the idle lists
+    uint64_t nb_misses;     ///< buffers which had to be allocated
+    int nb_used;            ///< buffers referenced at the moment
+    int nb_idle;            ///< buffers kept for reuse at the moment
+    int64_t idle_size;      ///< total size of the idle buffers in bytes
+} AVFramePoolStats;
+
+/**
+ * Allocate an empty buffer pool.
+ *
+ * @return the pool, or NULL if it could not be allocated
+ */
+AVFramePool *av_frame_pool_alloc(void);
+
+/**
+ * Release the caller's reference to a pool and set *pool to NULL.
+ * The idle buffers are freed at once; the pool itself goes away when the
+ * last of the buffers still referenced elsewhere is unreferenced, so this
+ * may be called while decoders or filters still hold some of them.
+ */
+void av_frame_pool_free(AVFramePool **pool);
+
+/**
+ * Get a buffer of at least size bytes from the pool, with a reference
+ * count of 1. Its contents are undefined.
+ *
+ * @return the buffer, or NULL if it could not be allocated
+ */
+AVFrameBuffer *av_frame_pool_get(AVFramePool *pool, unsigned int size);
+
+/**
+ * Fill stats with the counters of pool, as of the time of the call.
+ */
+void av_frame_pool_get_stats(AVFramePool *pool, AVFramePoolStats *stats);
+
+/**
+ * Add a reference to buf.
+ *
+ * @return buf
+ */
+AVFrameBuffer *av_frame_buffer_ref(AVFrameBuffer *buf);
+
+/**
+ * Drop a reference to *buf and set *buf to NULL. When the last reference
+ * is dropped, the buffer goes back to its pool.
+ */
+void av_frame_buffer_unref(AVFrameBuffer **buf);
+
+/**
+ * Return 1 if buf has no reference other than the caller's, so that it
+ * may be written to without affecting anybody else, 0 otherwise.
+ */
+int av_frame_buffer_is_writable(AVFrameBuffer *buf);
+
+#endif /* AVCORE_FRAMEPOOL_H */
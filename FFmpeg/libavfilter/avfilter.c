@@ -403,6 +403,7 @@ void avfilter_start_frame(AVFilterLink *link, AVFilterBufferRef *picref)
         link->cur_buf = avfilter_get_video_buffer(link, dst->min_perms, link->w, link->h);
         link->src_buf = picref;
         avfilter_copy_buffer_ref_props(link->cur_buf, link->src_buf);
+        link->frame_copies++;
     }
     else
         link->cur_buf = picref;
@@ -574,6 +575,8 @@ int avfilter_open(AVFilterContext **filter_ctx, AVFilter *filter, const char *in
     ret->filter   = filter;
     ret->name     = inst_name ? av_strdup(inst_name) : NULL;
     ret->priv     = av_mallocz(filter->priv_size);
+    ret->execute  = avfilter_default_execute;
+    ret->thread_count = 1;
 
     ret->input_count  = pad_count(filter->inputs);
     if (ret->input_count) {
@@ -593,6 +596,32 @@ int avfilter_open(AVFilterContext **filter_ctx, AVFilter *filter, const char *in
     return 0;
 }
 
+void ff_avfilter_link_downstream_perms(AVFilterLink *link, int *min_perms, int *rej_perms)
+{
+    *min_perms = *rej_perms = 0;
+    while (link) {
+        *min_perms |= link->dstpad->min_perms;
+        *rej_perms |= link->dstpad->rej_perms;
+
+        /* filters which send their input buffers on unchanged */
+        if (link->dstpad->start_frame != avfilter_null_start_frame ||
+            !link->dst->output_count)
+            break;
+        link = link->dst->outputs[0];
+    }
+}
+
+static void free_link(AVFilterLink *link)
+{
+    if (link->frame_copies)
+        av_log(link->dst, AV_LOG_VERBOSE,
+               "%u frames copied on the link from '%s'\n",
+               link->frame_copies, link->src ? link->src->name : "?");
+    avfilter_formats_unref(&link->in_formats);
+    avfilter_formats_unref(&link->out_formats);
+    av_frame_pool_free(&link->pool);
+}
+
 void avfilter_free(AVFilterContext *filter)
 {
     int i;
@@ -605,8 +634,7 @@ void avfilter_free(AVFilterContext *filter)
         if ((link = filter->inputs[i])) {
             if (link->src)
                 link->src->outputs[link->srcpad - link->src->output_pads] = NULL;
-            avfilter_formats_unref(&link->in_formats);
-            avfilter_formats_unref(&link->out_formats);
+            free_link(link);
         }
         av_freep(&link);
     }
@@ -614,8 +642,7 @@ void avfilter_free(AVFilterContext *filter)
         if ((link = filter->outputs[i])) {
             if (link->dst)
                 link->dst->inputs[link->dstpad - link->dst->input_pads] = NULL;
-            avfilter_formats_unref(&link->in_formats);
-            avfilter_formats_unref(&link->out_formats);
+            free_link(link);
         }
         av_freep(&link);
     }
@@ -27,7 +27,7 @@
 #include "libavcore/samplefmt.h"
 
 #define LIBAVFILTER_VERSION_MAJOR  1
-#define LIBAVFILTER_VERSION_MINOR 74
+#define LIBAVFILTER_VERSION_MINOR 77
 #define LIBAVFILTER_VERSION_MICRO  0
 
 #define LIBAVFILTER_VERSION_INT AV_VERSION_INT(LIBAVFILTER_VERSION_MAJOR, \
@@ -473,6 +473,18 @@ void avfilter_set_common_formats(AVFilterContext *ctx, AVFilterFormats *formats)
 /** Default handler for query_formats() */
 int avfilter_default_query_formats(AVFilterContext *ctx);
 
+/**
+ * A job run by AVFilterContext.execute().
+ *
+ * @param jobnr   index of the job, from 0 to nb_jobs - 1
+ * @param nb_jobs number of jobs of the execute() call
+ */
+typedef int (avfilter_action_func)(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs);
+
+/** Default execute() handler, which runs the jobs one after the other */
+int avfilter_default_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                             void *arg, int *ret, int nb_jobs);
+
 /** start_frame() handler for filters which simply pass video along */
 void avfilter_null_start_frame(AVFilterLink *link, AVFilterBufferRef *picref);
 
@@ -555,6 +567,22 @@ struct AVFilterContext {
     AVFilterLink **outputs;         ///< array of pointers to output links
 
     void *priv;                     ///< private data for use by the filter
+
+    /**
+     * Run func(ctx, arg, jobnr, nb_jobs) for each jobnr from 0 to
+     * nb_jobs - 1, possibly several at once on different threads, and
+     * return when all of them have returned. If ret is not NULL, the value
+     * returned by job jobnr is stored in ret[jobnr].
+     * Filters split their work, e.g. a frame into bands of rows, into jobs
+     * which may run in any order. This is set to avfilter_default_execute()
+     * by avfilter_open(), and to a threaded implementation by
+     * avfilter_graph_config() if the graph has nb_threads above 1.
+     */
+    int (*execute)(AVFilterContext *ctx, avfilter_action_func *func,
+                   void *arg, int *ret, int nb_jobs);
+
+    int thread_count;               ///< number of jobs execute() may run at once
+    void *thread_opaque;            ///< for use by the thread implementation only
 };
 
 /**
@@ -617,6 +645,22 @@ struct AVFilterLink {
      * input link is assumed to be an unchangeable property.
      */
     AVRational time_base;
+
+    /**
+     * Pool the default get_video_buffer() and get_audio_buffer() draw the
+     * buffers for this link from, allocated on first use. The buffers of a
+     * link mostly have the same size, so most of them are recycled rather
+     * than allocated. This should not be accessed directly by the filters.
+     */
+    struct AVFramePool *pool;
+
+    /**
+     * Number of frames which had to be copied to be sent across the link,
+     * because their buffer lacked permissions the destination requires, or
+     * (for a source) could not be passed on at all.
+     * Reported at the verbose log level when the link is freed.
+     */
+    unsigned frame_copies;
 };
 
 /**
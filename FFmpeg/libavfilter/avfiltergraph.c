@@ -22,6 +22,7 @@
 
 #include <ctype.h>
 #include <string.h>
+#include "config.h"
 
 #include "avfilter.h"
 #include "avfiltergraph.h"
@@ -38,10 +39,35 @@ void avfilter_graph_free(AVFilterGraph *graph)
         return;
     for (; graph->filter_count > 0; graph->filter_count --)
         avfilter_free(graph->filters[graph->filter_count - 1]);
+#if HAVE_PTHREADS
+    ff_avfilter_graph_thread_free(graph);
+#endif
     av_freep(&graph->scale_sws_opts);
     av_freep(&graph->filters);
 }
 
+void avfilter_graph_get_pool_stats(AVFilterGraph *graph, AVFramePoolStats *stats)
+{
+    AVFramePoolStats link_stats;
+    int i, j;
+
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < graph->filter_count; i++) {
+        AVFilterContext *filter = graph->filters[i];
+
+        for (j = 0; j < filter->output_count; j++) {
+            if (!filter->outputs[j] || !filter->outputs[j]->pool)
+                continue;
+            av_frame_pool_get_stats(filter->outputs[j]->pool, &link_stats);
+            stats->nb_hits   += link_stats.nb_hits;
+            stats->nb_misses += link_stats.nb_misses;
+            stats->nb_used   += link_stats.nb_used;
+            stats->nb_idle   += link_stats.nb_idle;
+            stats->idle_size += link_stats.idle_size;
+        }
+    }
+}
+
 int avfilter_graph_add_filter(AVFilterGraph *graph, AVFilterContext *filter)
 {
     AVFilterContext **filters = av_realloc(graph->filters,
@@ -234,6 +260,12 @@ int avfilter_graph_config(AVFilterGraph *graphctx, AVClass *log_ctx)
         return ret;
     if ((ret = ff_avfilter_graph_config_formats(graphctx, log_ctx)))
         return ret;
+#if HAVE_PTHREADS
+    /* before the links are configured, so that filters know thread_count
+     * when they allocate their buffers */
+    if ((ret = ff_avfilter_graph_thread_init(graphctx)) < 0)
+        return ret;
+#endif
     if ((ret = ff_avfilter_graph_config_links(graphctx, log_ctx)))
         return ret;
 
@@ -22,6 +22,7 @@
 #ifndef AVFILTER_AVFILTERGRAPH_H
 #define AVFILTER_AVFILTERGRAPH_H
 
+#include "libavcore/framepool.h"
 #include "avfilter.h"
 
 typedef struct AVFilterGraph {
@@ -29,6 +30,14 @@ typedef struct AVFilterGraph {
     AVFilterContext **filters;
 
     char *scale_sws_opts; ///< sws options to use for the auto-inserted scale filters
+
+    /**
+     * Maximum number of threads the filters may use to process a frame,
+     * see AVFilterContext.execute(). Set by the user before
+     * avfilter_graph_config(); 0 or 1 disables threading.
+     */
+    int nb_threads;
+    void *thread_opaque;  ///< for use by the thread implementation only
 } AVFilterGraph;
 
 /**
@@ -83,6 +92,15 @@ int avfilter_graph_config(AVFilterGraph *graphctx, AVClass *log_ctx);
  */
 void avfilter_graph_free(AVFilterGraph *graph);
 
+/**
+ * Sum up the counters of the buffer pools of all the links in the graph.
+ *
+ * @param stats filled with the totals, nb_hits/nb_misses tell how many of
+ *              the buffers allocated by the default get_video_buffer() and
+ *              get_audio_buffer() were recycled
+ */
+void avfilter_graph_get_pool_stats(AVFilterGraph *graph, AVFramePoolStats *stats);
+
 /**
  * A linked-list of the inputs/outputs of the filter chain.
  *
@@ -19,38 +19,79 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "libavutil/pixdesc.h"
 #include "libavcore/audioconvert.h"
+#include "libavcore/framepool.h"
 #include "libavcore/imgutils.h"
 #include "libavcore/samplefmt.h"
 #include "avfilter.h"
 #include "internal.h"
 
-/* TODO: buffer pool.  see comment for avfilter_default_get_video_buffer() */
 void ff_avfilter_default_free_buffer(AVFilterBuffer *ptr)
 {
     av_free(ptr->data[0]);
     av_free(ptr);
 }
 
-/* TODO: set the buffer's priv member to a context structure for the whole
- * filter chain.  This will allow for a buffer pool instead of the constant
- * alloc & free cycle currently implemented. */
+void ff_avfilter_pool_free_buffer(AVFilterBuffer *ptr)
+{
+    AVFrameBuffer *frame_buf = ptr->priv;
+
+    av_frame_buffer_unref(&frame_buf);
+    av_free(ptr);
+}
+
+/**
+ * Get a buffer of at least size bytes from the pool of link.
+ */
+static AVFrameBuffer *get_pool_buffer(AVFilterLink *link, int size)
+{
+    if (!link->pool && !(link->pool = av_frame_pool_alloc()))
+        return NULL;
+    return av_frame_pool_get(link->pool, size);
+}
+
 AVFilterBufferRef *avfilter_default_get_video_buffer(AVFilterLink *link, int perms, int w, int h)
 {
-    int linesize[4];
+    int linesize[4], i, size;
     uint8_t *data[4];
+    AVFrameBuffer *frame_buf;
     AVFilterBufferRef *picref = NULL;
 
-    // +2 is needed for swscaler, +16 to be SIMD-friendly
-    if (av_image_alloc(data, linesize, w, h, link->format, 16) < 0)
+    /* the palette of paletted formats has to be set up by av_image_alloc() */
+    if (av_pix_fmt_descriptors[link->format].flags & PIX_FMT_PAL) {
+        // +2 is needed for swscaler, +16 to be SIMD-friendly
+        if (av_image_alloc(data, linesize, w, h, link->format, 16) < 0)
+            return NULL;
+
+        picref = avfilter_get_video_buffer_ref_from_arrays(data, linesize,
+                                                           perms, w, h, link->format);
+        if (!picref)
+            av_free(data[0]);
+        return picref;
+    }
+
+    /* same layout as av_image_alloc() with an alignment of 16 */
+    if (av_image_check_size(w, h, 0, NULL) < 0 ||
+        av_image_fill_linesizes(linesize, link->format, w) < 0)
+        return NULL;
+    for (i = 0; i < 4; i++)
+        linesize[i] = FFALIGN(linesize[i], 16);
+    if ((size = av_image_fill_pointers(data, link->format, h, NULL, linesize)) < 0)
         return NULL;
 
+    if (!(frame_buf = get_pool_buffer(link, size + 16)))
+        return NULL;
+    av_image_fill_pointers(data, link->format, h, frame_buf->data, linesize);
+
     picref = avfilter_get_video_buffer_ref_from_arrays(data, linesize,
                                                        perms, w, h, link->format);
     if (!picref) {
-        av_free(data[0]);
+        av_frame_buffer_unref(&frame_buf);
         return NULL;
     }
+    picref->buf->priv = frame_buf;
+    picref->buf->free = ff_avfilter_pool_free_buffer;
 
     return picref;
 }
@@ -62,7 +103,8 @@ AVFilterBufferRef *avfilter_default_get_audio_buffer(AVFilterLink *link, int per
     AVFilterBuffer *samples = av_mallocz(sizeof(AVFilterBuffer));
     AVFilterBufferRef *ref = NULL;
     int i, sample_size, chans_nb, bufsize, per_channel_size, step_size = 0;
-    char *buf;
+    AVFrameBuffer *frame_buf;
+    uint8_t *buf;
 
     if (!samples || !(ref = av_mallocz(sizeof(AVFilterBufferRef))))
         goto fail;
@@ -82,7 +124,7 @@ AVFilterBufferRef *avfilter_default_get_audio_buffer(AVFilterLink *link, int per
     ref->perms = perms | AV_PERM_READ;
 
     samples->refcount   = 1;
-    samples->free       = ff_avfilter_default_free_buffer;
+    samples->free       = ff_avfilter_pool_free_buffer;
 
     sample_size = av_get_bits_per_sample_fmt(sample_fmt) >>3;
     chans_nb = av_get_channel_layout_nb_channels(channel_layout);
@@ -100,9 +142,10 @@ AVFilterBufferRef *avfilter_default_get_audio_buffer(AVFilterLink *link, int per
 
     /* Calculate total buffer size, round to multiple of 16 to be SIMD friendly */
     bufsize = (size + 15)&~15;
-    buf = av_malloc(bufsize);
-    if (!buf)
+    if (!(frame_buf = get_pool_buffer(link, bufsize)))
         goto fail;
+    samples->priv = frame_buf;
+    buf = frame_buf->data;
 
     /* For planar, set the start point of each channel's data within the buffer
      * For packed, set the start point of the entire buffer only
@@ -255,6 +298,19 @@ void avfilter_set_common_formats(AVFilterContext *ctx, AVFilterFormats *formats)
     }
 }
 
+int avfilter_default_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                             void *arg, int *ret, int nb_jobs)
+{
+    int i;
+
+    for (i = 0; i < nb_jobs; i++) {
+        int r = func(ctx, arg, i, nb_jobs);
+        if (ret)
+            ret[i] = r;
+    }
+    return 0;
+}
+
 int avfilter_default_query_formats(AVFilterContext *ctx)
 {
     enum AVMediaType type = ctx->inputs  && ctx->inputs [0] ? ctx->inputs [0]->type :
@@ -57,7 +57,29 @@ int ff_avfilter_graph_config_links(AVFilterGraph *graphctx, AVClass *log_ctx);
  */
 int ff_avfilter_graph_config_formats(AVFilterGraph *graphctx, AVClass *log_ctx);
 
+/**
+ * Start the thread pool of graph if it has nb_threads above 1, and make
+ * the execute() of all its filters run their jobs on it.
+ *
+ * @return 0 in case of success, a negative AVERROR code otherwise
+ */
+int ff_avfilter_graph_thread_init(AVFilterGraph *graph);
+
+/** Stop the thread pool of graph, if any. */
+void ff_avfilter_graph_thread_free(AVFilterGraph *graph);
+
+/**
+ * Collect the permissions required and rejected by the destination of link
+ * and, as long as they send the buffers they get on unchanged, by the
+ * filters after it. A source which gives its buffers the required and none
+ * of the rejected permissions saves avfilter_start_frame() from copying them.
+ */
+void ff_avfilter_link_downstream_perms(AVFilterLink *link, int *min_perms, int *rej_perms);
+
 /** default handler for freeing audio/video buffer when there are no references left */
 void ff_avfilter_default_free_buffer(AVFilterBuffer *buf);
 
+/** handler for freeing a buffer drawn from its link's pool, kept in buf->priv */
+void ff_avfilter_pool_free_buffer(AVFilterBuffer *buf);
+
 #endif  /* AVFILTER_INTERNAL_H */
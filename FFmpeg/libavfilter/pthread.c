@@ -0,0 +1,188 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * slice threading of the filters of a graph
+ */
+
+#include <pthread.h>
+
+#include "libavutil/internal.h"
+#include "avfilter.h"
+#include "avfiltergraph.h"
+#include "internal.h"
+
+/**
+ * Workers of a graph, stored in the graph and filter thread_opaque.
+ * The filters of a graph run one at a time, so there is a single
+ * execute() call in progress, whose jobs the workers and the calling
+ * thread take in turn.
+ */
+typedef struct ThreadPool {
+    pthread_t *workers;
+    int nb_workers;
+
+    pthread_mutex_t lock;       ///< Protects all the fields below.
+    pthread_cond_t work_cond;   ///< Signalled when jobs are started or the workers have to exit.
+    pthread_cond_t done_cond;   ///< Signalled when the last job of an execute() call has returned.
+
+    AVFilterContext *ctx;
+    avfilter_action_func *func;
+    void *arg;
+    int *rets;
+    int nb_jobs;
+    int current_job;            ///< Next job to start.
+    int jobs_finished;
+    int die;
+} ThreadPool;
+
+/**
+ * Run the next job of the current execute() call.
+ * Must be called with the lock held; it is released while the job runs.
+ */
+static void run_job(ThreadPool *pool)
+{
+    int job = pool->current_job++;
+    int ret;
+
+    pthread_mutex_unlock(&pool->lock);
+    ret = pool->func(pool->ctx, pool->arg, job, pool->nb_jobs);
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->rets)
+        pool->rets[job] = ret;
+    if (++pool->jobs_finished == pool->nb_jobs)
+        pthread_cond_signal(&pool->done_cond);
+}
+
+static void* attribute_align_arg worker(void *v)
+{
+    ThreadPool *pool = v;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->die) {
+        if (pool->current_job < pool->nb_jobs)
+            run_job(pool);
+        else
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                          void *arg, int *ret, int nb_jobs)
+{
+    ThreadPool *pool = ctx->thread_opaque;
+
+    if (nb_jobs <= 0)
+        return 0;
+    if (nb_jobs == 1)
+        return avfilter_default_execute(ctx, func, arg, ret, nb_jobs);
+
+    pthread_mutex_lock(&pool->lock);
+
+    pool->ctx           = ctx;
+    pool->func          = func;
+    pool->arg           = arg;
+    pool->rets          = ret;
+    pool->nb_jobs       = nb_jobs;
+    pool->current_job   = 0;
+    pool->jobs_finished = 0;
+    pthread_cond_broadcast(&pool->work_cond);
+
+    /* the calling thread works on the jobs as well */
+    while (pool->current_job < nb_jobs)
+        run_job(pool);
+    while (pool->jobs_finished < nb_jobs)
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+static void stop_workers(ThreadPool *pool, int nb_workers)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->die = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < nb_workers; i++)
+        pthread_join(pool->workers[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    av_free(pool->workers);
+    av_free(pool);
+}
+
+int ff_avfilter_graph_thread_init(AVFilterGraph *graph)
+{
+    ThreadPool *pool = graph->thread_opaque;
+    int i;
+
+    if (!pool) {
+        if (graph->nb_threads <= 1)
+            return 0;
+
+        if (!(pool = av_mallocz(sizeof(ThreadPool))))
+            return AVERROR(ENOMEM);
+        /* the thread calling execute() is one of the nb_threads */
+        if (!(pool->workers = av_mallocz(sizeof(pthread_t) * (graph->nb_threads - 1)))) {
+            av_free(pool);
+            return AVERROR(ENOMEM);
+        }
+
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_cond_init(&pool->work_cond, NULL);
+        pthread_cond_init(&pool->done_cond, NULL);
+
+        for (i = 0; i < graph->nb_threads - 1; i++) {
+            if (pthread_create(&pool->workers[i], NULL, worker, pool)) {
+                stop_workers(pool, i);
+                return AVERROR(ENOMEM);
+            }
+        }
+        pool->nb_workers = graph->nb_threads - 1;
+        graph->thread_opaque = pool;
+    }
+
+    for (i = 0; i < graph->filter_count; i++) {
+        graph->filters[i]->execute       = thread_execute;
+        graph->filters[i]->thread_count  = pool->nb_workers + 1;
+        graph->filters[i]->thread_opaque = pool;
+    }
+    return 0;
+}
+
+void ff_avfilter_graph_thread_free(AVFilterGraph *graph)
+{
+    ThreadPool *pool = graph->thread_opaque;
+
+    if (!pool)
+        return;
+    stop_workers(pool, pool->nb_workers);
+    graph->thread_opaque = NULL;
+}
@@ -21,6 +21,7 @@
 #include "libavutil/cpu.h"
 #include "libavutil/common.h"
 #include "avfilter.h"
+#include "internal.h"
 #include "yadif.h"
 
 #undef NDEBUG
@@ -115,10 +116,21 @@ static void filter_line_c(uint8_t *dst,
     }
 }
 
-static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
-                   int parity, int tff)
+typedef struct {
+    AVFilterBufferRef *dstpic;
+    int parity, tff;
+} ThreadData;
+
+/**
+ * Filter one band of rows of each plane; each output row depends on the
+ * input frames only, so the bands may be filtered in parallel.
+ */
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
     YADIFContext *yadif = ctx->priv;
+    ThreadData *td = arg;
+    AVFilterBufferRef *dstpic = td->dstpic;
+    int parity = td->parity, tff = td->tff;
     int y, i;
 
     for (i = 0; i < 3; i++) {
@@ -126,8 +138,10 @@ static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
         int w = dstpic->video->w >> is_chroma;
         int h = dstpic->video->h >> is_chroma;
         int refs = yadif->cur->linesize[i];
+        int slice_start = h *  jobnr      / nb_jobs;
+        int slice_end   = h * (jobnr + 1) / nb_jobs;
 
-        for (y = 0; y < h; y++) {
+        for (y = slice_start; y < slice_end; y++) {
             if ((y ^ parity) & 1) {
                 uint8_t *prev = &yadif->prev->data[i][y*refs];
                 uint8_t *cur  = &yadif->cur ->data[i][y*refs];
@@ -143,6 +157,18 @@ static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
 #if HAVE_MMX
     __asm__ volatile("emms \n\t" : : : "memory");
 #endif
+    return 0;
+}
+
+static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
+                   int parity, int tff)
+{
+    ThreadData td;
+
+    td.dstpic = dstpic;
+    td.parity = parity;
+    td.tff    = tff;
+    ctx->execute(ctx, filter_slice, &td, NULL, ctx->thread_count);
 }
 
 static AVFilterBufferRef *get_video_buffer(AVFilterLink *link, int perms, int w, int h)
@@ -163,6 +189,18 @@ static AVFilterBufferRef *get_video_buffer(AVFilterLink *link, int perms, int w,
     return picref;
 }
 
+static AVFilterBufferRef *get_out_buffer(AVFilterLink *link)
+{
+    int min_perms, rej_perms;
+
+    /* an output buffer is not used again once it is sent, so it need not
+     * have the permissions for which the filters downstream would copy it */
+    ff_avfilter_link_downstream_perms(link, &min_perms, &rej_perms);
+    return avfilter_get_video_buffer(link, AV_PERM_WRITE |
+                                     ((AV_PERM_PRESERVE | AV_PERM_REUSE) & ~rej_perms),
+                                     link->w, link->h);
+}
+
 static void return_frame(AVFilterContext *ctx, int is_second)
 {
     YADIFContext *yadif = ctx->priv;
@@ -177,8 +215,7 @@ static void return_frame(AVFilterContext *ctx, int is_second)
     }
 
     if (is_second)
-        yadif->out = avfilter_get_video_buffer(link, AV_PERM_WRITE | AV_PERM_PRESERVE |
-                                               AV_PERM_REUSE, link->w, link->h);
+        yadif->out = get_out_buffer(link);
 
     filter(ctx, yadif->out, tff ^ !is_second, tff);
 
@@ -219,8 +256,7 @@ static void start_frame(AVFilterLink *link, AVFilterBufferRef *picref)
     if (!yadif->prev)
         yadif->prev = avfilter_ref_buffer(yadif->cur, AV_PERM_READ);
 
-    yadif->out = avfilter_get_video_buffer(ctx->outputs[0], AV_PERM_WRITE | AV_PERM_PRESERVE |
-                                       AV_PERM_REUSE, link->w, link->h);
+    yadif->out = get_out_buffer(ctx->outputs[0]);
 
     avfilter_copy_buffer_ref_props(yadif->out, yadif->cur);
     yadif->out->video->interlaced = 0;
@@ -24,17 +24,22 @@
  */
 
 #include "avfilter.h"
+#include "internal.h"
 #include "vsrc_buffer.h"
+#include "libavcore/framepool.h"
 #include "libavcore/imgutils.h"
 
 typedef struct {
     int64_t           pts;
     AVFrame           frame;
+    AVFrameBuffer    *frame_buf;     ///< reference to the pool buffer holding frame, if any
     int               has_frame;
     int               h, w;
     enum PixelFormat  pix_fmt;
     AVRational        time_base;     ///< time_base to set in the output link
     AVRational        pixel_aspect;
+    int               min_perms;     ///< permissions required downstream
+    int               rej_perms;     ///< permissions rejected downstream
 } BufferSourceContext;
 
 int av_vsrc_buffer_add_frame(AVFilterContext *buffer_filter, AVFrame *frame,
@@ -52,6 +57,14 @@ int av_vsrc_buffer_add_frame(AVFilterContext *buffer_filter, AVFrame *frame,
 
     memcpy(c->frame.data    , frame->data    , sizeof(frame->data));
     memcpy(c->frame.linesize, frame->linesize, sizeof(frame->linesize));
+
+    /* a picture decoded into a pool buffer is passed on without copying it,
+     * unless it has been replaced (e.g. deinterlaced) since */
+    av_frame_buffer_unref(&c->frame_buf);
+    if (frame->pool_buf && frame->data[0] >= frame->pool_buf->data &&
+        frame->data[0] <  frame->pool_buf->data + frame->pool_buf->size)
+        c->frame_buf = av_frame_buffer_ref(frame->pool_buf);
+
     c->frame.interlaced_frame= frame->interlaced_frame;
     c->frame.top_field_first = frame->top_field_first;
     c->pts = pts;
@@ -61,6 +74,14 @@ int av_vsrc_buffer_add_frame(AVFilterContext *buffer_filter, AVFrame *frame,
     return 0;
 }
 
+static void free_pool_buffer(AVFilterBuffer *buf)
+{
+    AVFrameBuffer *frame_buf = buf->priv;
+
+    av_frame_buffer_unref(&frame_buf);
+    av_free(buf);
+}
+
 static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
 {
     BufferSourceContext *c = ctx->priv;
@@ -85,6 +106,13 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     return 0;
 }
 
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    BufferSourceContext *c = ctx->priv;
+
+    av_frame_buffer_unref(&c->frame_buf);
+}
+
 static int query_formats(AVFilterContext *ctx)
 {
     BufferSourceContext *c = ctx->priv;
@@ -101,6 +129,7 @@ static int config_props(AVFilterLink *link)
     link->w = c->w;
     link->h = c->h;
     link->time_base = c->time_base;
+    ff_avfilter_link_downstream_perms(link, &c->min_perms, &c->rej_perms);
 
     return 0;
 }
@@ -116,15 +145,45 @@ static int request_frame(AVFilterLink *link)
         //return -1;
     }
 
-    /* This picture will be needed unmodified later for decoding the next
-     * frame */
-    picref = avfilter_get_video_buffer(link, AV_PERM_WRITE | AV_PERM_PRESERVE |
-                                       AV_PERM_REUSE2,
-                                       link->w, link->h);
+    if (c->frame_buf &&
+        (!(c->min_perms & AV_PERM_WRITE) || av_frame_buffer_is_writable(c->frame_buf))) {
+        /* The decoder does not write to the buffer while it is referenced
+         * here, so nobody else can overwrite it. If a filter downstream
+         * writes to the picture, it may do so in place as long as the
+         * decoder no longer needs it (e.g. it is not a reference frame). */
+        int perms = c->min_perms & AV_PERM_WRITE ? AV_PERM_READ | AV_PERM_WRITE :
+                    AV_PERM_READ | AV_PERM_PRESERVE | AV_PERM_REUSE;
 
-    av_image_copy(picref->data, picref->linesize,
-                  c->frame.data, c->frame.linesize,
-                  picref->format, link->w, link->h);
+        picref = avfilter_get_video_buffer_ref_from_arrays(c->frame.data, c->frame.linesize,
+                                                           perms, link->w, link->h, link->format);
+        if (!picref) {
+            av_frame_buffer_unref(&c->frame_buf);
+            return AVERROR(ENOMEM);
+        }
+        picref->buf->priv = c->frame_buf;
+        picref->buf->free = free_pool_buffer;
+        c->frame_buf = NULL;
+    } else {
+        /* This picture will be needed unmodified later for decoding the next
+         * frame. The copy belongs to us alone, so it need not have the
+         * permissions the filters downstream would have to copy it for.
+         * A decoder with direct rendering keeps each picture it returns
+         * until its next decode call, even one that is not a reference, so
+         * when a filter downstream needs to write, its pictures get here
+         * too. Telling those apart by AVFrame.reference is not safe, as
+         * some decoders read their last picture again without setting it. */
+        picref = avfilter_get_video_buffer(link, AV_PERM_WRITE |
+                                           ((AV_PERM_PRESERVE | AV_PERM_REUSE2) & ~c->rej_perms),
+                                           link->w, link->h);
+        if (!picref)
+            return AVERROR(ENOMEM);
+
+        av_image_copy(picref->data, picref->linesize,
+                      c->frame.data, c->frame.linesize,
+                      picref->format, link->w, link->h);
+        av_frame_buffer_unref(&c->frame_buf);
+        link->frame_copies++;
+    }
 
     picref->pts                    = c->pts;
     picref->video->pixel_aspect    = c->pixel_aspect;
@@ -200,7 +259,7 @@ AVFilter avfilter_vsrc_buffer = {
     "buffer",
     sizeof(BufferSourceContext),
     init,
-	NULL,
+	uninit,
 	query_formats,
 	inputs,
 	outputs,
@@ -214,6 +273,7 @@ AVFilter avfilter_vsrc_buffer = {
     .query_formats = query_formats,
 
     .init      = init,
+    .uninit    = uninit,
 
     .inputs    = (AVFilterPad[]) {{ .name = NULL }},
     .outputs   = (AVFilterPad[]) {{ .name            = "default",
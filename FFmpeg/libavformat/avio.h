@@ -569,6 +569,14 @@ void init_checksum(ByteIOContext *s,
 /* udp.c */
 int udp_set_remote_url(URLContext *h, const char *uri);
 int udp_get_local_port(URLContext *h);
+/**
+ * Return the counters of the receive thread of a UDP connection opened
+ * with the fifo_size option.
+ * @param overruns set to the number of packets dropped because the fifo was full
+ * @param high_water set to the largest number of bytes queued in the fifo
+ * @return 0 on success, a negative value if the connection has no receive thread
+ */
+int udp_get_fifo_stats(URLContext *h, int *overruns, int *high_water);
 #if FF_API_UDP_GET_FILE
 int udp_get_file_handle(URLContext *h);
 #endif
@@ -86,6 +86,12 @@ struct Program {
     unsigned int pids[MAX_PIDS_PER_PROGRAM];
 };
 
+/** discard setting of an AVProgram, see check_program_discard() */
+struct ProgramDiscard {
+    unsigned int id;
+    enum AVDiscard discard;
+};
+
 struct MpegTSContext {
     /* user data */
     AVFormatContext *stream;
@@ -121,6 +127,13 @@ struct MpegTSContext {
 
     /** filters for various streams specified by PMT + for the PAT and PMT */
     MpegTSFilter *pids[NB_PID_MAX];
+
+    /** discard_pid() result for each pid: 0 if not known yet,
+     *  1 if the pid is used, 2 if it is discarded                */
+    uint8_t pid_discard[NB_PID_MAX];
+    /** the AVProgram discard settings pid_discard was computed for */
+    struct ProgramDiscard *program_discard;
+    int nb_program_discard;
 };
 
 /* TS stream handling */
@@ -160,6 +173,11 @@ typedef struct PESContext {
 
 extern AVInputFormat mpegts_demuxer;
 
+static void invalidate_pid_discard(MpegTSContext *ts)
+{
+    memset(ts->pid_discard, 0, sizeof(ts->pid_discard));
+}
+
 static void clear_program(MpegTSContext *ts, unsigned int programid)
 {
     int i;
@@ -167,12 +185,14 @@ static void clear_program(MpegTSContext *ts, unsigned int programid)
     for(i=0; i<ts->nb_prg; i++)
         if(ts->prg[i].id == programid)
             ts->prg[i].nb_pids = 0;
+    invalidate_pid_discard(ts);
 }
 
 static void clear_programs(MpegTSContext *ts)
 {
     av_freep(&ts->prg);
     ts->nb_prg=0;
+    invalidate_pid_discard(ts);
 }
 
 static void add_pat_entry(MpegTSContext *ts, unsigned int programid)
@@ -204,6 +224,7 @@ static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid, unsigned i
     if(p->nb_pids >= MAX_PIDS_PER_PROGRAM)
         return;
     p->pids[p->nb_pids++] = pid;
+    invalidate_pid_discard(ts);
 }
 
 /**
@@ -239,6 +260,47 @@ static int discard_pid(MpegTSContext *ts, unsigned int pid)
     return !used && discarded;
 }
 
+/**
+ * Forgets the cached discard_pid() results if the caller has changed the
+ * discard setting of a program, or if programs were added.
+ */
+static void check_program_discard(MpegTSContext *ts)
+{
+    AVFormatContext *s = ts->stream;
+    int i, changed = s->nb_programs != ts->nb_program_discard;
+
+    for (i = 0; !changed && i < s->nb_programs; i++)
+        changed = s->programs[i]->id      != ts->program_discard[i].id ||
+                  s->programs[i]->discard != ts->program_discard[i].discard;
+    if (!changed)
+        return;
+
+    if (s->nb_programs > ts->nb_program_discard) {
+        void *tmp = av_realloc(ts->program_discard,
+                               s->nb_programs * sizeof(*ts->program_discard));
+        if (!tmp) {
+            ts->nb_program_discard = 0;
+            invalidate_pid_discard(ts);
+            return;
+        }
+        ts->program_discard = tmp;
+    }
+    for (i = 0; i < s->nb_programs; i++) {
+        ts->program_discard[i].id      = s->programs[i]->id;
+        ts->program_discard[i].discard = s->programs[i]->discard;
+    }
+    ts->nb_program_discard = s->nb_programs;
+    invalidate_pid_discard(ts);
+}
+
+/** discard_pid(), looked up in a table instead of the program lists */
+static inline int is_discarded_pid(MpegTSContext *ts, unsigned int pid)
+{
+    if (!ts->pid_discard[pid])
+        ts->pid_discard[pid] = 1 + discard_pid(ts, pid);
+    return ts->pid_discard[pid] - 1;
+}
+
 /**
  *  Assemble PES packets out of TS packets, and then call the "section_cb"
  *  function when they are complete.
@@ -1237,7 +1299,7 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
     int64_t pos;
 
     pid = AV_RB16(packet + 1) & 0x1fff;
-    if(pid && discard_pid(ts, pid))
+    if(pid && is_discarded_pid(ts, pid))
         return 0;
     is_start = packet[1] & 0x40;
     tss = ts->pids[pid];
@@ -1357,15 +1419,61 @@ static int read_packet(AVFormatContext *s, uint8_t *buf, int raw_packet_size)
     return 0;
 }
 
+/**
+ * Returns the number of packets at the start of buf that begin with a sync
+ * byte, out of the nb_packets complete packets in buf.
+ */
+static int count_synced_packets(const uint8_t *buf, int nb_packets, int raw_packet_size)
+{
+    int i;
+
+    for (i = 0; i < nb_packets; i++)
+        if (buf[i * raw_packet_size] != 0x47)
+            break;
+    return i;
+}
+
 static int handle_packets(MpegTSContext *ts, int nb_packets)
 {
     AVFormatContext *s = ts->stream;
+    ByteIOContext *pb = s->pb;
     uint8_t packet[TS_PACKET_SIZE];
     int packet_num, ret;
 
+    check_program_discard(ts);
+
     ts->stop_parse = 0;
     packet_num = 0;
     for(;;) {
+        /* Handle the packets that are already in the I/O buffer in place:
+           check all their sync bytes at once, and skip the packets of
+           discarded pids without calling handle_packet(). */
+        uint8_t *batch = pb->buf_ptr;
+        int nb_batch = pb->write_flag ? 0 :
+                       (pb->buf_end - pb->buf_ptr) / ts->raw_packet_size;
+        int i;
+
+        nb_batch = count_synced_packets(batch, nb_batch, ts->raw_packet_size);
+        for (i = 0; i < nb_batch; i++) {
+            uint8_t *p = batch + i * ts->raw_packet_size;
+            int pid = AV_RB16(p + 1) & 0x1fff;
+
+            if (ts->stop_parse>0)
+                return 0;
+            packet_num++;
+            if (nb_packets != 0 && packet_num >= nb_packets)
+                return 0;
+            pb->buf_ptr = p + ts->raw_packet_size;
+            if (pid && is_discarded_pid(ts, pid))
+                continue;
+            ret = handle_packet(ts, p);
+            if (ret != 0)
+                return ret;
+        }
+        if (nb_batch > 0)
+            continue;
+
+        /* resync, or read a packet that straddles the end of the buffer */
         if (ts->stop_parse>0)
             break;
         packet_num++;
@@ -1635,6 +1743,7 @@ static int mpegts_read_close(AVFormatContext *s)
     int i;
 
     clear_programs(ts);
+    av_freep(&ts->program_discard);
 
     for(i=0;i<NB_PID_MAX;i++)
         if (ts->pids[i]) mpegts_close_filter(ts, ts->pids[i]);
@@ -1819,6 +1928,7 @@ int ff_mpegts_parse_packet(MpegTSContext *ts, AVPacket *pkt,
     len1 = len;
     ts->pkt = pkt;
     ts->stop_parse = 0;
+    check_program_discard(ts);
     for(;;) {
         if (ts->stop_parse>0)
             break;
@@ -1842,6 +1952,7 @@ void ff_mpegts_parse_close(MpegTSContext *ts)
 
     for(i=0;i<NB_PID_MAX;i++)
         av_free(ts->pids[i]);
+    av_free(ts->program_discard);
     av_free(ts);
 }
 
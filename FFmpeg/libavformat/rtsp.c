@@ -1014,6 +1014,100 @@ retry:
     return 0;
 }
 
+/**
+ * Set up the lower transport of a stream from the reply to its SETUP request.
+ *
+ * @return 0 on success, <0 on error, 1 if protocol is unavailable.
+ */
+static int setup_stream_transport(AVFormatContext *s, RTSPStream *rtsp_st,
+                                  RTSPMessageHeader *reply, int i,
+                                  const char *host, int lower_transport)
+{
+    RTSPState *rt = s->priv_data;
+
+    if (reply->status_code == 461 /* Unsupported protocol */ && i == 0)
+        return 1;
+    else if (reply->status_code != RTSP_STATUS_OK ||
+             reply->nb_transports != 1)
+        return AVERROR_INVALIDDATA;
+
+    /* XXX: same protocol for all streams is required */
+    if (i > 0) {
+        if (reply->transports[0].lower_transport != rt->lower_transport ||
+            reply->transports[0].transport != rt->transport)
+            return AVERROR_INVALIDDATA;
+    } else {
+        rt->lower_transport = reply->transports[0].lower_transport;
+        rt->transport = reply->transports[0].transport;
+    }
+
+    /* Fail if the server responded with another lower transport mode
+     * than what we requested. */
+    if (reply->transports[0].lower_transport != lower_transport) {
+        av_log(s, AV_LOG_ERROR, "Nonmatching transport in server reply\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    switch(reply->transports[0].lower_transport) {
+    case RTSP_LOWER_TRANSPORT_TCP:
+        rtsp_st->interleaved_min = reply->transports[0].interleaved_min;
+        rtsp_st->interleaved_max = reply->transports[0].interleaved_max;
+        break;
+
+    case RTSP_LOWER_TRANSPORT_UDP: {
+        char url[1024], options[30] = "";
+
+        if (rt->filter_source)
+            av_strlcpy(options, "?connect=1", sizeof(options));
+        /* Use source address if specified */
+        if (reply->transports[0].source[0]) {
+            ff_url_join(url, sizeof(url), "rtp", NULL,
+                        reply->transports[0].source,
+                        reply->transports[0].server_port_min, options);
+        } else {
+            ff_url_join(url, sizeof(url), "rtp", NULL, host,
+                        reply->transports[0].server_port_min, options);
+        }
+        if (!(rt->server_type == RTSP_SERVER_WMS && i > 1) &&
+            rtp_set_remote_url(rtsp_st->rtp_handle, url) < 0)
+            return AVERROR_INVALIDDATA;
+        /* Try to initialize the connection state in a
+         * potential NAT router by sending dummy packets.
+         * RTP/RTCP dummy packets are used for RDT, too.
+         */
+        if (!(rt->server_type == RTSP_SERVER_WMS && i > 1) && s->iformat &&
+            CONFIG_RTPDEC)
+            rtp_send_punch_packets(rtsp_st->rtp_handle);
+        break;
+    }
+    case RTSP_LOWER_TRANSPORT_UDP_MULTICAST: {
+        char url[1024], namebuf[50];
+        struct sockaddr_storage addr;
+        int port, ttl;
+
+        if (reply->transports[0].destination.ss_family) {
+            addr      = reply->transports[0].destination;
+            port      = reply->transports[0].port_min;
+            ttl       = reply->transports[0].ttl;
+        } else {
+            addr      = rtsp_st->sdp_ip;
+            port      = rtsp_st->sdp_port;
+            ttl       = rtsp_st->sdp_ttl;
+        }
+        getnameinfo((struct sockaddr*) &addr, sizeof(addr),
+                    namebuf, sizeof(namebuf), NULL, 0, NI_NUMERICHOST);
+        ff_url_join(url, sizeof(url), "rtp", NULL, namebuf,
+                    port, "?ttl=%d", ttl);
+        if (url_open(&rtsp_st->rtp_handle, url, URL_RDWR) < 0)
+            return AVERROR_INVALIDDATA;
+        break;
+    }
+    }
+
+
+    return rtsp_open_transport_ctx(s, rtsp_st);
+}
+
 /**
  * @return 0 on success, <0 on error, 1 if protocol is unavailable.
  */
@@ -1021,7 +1115,7 @@ static int make_setup_request(AVFormatContext *s, const char *host, int port,
                               int lower_transport, const char *real_challenge)
 {
     RTSPState *rt = s->priv_data;
-    int rtx, j, i, err, interleave = 0;
+    int rtx, j, i, err, interleave = 0, nb_pipelined = 0;
     RTSPStream *rtsp_st;
     RTSPMessageHeader reply1, *reply = &reply1;
     char cmd[2048];
@@ -1153,98 +1247,42 @@ static int make_setup_request(AVFormatContext *s, const char *host, int port,
                         "RealChallenge2: %s, sd=%s\r\n",
                         rt->session_id, real_res, real_csum);
         }
-        ff_rtsp_send_cmd(s, "SETUP", rtsp_st->control_url, cmd, reply, NULL);
-        if (reply->status_code == 461 /* Unsupported protocol */ && i == 0) {
-            err = 1;
-            goto fail;
-        } else if (reply->status_code != RTSP_STATUS_OK ||
-                   reply->nb_transports != 1) {
-            err = AVERROR_INVALIDDATA;
-            goto fail;
-        }
-
-        /* XXX: same protocol for all streams is required */
-        if (i > 0) {
-            if (reply->transports[0].lower_transport != rt->lower_transport ||
-                reply->transports[0].transport != rt->transport) {
-                err = AVERROR_INVALIDDATA;
-                goto fail;
-            }
-        } else {
-            rt->lower_transport = reply->transports[0].lower_transport;
-            rt->transport = reply->transports[0].transport;
+        if (rt->pipeline_setup && i > 0 && rt->session_id[0] &&
+            rt->server_type != RTSP_SERVER_WMS &&
+            rt->server_type != RTSP_SERVER_REAL) {
+            /* The reply to the first SETUP has given us the session, so send
+             * the others without waiting for each other's replies. */
+            ff_rtsp_send_cmd_async(s, "SETUP", rtsp_st->control_url, cmd);
+            nb_pipelined++;
+            continue;
         }
-
-        /* Fail if the server responded with another lower transport mode
-         * than what we requested. */
-        if (reply->transports[0].lower_transport != lower_transport) {
-            av_log(s, AV_LOG_ERROR, "Nonmatching transport in server reply\n");
-            err = AVERROR_INVALIDDATA;
+        ff_rtsp_send_cmd(s, "SETUP", rtsp_st->control_url, cmd, reply, NULL);
+        if ((err = setup_stream_transport(s, rtsp_st, reply, i, host,
+                                          lower_transport)))
             goto fail;
-        }
-
-        switch(reply->transports[0].lower_transport) {
-        case RTSP_LOWER_TRANSPORT_TCP:
-            rtsp_st->interleaved_min = reply->transports[0].interleaved_min;
-            rtsp_st->interleaved_max = reply->transports[0].interleaved_max;
-            break;
-
-        case RTSP_LOWER_TRANSPORT_UDP: {
-            char url[1024], options[30] = "";
+    }
 
-            if (rt->filter_source)
-                av_strlcpy(options, "?connect=1", sizeof(options));
-            /* Use source address if specified */
-            if (reply->transports[0].source[0]) {
-                ff_url_join(url, sizeof(url), "rtp", NULL,
-                            reply->transports[0].source,
-                            reply->transports[0].server_port_min, options);
-            } else {
-                ff_url_join(url, sizeof(url), "rtp", NULL, host,
-                            reply->transports[0].server_port_min, options);
-            }
-            if (!(rt->server_type == RTSP_SERVER_WMS && i > 1) &&
-                rtp_set_remote_url(rtsp_st->rtp_handle, url) < 0) {
-                err = AVERROR_INVALIDDATA;
+    /* read the replies to the pipelined SETUPs, which come in the order
+     * the requests were sent */
+    if (nb_pipelined) {
+        int last_seq = rt->seq;
+
+        for (i = rt->nb_rtsp_streams - nb_pipelined; i < rt->nb_rtsp_streams; i++) {
+            /* ff_rtsp_read_reply() checks the CSeq against rt->seq */
+            rt->seq = last_seq - (rt->nb_rtsp_streams - 1 - i);
+            err = ff_rtsp_read_reply(s, reply, NULL, 0, "SETUP");
+            if (!err && reply->status_code > 400)
+                av_log(s, AV_LOG_ERROR, "method SETUP failed: %d%s\n",
+                       reply->status_code, reply->reason);
+            if (!err)
+                err = setup_stream_transport(s, rt->rtsp_streams[i], reply, i,
+                                             host, lower_transport);
+            if (err) {
+                rt->seq = last_seq;
                 goto fail;
             }
-            /* Try to initialize the connection state in a
-             * potential NAT router by sending dummy packets.
-             * RTP/RTCP dummy packets are used for RDT, too.
-             */
-            if (!(rt->server_type == RTSP_SERVER_WMS && i > 1) && s->iformat &&
-                CONFIG_RTPDEC)
-                rtp_send_punch_packets(rtsp_st->rtp_handle);
-            break;
         }
-        case RTSP_LOWER_TRANSPORT_UDP_MULTICAST: {
-            char url[1024], namebuf[50];
-            struct sockaddr_storage addr;
-            int port, ttl;
-
-            if (reply->transports[0].destination.ss_family) {
-                addr      = reply->transports[0].destination;
-                port      = reply->transports[0].port_min;
-                ttl       = reply->transports[0].ttl;
-            } else {
-                addr      = rtsp_st->sdp_ip;
-                port      = rtsp_st->sdp_port;
-                ttl       = rtsp_st->sdp_ttl;
-            }
-            getnameinfo((struct sockaddr*) &addr, sizeof(addr),
-                        namebuf, sizeof(namebuf), NULL, 0, NI_NUMERICHOST);
-            ff_url_join(url, sizeof(url), "rtp", NULL, namebuf,
-                        port, "?ttl=%d", ttl);
-            if (url_open(&rtsp_st->rtp_handle, url, URL_RDWR) < 0) {
-                err = AVERROR_INVALIDDATA;
-                goto fail;
-            }
-            break;
-        }
-        }
-
-        if ((err = rtsp_open_transport_ctx(s, rtsp_st)))
-            goto fail;
+        rt->seq = last_seq;
     }
 
     if (reply->timeout > 0)
@@ -1323,6 +1361,8 @@ redirect:
                 rt->control_transport = RTSP_MODE_TUNNEL;
             } else if (!strcmp(option, "filter_src")) {
                 rt->filter_source = 1;
+            } else if (!strcmp(option, "pipeline")) {
+                rt->pipeline_setup = 1;
             } else {
                 /* Write options back into the buffer, using memmove instead
                  * of strcpy since the strings may overlap. */
@@ -1440,6 +1480,12 @@ redirect:
     rt->seq = 0;
 
     tcp_fd = url_get_file_handle(rt->rtsp_hd);
+    if (rt->pipeline_setup && rt->rtsp_hd_out == rt->rtsp_hd) {
+        /* don't hold pipelined requests back until the previous ones
+         * have been acknowledged */
+        int nodelay = 1;
+        setsockopt(tcp_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    }
     if (!getpeername(tcp_fd, (struct sockaddr*) &peer, &peer_len)) {
         getnameinfo((struct sockaddr*) &peer, peer_len, host, sizeof(host),
                     NULL, 0, NI_NUMERICHOST);
@@ -313,6 +313,10 @@ typedef struct RTSPState {
     /** Filter incoming UDP packets - receive packets only from the right
      * source address and port. */
     int filter_source;
+
+    /** Send the SETUP requests for all streams but the first one without
+     * waiting for each other's replies. */
+    int pipeline_setup;
 } RTSPState;
 
 /**
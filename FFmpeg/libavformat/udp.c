@@ -25,6 +25,7 @@
  */
 
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for using recvmmsg() with glibc */
 #define _DARWIN_C_SOURCE /* Needed for using IP_MULTICAST_TTL on OS X */
 #include "avformat.h"
 #include <unistd.h>
@@ -35,6 +36,9 @@
 #include <sys/select.h>
 #endif
 #include <sys/time.h>
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 #ifndef IPV6_ADD_MEMBERSHIP
 #define IPV6_ADD_MEMBERSHIP IPV6_JOIN_GROUP
@@ -51,10 +55,41 @@ typedef struct {
     struct sockaddr_storage dest_addr;
     int dest_addr_len;
     int is_connected;
+    int fifo_size;
+
+#if HAVE_PTHREADS
+    /* Receive thread and the ring buffer it fills. The ring has a single
+     * writer and a single reader, each of which only moves its own position,
+     * so the packets themselves are passed without locking. */
+    pthread_t receive_thread;
+    uint8_t *fifo;                     ///< queued packets, each prefixed by its int length
+    uint8_t *tmp;                      ///< buffers the receive thread reads packets into
+    int no_recvmmsg;                   ///< set if the running kernel lacks recvmmsg()
+    volatile unsigned int fifo_wpos;   ///< bytes written so far, moved by the receive thread
+    volatile unsigned int fifo_rpos;   ///< bytes read so far, moved by udp_read()
+    volatile int thread_error;
+    volatile int thread_die;
+    volatile int reader_waiting;       ///< set while udp_read() sleeps on cond
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int overruns;                      ///< packets dropped because the ring was full
+    int high_water;                    ///< largest number of bytes queued in the ring
+#endif
 } UDPContext;
 
 #define UDP_TX_BUF_SIZE 32768
 #define UDP_MAX_PKT_SIZE 65536
+#define UDP_FIFO_UNIT 188
+#define UDP_MAX_FIFO_SIZE (1 << 30)
+
+#if HAVE_PTHREADS
+#define UDP_MEMORY_BARRIER() __sync_synchronize()
+#if HAVE_RECVMMSG
+#define UDP_RECV_BATCH 8   ///< max packets the receive thread gets per system call
+#else
+#define UDP_RECV_BATCH 1
+#endif
+#endif
 
 static int udp_set_multicast_ttl(int sockfd, int mcastTTL,
                                  struct sockaddr *addr)
@@ -287,6 +322,234 @@ int udp_get_local_port(URLContext *h)
     return s->local_port;
 }
 
+int udp_get_fifo_stats(URLContext *h, int *overruns, int *high_water)
+{
+#if HAVE_PTHREADS
+    UDPContext *s = h->priv_data;
+
+    if (s->fifo) {
+        *overruns   = s->overruns;
+        *high_water = s->high_water;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+#if HAVE_PTHREADS
+static void fifo_write(UDPContext *s, unsigned int pos, const uint8_t *src, int len)
+{
+    unsigned int off = pos & (s->fifo_size - 1);
+    int n = FFMIN(len, s->fifo_size - off);
+
+    memcpy(s->fifo + off, src, n);
+    memcpy(s->fifo, src + n, len - n);
+}
+
+static void fifo_read(UDPContext *s, unsigned int pos, uint8_t *dst, int len)
+{
+    unsigned int off = pos & (s->fifo_size - 1);
+    int n = FFMIN(len, s->fifo_size - off);
+
+    memcpy(dst, s->fifo + off, n);
+    memcpy(dst + n, s->fifo, len - n);
+}
+
+static void wake_reader(UDPContext *s)
+{
+    UDP_MEMORY_BARRIER();
+    if (s->reader_waiting) {
+        pthread_mutex_lock(&s->mutex);
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->mutex);
+    }
+}
+
+static void fifo_put(UDPContext *s, const uint8_t *buf, int len)
+{
+    unsigned int used = s->fifo_wpos - s->fifo_rpos;
+
+    UDP_MEMORY_BARRIER();
+    if (s->fifo_size - used < len + sizeof(int)) {
+        /* the total is reported when the connection is closed */
+        if (!s->overruns++)
+            av_log(NULL, AV_LOG_WARNING,
+                   "udp: receive fifo overrun, dropping packets; consider increasing fifo_size\n");
+        return;
+    }
+
+    fifo_write(s, s->fifo_wpos, (uint8_t *)&len, sizeof(int));
+    fifo_write(s, s->fifo_wpos + sizeof(int), buf, len);
+    UDP_MEMORY_BARRIER();
+    s->fifo_wpos += len + sizeof(int);
+
+    used += len + sizeof(int);
+    if (used > s->high_water)
+        s->high_water = used;
+
+    wake_reader(s);
+}
+
+/**
+ * Read the packets queued on the socket into s->tmp, up to UDP_RECV_BATCH
+ * of them with a single recvmmsg() where it is available.
+ * @return the number of packets read, with their sizes in lens, or -1 with
+ * the socket error left in errno
+ */
+static int udp_recv_packets(UDPContext *s, int *lens)
+{
+#if HAVE_RECVMMSG
+    if (!s->no_recvmmsg) {
+        struct mmsghdr msgs[UDP_RECV_BATCH];
+        struct iovec iov[UDP_RECV_BATCH];
+        int i, n;
+
+        memset(msgs, 0, sizeof(msgs));
+        for (i = 0; i < UDP_RECV_BATCH; i++) {
+            iov[i].iov_base = s->tmp + i * UDP_MAX_PKT_SIZE;
+            iov[i].iov_len  = UDP_MAX_PKT_SIZE;
+            msgs[i].msg_hdr.msg_iov    = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        n = recvmmsg(s->udp_fd, msgs, UDP_RECV_BATCH, 0, NULL);
+        if (n >= 0 || errno != ENOSYS) {
+            for (i = 0; i < n; i++)
+                lens[i] = msgs[i].msg_len;
+            return n < 0 ? -1 : n;
+        }
+        av_log(NULL, AV_LOG_VERBOSE, "udp: recvmmsg() not supported, reading one packet at a time\n");
+        s->no_recvmmsg = 1;
+    }
+#endif
+    lens[0] = recv(s->udp_fd, s->tmp, UDP_MAX_PKT_SIZE, 0);
+    return lens[0] < 0 ? -1 : 1;
+}
+
+static void *udp_receive_thread(void *arg)
+{
+    UDPContext *s = arg;
+    fd_set rfds;
+    struct timeval tv;
+    int ret, i, n, lens[UDP_RECV_BATCH];
+
+    while (!s->thread_die) {
+        FD_ZERO(&rfds);
+        FD_SET(s->udp_fd, &rfds);
+        tv.tv_sec = 0;
+        tv.tv_usec = 100 * 1000;
+        ret = select(s->udp_fd + 1, &rfds, NULL, NULL, &tv);
+        if (ret < 0) {
+            if (ff_neterrno() == FF_NETERROR(EINTR))
+                continue;
+            s->thread_error = AVERROR(EIO);
+            break;
+        }
+        if (!(ret > 0 && FD_ISSET(s->udp_fd, &rfds)))
+            continue;
+
+        /* the socket is non-blocking: drain it before sleeping again */
+        for (;;) {
+            n = udp_recv_packets(s, lens);
+            if (n < 0) {
+                if (ff_neterrno() != FF_NETERROR(EAGAIN) &&
+                    ff_neterrno() != FF_NETERROR(EINTR))
+                    s->thread_error = AVERROR(EIO);
+                break;
+            }
+            for (i = 0; i < n; i++)
+                fifo_put(s, s->tmp + i * UDP_MAX_PKT_SIZE, lens[i]);
+        }
+        if (s->thread_error)
+            break;
+    }
+
+    wake_reader(s);
+    return NULL;
+}
+
+static int udp_start_receive_thread(UDPContext *s)
+{
+    int size = 1;
+
+    while (size < s->fifo_size)
+        size <<= 1;
+    s->fifo_size = size;
+
+    s->fifo = av_malloc(s->fifo_size);
+    s->tmp  = av_malloc(UDP_RECV_BATCH * UDP_MAX_PKT_SIZE);
+    if (!s->fifo || !s->tmp)
+        goto fail;
+
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if (pthread_create(&s->receive_thread, NULL, udp_receive_thread, s)) {
+        av_log(NULL, AV_LOG_ERROR, "udp: cannot start the receive thread\n");
+        pthread_mutex_destroy(&s->mutex);
+        pthread_cond_destroy(&s->cond);
+        goto fail;
+    }
+    return 0;
+ fail:
+    av_freep(&s->fifo);
+    av_freep(&s->tmp);
+    return -1;
+}
+
+static void udp_stop_receive_thread(UDPContext *s)
+{
+    s->thread_die = 1;
+    pthread_join(s->receive_thread, NULL);
+    pthread_mutex_destroy(&s->mutex);
+    pthread_cond_destroy(&s->cond);
+
+    av_log(NULL, s->overruns ? AV_LOG_WARNING : AV_LOG_VERBOSE,
+           "udp: %d packets dropped by receive fifo overruns, "
+           "high water mark %d of %d bytes\n",
+           s->overruns, s->high_water, s->fifo_size);
+
+    av_freep(&s->fifo);
+    av_freep(&s->tmp);
+}
+
+static int udp_read_fifo(UDPContext *s, uint8_t *buf, int size)
+{
+    struct timeval tv;
+    struct timespec ts;
+    int len;
+
+    for (;;) {
+        unsigned int rpos = s->fifo_rpos;
+
+        if (s->fifo_wpos != rpos) {
+            UDP_MEMORY_BARRIER();
+            fifo_read(s, rpos, (uint8_t *)&len, sizeof(int));
+            /* like recv(), truncate datagrams larger than the buffer */
+            fifo_read(s, rpos + sizeof(int), buf, FFMIN(len, size));
+            UDP_MEMORY_BARRIER();
+            s->fifo_rpos = rpos + sizeof(int) + len;
+            return FFMIN(len, size);
+        }
+        if (s->thread_error)
+            return s->thread_error;
+        if (url_interrupt_cb())
+            return AVERROR(EINTR);
+
+        pthread_mutex_lock(&s->mutex);
+        s->reader_waiting = 1;
+        UDP_MEMORY_BARRIER();
+        if (s->fifo_wpos == s->fifo_rpos && !s->thread_error) {
+            gettimeofday(&tv, NULL);
+            tv.tv_usec += 100 * 1000;
+            ts.tv_sec  = tv.tv_sec + tv.tv_usec / 1000000;
+            ts.tv_nsec = tv.tv_usec % 1000000 * 1000;
+            pthread_cond_timedwait(&s->cond, &s->mutex, &ts);
+        }
+        s->reader_waiting = 0;
+        pthread_mutex_unlock(&s->mutex);
+    }
+}
+#endif
+
 /**
  * Return the udp file handle for select() usage to wait for several RTP
  * streams at the same time.
@@ -345,6 +608,12 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         if (find_info_tag(buf, sizeof(buf), "connect", p)) {
             s->is_connected = strtol(buf, NULL, 10);
         }
+        if (find_info_tag(buf, sizeof(buf), "fifo_size", p)) {
+            s->fifo_size = strtol(buf, NULL, 10);
+            if (s->fifo_size < 0 || s->fifo_size > UDP_MAX_FIFO_SIZE / UDP_FIFO_UNIT)
+                goto fail;
+            s->fifo_size *= UDP_FIFO_UNIT;
+        }
     }
 
     /* fill the dest addr */
@@ -421,6 +690,15 @@ static int udp_open(URLContext *h, const char *uri, int flags)
     }
 
     s->udp_fd = udp_fd;
+
+    if (!is_output && s->fifo_size) {
+#if HAVE_PTHREADS
+        if (udp_start_receive_thread(s) < 0)
+            goto fail;
+#else
+        av_log(NULL, AV_LOG_WARNING, "udp: fifo_size ignored, no thread support\n");
+#endif
+    }
     return 0;
  fail:
     if (udp_fd >= 0)
@@ -437,6 +715,11 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     int ret;
     struct timeval tv;
 
+#if HAVE_PTHREADS
+    if (s->fifo)
+        return udp_read_fifo(s, buf, size);
+#endif
+
     for(;;) {
         if (url_interrupt_cb())
             return AVERROR(EINTR);
@@ -491,6 +774,10 @@ static int udp_close(URLContext *h)
 {
     UDPContext *s = h->priv_data;
 
+#if HAVE_PTHREADS
+    if (s->fifo)
+        udp_stop_receive_thread(s);
+#endif
     if (s->is_multicast && !(h->flags & URL_WRONLY))
         udp_leave_multicast_group(s->udp_fd, (struct sockaddr *)&s->dest_addr);
     closesocket(s->udp_fd);
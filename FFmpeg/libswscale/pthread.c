@@ -0,0 +1,282 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Slice threading for sws_scale().
+ *
+ * A whole frame is split into horizontal bands, and each band is scaled by
+ * its own copy of the SwsContext (the scaler keeps per-line state in the
+ * context, so a context cannot be shared between threads). The band
+ * contexts have their own line buffers and share everything else, such as
+ * the filters and the yuv2rgb tables, with the user's context.
+ *
+ * For the scaled path, a band of destination lines is produced by starting
+ * the vertical scaler at its first line, with the source beginning at the
+ * first line that this destination line needs. Each destination line is
+ * computed exactly as in a single pass over the frame, so the output is
+ * bit-exact. The unscaled special converters already handle any slice
+ * independently; their bands are simply slices of the source.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "config.h"
+#include "libavutil/avutil.h"
+#include "libavutil/pixdesc.h"
+#include "swscale.h"
+#include "swscale_internal.h"
+
+typedef struct SwsThreadContext {
+    pthread_t workers[MAX_SWS_THREADS];
+    int nb_workers;
+    int nb_threads;                         ///< c->threads the bands were set up for
+    SwsContext *band_ctx[MAX_SWS_THREADS];  ///< one context per band
+    int nb_bands;
+    int band_height;                        ///< in destination lines (source lines if unscaled)
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;                ///< signalled when a frame is submitted, and on exit
+    pthread_cond_t done_cond;               ///< signalled when the last band of a frame is done
+    unsigned job;                           ///< incremented for each frame
+    int next_band;
+    int bands_done;
+    int ret;
+    int exit;
+
+    /* the frame being scaled */
+    const uint8_t **src;
+    int *srcStride;
+    uint8_t **dst;
+    int *dstStride;
+} SwsThreadContext;
+
+/**
+ * Copies the user's context into a band context, keeping the band
+ * context's own line buffers. This is done for every frame, so that
+ * palettes and colorspace settings changed since the last frame apply.
+ */
+static void update_band_context(SwsContext *bc, const SwsContext *c)
+{
+    int16_t **lumPixBuf = bc->lumPixBuf;
+    int16_t **chrPixBuf = bc->chrPixBuf;
+    int16_t **alpPixBuf = bc->alpPixBuf;
+
+    memcpy(bc, c, sizeof(*bc));
+    bc->lumPixBuf  = lumPixBuf;
+    bc->chrPixBuf  = chrPixBuf;
+    bc->alpPixBuf  = alpPixBuf;
+    bc->threads    = 1;
+    bc->thread_ctx = NULL;
+}
+
+static int scale_band(SwsThreadContext *t, int band)
+{
+    SwsContext *bc = t->band_ctx[band];
+    /* the unscaled special converters don't use the line buffers */
+    const int scaled = bc->lumPixBuf != NULL;
+    const int y0 = band * t->band_height;
+    const int y1 = FFMIN(y0 + t->band_height, scaled ? bc->dstH : bc->srcH);
+    const uint8_t *src[4];
+    uint8_t *dst[4];
+    int srcStride[4], dstStride[4];
+    int srcY, i;
+
+    if (scaled) {
+        // begin with the first source line needed for line y0
+        int lumY = bc->vLumFilterPos[y0];
+        int chrY = bc->vChrFilterPos[y0 >> bc->chrDstVSubSample] << bc->chrSrcVSubSample;
+        srcY = FFMAX(FFMIN(lumY, chrY), 0) & ~((1 << bc->chrSrcVSubSample) - 1);
+    } else
+        srcY = y0;
+
+    for (i = 0; i < 4; i++) {
+        srcStride[i] = t->srcStride[i];
+        dstStride[i] = t->dstStride[i];
+        dst[i]       = t->dst[i];
+    }
+    src[0] = t->src[0] + srcY * srcStride[0];
+    for (i = 1; i < 3; i++) {
+        src[i] = t->src[i];
+        if (src[i] && !usePal(bc->srcFormat))
+            src[i] += (srcY >> (bc->chrSrcVSubSample - bc->vChrDrop)) * srcStride[i];
+    }
+    src[3] = t->src[3] ? t->src[3] + srcY * srcStride[3] : NULL;
+
+    if (!scaled)
+        return bc->swScale(bc, src, srcStride, y0, y1 - y0, dst, dstStride);
+
+    bc->dstY         = y0;
+    bc->dstSliceEnd  = y1;
+    bc->lumBufIndex  = -1;
+    bc->chrBufIndex  = -1;
+    bc->lastInLumBuf = -1;
+    bc->lastInChrBuf = -1;
+    return bc->swScale(bc, src, srcStride, srcY, bc->srcH - srcY, dst, dstStride);
+}
+
+/**
+ * Scales bands of the current frame until none are left.
+ * Must be called with t->lock held.
+ */
+static void run_bands(SwsThreadContext *t)
+{
+    while (t->next_band < t->nb_bands) {
+        int band = t->next_band++;
+        int ret;
+
+        pthread_mutex_unlock(&t->lock);
+        ret = scale_band(t, band);
+        pthread_mutex_lock(&t->lock);
+
+        t->ret += ret;
+        if (++t->bands_done == t->nb_bands)
+            pthread_cond_signal(&t->done_cond);
+    }
+}
+
+static void *worker(void *arg)
+{
+    SwsThreadContext *t = arg;
+    unsigned job = 0;
+
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+        while (!t->exit && t->job == job)
+            pthread_cond_wait(&t->job_cond, &t->lock);
+        if (t->exit)
+            break;
+        job = t->job;
+        run_bands(t);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+void ff_sws_thread_free(SwsContext *c)
+{
+    SwsThreadContext *t = c->thread_ctx;
+    int i;
+
+    if (!t)
+        return;
+
+    pthread_mutex_lock(&t->lock);
+    t->exit = 1;
+    pthread_cond_broadcast(&t->job_cond);
+    pthread_mutex_unlock(&t->lock);
+
+    for (i = 0; i < t->nb_workers; i++)
+        pthread_join(t->workers[i], NULL);
+
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->job_cond);
+    pthread_cond_destroy(&t->done_cond);
+
+    for (i = 0; i < t->nb_bands; i++) {
+        if (t->band_ctx[i]) {
+            ff_sws_free_pixbufs(t->band_ctx[i]);
+            av_free(t->band_ctx[i]);
+        }
+    }
+    av_freep(&c->thread_ctx);
+}
+
+static int thread_init(SwsContext *c)
+{
+    SwsThreadContext *t;
+    const int nb_threads = FFMIN(c->threads, MAX_SWS_THREADS);
+    const int height = c->lumPixBuf ? c->dstH : c->srcH;
+    /* bands must start on a chroma line in both the source and destination */
+    const int align = 1 << FFMAX3(c->chrSrcVSubSample, c->chrDstVSubSample, 4);
+    int i;
+
+    t = av_mallocz(sizeof(SwsThreadContext));
+    if (!t)
+        return AVERROR(ENOMEM);
+    c->thread_ctx = t;
+
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->job_cond, NULL);
+    pthread_cond_init(&t->done_cond, NULL);
+
+    t->nb_threads  = c->threads;
+    t->band_height = FFALIGN((height + nb_threads - 1) / nb_threads, align);
+    t->nb_bands    = (height + t->band_height - 1) / t->band_height;
+
+    for (i = 0; i < t->nb_bands; i++) {
+        SwsContext *bc = av_mallocz(sizeof(SwsContext));
+        if (!bc)
+            goto fail;
+        t->band_ctx[i] = bc;
+        update_band_context(bc, c);
+        if (c->lumPixBuf && ff_sws_alloc_pixbufs(bc) < 0)
+            goto fail;
+    }
+
+    /* the calling thread scales bands too */
+    for (i = 0; i < t->nb_bands - 1; i++) {
+        if (pthread_create(&t->workers[i], NULL, worker, t))
+            break;
+        t->nb_workers++;
+    }
+
+    return 0;
+fail:
+    ff_sws_thread_free(c);
+    return AVERROR(ENOMEM);
+}
+
+int ff_sws_scale_threaded(SwsContext *c, const uint8_t* src[], int srcStride[],
+                          uint8_t* dst[], int dstStride[])
+{
+    SwsThreadContext *t = c->thread_ctx;
+    int i, ret;
+
+    if (t && t->nb_threads != c->threads)
+        ff_sws_thread_free(c);
+    if (!c->thread_ctx && thread_init(c) < 0) {
+        av_log(c, AV_LOG_ERROR, "Could not set up scaler threads, using one thread\n");
+        c->threads = 1;
+        return c->swScale(c, src, srcStride, 0, c->srcH, dst, dstStride);
+    }
+    t = c->thread_ctx;
+
+    for (i = 0; i < t->nb_bands; i++)
+        update_band_context(t->band_ctx[i], c);
+
+    pthread_mutex_lock(&t->lock);
+    t->src        = src;
+    t->srcStride  = srcStride;
+    t->dst        = dst;
+    t->dstStride  = dstStride;
+    t->next_band  = 0;
+    t->bands_done = 0;
+    t->ret        = 0;
+    t->job++;
+    pthread_cond_broadcast(&t->job_cond);
+
+    run_bands(t);
+    while (t->bands_done < t->nb_bands)
+        pthread_cond_wait(&t->done_cond, &t->lock);
+    ret = t->ret;
+    pthread_mutex_unlock(&t->lock);
+
+    return ret;
+}
@@ -23,6 +23,7 @@
 #include <string.h>
 #include <inttypes.h>
 #include <stdarg.h>
+#include <sys/time.h>
 
 #undef HAVE_AV_CONFIG_H
 #include "libavcore/imgutils.h"
@@ -31,6 +32,7 @@
 #include "libavutil/crc.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/lfg.h"
+#include "libavutil/opt.h"
 #include "swscale.h"
 
 /* HACK Duplicated from swscale_internal.h.
@@ -53,6 +55,8 @@
         || (x)==PIX_FMT_YUVA420P    \
     )
 
+static int threads = 1;
+
 static uint64_t getSSD(uint8_t *src1, uint8_t *src2, int stride1, int stride2, int w, int h)
 {
     int x,y;
@@ -163,6 +167,7 @@ static int doTest(uint8_t *ref[4], int refStride[4], int w, int h,
 
         goto end;
     }
+    av_set_int(dstContext, "threads", threads);
 //    printf("test %X %X %X -> %X %X %X\n", (int)ref[0], (int)ref[1], (int)ref[2],
 //        (int)src[0], (int)src[1], (int)src[2]);
 
@@ -339,6 +344,216 @@ static int fileTest(uint8_t *ref[4], int refStride[4], int w, int h, FILE *fp,
     return 0;
 }
 
+static int64_t gettime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// scale one frame repeatedly with 1 and with 'threads' threads, and
+// compare the speed and the output
+static int benchTest(uint8_t *ref[4], int refStride[4], int w, int h,
+                     enum PixelFormat srcFormat, enum PixelFormat dstFormat,
+                     int srcW, int srcH, int dstW, int dstH, int flags,
+                     int frames)
+{
+    uint8_t *src[4] = {0}, *dst[4] = {0};
+    int srcStride[4], dstStride[4];
+    struct SwsContext *context;
+    int64_t time1 = 0;
+    uint32_t crc1 = 0;
+    int nb_threads[2] = { 1, threads };
+    int i, k, n, res = 0;
+
+    av_image_fill_linesizes(srcStride, srcFormat, srcW);
+    av_image_fill_linesizes(dstStride, dstFormat, dstW);
+    for (i = 0; i < 4; i++) {
+        if ((srcStride[i] && !(src[i] = av_mallocz(srcStride[i]*srcH+16))) ||
+            (dstStride[i] && !(dst[i] = av_mallocz(dstStride[i]*dstH+16)))) {
+            perror("Malloc");
+            res = -1;
+            goto end;
+        }
+    }
+
+    context = sws_getContext(w, h, PIX_FMT_YUVA420P, srcW, srcH, srcFormat,
+                             SWS_BILINEAR, NULL, NULL, NULL);
+    if (!context) {
+        fprintf(stderr, "Failed to get %s ---> %s\n",
+                av_pix_fmt_descriptors[PIX_FMT_YUVA420P].name,
+                av_pix_fmt_descriptors[srcFormat].name);
+        res = -1;
+        goto end;
+    }
+    sws_scale(context, ref, refStride, 0, h, src, srcStride);
+    sws_freeContext(context);
+
+    for (k = 0; k < 2 && (k == 0 || threads > 1); k++) {
+        int64_t start, time;
+        uint32_t crc = 0;
+
+        context = sws_getContext(srcW, srcH, srcFormat, dstW, dstH, dstFormat,
+                                 flags, NULL, NULL, NULL);
+        if (!context) {
+            fprintf(stderr, "Failed to get %s ---> %s\n",
+                    av_pix_fmt_descriptors[srcFormat].name,
+                    av_pix_fmt_descriptors[dstFormat].name);
+            res = -1;
+            goto end;
+        }
+        av_set_int(context, "threads", nb_threads[k]);
+
+        start = gettime();
+        for (n = 0; n < frames; n++)
+            sws_scale(context, src, srcStride, 0, srcH, dst, dstStride);
+        time = FFMAX(gettime() - start, 1);
+        sws_freeContext(context);
+
+        for (i = 0; i < 4 && dstStride[i]; i++)
+            crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), crc, dst[i], dstStride[i] * dstH);
+
+        printf(" %s %dx%d -> %s %dx%d flags=%d threads=%d: %d frames in %0.3fs, "
+               "%0.1f fps, %0.1f Mpixel/s",
+               av_pix_fmt_descriptors[srcFormat].name, srcW, srcH,
+               av_pix_fmt_descriptors[dstFormat].name, dstW, dstH,
+               flags, nb_threads[k], frames, time / 1000000.0,
+               frames * 1000000.0 / time, (double)frames * dstW * dstH / time);
+        if (k == 0) {
+            time1 = time;
+            crc1  = crc;
+        } else {
+            printf(", speedup %0.2fx, %s", (double)time1 / time,
+                   crc == crc1 ? "output identical" : "OUTPUT DIFFERS");
+            if (crc != crc1)
+                res = -1;
+        }
+        printf(" CRC=%08x\n", crc);
+    }
+
+end:
+    for (i = 0; i < 4; i++) {
+        av_free(src[i]);
+        av_free(dst[i]);
+    }
+    return res;
+}
+
+static int getMaxDiff(uint8_t *src1, uint8_t *src2, int stride, int w, int h)
+{
+    int x, y, maxDiff = 0;
+
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            maxDiff = FFMAX(maxDiff, FFABS(src1[x + y*stride] - src2[x + y*stride]));
+
+    return maxDiff;
+}
+
+// compare the output and the speed of the SIMD code with those of the C code
+static int simdTest(int frames)
+{
+    static const struct {
+        enum PixelFormat dstFormat;
+        int srcW, srcH, dstW, dstH, flags;
+        int maxDiff;    ///< the SIMD YUV->RGB code is less precise than the C code
+    } tests[] = {
+#define BITEXACT (SWS_BITEXACT | SWS_ACCURATE_RND)
+        { PIX_FMT_YUV420P, 352, 288, 704, 576, SWS_BILINEAR|BITEXACT, 0 },
+        { PIX_FMT_YUV420P, 352, 288, 704, 576, SWS_BICUBIC|BITEXACT, 0 },
+        { PIX_FMT_YUV420P, 720, 576, 352, 288, SWS_BICUBIC|BITEXACT, 0 },
+        { PIX_FMT_YUV420P, 720, 576, 176, 144, SWS_LANCZOS|BITEXACT, 0 },
+        { PIX_FMT_YUV420P, 721, 577, 353, 289, SWS_SPLINE|BITEXACT, 0 },
+        { PIX_FMT_YUV420P, 721, 577, 923, 411, SWS_AREA|BITEXACT, 0 },
+        { PIX_FMT_RGB32,   640, 480, 640, 480, SWS_BICUBIC,  4 },
+        { PIX_FMT_BGR32,   640, 480, 640, 480, SWS_BICUBIC,  4 },
+        { PIX_FMT_RGB24,   640, 480, 640, 480, SWS_BICUBIC,  4 },
+        { PIX_FMT_BGR24,   640, 480, 640, 480, SWS_BICUBIC,  4 },
+        { PIX_FMT_RGB32,   632, 480, 632, 480, SWS_BICUBIC,  4 },
+        { PIX_FMT_BGR24,   632, 480, 632, 480, SWS_BICUBIC,  4 },
+        { PIX_FMT_RGB24,   636, 480, 636, 480, SWS_BICUBIC,  4 },
+#undef BITEXACT
+    };
+    const enum PixelFormat srcFormat = PIX_FMT_YUV420P;
+    const int cpuCaps[2] = { 0, SWS_CPU_CAPS_MMX|SWS_CPU_CAPS_MMX2 };
+    AVLFG rand;
+    int t, res = 0;
+
+    if (!strstr(swscale_configuration(), "--enable-runtime-cpudetect"))
+        printf("warning: built without --enable-runtime-cpudetect, "
+               "the C code cannot be selected and is compared with itself\n");
+
+    av_lfg_init(&rand, 1);
+
+    for (t = 0; t < sizeof(tests) / sizeof(tests[0]); t++) {
+        const int srcW = tests[t].srcW, srcH = tests[t].srcH;
+        const int dstW = tests[t].dstW, dstH = tests[t].dstH;
+        const enum PixelFormat dstFormat = tests[t].dstFormat;
+        uint8_t *src[4] = {0}, *dst[2][4] = {{0}};
+        int srcStride[4], dstStride[4];
+        int64_t time[2];
+        int i, k, n, maxDiff = 0;
+
+        av_image_fill_linesizes(srcStride, srcFormat, srcW);
+        av_image_fill_linesizes(dstStride, dstFormat, dstW);
+        for (i = 0; i < 4; i++) {
+            if ((srcStride[i] && !(src[i] = av_malloc(srcStride[i]*srcH+16))) ||
+                (dstStride[i] && (!(dst[0][i] = av_mallocz(dstStride[i]*dstH+16)) ||
+                                  !(dst[1][i] = av_mallocz(dstStride[i]*dstH+16))))) {
+                perror("Malloc");
+                res = -1;
+                goto next;
+            }
+            for (n = 0; n < srcStride[i]*srcH; n++)
+                src[i][n] = av_lfg_get(&rand);
+        }
+
+        for (k = 0; k < 2; k++) {
+            struct SwsContext *context;
+            int64_t start;
+
+            context = sws_getContext(srcW, srcH, srcFormat, dstW, dstH, dstFormat,
+                                     tests[t].flags | cpuCaps[k],
+                                     NULL, NULL, NULL);
+            if (!context) {
+                fprintf(stderr, "Failed to get %s ---> %s\n",
+                        av_pix_fmt_descriptors[srcFormat].name,
+                        av_pix_fmt_descriptors[dstFormat].name);
+                res = -1;
+                goto next;
+            }
+            start = gettime();
+            for (n = 0; n < frames; n++)
+                sws_scale(context, src, srcStride, 0, srcH, dst[k], dstStride);
+            time[k] = FFMAX(gettime() - start, 1);
+            sws_freeContext(context);
+        }
+
+        for (i = 0; i < 4 && dstStride[i]; i++) {
+            int h = i == 1 || i == 2 ? -((-dstH) >> av_pix_fmt_descriptors[dstFormat].log2_chroma_h) : dstH;
+            maxDiff = FFMAX(maxDiff, getMaxDiff(dst[0][i], dst[1][i], dstStride[i],
+                                                FFABS(dstStride[i]), h));
+        }
+
+        printf(" %s %dx%d -> %s %dx%d flags=%d: C %0.2fms, SIMD %0.2fms (%0.2fx), max difference %d%s\n",
+               av_pix_fmt_descriptors[srcFormat].name, srcW, srcH,
+               av_pix_fmt_descriptors[dstFormat].name, dstW, dstH, tests[t].flags,
+               time[0] / 1000.0 / frames, time[1] / 1000.0 / frames,
+               (double)time[0] / time[1], maxDiff,
+               maxDiff > tests[t].maxDiff ? " FAILED" : "");
+        if (maxDiff > tests[t].maxDiff)
+            res = -1;
+next:
+        for (i = 0; i < 4; i++) {
+            av_free(src[i]);
+            av_free(dst[0][i]);
+            av_free(dst[1][i]);
+        }
+    }
+
+    return res;
+}
+
 #define W 96
 #define H 96
 
@@ -357,6 +572,8 @@ int main(int argc, char **argv)
     AVLFG rand;
     int res = -1;
     int i;
+    int benchW = 0, benchH = 0, benchDstW = 0, benchDstH = 0;
+    int benchFlags = SWS_BILINEAR, benchFrames = 100;
 
     if (!rgb_data || !data)
         return -1;
@@ -386,6 +603,26 @@ int main(int argc, char **argv)
             res = fileTest(src, stride, W, H, fp, srcFormat, dstFormat);
             fclose(fp);
             goto end;
+        } else if (!strcmp(argv[i], "-threads")) {
+            threads = atoi(argv[i+1]);
+            if (threads < 1) {
+                fprintf(stderr, "invalid number of threads %s\n", argv[i+1]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "-bench") || !strcmp(argv[i], "-bench_dst")) {
+            int *bw = argv[i][6] ? &benchDstW : &benchW;
+            int *bh = argv[i][6] ? &benchDstH : &benchH;
+            if (sscanf(argv[i+1], "%dx%d", bw, bh) != 2 || *bw <= 0 || *bh <= 0) {
+                fprintf(stderr, "invalid size %s\n", argv[i+1]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "-simd")) {
+            res = simdTest(FFMAX(atoi(argv[i+1]), 1));
+            goto error;
+        } else if (!strcmp(argv[i], "-bench_flags")) {
+            benchFlags = atoi(argv[i+1]);
+        } else if (!strcmp(argv[i], "-bench_frames")) {
+            benchFrames = FFMAX(atoi(argv[i+1]), 1);
         } else if (!strcmp(argv[i], "-src")) {
             srcFormat = av_get_pix_fmt(argv[i+1]);
             if (srcFormat == PIX_FMT_NONE) {
@@ -405,6 +642,17 @@ bad_option:
         }
     }
 
+    if (benchW) {
+        /* throughput mode */
+        res = benchTest(src, stride, W, H,
+                        srcFormat != PIX_FMT_NONE ? srcFormat : PIX_FMT_YUV420P,
+                        dstFormat != PIX_FMT_NONE ? dstFormat : PIX_FMT_RGB32,
+                        benchW, benchH,
+                        benchDstW ? benchDstW : benchW, benchDstH ? benchDstH : benchH,
+                        benchFlags, benchFrames);
+        goto error;
+    }
+
     selfTest(src, stride, W, H, srcFormat, dstFormat);
 end:
     res = 0;
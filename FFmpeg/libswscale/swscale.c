@@ -1264,6 +1264,10 @@ SwsFunc ff_getSwsFunc(SwsContext *c)
     // ordered per speed fastest first
     if (flags & SWS_CPU_CAPS_MMX2) {
         sws_init_swScale_MMX2(c);
+#if HAVE_SSE
+        if (flags & SWS_CPU_CAPS_SSE2)
+            ff_sws_init_swScale_sse2(c);
+#endif
         return swScale_MMX2;
     } else if (flags & SWS_CPU_CAPS_3DNOW) {
         sws_init_swScale_3DNow(c);
@@ -1292,6 +1296,10 @@ SwsFunc ff_getSwsFunc(SwsContext *c)
 #else //CONFIG_RUNTIME_CPUDETECT
 #if   COMPILE_TEMPLATE_MMX2
     sws_init_swScale_MMX2(c);
+#if HAVE_SSE
+    if (c->flags & SWS_CPU_CAPS_SSE2)
+        ff_sws_init_swScale_sse2(c);
+#endif
     return swScale_MMX2;
 #elif COMPILE_TEMPLATE_AMD3DNOW
     sws_init_swScale_3DNow(c);
@@ -1996,6 +2004,13 @@ int sws_scale(SwsContext *c, const uint8_t* const src[], const int srcStride[],
         if (srcSliceY + srcSliceH == c->srcH)
             c->sliceDir = 0;
 
+#if HAVE_PTHREADS
+        /* (yvu9ToYv12Wrapper() interpolates chroma within each slice, so its
+           output would depend on how the frame is split) */
+        if (c->threads > 1 && srcSliceY == 0 && srcSliceH == c->srcH &&
+            c->swScale != yvu9ToYv12Wrapper)
+            return ff_sws_scale_threaded(c, src2, srcStride2, dst2, dstStride2);
+#endif
         return c->swScale(c, src2, srcStride2, srcSliceY, srcSliceH, dst2, dstStride2);
     } else {
         // slices go from bottom to top => we flip the image internally
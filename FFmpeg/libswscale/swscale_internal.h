@@ -314,6 +314,17 @@ typedef struct SwsContext {
 
     int needs_hcscale; ///< Set if there are chroma planes to be converted.
 
+    /**
+     * @name Slice threading.
+     * Whole frames are split into horizontal bands of the destination,
+     * which are scaled in parallel, each by its own copy of this context.
+     */
+    //@{
+    int threads;                  ///< Number of threads to scale whole frames with (1 = no threading).
+    int dstSliceEnd;              ///< If nonzero, the scaler stops before this destination line.
+    struct SwsThreadContext *thread_ctx; ///< Worker threads and band contexts, set up by the first threaded call.
+    //@}
+
 } SwsContext;
 //FIXME check init (where 0)
 
@@ -330,6 +341,7 @@ SwsFunc ff_yuv2rgb_init_mlib(SwsContext *c);
 SwsFunc ff_yuv2rgb_init_altivec(SwsContext *c);
 SwsFunc ff_yuv2rgb_get_func_ptr_bfin(SwsContext *c);
 void ff_bfin_get_unscaled_swscale(SwsContext *c);
+void ff_sws_init_swScale_sse2(SwsContext *c);
 void ff_yuv2packedX_altivec(SwsContext *c,
                             const int16_t *lumFilter, const int16_t **lumSrc, int lumFilterSize,
                             const int16_t *chrFilter, const int16_t **chrSrc, int chrFilterSize,
@@ -468,4 +480,22 @@ int ff_hardcodedcpuflags(void);
  */
 SwsFunc ff_getSwsFunc(SwsContext *c);
 
+/**
+ * Allocates the ring buffers of scaled horizontal lines (lumPixBuf,
+ * chrPixBuf and alpPixBuf) for the buffer sizes set in c.
+ */
+int ff_sws_alloc_pixbufs(SwsContext *c);
+void ff_sws_free_pixbufs(SwsContext *c);
+
+#define MAX_SWS_THREADS 16
+
+/**
+ * Scales a whole frame (srcSliceY == 0 and srcSliceH == srcH) with
+ * c->threads threads; the arguments are as for c->swScale().
+ * The result is bit-exact with a single call to c->swScale().
+ */
+int ff_sws_scale_threaded(SwsContext *c, const uint8_t* src[], int srcStride[],
+                          uint8_t* dst[], int dstStride[]);
+void ff_sws_thread_free(SwsContext *c);
+
 #endif /* SWSCALE_SWSCALE_INTERNAL_H */
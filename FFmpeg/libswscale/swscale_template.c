@@ -2374,6 +2374,8 @@ static inline void RENAME(hyscale_fast)(SwsContext *c, int16_t *dst,
         dst[i]= (src[xx]<<7) + (src[xx+1] - src[xx])*xalpha;
         xpos+=xInc;
     }
+    // don't interpolate with whatever follows the last pixel (as the MMX2 code)
+    for (i=dstWidth-1; (i*xInc)>>16 >=srcW-1; i--) dst[i] = src[srcW-1]*128;
 #endif /* ARCH_X86 */
 }
 
@@ -2525,6 +2527,11 @@ which is needed to support GCC 4.0. */
         */
         xpos+=xInc;
     }
+    // don't interpolate with whatever follows the last pixel (as the MMX2 code)
+    for (i=dstWidth-1; (i*xInc)>>16 >=srcW-1; i--) {
+        dst[i] = src1[srcW-1]*128;
+        dst[i+VOFW] = src2[srcW-1]*128;
+    }
 #endif /* ARCH_X86 */
 }
 
@@ -2565,6 +2572,7 @@ static int RENAME(swScale)(SwsContext *c, const uint8_t* src[], int srcStride[],
     const int srcW= c->srcW;
     const int dstW= c->dstW;
     const int dstH= c->dstH;
+    const int dstEnd= c->dstSliceEnd ? c->dstSliceEnd : dstH;
     const int chrDstW= c->chrDstW;
     const int chrSrcW= c->chrSrcW;
     const int lumXInc= c->lumXInc;
@@ -2636,8 +2644,9 @@ static int RENAME(swScale)(SwsContext *c, const uint8_t* src[], int srcStride[],
 
     /* Note the user might start scaling the picture in the middle so this
        will not get executed. This is not really intended but works
-       currently, so people might do it. */
-    if (srcSliceY ==0) {
+       currently, so people might do it.
+       (The band contexts of a threaded scale are set up by the caller.) */
+    if (srcSliceY ==0 && !c->dstSliceEnd) {
         lumBufIndex=-1;
         chrBufIndex=-1;
         dstY=0;
@@ -2647,7 +2656,7 @@ static int RENAME(swScale)(SwsContext *c, const uint8_t* src[], int srcStride[],
 
     lastDstY= dstY;
 
-    for (;dstY < dstH; dstY++) {
+    for (;dstY < dstEnd; dstY++) {
         unsigned char *dest =dst[0]+dstStride[0]*dstY;
         const int chrDstY= dstY>>c->chrDstVSubSample;
         unsigned char *uDest=dst[1]+dstStride[1]*chrDstY;
@@ -43,6 +43,7 @@
 #include "libavutil/x86_cpu.h"
 #include "libavutil/avutil.h"
 #include "libavutil/bswap.h"
+#include "libavutil/cpu.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 
@@ -740,6 +741,14 @@ static int update_flags_cpu(int flags)
                |SWS_CPU_CAPS_BFIN);
     flags |= ff_hardcodedcpuflags();
 #endif /* CONFIG_RUNTIME_CPUDETECT */
+#if ARCH_X86 && HAVE_SSE
+    /* The SSE2 code extends the MMX2 code; use it if the CPU has SSE2. */
+    if (flags & SWS_CPU_CAPS_MMX2) {
+        int cpu_flags = av_get_cpu_flags();
+        if ((cpu_flags & AV_CPU_FLAG_SSE2) && !(cpu_flags & AV_CPU_FLAG_SSE2SLOW))
+            flags |= SWS_CPU_CAPS_SSE2;
+    }
+#endif
     return flags;
 }
 
@@ -753,6 +762,63 @@ SwsContext *sws_alloc_context(void)
     return c;
 }
 
+int ff_sws_alloc_pixbufs(SwsContext *c)
+{
+    int i;
+
+    // allocate pixbufs (we use dynamic allocation because otherwise we would need to
+    // allocate several megabytes to handle all possible cases)
+    FF_ALLOCZ_OR_GOTO(c, c->lumPixBuf, c->vLumBufSize*2*sizeof(int16_t*), fail);
+    FF_ALLOCZ_OR_GOTO(c, c->chrPixBuf, c->vChrBufSize*2*sizeof(int16_t*), fail);
+	if (CONFIG_SWSCALE_ALPHA && isALPHA(c->srcFormat) && isALPHA(c->dstFormat))
+        FF_ALLOCZ_OR_GOTO(c, c->alpPixBuf, c->vLumBufSize*2*sizeof(int16_t*), fail);
+    //Note we need at least one pixel more at the end because of the MMX code (just in case someone wanna replace the 4000/8000)
+    /* align at 16 bytes for AltiVec */
+    for (i=0; i<c->vLumBufSize; i++) {
+        FF_ALLOCZ_OR_GOTO(c, c->lumPixBuf[i+c->vLumBufSize], VOF+1, fail);
+        c->lumPixBuf[i] = c->lumPixBuf[i+c->vLumBufSize];
+    }
+    for (i=0; i<c->vChrBufSize; i++) {
+        FF_ALLOC_OR_GOTO(c, c->chrPixBuf[i+c->vChrBufSize], (VOF+1)*2, fail);
+        c->chrPixBuf[i] = c->chrPixBuf[i+c->vChrBufSize];
+    }
+    if (CONFIG_SWSCALE_ALPHA && c->alpPixBuf)
+        for (i=0; i<c->vLumBufSize; i++) {
+            FF_ALLOCZ_OR_GOTO(c, c->alpPixBuf[i+c->vLumBufSize], VOF+1, fail);
+            c->alpPixBuf[i] = c->alpPixBuf[i+c->vLumBufSize];
+        }
+
+    //try to avoid drawing green stuff between the right end and the stride end
+    for (i=0; i<c->vChrBufSize; i++) memset(c->chrPixBuf[i], 64, (VOF+1)*2);
+
+    return 0;
+fail:
+    return -1;
+}
+
+void ff_sws_free_pixbufs(SwsContext *c)
+{
+    int i;
+
+    if (c->lumPixBuf) {
+        for (i=0; i<c->vLumBufSize; i++)
+            av_freep(&c->lumPixBuf[i]);
+        av_freep(&c->lumPixBuf);
+    }
+
+    if (c->chrPixBuf) {
+        for (i=0; i<c->vChrBufSize; i++)
+            av_freep(&c->chrPixBuf[i]);
+        av_freep(&c->chrPixBuf);
+    }
+
+    if (CONFIG_SWSCALE_ALPHA && c->alpPixBuf) {
+        for (i=0; i<c->vLumBufSize; i++)
+            av_freep(&c->alpPixBuf[i]);
+        av_freep(&c->alpPixBuf);
+    }
+}
+
 int sws_init_context(SwsContext *c, SwsFilter *srcFilter, SwsFilter *dstFilter)
 {
     int i;
@@ -1005,30 +1071,8 @@ int sws_init_context(SwsContext *c, SwsFilter *srcFilter, SwsFilter *dstFilter)
             c->vChrBufSize= (nextSlice>>c->chrSrcVSubSample) - c->vChrFilterPos[chrI];
     }
 
-    // allocate pixbufs (we use dynamic allocation because otherwise we would need to
-    // allocate several megabytes to handle all possible cases)
-    FF_ALLOC_OR_GOTO(c, c->lumPixBuf, c->vLumBufSize*2*sizeof(int16_t*), fail);
-    FF_ALLOC_OR_GOTO(c, c->chrPixBuf, c->vChrBufSize*2*sizeof(int16_t*), fail);
-	if (CONFIG_SWSCALE_ALPHA && isALPHA(c->srcFormat) && isALPHA(c->dstFormat))
-        FF_ALLOCZ_OR_GOTO(c, c->alpPixBuf, c->vLumBufSize*2*sizeof(int16_t*), fail);
-    //Note we need at least one pixel more at the end because of the MMX code (just in case someone wanna replace the 4000/8000)
-    /* align at 16 bytes for AltiVec */
-    for (i=0; i<c->vLumBufSize; i++) {
-        FF_ALLOCZ_OR_GOTO(c, c->lumPixBuf[i+c->vLumBufSize], VOF+1, fail);
-        c->lumPixBuf[i] = c->lumPixBuf[i+c->vLumBufSize];
-    }
-    for (i=0; i<c->vChrBufSize; i++) {
-        FF_ALLOC_OR_GOTO(c, c->chrPixBuf[i+c->vChrBufSize], (VOF+1)*2, fail);
-        c->chrPixBuf[i] = c->chrPixBuf[i+c->vChrBufSize];
-    }
-    if (CONFIG_SWSCALE_ALPHA && c->alpPixBuf)
-        for (i=0; i<c->vLumBufSize; i++) {
-            FF_ALLOCZ_OR_GOTO(c, c->alpPixBuf[i+c->vLumBufSize], VOF+1, fail);
-            c->alpPixBuf[i] = c->alpPixBuf[i+c->vLumBufSize];
-        }
-
-    //try to avoid drawing green stuff between the right end and the stride end
-    for (i=0; i<c->vChrBufSize; i++) memset(c->chrPixBuf[i], 64, (VOF+1)*2);
+    if (ff_sws_alloc_pixbufs(c) < 0)
+        goto fail;
 
     assert(2*VOFW == VOF);
 
@@ -1469,26 +1513,13 @@ void sws_freeFilter(SwsFilter *filter)
 
 void sws_freeContext(SwsContext *c)
 {
-    int i;
     if (!c) return;
 
-    if (c->lumPixBuf) {
-        for (i=0; i<c->vLumBufSize; i++)
-            av_freep(&c->lumPixBuf[i]);
-        av_freep(&c->lumPixBuf);
-    }
-
-    if (c->chrPixBuf) {
-        for (i=0; i<c->vChrBufSize; i++)
-            av_freep(&c->chrPixBuf[i]);
-        av_freep(&c->chrPixBuf);
-    }
+#if HAVE_PTHREADS
+    ff_sws_thread_free(c);
+#endif
 
-    if (CONFIG_SWSCALE_ALPHA && c->alpPixBuf) {
-        for (i=0; i<c->vLumBufSize; i++)
-            av_freep(&c->alpPixBuf[i]);
-        av_freep(&c->alpPixBuf);
-    }
+    ff_sws_free_pixbufs(c);
 
     av_freep(&c->vLumFilter);
     av_freep(&c->vChrFilter);
@@ -1530,12 +1561,16 @@ struct SwsContext *sws_getCachedContext(struct SwsContext *context,
                                         SwsFilter *srcFilter, SwsFilter *dstFilter, const double *param)
 {
     static const double default_param[2] = {SWS_PARAM_DEFAULT, SWS_PARAM_DEFAULT};
+    int threads = 1;
 
     if (!param)
         param = default_param;
 
     flags = update_flags_cpu(flags);
 
+    if (context)
+        threads = context->threads;
+
     if (context &&
         (context->srcW      != srcW      ||
          context->srcH      != srcH      ||
@@ -1564,6 +1599,7 @@ struct SwsContext *sws_getCachedContext(struct SwsContext *context,
         context->flags     = flags;
         context->param[0]  = param[0];
         context->param[1]  = param[1];
+        context->threads   = threads;
         sws_setColorspaceDetails(context, ff_yuv2rgb_coeffs[SWS_CS_DEFAULT], context->srcRange, ff_yuv2rgb_coeffs[SWS_CS_DEFAULT] /* FIXME*/, context->dstRange, 0, 1<<16, 1<<16);
         if (sws_init_context(context, srcFilter, dstFilter) < 0) {
             sws_freeContext(context);
@@ -0,0 +1,242 @@
+/*
+ * SSE2 horizontal and vertical scalers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * SSE2 versions of the hScale() and yuv2yuvX() inner loops.
+ *
+ * Both compute exactly what the C versions compute (the 32-bit sums of
+ * pmaddwd are the same as the sums in C), so unlike the MMX vertical
+ * scaler, they are also used with SWS_BITEXACT.
+ */
+
+#include <inttypes.h>
+
+#include "config.h"
+#include "libswscale/swscale.h"
+#include "libswscale/swscale_internal.h"
+#include "libavutil/x86_cpu.h"
+
+DECLARE_ASM_CONST(16, int32_t, sse2_vrounder)[4] = { 1<<18, 1<<18, 1<<18, 1<<18 };
+
+/* Horizontal scaling, two output pixels at a time. filterPos has room for
+ * dstW + 1 entries, and dst for at least that many, so an odd dstW is fine.
+ * The result is left in the low 2 words of xmm0. */
+
+/* sum each of the 4 dwords of xmm0 (first pixel) and xmm1 (second pixel) */
+#define HSUM_PAIR_SSE2                      \
+    "movdqa     %%xmm0, %%xmm2  \n\t"       \
+    "punpckldq  %%xmm1, %%xmm0  \n\t"       \
+    "punpckhdq  %%xmm1, %%xmm2  \n\t"       \
+    "paddd      %%xmm2, %%xmm0  \n\t"       \
+    "pshufd $0x0E, %%xmm0, %%xmm1 \n\t"     \
+    "paddd      %%xmm1, %%xmm0  \n\t"       \
+
+#define HSTORE_PAIR_SSE2                    \
+    "psrad          $7, %%xmm0  \n\t"       \
+    "packssdw   %%xmm0, %%xmm0  \n\t"       \
+    "movd       %%xmm0, %0      \n\t"       \
+
+static void hscale_sse2(int16_t *dst, int dstW, const uint8_t *src, int srcW,
+                        int xInc, const int16_t *filter, const int16_t *filterPos,
+                        long filterSize)
+{
+    int i;
+
+    for (i = 0; i < dstW; i += 2) {
+        const int16_t *f = filter + i*filterSize;
+        uint32_t out;
+
+        if (filterSize == 4) {
+            __asm__ volatile(
+                "pxor       %%xmm7, %%xmm7  \n\t"
+                "movd         (%1), %%xmm0  \n\t"
+                "movd         (%2), %%xmm1  \n\t"
+                "movdqu       (%3), %%xmm2  \n\t"
+                "punpckldq  %%xmm1, %%xmm0  \n\t"
+                "punpcklbw  %%xmm7, %%xmm0  \n\t"
+                "pmaddwd    %%xmm2, %%xmm0  \n\t"
+                "pshufd $0xB1, %%xmm0, %%xmm1 \n\t"
+                "paddd      %%xmm1, %%xmm0  \n\t"
+                "pshufd $0x08, %%xmm0, %%xmm0 \n\t"
+                HSTORE_PAIR_SSE2
+                : "=r" (out)
+                : "r" (src + filterPos[i]), "r" (src + filterPos[i + 1]), "r" (f)
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm7",) "memory"
+            );
+        } else if (filterSize == 8) {
+            __asm__ volatile(
+                "pxor       %%xmm7, %%xmm7  \n\t"
+                "movq         (%1), %%xmm0  \n\t"
+                "movq         (%2), %%xmm1  \n\t"
+                "movdqu       (%3), %%xmm2  \n\t"
+                "movdqu     16(%3), %%xmm3  \n\t"
+                "punpcklbw  %%xmm7, %%xmm0  \n\t"
+                "punpcklbw  %%xmm7, %%xmm1  \n\t"
+                "pmaddwd    %%xmm2, %%xmm0  \n\t"
+                "pmaddwd    %%xmm3, %%xmm1  \n\t"
+                HSUM_PAIR_SSE2
+                HSTORE_PAIR_SSE2
+                : "=r" (out)
+                : "r" (src + filterPos[i]), "r" (src + filterPos[i + 1]), "r" (f)
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm7",) "memory"
+            );
+        } else { // a multiple of 8, see ff_sws_init_swScale_sse2()
+            x86_reg j = 0;
+            __asm__ volatile(
+                "pxor       %%xmm7, %%xmm7  \n\t"
+                "pxor       %%xmm4, %%xmm4  \n\t"
+                "pxor       %%xmm5, %%xmm5  \n\t"
+                "1:                         \n\t"
+                "movq     (%2, %1), %%xmm0  \n\t"
+                "movq     (%3, %1), %%xmm1  \n\t"
+                "movdqu (%4, %1, 2), %%xmm2 \n\t"
+                "movdqu (%5, %1, 2), %%xmm3 \n\t"
+                "punpcklbw  %%xmm7, %%xmm0  \n\t"
+                "punpcklbw  %%xmm7, %%xmm1  \n\t"
+                "pmaddwd    %%xmm2, %%xmm0  \n\t"
+                "pmaddwd    %%xmm3, %%xmm1  \n\t"
+                "paddd      %%xmm0, %%xmm4  \n\t"
+                "paddd      %%xmm1, %%xmm5  \n\t"
+                "add            $8, %1      \n\t"
+                "cmp            %6, %1      \n\t"
+                "jb             1b          \n\t"
+                "movdqa     %%xmm4, %%xmm0  \n\t"
+                "movdqa     %%xmm5, %%xmm1  \n\t"
+                HSUM_PAIR_SSE2
+                HSTORE_PAIR_SSE2
+                : "=r" (out), "+r" (j)
+                : "r" (src + filterPos[i]), "r" (src + filterPos[i + 1]),
+                  "r" (f), "r" (f + filterSize), "g" ((x86_reg)filterSize)
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                               "%xmm4", "%xmm5", "%xmm7",) "memory"
+            );
+        }
+        dst[i    ] = out;
+        dst[i + 1] = out >> 16;
+    }
+}
+
+/* One pair of vertical filter taps: the two coefficients, repeated for
+ * pmaddwd, and the lines they apply to. */
+typedef struct VScaleTap {
+    int16_t coeff[8];
+    union {
+        const int16_t *ptr;
+        uint64_t pad;     ///< keeps the size at 32 bytes on 32-bit systems
+    } src[2];
+} VScaleTap;
+
+static int init_vscale_taps(VScaleTap *taps, const int16_t *filter,
+                            const int16_t **src, int filterSize, int offset)
+{
+    int i, j;
+
+    for (i = 0; i < filterSize; i += 2) {
+        VScaleTap *t = &taps[i >> 1];
+        int16_t c0 = filter[i];
+        int16_t c1 = i + 1 < filterSize ? filter[i + 1] : 0;
+
+        for (j = 0; j < 8; j += 2) {
+            t->coeff[j    ] = c0;
+            t->coeff[j + 1] = c1;
+        }
+        t->src[0].ptr = src[i] + offset;
+        t->src[1].ptr = (i + 1 < filterSize ? src[i + 1] : src[i]) + offset;
+    }
+    return (filterSize + 1) >> 1;
+}
+
+/* dest[i] = av_clip_uint8(((1<<18) + sum of src[j][i]*filter[j]) >> 19),
+ * 8 pixels at a time (like the MMX code, this may write up to 7 bytes past
+ * the end of the line) */
+static void vscale_sse2(const VScaleTap *taps, int nb_taps, uint8_t *dest, long dstW)
+{
+    const VScaleTap *end = taps + nb_taps;
+    x86_reg i = 0;
+
+    __asm__ volatile(
+        "1:                                 \n\t"
+        "mov                %3, %%"REG_c"   \n\t"
+        "movdqa "MANGLE(sse2_vrounder)", %%xmm2 \n\t"
+        "movdqa         %%xmm2, %%xmm3      \n\t"
+        "2:                                 \n\t"
+        "mov  16(%%"REG_c"), %%"REG_d"      \n\t"
+        "movdqu (%%"REG_d", %0, 2), %%xmm0  \n\t"
+        "mov  24(%%"REG_c"), %%"REG_d"      \n\t"
+        "movdqu (%%"REG_d", %0, 2), %%xmm1  \n\t"
+        "movdqa         %%xmm0, %%xmm4      \n\t"
+        "punpcklwd      %%xmm1, %%xmm0      \n\t"
+        "punpckhwd      %%xmm1, %%xmm4      \n\t"
+        "movdqu (%%"REG_c"), %%xmm1         \n\t"
+        "pmaddwd        %%xmm1, %%xmm0      \n\t"
+        "pmaddwd        %%xmm1, %%xmm4      \n\t"
+        "paddd          %%xmm0, %%xmm2      \n\t"
+        "paddd          %%xmm4, %%xmm3      \n\t"
+        "add               $32, %%"REG_c"   \n\t"
+        "cmp                %4, %%"REG_c"   \n\t"
+        "jb                 2b              \n\t"
+        "psrad             $19, %%xmm2      \n\t"
+        "psrad             $19, %%xmm3      \n\t"
+        "packssdw       %%xmm3, %%xmm2      \n\t"
+        "packuswb       %%xmm2, %%xmm2      \n\t"
+        "movq           %%xmm2, (%1, %0)    \n\t"
+        "add                $8, %0          \n\t"
+        "cmp                %2, %0          \n\t"
+        "jb                 1b              \n\t"
+        : "+r" (i)
+        : "r" (dest), "g" ((x86_reg)dstW), "g" (taps), "g" (end)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4",)
+          "%"REG_c, "%"REG_d, "memory"
+    );
+}
+
+static void yuv2yuvX_sse2(SwsContext *c, const int16_t *lumFilter,
+                          const int16_t **lumSrc, int lumFilterSize,
+                          const int16_t *chrFilter, const int16_t **chrSrc,
+                          int chrFilterSize, const int16_t **alpSrc,
+                          uint8_t *dest, uint8_t *uDest, uint8_t *vDest,
+                          uint8_t *aDest, long dstW, long chrDstW)
+{
+    DECLARE_ALIGNED(16, VScaleTap, taps)[(MAX_FILTER_SIZE + 1) / 2];
+    int nb_taps;
+
+    if (uDest) {
+        nb_taps = init_vscale_taps(taps, chrFilter, chrSrc, chrFilterSize, 0);
+        vscale_sse2(taps, nb_taps, uDest, chrDstW);
+        nb_taps = init_vscale_taps(taps, chrFilter, chrSrc, chrFilterSize, VOFW);
+        vscale_sse2(taps, nb_taps, vDest, chrDstW);
+    }
+    if (CONFIG_SWSCALE_ALPHA && aDest) {
+        nb_taps = init_vscale_taps(taps, lumFilter, alpSrc, lumFilterSize, 0);
+        vscale_sse2(taps, nb_taps, aDest, dstW);
+    }
+    nb_taps = init_vscale_taps(taps, lumFilter, lumSrc, lumFilterSize, 0);
+    vscale_sse2(taps, nb_taps, dest, dstW);
+}
+
+void ff_sws_init_swScale_sse2(SwsContext *c)
+{
+    /* hScale() gets filter sizes that are a multiple of 4 on x86 */
+    if ((c->hLumFilterSize == 4 || !(c->hLumFilterSize & 7)) &&
+        (c->hChrFilterSize == 4 || !(c->hChrFilterSize & 7)))
+        c->hScale = hscale_sse2;
+    c->yuv2yuvX = yuv2yuvX_sse2;
+}
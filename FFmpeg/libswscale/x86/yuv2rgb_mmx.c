@@ -33,6 +33,7 @@
 #include "libswscale/rgb2rgb.h"
 #include "libswscale/swscale.h"
 #include "libswscale/swscale_internal.h"
+#include "libavutil/cpu.h"
 #include "libavutil/x86_cpu.h"
 
 #define DITHER1XBPP // only for MMX
@@ -61,8 +62,246 @@ DECLARE_ASM_CONST(8, uint64_t, pb_07) = 0x0707070707070707ULL;
 #define RENAME(a) a ## _MMX2
 #include "yuv2rgb_template.c"
 
+#if HAVE_SSE
+/* SSE2 versions: 16 pixels per iteration, with the same arithmetic as the
+ * MMX code above, so that the output is identical. */
+
+DECLARE_ASM_CONST(16, uint64_t, sse2_00ffw)[2] = { 0x00ff00ff00ff00ffULL, 0x00ff00ff00ff00ffULL };
+/* gathers B G R of each BGRA/RGBA pixel into the low 12 bytes */
+DECLARE_ASM_CONST(16, uint8_t, ssse3_pack24)[16] = {
+    0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0x80, 0x80, 0x80, 0x80
+};
+
+/* coefficients of the context, widened to 128 bits */
+#define XMM_Y_COEFF  "0*16"
+#define XMM_VR_COEFF "1*16"
+#define XMM_UB_COEFF "2*16"
+#define XMM_VG_COEFF "3*16"
+#define XMM_UG_COEFF "4*16"
+#define XMM_Y_OFFSET "5*16"
+#define XMM_U_OFFSET "6*16"
+#define XMM_V_OFFSET "7*16"
+
+static void load_coeffs_sse2(SwsContext *c, uint64_t coeffs[8][2])
+{
+    const uint64_t *src[8] = { &c->yCoeff,  &c->vrCoeff, &c->ubCoeff, &c->vgCoeff,
+                               &c->ugCoeff, &c->yOffset, &c->uOffset, &c->vOffset };
+    int i;
+
+    for (i = 0; i < 8; i++)
+        coeffs[i][0] = coeffs[i][1] = *src[i];
+}
+
+/* Only used for even widths of at least 16 (see ff_yuv2rgb_init_mmx()).
+ * Each line is converted 16 pixels at a time; if the width is not a
+ * multiple of 16, the last 16 pixels are then converted again, overlapping
+ * the others, so nothing is written past the end of the line. */
+#define YUV2RGB_LOOP_SSE2(depth)                                     \
+    DECLARE_ALIGNED(16, uint64_t, coeffs)[8][2];                     \
+    int y, h_size = c->dstW;                                         \
+                                                                     \
+    load_coeffs_sse2(c, coeffs);                                     \
+    if (c->srcFormat == PIX_FMT_YUV422P) {                           \
+        srcStride[1] *= 2;                                           \
+        srcStride[2] *= 2;                                           \
+    }                                                                \
+                                                                     \
+    for (y = 0; y < srcSliceH; y++) {                                \
+        uint8_t *line_rgb     = dst[0] + (y + srcSliceY) * dstStride[0]; \
+        const uint8_t *line_y = src[0] +               y * srcStride[0]; \
+        const uint8_t *line_u = src[1] +        (y >> 1) * srcStride[1]; \
+        const uint8_t *line_v = src[2] +        (y >> 1) * srcStride[2]; \
+        int x = 0, n = h_size & ~15;                                 \
+                                                                     \
+        while (n > 0) {                                              \
+        uint8_t *image    = line_rgb + x * depth;                    \
+        const uint8_t *py = line_y + x;                              \
+        const uint8_t *pu = line_u + x / 2;                          \
+        const uint8_t *pv = line_v + x / 2;                          \
+        x86_reg index = -n / 2;                                      \
+                                                                     \
+        __asm__ volatile (                                           \
+            "1:                            \n\t"                     \
+            "pxor           %%xmm4, %%xmm4 \n\t"                     \
+            "movdqu   (%5, %0, 2),  %%xmm6 \n\t"                     \
+            "movq        (%2, %0),  %%xmm0 \n\t"                     \
+            "movq        (%3, %0),  %%xmm1 \n\t"                     \
+
+/* Input: xmm0 - U (8 elems), xmm1 - V (8 elems), xmm6 - Y (16 elems),
+ *        xmm4 - zero register
+ * Output: xmm0 - B, xmm1 - R, xmm2 - G (16 pixels each) */
+#define YUV2RGB_SSE2                                         \
+    "movdqa         %%xmm6, %%xmm7 \n\t"                     \
+    "punpcklbw      %%xmm4, %%xmm0 \n\t"                     \
+    "punpcklbw      %%xmm4, %%xmm1 \n\t"                     \
+    "pand "MANGLE(sse2_00ffw)", %%xmm6 \n\t"                 \
+    "psrlw              $8, %%xmm7 \n\t"                     \
+    "psllw              $3, %%xmm0 \n\t"                     \
+    "psllw              $3, %%xmm1 \n\t"                     \
+    "psllw              $3, %%xmm6 \n\t"                     \
+    "psllw              $3, %%xmm7 \n\t"                     \
+    "psubsw "XMM_U_OFFSET"(%4), %%xmm0 \n\t"                 \
+    "psubsw "XMM_V_OFFSET"(%4), %%xmm1 \n\t"                 \
+    "psubw  "XMM_Y_OFFSET"(%4), %%xmm6 \n\t"                 \
+    "psubw  "XMM_Y_OFFSET"(%4), %%xmm7 \n\t"                 \
+    "movdqa         %%xmm0, %%xmm2 \n\t"                     \
+    "movdqa         %%xmm1, %%xmm3 \n\t"                     \
+    "pmulhw "XMM_UG_COEFF"(%4), %%xmm2 \n\t"                 \
+    "pmulhw "XMM_VG_COEFF"(%4), %%xmm3 \n\t"                 \
+    "pmulhw "XMM_Y_COEFF "(%4), %%xmm6 \n\t"                 \
+    "pmulhw "XMM_Y_COEFF "(%4), %%xmm7 \n\t"                 \
+    "pmulhw "XMM_UB_COEFF"(%4), %%xmm0 \n\t"                 \
+    "pmulhw "XMM_VR_COEFF"(%4), %%xmm1 \n\t"                 \
+    "paddsw         %%xmm3, %%xmm2 \n\t"                     \
+    "movdqa         %%xmm7, %%xmm3 \n\t"                     \
+    "movdqa         %%xmm7, %%xmm5 \n\t"                     \
+    "paddsw         %%xmm0, %%xmm3 \n\t"                     \
+    "paddsw         %%xmm1, %%xmm5 \n\t"                     \
+    "paddsw         %%xmm2, %%xmm7 \n\t"                     \
+    "paddsw         %%xmm6, %%xmm0 \n\t"                     \
+    "paddsw         %%xmm6, %%xmm1 \n\t"                     \
+    "paddsw         %%xmm6, %%xmm2 \n\t"                     \
+    /* pack and interleave even/odd pixels */                \
+    "packuswb       %%xmm1, %%xmm0 \n\t"                     \
+    "packuswb       %%xmm5, %%xmm3 \n\t"                     \
+    "packuswb       %%xmm2, %%xmm2 \n\t"                     \
+    "movdqa         %%xmm0, %%xmm1 \n\t"                     \
+    "packuswb       %%xmm7, %%xmm7 \n\t"                     \
+    "punpcklbw      %%xmm3, %%xmm0 \n\t"                     \
+    "punpckhbw      %%xmm3, %%xmm1 \n\t"                     \
+    "punpcklbw      %%xmm7, %%xmm2 \n\t"                     \
+
+/* leaves pixels 0-3, 4-7, 8-11 and 12-15 in blue, green, xmm5 and alpha */
+#define RGB_PACK32_SSE2(red, green, blue, alpha)             \
+    "pcmpeqd  %%xmm"alpha", %%xmm"alpha"\n\t"                \
+    "movdqa   %%xmm"blue",  %%xmm5\n\t"                      \
+    "movdqa   %%xmm"red",   %%xmm6\n\t"                      \
+    "punpckhbw %%xmm"green", %%xmm5\n\t"                     \
+    "punpcklbw %%xmm"green", %%xmm"blue"\n\t"                \
+    "punpckhbw %%xmm"alpha", %%xmm6\n\t"                     \
+    "punpcklbw %%xmm"alpha", %%xmm"red"\n\t"                 \
+    "movdqa   %%xmm"blue",  %%xmm"green"\n\t"                \
+    "movdqa   %%xmm5,       %%xmm"alpha"\n\t"                \
+    "punpcklwd %%xmm"red",  %%xmm"blue"\n\t"                 \
+    "punpckhwd %%xmm"red",  %%xmm"green"\n\t"                \
+    "punpcklwd %%xmm6,      %%xmm5\n\t"                      \
+    "punpckhwd %%xmm6,      %%xmm"alpha"\n\t"                \
+
+#define STORE32_SSE2(blue, green, alpha)                     \
+    "movdqu   %%xmm"blue",   0(%1)\n\t"                      \
+    "movdqu   %%xmm"green", 16(%1)\n\t"                      \
+    "movdqu   %%xmm5,       32(%1)\n\t"                      \
+    "movdqu   %%xmm"alpha", 48(%1)\n\t"                      \
+
+/* drops the alpha bytes of 16 packed 32-bit pixels */
+#define STORE24_SSSE3(blue, green, alpha)                    \
+    "pshufb "MANGLE(ssse3_pack24)", %%xmm"blue"\n\t"         \
+    "pshufb "MANGLE(ssse3_pack24)", %%xmm"green"\n\t"        \
+    "pshufb "MANGLE(ssse3_pack24)", %%xmm5\n\t"              \
+    "pshufb "MANGLE(ssse3_pack24)", %%xmm"alpha"\n\t"        \
+    "movdqa   %%xmm"green", %%xmm6\n\t"                      \
+    "pslldq   $12,          %%xmm6\n\t"                      \
+    "psrldq   $4,           %%xmm"green"\n\t"                \
+    "por      %%xmm6,       %%xmm"blue"\n\t"                 \
+    "movdqa   %%xmm5,       %%xmm6\n\t"                      \
+    "pslldq   $8,           %%xmm6\n\t"                      \
+    "psrldq   $8,           %%xmm5\n\t"                      \
+    "por      %%xmm6,       %%xmm"green"\n\t"                \
+    "pslldq   $4,           %%xmm"alpha"\n\t"                \
+    "por      %%xmm"alpha", %%xmm5\n\t"                      \
+    "movdqu   %%xmm"blue",   0(%1)\n\t"                      \
+    "movdqu   %%xmm"green", 16(%1)\n\t"                      \
+    "movdqu   %%xmm5,       32(%1)\n\t"                      \
+
+#define YUV2RGB_ENDLOOP_SSE2(depth)                          \
+            "add $"AV_STRINGIFY(depth * 16)", %1\n\t"        \
+            "add                    $8, %0\n\t"              \
+            "js                     1b\n\t"                  \
+            : "+r" (index), "+r" (image)                     \
+            : "r" (pu - index), "r" (pv - index), "r" (coeffs), \
+              "r" (py - 2*index)                             \
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", \
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7",) \
+              "memory"                                       \
+        );                                                   \
+        if (x + n < h_size) {                                \
+            x = h_size - 16;                                 \
+            n = 16;                                          \
+        } else                                               \
+            n = 0;                                           \
+        }                                                    \
+    }                                                        \
+    return srcSliceH;                                        \
+
+static int yuv420_rgb32_SSE2(SwsContext *c, const uint8_t *src[], int srcStride[],
+                             int srcSliceY, int srcSliceH,
+                             uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(4)
+        YUV2RGB_SSE2
+        RGB_PACK32_SSE2(REG_RED, REG_GREEN, REG_BLUE, REG_ALPHA)
+        STORE32_SSE2(REG_BLUE, REG_GREEN, REG_ALPHA)
+    YUV2RGB_ENDLOOP_SSE2(4)
+}
+
+static int yuv420_bgr32_SSE2(SwsContext *c, const uint8_t *src[], int srcStride[],
+                             int srcSliceY, int srcSliceH,
+                             uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(4)
+        YUV2RGB_SSE2
+        RGB_PACK32_SSE2(REG_BLUE, REG_GREEN, REG_RED, REG_ALPHA)
+        STORE32_SSE2(REG_RED, REG_GREEN, REG_ALPHA)
+    YUV2RGB_ENDLOOP_SSE2(4)
+}
+
+#if HAVE_SSSE3
+static int yuv420_rgb24_SSSE3(SwsContext *c, const uint8_t *src[], int srcStride[],
+                              int srcSliceY, int srcSliceH,
+                              uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(3)
+        YUV2RGB_SSE2
+        RGB_PACK32_SSE2(REG_BLUE, REG_GREEN, REG_RED, REG_ALPHA)
+        STORE24_SSSE3(REG_RED, REG_GREEN, REG_ALPHA)
+    YUV2RGB_ENDLOOP_SSE2(3)
+}
+
+static int yuv420_bgr24_SSSE3(SwsContext *c, const uint8_t *src[], int srcStride[],
+                              int srcSliceY, int srcSliceH,
+                              uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(3)
+        YUV2RGB_SSE2
+        RGB_PACK32_SSE2(REG_RED, REG_GREEN, REG_BLUE, REG_ALPHA)
+        STORE24_SSSE3(REG_BLUE, REG_GREEN, REG_ALPHA)
+    YUV2RGB_ENDLOOP_SSE2(3)
+}
+#endif /* HAVE_SSSE3 */
+#endif /* HAVE_SSE */
+
 SwsFunc ff_yuv2rgb_init_mmx(SwsContext *c)
 {
+#if HAVE_SSE
+    if (c->flags & SWS_CPU_CAPS_SSE2 && c->dstW >= 16 && !(c->dstW & 1)) {
+        switch (c->dstFormat) {
+        case PIX_FMT_RGB32:
+            if (c->srcFormat != PIX_FMT_YUVA420P) return yuv420_rgb32_SSE2;
+            break;
+        case PIX_FMT_BGR32:
+            if (c->srcFormat != PIX_FMT_YUVA420P) return yuv420_bgr32_SSE2;
+            break;
+#if HAVE_SSSE3
+        case PIX_FMT_RGB24:
+            if (av_get_cpu_flags() & AV_CPU_FLAG_SSSE3) return yuv420_rgb24_SSSE3;
+            break;
+        case PIX_FMT_BGR24:
+            if (av_get_cpu_flags() & AV_CPU_FLAG_SSSE3) return yuv420_bgr24_SSSE3;
+            break;
+#endif
+        }
+    }
+#endif
     if (c->flags & SWS_CPU_CAPS_MMX2) {
         switch (c->dstFormat) {
         case PIX_FMT_RGB32:
@@ -0,0 +1,193 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Decode the first video stream of a file in N simultaneous codec contexts
+ * and report the total throughput, either with per-context slice threads
+ * or with the shared thread pool (avcodec_thread_pool_init()).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "libavformat/avformat.h"
+
+typedef struct Stream {
+    pthread_t thread;
+    AVFormatContext *fmt;
+    AVCodecContext *avctx;
+    AVPacket *pkts;
+    int nb_pkts;
+    int nb_frames;
+} Stream;
+
+static void usage(void)
+{
+    fprintf(stderr, "decode_bench [-n streams] [-t threads] [-p pool_threads] input\n"
+                    "Decode the first video stream of input in several contexts at once.\n"
+                    "-n\tnumber of simultaneous decodes (default 4)\n"
+                    "-t\tthread_count of each codec context (default 2)\n"
+                    "-p\tsize of the shared thread pool, 0 to start threads per context (default 0)\n");
+}
+
+static int open_stream(Stream *s, const char *filename, int thread_count)
+{
+    AVCodec *codec;
+    AVPacket pkt;
+    int i, idx = -1;
+
+    if (av_open_input_file(&s->fmt, filename, NULL, 0, NULL) < 0 ||
+        av_find_stream_info(s->fmt) < 0) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return -1;
+    }
+
+    for (i = 0; i < s->fmt->nb_streams; i++)
+        if (s->fmt->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
+            idx = i;
+            break;
+        }
+    if (idx < 0) {
+        fprintf(stderr, "No video stream in %s\n", filename);
+        return -1;
+    }
+
+    s->avctx = s->fmt->streams[idx]->codec;
+    codec    = avcodec_find_decoder(s->avctx->codec_id);
+    s->avctx->thread_count = thread_count;
+    s->avctx->thread_type  = FF_THREAD_SLICE;
+    if (!codec || avcodec_open(s->avctx, codec) < 0) {
+        fprintf(stderr, "Could not open the decoder\n");
+        return -1;
+    }
+
+    /* keep the demuxer out of the measurement */
+    while (av_read_frame(s->fmt, &pkt) >= 0) {
+        if (pkt.stream_index == idx && !av_dup_packet(&pkt)) {
+            s->pkts = av_realloc(s->pkts, (s->nb_pkts + 1) * sizeof(AVPacket));
+            if (!s->pkts)
+                return -1;
+            s->pkts[s->nb_pkts++] = pkt;
+        } else
+            av_free_packet(&pkt);
+    }
+
+    return 0;
+}
+
+static void *decode_thread(void *arg)
+{
+    Stream *s = arg;
+    AVFrame *frame = avcodec_alloc_frame();
+    AVPacket flush;
+    int i, got_picture;
+
+    for (i = 0; i < s->nb_pkts; i++) {
+        AVPacket pkt = s->pkts[i];
+
+        while (pkt.size > 0) {
+            int ret = avcodec_decode_video2(s->avctx, frame, &got_picture, &pkt);
+            if (ret < 0)
+                break;
+            s->nb_frames += !!got_picture;
+            pkt.data += ret;
+            pkt.size -= ret;
+        }
+    }
+
+    av_init_packet(&flush);
+    flush.data = NULL;
+    flush.size = 0;
+    do {
+        avcodec_decode_video2(s->avctx, frame, &got_picture, &flush);
+        s->nb_frames += !!got_picture;
+    } while (got_picture);
+
+    av_free(frame);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int nb_streams = 4, thread_count = 2, pool_threads = 0;
+    int i, j, opt, nb_frames = 0;
+    Stream *streams;
+    int64_t start, elapsed;
+
+    while ((opt = getopt(argc, argv, "n:t:p:h")) != -1) {
+        switch (opt) {
+        case 'n': nb_streams   = atoi(optarg); break;
+        case 't': thread_count = atoi(optarg); break;
+        case 'p': pool_threads = atoi(optarg); break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || nb_streams < 1) {
+        usage();
+        return 1;
+    }
+
+    av_register_all();
+
+    if (pool_threads > 0 && avcodec_thread_pool_init(pool_threads) < 0) {
+        fprintf(stderr, "Could not start the thread pool\n");
+        return 1;
+    }
+
+    streams = av_mallocz(nb_streams * sizeof(Stream));
+    if (!streams)
+        return 1;
+    for (i = 0; i < nb_streams; i++)
+        if (open_stream(&streams[i], argv[optind], thread_count) < 0)
+            return 1;
+
+    start = av_gettime();
+    for (i = 0; i < nb_streams; i++)
+        if (pthread_create(&streams[i].thread, NULL, decode_thread, &streams[i])) {
+            fprintf(stderr, "Could not start decoding thread %d\n", i);
+            return 1;
+        }
+    for (i = 0; i < nb_streams; i++) {
+        pthread_join(streams[i].thread, NULL);
+        nb_frames += streams[i].nb_frames;
+    }
+    elapsed = FFMAX(av_gettime() - start, 1);
+
+    printf("streams=%d threads=%d pool=%d decoding_threads=%d frames=%d time=%0.3fs fps=%0.1f\n",
+           nb_streams, thread_count, pool_threads,
+           pool_threads > 0 ? pool_threads + nb_streams : nb_streams * (thread_count > 1 ? thread_count + 1 : 1),
+           nb_frames, elapsed / 1000000.0, nb_frames * 1000000.0 / elapsed);
+
+    for (i = 0; i < nb_streams; i++) {
+        for (j = 0; j < streams[i].nb_pkts; j++)
+            av_free_packet(&streams[i].pkts[j]);
+        av_free(streams[i].pkts);
+        if (streams[i].avctx)
+            avcodec_close(streams[i].avctx);
+        av_close_input_file(streams[i].fmt);
+    }
+    av_free(streams);
+    avcodec_thread_pool_free();
+
+    return 0;
+}
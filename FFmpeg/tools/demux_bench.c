@@ -0,0 +1,117 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Demux a file several times without decoding and report the throughput
+ * of the demuxer, optionally keeping only the audio streams and the
+ * programs that contain them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libavformat/avformat.h"
+
+static void usage(void)
+{
+    fprintf(stderr, "demux_bench [-n runs] [-a] input\n"
+                    "Read all packets of input and report the demuxing speed.\n"
+                    "-n\tnumber of times the input is demuxed (default 10)\n"
+                    "-a\tdiscard everything but audio, like an audio-only receiver\n");
+}
+
+/* discard the non-audio streams, and the programs without audio */
+static void keep_audio_only(AVFormatContext *fmt)
+{
+    int i, j;
+
+    for (i = 0; i < fmt->nb_streams; i++)
+        if (fmt->streams[i]->codec->codec_type != AVMEDIA_TYPE_AUDIO)
+            fmt->streams[i]->discard = AVDISCARD_ALL;
+
+    for (i = 0; i < fmt->nb_programs; i++) {
+        AVProgram *program = fmt->programs[i];
+        int has_audio = 0;
+
+        for (j = 0; j < program->nb_stream_indexes; j++)
+            has_audio |= fmt->streams[program->stream_index[j]]->codec->codec_type == AVMEDIA_TYPE_AUDIO;
+        if (!has_audio)
+            program->discard = AVDISCARD_ALL;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int nb_runs = 10, audio_only = 0;
+    int run, opt;
+    int64_t nb_packets = 0, nb_bytes = 0, file_size = 0, elapsed = 0;
+
+    while ((opt = getopt(argc, argv, "n:ah")) != -1) {
+        switch (opt) {
+        case 'n': nb_runs    = atoi(optarg); break;
+        case 'a': audio_only = 1;            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || nb_runs < 1) {
+        usage();
+        return 1;
+    }
+
+    av_register_all();
+
+    for (run = 0; run < nb_runs; run++) {
+        AVFormatContext *fmt;
+        AVPacket pkt;
+        int64_t start;
+
+        if (av_open_input_file(&fmt, argv[optind], NULL, 0, NULL) < 0 ||
+            av_find_stream_info(fmt) < 0) {
+            fprintf(stderr, "Could not open %s\n", argv[optind]);
+            return 1;
+        }
+        if (audio_only)
+            keep_audio_only(fmt);
+        if (!run)
+            printf("%s: %s, %d streams, %d programs\n", argv[optind],
+                   fmt->iformat->name, fmt->nb_streams, fmt->nb_programs);
+        file_size += url_fsize(fmt->pb);
+
+        start = av_gettime();
+        while (av_read_frame(fmt, &pkt) >= 0) {
+            nb_packets++;
+            nb_bytes += pkt.size;
+            av_free_packet(&pkt);
+        }
+        elapsed += av_gettime() - start;
+
+        av_close_input_file(fmt);
+    }
+    elapsed = FFMAX(elapsed, 1);
+
+    printf("runs=%d packets=%"PRId64" payload=%0.1fMB time=%0.3fs "
+           "input=%0.1fMB/s packets=%0.0f/s\n",
+           nb_runs, nb_packets, nb_bytes / 1000000.0, elapsed / 1000000.0,
+           (double)file_size / elapsed, nb_packets * 1000000.0 / elapsed);
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Find all start codes of an elementary stream (or of random data) several
+ * times and report the scanning speed of ff_find_start_code() and of the C
+ * and CPU specific start code candidate scanners, compared with scanning
+ * byte by byte.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavcodec/mpegvideo.h"
+#include "libavcodec/startcode.h"
+#include "libavformat/avformat.h"
+
+static void usage(void)
+{
+    fprintf(stderr, "startcode_bench [-n runs] [-s size] [input]\n"
+                    "Find all start codes of input and report the scanning speed.\n"
+                    "-n\tnumber of times the input is scanned (default 10)\n"
+                    "-s\tsize in MB of the random data scanned without input (default 64)\n");
+}
+
+/* ff_find_start_code() as it was before it used ff_startcode_find_candidate() */
+static const uint8_t *find_start_code_bytewise(const uint8_t *p, const uint8_t *end,
+                                               uint32_t *state)
+{
+    int i;
+
+    if (p >= end)
+        return end;
+
+    for (i = 0; i < 3; i++) {
+        uint32_t tmp = *state << 8;
+        *state = tmp + *(p++);
+        if (tmp == 0x100 || p == end)
+            return p;
+    }
+
+    while (p < end) {
+        if      (p[-1] > 1       ) p += 3;
+        else if (p[-2]           ) p += 2;
+        else if (p[-3]|(p[-1]-1)) p++;
+        else {
+            p++;
+            break;
+        }
+    }
+
+    p = FFMIN(p, end) - 4;
+    *state = AV_RB32(p);
+
+    return p + 4;
+}
+
+static int64_t count_start_codes(const uint8_t *(*find)(const uint8_t *, const uint8_t *, uint32_t *),
+                                 const uint8_t *buf, int size)
+{
+    const uint8_t *p = buf, *end = buf + size;
+    int64_t count = 0;
+
+    while (p < end) {
+        uint32_t state = -1;
+        p = find(p, end, &state);
+        count += (state & 0xFFFFFF00) == 0x100;
+    }
+    return count;
+}
+
+static int64_t count_candidates(int (*find)(const uint8_t *, int),
+                                const uint8_t *buf, int size)
+{
+    int64_t count = 0;
+    int i = 0;
+
+    while ((i += find(buf + i, size - i)) < size) {
+        count++;
+        i++;
+    }
+    return count;
+}
+
+static uint8_t *read_file(const char *name, int *size)
+{
+    FILE *f = fopen(name, "rb");
+    uint8_t *buf = NULL;
+    long len;
+
+    if (!f)
+        return NULL;
+    if (!fseek(f, 0, SEEK_END) && (len = ftell(f)) > 0 && len < INT_MAX &&
+        !fseek(f, 0, SEEK_SET) && (buf = av_malloc(len))) {
+        if (fread(buf, 1, len, f) == len)
+            *size = len;
+        else
+            av_freep(&buf);
+    }
+    fclose(f);
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    int nb_runs = 10, size = 64, run, opt, i;
+    int64_t count, start, elapsed;
+    uint8_t *buf;
+
+    while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+        switch (opt) {
+        case 'n': nb_runs = atoi(optarg); break;
+        case 's': size    = atoi(optarg); break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (optind < argc - 1 || nb_runs < 1 || size < 1 || size > 1024) {
+        usage();
+        return 1;
+    }
+
+    if (optind < argc) {
+        if (!(buf = read_file(argv[optind], &size))) {
+            fprintf(stderr, "Could not read %s\n", argv[optind]);
+            return 1;
+        }
+    } else {
+        AVLFG lfg;
+
+        size <<= 20;
+        if (!(buf = av_malloc(size)))
+            return 1;
+        av_lfg_init(&lfg, 1);
+        for (i = 0; i < size; i += 4)
+            AV_WN32(buf + i, av_lfg_get(&lfg));
+    }
+    printf("%d bytes\n", size);
+
+#define BENCH(name, expr)                                                   \
+    elapsed = 0;                                                            \
+    for (run = 0; run < nb_runs; run++) {                                   \
+        start = av_gettime();                                               \
+        count = expr;                                                       \
+        elapsed += av_gettime() - start;                                    \
+    }                                                                       \
+    elapsed = FFMAX(elapsed, 1);                                            \
+    printf("%-28s %10"PRId64" found %7.3fGB/s\n", name, count,             \
+           (double)size * nb_runs / elapsed / 1000.0)
+
+    BENCH("start codes, byte by byte",
+          count_start_codes(find_start_code_bytewise, buf, size));
+    BENCH("start codes",
+          count_start_codes(ff_find_start_code, buf, size));
+    BENCH("candidates, C",
+          count_candidates(ff_startcode_find_candidate_c, buf, size));
+    BENCH("candidates, CPU specific",
+          count_candidates(ff_startcode_find_candidate, buf, size));
+
+    av_free(buf);
+    return 0;
+}
@@ -23,100 +23,205 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #if defined(__WIN32__) || defined(_WIN32)
 #else
 #include <stddef.h>
+#include <pthread.h>
+#define USE_SHARD_LOCKS 1
 #endif
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-// When there are this many entries per bucket, on average, rebuild
-// the table to increase the number of buckets
-#define REBUILD_MULTIPLIER 3
+// The "hash" field of a slot that holds no entry.  (The hash of a key is
+// never one of these values.)  A slot whose entry was removed is marked
+// "DELETED_SLOT" rather than "EMPTY_SLOT", so that any probe sequence that
+// continues past it still finds its entry:
+#define EMPTY_SLOT 0
+#define DELETED_SLOT 1
+#define FIRST_HASH 2
+
+// A table is resized when it would become more than half full.  After that,
+// each "Add()" moves the entries from (at most) this many of the old slots
+// to the new slot array - which is enough for them all to have been moved
+// before the new slot array becomes half full in turn:
+#define NUM_SLOTS_TO_MOVE 8
+
+// The number of shards in a thread-safe table (which must be a power of 2):
+#define NUM_SHARDS_IF_THREAD_SAFE 16
+#define SHARD_SHIFT_IF_THREAD_SAFE 28 // 32 - log2(NUM_SHARDS_IF_THREAD_SAFE)
+
+class BasicHashTable::Shard {
+public:
+  Shard();
+  void init(Boolean threadSafe);
+  virtual ~Shard();
+
+  void lock() {
+#ifdef USE_SHARD_LOCKS
+    if (fIsThreadSafe) pthread_mutex_lock(&fMutex);
+#endif
+  }
+  void unlock() {
+#ifdef USE_SHARD_LOCKS
+    if (fIsThreadSafe) pthread_mutex_unlock(&fMutex);
+#endif
+  }
+
+  SlotArray fSlots; // the slot array that new entries are added to
+  SlotArray fOldSlots; // while resizing, the slot array whose entries are being moved to "fSlots"; otherwise its "fSlots" is NULL
+  unsigned fNextIndexToMove; // in "fOldSlots"
 
-BasicHashTable::BasicHashTable(int keyType)
-  : fBuckets(fStaticBuckets), fNumBuckets(SMALL_HASH_TABLE_SIZE),
-    fNumEntries(0), fRebuildSize(SMALL_HASH_TABLE_SIZE*REBUILD_MULTIPLIER),
-    fDownShift(28), fMask(0x3), fKeyType(keyType) {
-  for (unsigned i = 0; i < SMALL_HASH_TABLE_SIZE; ++i) {
-    fStaticBuckets[i] = NULL;
+private:
+#ifdef USE_SHARD_LOCKS
+  Boolean fIsThreadSafe;
+  pthread_mutex_t fMutex;
+#endif
+};
+
+BasicHashTable::BasicHashTable(int keyType, Boolean threadSafe)
+  : fNumShards(1), fShardShift(0), fKeyType(keyType) {
+#ifdef USE_SHARD_LOCKS
+  if (threadSafe) {
+    fNumShards = NUM_SHARDS_IF_THREAD_SAFE;
+    fShardShift = SHARD_SHIFT_IF_THREAD_SAFE;
   }
+#else
+  threadSafe = False; // we're not using threads
+#endif
+  fShards = new Shard[fNumShards];
+  for (unsigned i = 0; i < fNumShards; ++i) fShards[i].init(threadSafe);
 }
 
 BasicHashTable::~BasicHashTable() {
-  // Free all the entries in the table:
-  for (unsigned i = 0; i < fNumBuckets; ++i) {
-    TableEntry* entry;
-    while ((entry = fBuckets[i]) != NULL) {
-      deleteEntry(i, entry);
+  // Free all the keys in the table:
+  for (unsigned i = 0; i < fNumShards; ++i) {
+    SlotArray* slotArrays[2] = { &fShards[i].fSlots, &fShards[i].fOldSlots };
+    for (unsigned j = 0; j < 2; ++j) {
+      SlotArray& slots = *slotArrays[j];
+      if (slots.fSlots == NULL) continue;
+
+      for (unsigned index = slots.fFirstLiveIndex; index <= slots.fMask; ++index) {
+	if (slots.fSlots[index].hash >= FIRST_HASH) deleteKey(&slots.fSlots[index]);
+      }
     }
   }
 
-  // Also free the bucket array, if it was dynamically allocated:
-  if (fBuckets != fStaticBuckets) delete[] fBuckets;
+  delete[] fShards; // also frees the slot arrays
 }
 
 void* BasicHashTable::Add(char const* key, void* value) {
+  unsigned hash = hashFromKey(key);
+  Shard& shard = shardFromHash(hash);
+  shard.lock();
+
+  // If we're resizing, then continue moving entries to the new slot array:
+  if (shard.fOldSlots.fSlots != NULL) moveSomeEntries(shard, NUM_SLOTS_TO_MOVE);
+
   void* oldValue;
-  unsigned index;
-  TableEntry* entry = lookupKey(key, index);
+  SlotArray* slots;
+  TableEntry* entry = lookupKey(shard, key, hash, slots);
   if (entry != NULL) {
     // There's already an item with this key
     oldValue = entry->value;
   } else {
-    // There's no existing entry; create a new one:
-    entry = insertNewEntry(index, key);
+    // There's no existing entry; create a new one (after first making room for it, if necessary):
+    growIfNecessary(shard);
+    entry = insertEntry(shard.fSlots, hash);
+    assignKey(entry, key);
     oldValue = NULL;
   }
   entry->value = value;
 
-  // If the table has become too large, rebuild it with more buckets:
-  if (fNumEntries >= fRebuildSize) rebuild();
-
+  shard.unlock();
   return oldValue;
 }
 
 Boolean BasicHashTable::Remove(char const* key) {
-  unsigned index;
-  TableEntry* entry = lookupKey(key, index);
-  if (entry == NULL) return False; // no such entry
+  unsigned hash = hashFromKey(key);
+  Shard& shard = shardFromHash(hash);
+  shard.lock();
 
-  deleteEntry(index, entry);
+  SlotArray* slots;
+  TableEntry* entry = lookupKey(shard, key, hash, slots);
+  if (entry != NULL) {
+    deleteKey(entry);
+    deleteEntry(*slots, entry);
+  }
 
-  return True;
+  shard.unlock();
+  return entry != NULL;
 }
 
 void* BasicHashTable::Lookup(char const* key) const {
-  unsigned index;
-  TableEntry* entry = lookupKey(key, index);
-  if (entry == NULL) return NULL; // no such entry
+  unsigned hash = hashFromKey(key);
+  Shard& shard = shardFromHash(hash);
+  shard.lock();
+
+  SlotArray* slots;
+  TableEntry* entry = lookupKey(shard, key, hash, slots);
+  void* value = entry == NULL ? NULL : entry->value;
 
-  return entry->value;
+  shard.unlock();
+  return value;
 }
 
 unsigned BasicHashTable::numEntries() const {
-  return fNumEntries;
+  unsigned result = 0;
+  for (unsigned i = 0; i < fNumShards; ++i) {
+    result += fShards[i].fSlots.fNumLive + fShards[i].fOldSlots.fNumLive;
+  }
+
+  return result;
 }
 
 BasicHashTable::Iterator::Iterator(BasicHashTable& table)
-  : fTable(table), fNextIndex(0), fNextEntry(NULL) {
+  : fTable(table), fShardIndex(0), fInOldSlots(True), fFoundEntryInSlots(False), fNextIndex(0) {
 }
 
 void* BasicHashTable::Iterator::next(char const*& key) {
-  while (fNextEntry == NULL) {
-    if (fNextIndex >= fTable.fNumBuckets) return NULL;
+  // Enumerate each shard's old slot array (if it's being resized), then its current slot array:
+  while (fShardIndex < fTable.fNumShards) {
+    Shard& shard = fTable.fShards[fShardIndex];
+    shard.lock();
+
+    SlotArray& slots = fInOldSlots ? shard.fOldSlots : shard.fSlots;
+    if (slots.fSlots != NULL) {
+      if (fNextIndex < slots.fFirstLiveIndex) fNextIndex = slots.fFirstLiveIndex;
+      for (; fNextIndex <= slots.fMask; ++fNextIndex) {
+	BasicHashTable::TableEntry* entry = &slots.fSlots[fNextIndex];
+	if (entry->hash < FIRST_HASH) continue;
+
+	// Note where the first entry is, so that the next iteration (e.g., by "RemoveNext()") can start there:
+	if (!fFoundEntryInSlots) {
+	  slots.fFirstLiveIndex = fNextIndex;
+	  fFoundEntryInSlots = True;
+	}
+	++fNextIndex;
+
+	key = entry->key;
+	void* value = entry->value;
+	shard.unlock();
+	return value;
+      }
+      if (!fFoundEntryInSlots) slots.fFirstLiveIndex = fNextIndex; // the slot array has no entries
+    }
 
-    fNextEntry = fTable.fBuckets[fNextIndex++];
+    shard.unlock();
+    if (fInOldSlots) {
+      fInOldSlots = False;
+    } else {
+      ++fShardIndex;
+      fInOldSlots = True;
+    }
+    fNextIndex = 0;
+    fFoundEntryInSlots = False;
   }
 
-  BasicHashTable::TableEntry* entry = fNextEntry;
-  fNextEntry = entry->fNext;
-
-  key = entry->key;
-  return entry->value;
+  return NULL;
 }
 
 ////////// Implementation of HashTable creation functions //////////
 
-HashTable* HashTable::create(int keyType) {
-  return new BasicHashTable(keyType);
+HashTable* HashTable::create(int keyType, Boolean threadSafe) {
+  return new BasicHashTable(keyType, threadSafe);
 }
 
 HashTable::Iterator* HashTable::Iterator::create(HashTable& hashTable) {
@@ -124,18 +229,76 @@ HashTable::Iterator* HashTable::Iterator::create(HashTable& hashTable) {
   return new BasicHashTable::Iterator((BasicHashTable&)hashTable);
 }
 
+////////// Implementation of "BasicHashTable::Shard" //////////
+
+BasicHashTable::Shard::Shard()
+  : fNextIndexToMove(0) {
+  fSlots.fSlots = fOldSlots.fSlots = NULL;
+  fSlots.fMask = fOldSlots.fMask = 0;
+  fSlots.fNumUsed = fOldSlots.fNumUsed = 0;
+  fSlots.fNumLive = fOldSlots.fNumLive = 0;
+  fSlots.fFirstLiveIndex = fOldSlots.fFirstLiveIndex = 0;
+#ifdef USE_SHARD_LOCKS
+  fIsThreadSafe = False;
+#endif
+}
+
+void BasicHashTable::Shard::init(Boolean threadSafe) {
+#ifdef USE_SHARD_LOCKS
+  fIsThreadSafe = threadSafe;
+  if (fIsThreadSafe) pthread_mutex_init(&fMutex, NULL);
+#endif
+}
+
+BasicHashTable::Shard::~Shard() {
+  free(fSlots.fSlots);
+  free(fOldSlots.fSlots);
+#ifdef USE_SHARD_LOCKS
+  if (fIsThreadSafe) pthread_mutex_destroy(&fMutex);
+#endif
+}
+
 ////////// Implementation of internal member functions //////////
 
-BasicHashTable::TableEntry* BasicHashTable
-::lookupKey(char const* key, unsigned& index) const {
-  TableEntry* entry;
-  index = hashIndexFromKey(key);
+BasicHashTable::Shard& BasicHashTable::shardFromHash(unsigned hash) const {
+  return fNumShards == 1 ? fShards[0] : fShards[hash >> fShardShift];
+}
+
+static unsigned finalMix(unsigned h) {
+  // The final mixing step of Austin Appleby's "MurmurHash3" - so that every bit of "h" affects every bit of the result:
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+unsigned BasicHashTable::hashFromKey(char const* key) const {
+  unsigned result;
 
-  for (entry = fBuckets[index]; entry != NULL; entry = entry->fNext) {
-    if (keyMatches(key, entry->key)) break;
+  if (fKeyType == STRING_HASH_KEYS) {
+    // Use the 32-bit "FNV-1a" hash:
+    result = 2166136261U;
+    while (1) {
+      unsigned char c = (unsigned char)*key++;
+      if (c == 0) break;
+      result = (result^c)*16777619U;
+    }
+    result = finalMix(result);
+  } else if (fKeyType == ONE_WORD_HASH_KEYS) {
+    unsigned long k = (unsigned long)key;
+    result = finalMix((unsigned)k + finalMix((unsigned)((k>>16)>>16))); // (two shifts, in case "long" is 32 bits)
+  } else {
+    unsigned* k = (unsigned*)key;
+    result = 0;
+    for (int i = 0; i < fKeyType; ++i) {
+      result = finalMix(result + k[i]);
+    }
   }
 
-  return entry;
+  if (result < FIRST_HASH) result += FIRST_HASH;
+  return result;
 }
 
 Boolean BasicHashTable
@@ -156,18 +319,6 @@ Boolean BasicHashTable
   }
 }
 
-BasicHashTable::TableEntry* BasicHashTable
-::insertNewEntry(unsigned index, char const* key) {
-  TableEntry* entry = new TableEntry();
-  entry->fNext = fBuckets[index];
-  fBuckets[index] = entry;
-
-  ++fNumEntries;
-  assignKey(entry, key);
-
-  return entry;
-}
-
 void BasicHashTable::assignKey(TableEntry* entry, char const* key) {
   // The way we assign the key depends upon its type:
   if (fKeyType == STRING_HASH_KEYS) {
@@ -183,32 +334,6 @@ void BasicHashTable::assignKey(TableEntry* entry, char const* key) {
   }
 }
 
-void BasicHashTable::deleteEntry(unsigned index, TableEntry* entry) {
-  TableEntry** ep = &fBuckets[index];
-
-  Boolean foundIt = False;
-  while (*ep != NULL) {
-    if (*ep == entry) {
-      foundIt = True;
-      *ep = entry->fNext;
-      break;
-    }
-    ep = &((*ep)->fNext);
-  }
-
-  if (!foundIt) { // shouldn't happen
-#ifdef DEBUG
-    fprintf(stderr, "BasicHashTable[%p]::deleteEntry(%d,%p): internal error - not found (first entry %p", this, index, entry, fBuckets[index]);
-    if (fBuckets[index] != NULL) fprintf(stderr, ", next entry %p", fBuckets[index]->fNext);
-    fprintf(stderr, ")\n");
-#endif
-  }
-
-  --fNumEntries;
-  deleteKey(entry);
-  delete entry;
-}
-
 void BasicHashTable::deleteKey(TableEntry* entry) {
   // The way we delete the key depends upon its type:
   if (fKeyType == ONE_WORD_HASH_KEYS) {
@@ -219,60 +344,116 @@ void BasicHashTable::deleteKey(TableEntry* entry) {
   }
 }
 
-void BasicHashTable::rebuild() {
-  // Remember the existing table size:
-  unsigned oldSize = fNumBuckets;
-  TableEntry** oldBuckets = fBuckets;
+BasicHashTable::TableEntry* BasicHashTable
+::lookupKey(Shard& shard, char const* key, unsigned hash, SlotArray*& slots) const {
+  TableEntry* entry;
+
+  slots = &shard.fSlots;
+  entry = lookupKey(*slots, key, hash);
+  if (entry == NULL && shard.fOldSlots.fSlots != NULL) {
+    // We're resizing, so the entry might not have been moved yet:
+    slots = &shard.fOldSlots;
+    entry = lookupKey(*slots, key, hash);
+  }
+
+  return entry;
+}
 
-  // Create the new sized table:
-  fNumBuckets *= 4;
-  fBuckets = new TableEntry*[fNumBuckets];
-  for (unsigned i = 0; i < fNumBuckets; ++i) {
-    fBuckets[i] = NULL;
+BasicHashTable::TableEntry* BasicHashTable
+::lookupKey(SlotArray& slots, char const* key, unsigned hash) const {
+  if (slots.fSlots == NULL) return NULL;
+
+  // Probe each slot, starting from the one indexed by the hash, until we find the entry, or an empty slot.
+  // (There's always an empty slot, because we don't let a slot array become more than half full.)
+  for (unsigned index = hash&slots.fMask; ; index = (index+1)&slots.fMask) {
+    TableEntry* entry = &slots.fSlots[index];
+    if (entry->hash == hash && keyMatches(key, entry->key)) return entry;
+    if (entry->hash == EMPTY_SLOT) return NULL;
   }
-  fRebuildSize *= 4;
-  fDownShift -= 2;
-  fMask = (fMask<<2)|0x3;
+}
 
-  // Rehash the existing entries into the new table:
-  for (TableEntry** oldChainPtr = oldBuckets; oldSize > 0;
-       --oldSize, ++oldChainPtr) {
-    for (TableEntry* hPtr = *oldChainPtr; hPtr != NULL;
-	 hPtr = *oldChainPtr) {
-      *oldChainPtr = hPtr->fNext;
+BasicHashTable::TableEntry* BasicHashTable::insertEntry(SlotArray& slots, unsigned hash) {
+  // Use the first empty or deleted slot in the probe sequence:
+  unsigned index = hash&slots.fMask;
+  while (slots.fSlots[index].hash >= FIRST_HASH) index = (index+1)&slots.fMask;
 
-      unsigned index = hashIndexFromKey(hPtr->key);
+  TableEntry* entry = &slots.fSlots[index];
+  if (entry->hash == EMPTY_SLOT) ++slots.fNumUsed;
+  ++slots.fNumLive;
+  if (index < slots.fFirstLiveIndex) slots.fFirstLiveIndex = index;
 
-      hPtr->fNext = fBuckets[index];
-      fBuckets[index] = hPtr;
+  entry->hash = hash;
+  return entry;
+}
+
+void BasicHashTable::deleteEntry(SlotArray& slots, TableEntry* entry) {
+  entry->hash = DELETED_SLOT;
+  --slots.fNumLive;
+
+  // If the next slot is empty, then no probe sequence continues past this one, so this slot - and any deleted slots
+  // just before it - can be marked empty again:
+  unsigned index = entry - slots.fSlots;
+  if (slots.fSlots[(index+1)&slots.fMask].hash == EMPTY_SLOT) {
+    while (slots.fSlots[index].hash == DELETED_SLOT) {
+      slots.fSlots[index].hash = EMPTY_SLOT;
+      --slots.fNumUsed;
+      index = (index-1)&slots.fMask;
     }
   }
+}
 
-  // Free the old bucket array, if it was dynamically allocated:
-  if (oldBuckets != fStaticBuckets) delete[] oldBuckets;
+void BasicHashTable::allocateSlots(SlotArray& slots, unsigned numSlots) {
+  // Note: We use "calloc()" - rather than initializing each slot to "EMPTY_SLOT" (i.e., 0) ourself - because (for a large
+  // slot array) it gets memory that the OS zeroes only as it's first used, so allocating it doesn't take long:
+  slots.fSlots = (TableEntry*)calloc(numSlots, sizeof (TableEntry));
+  slots.fMask = numSlots - 1;
+  slots.fNumUsed = slots.fNumLive = 0;
+  slots.fFirstLiveIndex = numSlots;
 }
 
-unsigned BasicHashTable::hashIndexFromKey(char const* key) const {
-  unsigned result = 0;
+void BasicHashTable::growIfNecessary(Shard& shard) {
+  SlotArray& slots = shard.fSlots;
+  if (slots.fSlots != NULL && (slots.fNumUsed+1)*2 <= slots.fMask+1) return; // there's room for another entry
 
-  if (fKeyType == STRING_HASH_KEYS) {
-    while (1) {
-      char c = *key++;
-      if (c == 0) break;
-      result += (result<<3) + (unsigned)c;
-    }
-    result &= fMask;
-  } else if (fKeyType == ONE_WORD_HASH_KEYS) {
-    result = randomIndex((unsigned long)key);
+  // If we haven't yet finished moving the entries from a previous resize, then do so now.  (This shouldn't happen.)
+  if (shard.fOldSlots.fSlots != NULL) moveSomeEntries(shard, ~0);
+
+  // Choose a new size that will be at most one quarter full (which might be no larger than the current size, if many of
+  // the current slots are 'deleted' ones):
+  unsigned numSlots = SMALL_HASH_TABLE_SIZE;
+  while (numSlots < (slots.fNumLive+1)*4) numSlots *= 2;
+
+  if (slots.fSlots == NULL) {
+    allocateSlots(slots, numSlots);
   } else {
-    unsigned* k = (unsigned*)key;
-    unsigned long sum = 0;
-    for (int i = 0; i < fKeyType; ++i) {
-      sum += k[i];
-    }
-    result = randomIndex(sum);
+    // Keep the current slot array until its entries have all been moved to the new one:
+    shard.fOldSlots = slots;
+    shard.fNextIndexToMove = slots.fFirstLiveIndex;
+    allocateSlots(slots, numSlots);
+    if (shard.fOldSlots.fNumLive == 0) moveSomeEntries(shard, 0); // just frees it
   }
-
-  return result;
 }
 
+void BasicHashTable::moveSomeEntries(Shard& shard, unsigned maxNumSlots) {
+  SlotArray& oldSlots = shard.fOldSlots;
+  while (maxNumSlots-- > 0 && shard.fNextIndexToMove <= oldSlots.fMask && oldSlots.fNumLive > 0) {
+    TableEntry* oldEntry = &oldSlots.fSlots[shard.fNextIndexToMove++];
+    if (oldEntry->hash < FIRST_HASH) continue;
+
+    TableEntry* entry = insertEntry(shard.fSlots, oldEntry->hash);
+    entry->key = oldEntry->key;
+    entry->value = oldEntry->value;
+
+    // Leave a 'deleted' slot behind, so that lookups in the old slot array still find the entries after it:
+    oldEntry->hash = DELETED_SLOT;
+    --oldSlots.fNumLive;
+  }
+
+  if (oldSlots.fNumLive == 0) {
+    // We've moved all of the entries:
+    free(oldSlots.fSlots);
+    oldSlots.fSlots = NULL;
+    oldSlots.fMask = oldSlots.fNumUsed = 0;
+    oldSlots.fFirstLiveIndex = 0;
+  }
+}
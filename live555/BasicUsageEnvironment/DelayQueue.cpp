@@ -19,6 +19,7 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 // Implementation
 
 #include "DelayQueue.hh"
+#include "HashTable.hh"
 #include "GroupsockHelper.hh"
 
 static const int MILLION = 1000000;
@@ -89,12 +90,8 @@ const DelayInterval ETERNITY(INT_MAX, MILLION-1);
 
 ///// DelayQueueEntry /////
 
-long DelayQueueEntry::tokenCounter = 0;
-
 DelayQueueEntry::DelayQueueEntry(DelayInterval delay)
-  : fDeltaTimeRemaining(delay) {
-  fNext = fPrev = this;
-  fToken = ++tokenCounter;
+  : fDelay(delay), fHeapIndex(0), fSequenceNum(0), fToken(0) {
 }
 
 DelayQueueEntry::~DelayQueueEntry() {
@@ -108,36 +105,47 @@ void DelayQueueEntry::handleTimeout() {
 ///// DelayQueue /////
 
 DelayQueue::DelayQueue()
-  : DelayQueueEntry(ETERNITY) {
+  : fHeap(NULL), fHeapSize(0), fNumEntries(0), fSequenceCounter(0),
+    fTokenCounter(0), fTimeToNextAlarm(DELAY_ZERO) {
+  fEntriesByToken = HashTable::create(ONE_WORD_HASH_KEYS);
   fLastSyncTime = TimeNow();
 }
 
 DelayQueue::~DelayQueue() {
-  while (fNext != this) removeEntry(fNext);
+  while (fNumEntries > 0) removeEntry(head());
+  delete[] fHeap;
+  delete fEntriesByToken;
 }
 
 void DelayQueue::addEntry(DelayQueueEntry* newEntry) {
   synchronize();
 
-  DelayQueueEntry* cur = head();
-  while (newEntry->fDeltaTimeRemaining >= cur->fDeltaTimeRemaining) {
-    newEntry->fDeltaTimeRemaining -= cur->fDeltaTimeRemaining;
-    cur = cur->fNext;
+  newEntry->fDueTime = fLastSyncTime;
+  newEntry->fDueTime += newEntry->fDelay;
+  newEntry->fSequenceNum = ++fSequenceCounter;
+  // An entry keeps its token when it's rescheduled (by "updateEntry()"):
+  if (newEntry->fToken == 0) newEntry->fToken = ++fTokenCounter;
+
+  if (fNumEntries + 1 >= fHeapSize) {
+    // Grow the heap array:
+    unsigned newHeapSize = fHeapSize == 0 ? 64 : 2*fHeapSize;
+    DelayQueueEntry** newHeap = new DelayQueueEntry*[newHeapSize];
+    for (unsigned i = 1; i <= fNumEntries; ++i) newHeap[i] = fHeap[i];
+    delete[] fHeap;
+    fHeap = newHeap;
+    fHeapSize = newHeapSize;
   }
+  placeEntry(newEntry, ++fNumEntries);
+  siftUp(fNumEntries);
 
-  cur->fDeltaTimeRemaining -= newEntry->fDeltaTimeRemaining;
-
-  // Add "newEntry" to the queue, just before "cur":
-  newEntry->fNext = cur;
-  newEntry->fPrev = cur->fPrev;
-  cur->fPrev = newEntry->fPrev->fNext = newEntry;
+  fEntriesByToken->Add((char const*)(newEntry->token()), newEntry);
 }
 
 void DelayQueue::updateEntry(DelayQueueEntry* entry, DelayInterval newDelay) {
   if (entry == NULL) return;
 
   removeEntry(entry);
-  entry->fDeltaTimeRemaining = newDelay;
+  entry->fDelay = newDelay;
   addEntry(entry);
 }
 
@@ -147,13 +155,19 @@ void DelayQueue::updateEntry(long tokenToFind, DelayInterval newDelay) {
 }
 
 void DelayQueue::removeEntry(DelayQueueEntry* entry) {
-  if (entry == NULL || entry->fNext == NULL) return;
+  if (entry == NULL || entry->fHeapIndex == 0) return;
+
+  // Replace the entry with the last one in the heap, then move that one into place:
+  unsigned index = entry->fHeapIndex;
+  DelayQueueEntry* last = fHeap[fNumEntries--];
+  if (index <= fNumEntries) {
+    placeEntry(last, index);
+    siftUp(index);
+    siftDown(last->fHeapIndex);
+  }
+  entry->fHeapIndex = 0; // in case we should try to remove it again
 
-  entry->fNext->fDeltaTimeRemaining += entry->fDeltaTimeRemaining;
-  entry->fPrev->fNext = entry->fNext;
-  entry->fNext->fPrev = entry->fPrev;
-  entry->fNext = entry->fPrev = NULL;
-  // in case we should try to remove it again
+  fEntriesByToken->Remove((char const*)(entry->token()));
 }
 
 DelayQueueEntry* DelayQueue::removeEntry(long tokenToFind) {
@@ -163,16 +177,19 @@ DelayQueueEntry* DelayQueue::removeEntry(long tokenToFind) {
 }
 
 DelayInterval const& DelayQueue::timeToNextAlarm() {
-  if (head()->fDeltaTimeRemaining == DELAY_ZERO) return DELAY_ZERO; // a common case
+  if (fNumEntries == 0) return ETERNITY;
+  if (head()->fDueTime <= fLastSyncTime) return DELAY_ZERO; // a common case
 
   synchronize();
-  return head()->fDeltaTimeRemaining;
+  fTimeToNextAlarm = head()->fDueTime - fLastSyncTime; // (DELAY_ZERO if it's due)
+  return fTimeToNextAlarm;
 }
 
 void DelayQueue::handleAlarm() {
-  if (head()->fDeltaTimeRemaining != DELAY_ZERO) synchronize();
+  if (fNumEntries == 0) return;
+  if (fLastSyncTime < head()->fDueTime) synchronize();
 
-  if (head()->fDeltaTimeRemaining == DELAY_ZERO) {
+  if (head()->fDueTime <= fLastSyncTime) {
     // This event is due to be handled:
     DelayQueueEntry* toRemove = head();
     removeEntry(toRemove); // do this first, in case handler accesses queue
@@ -182,34 +199,53 @@ void DelayQueue::handleAlarm() {
 }
 
 DelayQueueEntry* DelayQueue::findEntryByToken(long tokenToFind) {
-  DelayQueueEntry* cur = head();
-  while (cur != this) {
-    if (cur->token() == tokenToFind) return cur;
-    cur = cur->fNext;
-  }
-
-  return NULL;
+  return (DelayQueueEntry*)(fEntriesByToken->Lookup((char const*)tokenToFind));
 }
 
 void DelayQueue::synchronize() {
-  // First, figure out how much time has elapsed since the last sync:
   EventTime timeNow = TimeNow();
   if (timeNow < fLastSyncTime) {
-    // The system clock has apparently gone back in time; reset our sync time and return:
-    fLastSyncTime  = timeNow;
-    return;
+    // The system clock has apparently gone back in time.  Move each entry's due time back
+    // by the same amount, so that it remains due after the same delay.  (This doesn't change
+    // the order of the entries.)
+    DelayInterval timeWentBack = fLastSyncTime - timeNow;
+    for (unsigned i = 1; i <= fNumEntries; ++i) fHeap[i]->fDueTime -= timeWentBack;
   }
-  DelayInterval timeSinceLastSync = timeNow - fLastSyncTime;
   fLastSyncTime = timeNow;
+}
+
+int DelayQueue::isEarlier(DelayQueueEntry const* entry1, DelayQueueEntry const* entry2) const {
+  if (entry1->fDueTime != entry2->fDueTime) return entry1->fDueTime < entry2->fDueTime;
+
+  // Entries that are due at the same time are handled in the order in which they were added:
+  return entry1->fSequenceNum < entry2->fSequenceNum;
+}
+
+void DelayQueue::placeEntry(DelayQueueEntry* entry, unsigned index) {
+  fHeap[index] = entry;
+  entry->fHeapIndex = index;
+}
+
+void DelayQueue::siftUp(unsigned index) {
+  DelayQueueEntry* entry = fHeap[index];
+  while (index > 1 && isEarlier(entry, fHeap[index/2])) {
+    placeEntry(fHeap[index/2], index);
+    index /= 2;
+  }
+  placeEntry(entry, index);
+}
+
+void DelayQueue::siftDown(unsigned index) {
+  DelayQueueEntry* entry = fHeap[index];
+  while (2*index <= fNumEntries) {
+    unsigned child = 2*index;
+    if (child < fNumEntries && isEarlier(fHeap[child+1], fHeap[child])) ++child;
+    if (!isEarlier(fHeap[child], entry)) break;
 
-  // Then, adjust the delay queue for any entries whose time is up:
-  DelayQueueEntry* curEntry = head();
-  while (timeSinceLastSync >= curEntry->fDeltaTimeRemaining) {
-    timeSinceLastSync -= curEntry->fDeltaTimeRemaining;
-    curEntry->fDeltaTimeRemaining = DELAY_ZERO;
-    curEntry = curEntry->fNext;
+    placeEntry(fHeap[child], index);
+    index = child;
   }
-  curEntry->fDeltaTimeRemaining -= timeSinceLastSync;
+  placeEntry(entry, index);
 }
 
 
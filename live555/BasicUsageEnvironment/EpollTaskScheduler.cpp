@@ -0,0 +1,264 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// Copyright (c) 1996-2011 Live Networks, Inc.  All rights reserved.
+// Basic Usage Environment: for a simple, non-scripted, console application
+// Implementation of a task scheduler that uses "epoll()" (Linux only)
+
+#if defined(__linux__)
+
+#include "BasicUsageEnvironment.hh"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+////////// EpollTaskScheduler //////////
+
+// What we know about each socket that has a handler:
+struct EpollTaskScheduler::SocketRecord {
+  int conditionSet; // 0 iff the socket has no handler
+  TaskScheduler::BackgroundHandlerProc* handlerProc;
+  void* clientData;
+  unsigned generation;
+      // changed whenever the socket stops being handled, so that events for it
+      // that "epoll_wait()" has already returned won't be handled by a later user
+      // of the same socket number
+  Boolean alwaysReady; // "epoll()" can't handle this descriptor (e.g., a file)
+};
+
+#define MAX_EPOLL_EVENTS 256 // the most events that we get from a single "epoll_wait()"
+
+#define MAX_SCHEDULER_GRANULARITY 10000 // 10 milliseconds: We will return to the event loop at least this often
+static void schedulerTickTask(void* clientData) {
+  ((EpollTaskScheduler*)clientData)->scheduleDelayedTask(MAX_SCHEDULER_GRANULARITY, schedulerTickTask, clientData);
+}
+
+EpollTaskScheduler* EpollTaskScheduler::createNew() {
+  int epollFd = epoll_create(MAX_EPOLL_EVENTS/*ignored, but must be > 0*/);
+  if (epollFd < 0) return NULL;
+
+  return new EpollTaskScheduler(epollFd);
+}
+
+EpollTaskScheduler::EpollTaskScheduler(int epollFd)
+  : fEpollFd(epollFd), fSocketTable(NULL), fSocketTableSize(0),
+    fNumReadyEvents(0), fNextReadyEvent(0), fNumAlwaysReadySockets(0) {
+  fReadyEvents = new struct epoll_event[MAX_EPOLL_EVENTS];
+
+  schedulerTickTask(this); // ensures that we handle events frequently
+}
+
+EpollTaskScheduler::~EpollTaskScheduler() {
+  close(fEpollFd);
+  delete[] fReadyEvents;
+  delete[] fSocketTable;
+}
+
+#ifndef MILLION
+#define MILLION 1000000
+#endif
+
+void EpollTaskScheduler::SingleStep(unsigned maxDelayTime) {
+  if (fNextReadyEvent >= fNumReadyEvents) {
+    // We've handled all of the events from our last "epoll_wait()", so wait for more.
+    // (If some descriptors are always ready, just poll.)
+    int64_t uSecondsToDelay = 0;
+    if (fNumAlwaysReadySockets == 0) {
+      DelayInterval const& timeToDelay = fDelayQueue.timeToNextAlarm();
+      // Don't wait any longer than 1 million seconds (11.5 days):
+      long secondsToDelay = timeToDelay.seconds();
+      if (secondsToDelay > MILLION) secondsToDelay = MILLION;
+      uSecondsToDelay = (int64_t)secondsToDelay*MILLION + timeToDelay.useconds();
+      // Also check our "maxDelayTime" parameter (if it's > 0):
+      if (maxDelayTime > 0 && uSecondsToDelay > (int64_t)maxDelayTime) {
+	uSecondsToDelay = maxDelayTime;
+      }
+    }
+
+    // "epoll_wait()" counts in milliseconds; round up, so that we don't spin:
+    int numReadyEvents = epoll_wait(fEpollFd, fReadyEvents, MAX_EPOLL_EVENTS,
+				    (int)((uSecondsToDelay + 999)/1000));
+    if (numReadyEvents < 0) {
+      if (errno != EINTR) {
+	// Unexpected error - treat this as fatal:
+	perror("EpollTaskScheduler::SingleStep(): epoll_wait() fails");
+	internalError();
+      }
+      numReadyEvents = 0;
+    }
+    fNumReadyEvents = numReadyEvents;
+    fNextReadyEvent = 0;
+  }
+
+  // Call the handler function for one ready socket:
+  Boolean handledSocket = False;
+  while (fNextReadyEvent < fNumReadyEvents) {
+    struct epoll_event const& event = fReadyEvents[fNextReadyEvent++];
+        // Note: we advance "fNextReadyEvent" before calling the handler,
+        // in case the handler calls "doEventLoop()" reentrantly.
+    int sock = (int)(event.data.u64&0xFFFFFFFF);
+    unsigned generation = (unsigned)(event.data.u64>>32);
+    SocketRecord* record = lookupSocketRecord(sock, False);
+    if (record == NULL || record->conditionSet == 0
+	|| record->generation != generation) continue; // no longer handled
+
+    int resultConditionSet = 0;
+    if (event.events&(EPOLLIN|EPOLLHUP|EPOLLERR)) resultConditionSet |= SOCKET_READABLE;
+    if (event.events&(EPOLLOUT|EPOLLERR)) resultConditionSet |= SOCKET_WRITABLE;
+    if (event.events&EPOLLPRI) resultConditionSet |= SOCKET_EXCEPTION;
+    resultConditionSet &= record->conditionSet;
+    if (resultConditionSet != 0 && record->handlerProc != NULL) {
+      fLastHandledSocketNum = sock;
+      (*record->handlerProc)(record->clientData, resultConditionSet);
+      handledSocket = True;
+      break;
+    }
+  }
+
+  if (!handledSocket && fNumAlwaysReadySockets > 0) {
+    // Call the handler for one of the descriptors that "epoll()" can't handle (these
+    // are always readable and writable, as with "select()").  To ensure forward progress
+    // through these, begin past the last socket number that we handled:
+    for (unsigned i = 1; i <= fSocketTableSize; ++i) {
+      int sock = (fLastHandledSocketNum + i)%fSocketTableSize;
+      SocketRecord& record = fSocketTable[sock];
+      if (!record.alwaysReady || record.handlerProc == NULL) continue;
+
+      int resultConditionSet = record.conditionSet&(SOCKET_READABLE|SOCKET_WRITABLE);
+      if (resultConditionSet != 0) {
+	fLastHandledSocketNum = sock;
+	(*record.handlerProc)(record.clientData, resultConditionSet);
+	break;
+      }
+    }
+  }
+
+  // Also handle any newly-triggered event (Note that we do this *after* calling a socket handler,
+  // in case the triggered event handler modifies The set of readable sockets.)
+  handleEventTriggers();
+
+  // Also handle any delayed event that may have come due.
+  fDelayQueue.handleAlarm();
+}
+
+void EpollTaskScheduler
+  ::setBackgroundHandling(int socketNum, int conditionSet, BackgroundHandlerProc* handlerProc, void* clientData) {
+  if (socketNum < 0) return;
+
+  if (conditionSet == 0) {
+    SocketRecord* record = lookupSocketRecord(socketNum, False);
+    if (record != NULL) unregisterSocket(socketNum, *record);
+  } else {
+    SocketRecord* record = lookupSocketRecord(socketNum, True);
+    if (!registerSocket(socketNum, *record, conditionSet)) return;
+    record->handlerProc = handlerProc;
+    record->clientData = clientData;
+  }
+}
+
+void EpollTaskScheduler::moveSocketHandling(int oldSocketNum, int newSocketNum) {
+  if (oldSocketNum < 0 || newSocketNum < 0) return; // sanity check
+  SocketRecord* oldRecord = lookupSocketRecord(oldSocketNum, False);
+  if (oldRecord == NULL || oldRecord->conditionSet == 0) return;
+
+  int conditionSet = oldRecord->conditionSet;
+  BackgroundHandlerProc* handlerProc = oldRecord->handlerProc;
+  void* clientData = oldRecord->clientData;
+  unregisterSocket(oldSocketNum, *oldRecord);
+  setBackgroundHandling(newSocketNum, conditionSet, handlerProc, clientData);
+}
+
+EpollTaskScheduler::SocketRecord* EpollTaskScheduler
+::lookupSocketRecord(int socketNum, Boolean createIfNotFound) {
+  if ((unsigned)socketNum >= fSocketTableSize) {
+    if (!createIfNotFound) return NULL;
+
+    // Grow the table (which is indexed by socket number) to hold this socket:
+    unsigned newSize = fSocketTableSize == 0 ? 64 : fSocketTableSize;
+    while (newSize <= (unsigned)socketNum) newSize *= 2;
+    SocketRecord* newTable = new SocketRecord[newSize];
+    if (fSocketTableSize > 0) memcpy(newTable, fSocketTable, fSocketTableSize*sizeof (SocketRecord));
+    memset(&newTable[fSocketTableSize], 0, (newSize - fSocketTableSize)*sizeof (SocketRecord));
+    delete[] fSocketTable;
+    fSocketTable = newTable;
+    fSocketTableSize = newSize;
+  }
+
+  return &fSocketTable[socketNum];
+}
+
+Boolean EpollTaskScheduler::registerSocket(int socketNum, SocketRecord& record, int conditionSet) {
+  if (record.alwaysReady) { // "epoll()" is of no use here
+    record.conditionSet = conditionSet;
+    return True;
+  }
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof event);
+  if (conditionSet&SOCKET_READABLE) event.events |= EPOLLIN;
+  if (conditionSet&SOCKET_WRITABLE) event.events |= EPOLLOUT;
+  if (conditionSet&SOCKET_EXCEPTION) event.events |= EPOLLPRI;
+  if (conditionSet&SOCKET_EDGE_TRIGGERED) event.events |= EPOLLET;
+  event.data.u64 = ((u_int64_t)record.generation<<32) | (unsigned)socketNum;
+
+  // If we think that the socket is already registered, just modify it.  (However, the kernel
+  // will have forgotten about it if it was closed - and its number reused - without first
+  // being unregistered.)
+  int op = record.conditionSet != 0 ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  if (epoll_ctl(fEpollFd, op, socketNum, &event) < 0) {
+    if (errno == ENOENT || errno == EEXIST) {
+      op = op == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+      if (epoll_ctl(fEpollFd, op, socketNum, &event) == 0) {
+	record.conditionSet = conditionSet;
+	return True;
+      }
+    }
+    if (errno == EPERM) {
+      // This descriptor (e.g., a regular file) doesn't support "epoll()".  "select()" would
+      // always report it as being ready, so we do the same:
+      record.alwaysReady = True;
+      record.conditionSet = conditionSet;
+      ++fNumAlwaysReadySockets;
+      return True;
+    }
+    perror("EpollTaskScheduler::setBackgroundHandling(): epoll_ctl() fails");
+    return False;
+  }
+
+  record.conditionSet = conditionSet;
+  return True;
+}
+
+void EpollTaskScheduler::unregisterSocket(int socketNum, SocketRecord& record) {
+  if (record.conditionSet != 0) {
+    if (record.alwaysReady) {
+      --fNumAlwaysReadySockets;
+    } else {
+      // (This fails - harmlessly - if the socket has already been closed.)
+      struct epoll_event event; // (unused, but must be non-NULL for older kernels)
+      epoll_ctl(fEpollFd, EPOLL_CTL_DEL, socketNum, &event);
+    }
+  }
+
+  record.conditionSet = 0;
+  record.handlerProc = NULL;
+  record.clientData = NULL;
+  record.alwaysReady = False;
+  ++record.generation;
+}
+
+#endif
@@ -24,20 +24,27 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "HashTable.hh"
 #endif
 
-// A simple hash table implementation, inspired by the hash table
-// implementation used in Tcl 7.6: <http://www.tcl.tk/>
+// A hash table implementation that uses 'open addressing' (with linear
+// probing) in a power-of-two-sized array of slots.  When the array fills up,
+// a larger one is allocated, but the entries are moved to it only a few at a
+// time - by subsequent calls to "Add()" - so that no one call takes long.
+// A table that is created to be 'thread-safe' is split into several 'shards'
+// (chosen by the keys' hash values), each with its own lock, so that
+// several threads can use the table at once without much contention.
 
-#define SMALL_HASH_TABLE_SIZE 4
+#define SMALL_HASH_TABLE_SIZE 8
 
 class BasicHashTable: public HashTable {
 private:
-	class TableEntry; // forward
+  class Shard; friend class Shard; // forward
 
 public:
-  BasicHashTable(int keyType);
+  BasicHashTable(int keyType, Boolean threadSafe = False);
   virtual ~BasicHashTable();
 
   // Used to iterate through the members of the table:
+  // (Entries may be removed - but not added - during an iteration.  For a thread-safe table,
+  //  other threads should not modify the table during an iteration.)
   class Iterator; friend class Iterator; // to make Sun's C++ compiler happy
   class Iterator: public HashTable::Iterator {
   public:
@@ -48,8 +55,10 @@ public:
 
   private:
     BasicHashTable& fTable;
-    unsigned fNextIndex; // index of next bucket to be enumerated after this
-    TableEntry* fNextEntry; // next entry in the current bucket
+    unsigned fShardIndex; // index of the shard being enumerated
+    Boolean fInOldSlots; // True iff we're enumerating the shard's old slot array (while it's being resized)
+    Boolean fFoundEntryInSlots; // True iff we've found an entry in the current slot array
+    unsigned fNextIndex; // index of the next slot to be enumerated
   };
 
 private: // implementation of inherited pure virtual functions
@@ -63,38 +72,41 @@ private: // implementation of inherited pure virtual functions
 private:
   class TableEntry {
   public:
-    TableEntry* fNext;
     char const* key;
     void* value;
+    unsigned hash; // EMPTY_SLOT, DELETED_SLOT, or else the hash of "key"
   };
 
-  TableEntry* lookupKey(char const* key, unsigned& index) const;
-    // returns entry matching "key", or NULL if none
-  Boolean keyMatches(char const* key1, char const* key2) const;
-    // used to implement "lookupKey()"
+  class SlotArray {
+  public:
+    TableEntry* fSlots;
+    unsigned fMask; // the number of slots, minus 1
+    unsigned fNumUsed; // slots that are not EMPTY_SLOT (including DELETED_SLOT ones)
+    unsigned fNumLive; // slots that hold an entry
+    unsigned fFirstLiveIndex; // no slot before this holds an entry
+  };
 
-  TableEntry* insertNewEntry(unsigned index, char const* key);
-    // creates a new entry, and inserts it in the table
+  Shard& shardFromHash(unsigned hash) const;
+  unsigned hashFromKey(char const* key) const;
+  Boolean keyMatches(char const* key1, char const* key2) const;
   void assignKey(TableEntry* entry, char const* key);
-    // used to implement "insertNewEntry()"
-
-  void deleteEntry(unsigned index, TableEntry* entry);
   void deleteKey(TableEntry* entry);
-    // used to implement "deleteEntry()"
-
-  void rebuild(); // rebuilds the table as its size increases
 
-  unsigned hashIndexFromKey(char const* key) const;
-    // used to implement many of the routines above
+  TableEntry* lookupKey(Shard& shard, char const* key, unsigned hash, SlotArray*& slots) const;
+    // returns entry matching "key" (in either of the shard's slot arrays), or NULL if none
+  TableEntry* lookupKey(SlotArray& slots, char const* key, unsigned hash) const;
+  static TableEntry* insertEntry(SlotArray& slots, unsigned hash);
+    // returns the slot that an entry (not already present) with hash "hash" should occupy
+  static void deleteEntry(SlotArray& slots, TableEntry* entry);
 
-  unsigned randomIndex(unsigned long i) const {
-    return (((i*1103515245) >> fDownShift) & fMask);
-  }
+  static void allocateSlots(SlotArray& slots, unsigned numSlots);
+  void growIfNecessary(Shard& shard); // prepares the shard for one more entry
+  void moveSomeEntries(Shard& shard, unsigned maxNumSlots);
+    // moves entries from the shard's old slot array to its new one, while it's being resized
 
 private:
-  TableEntry** fBuckets; // pointer to bucket array
-  TableEntry* fStaticBuckets[SMALL_HASH_TABLE_SIZE];// used for small tables
-  unsigned fNumBuckets, fNumEntries, fRebuildSize, fDownShift, fMask;
+  Shard* fShards;
+  unsigned fNumShards, fShardShift;
   int fKeyType;
 };
 
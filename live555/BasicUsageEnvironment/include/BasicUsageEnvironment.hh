@@ -68,4 +68,43 @@ protected:
   fd_set fExceptionSet;
 };
 
+#if defined(__linux__)
+struct epoll_event; // forward
+
+// A task scheduler that uses "epoll()" instead of "select()".  It is not limited to
+// FD_SETSIZE sockets, and the cost of each event loop iteration does not grow with
+// the number of sockets being handled.  It can be used in place of "BasicTaskScheduler".
+class EpollTaskScheduler: public BasicTaskScheduler0 {
+public:
+  static EpollTaskScheduler* createNew();
+      // returns NULL if "epoll()" is not available
+  virtual ~EpollTaskScheduler();
+
+protected:
+  EpollTaskScheduler(int epollFd);
+      // called only by "createNew()"
+
+protected:
+  // Redefined virtual functions:
+  virtual void SingleStep(unsigned maxDelayTime);
+
+  virtual void setBackgroundHandling(int socketNum, int conditionSet, BackgroundHandlerProc* handlerProc, void* clientData);
+  virtual void moveSocketHandling(int oldSocketNum, int newSocketNum);
+
+private:
+  struct SocketRecord; // defined in "EpollTaskScheduler.cpp"
+  SocketRecord* lookupSocketRecord(int socketNum, Boolean createIfNotFound);
+  Boolean registerSocket(int socketNum, SocketRecord& record, int conditionSet);
+  void unregisterSocket(int socketNum, SocketRecord& record);
+
+private:
+  int fEpollFd;
+  SocketRecord* fSocketTable; // indexed by socket number
+  unsigned fSocketTableSize;
+  struct epoll_event* fReadyEvents; // from the last "epoll_wait()"
+  int fNumReadyEvents, fNextReadyEvent;
+  unsigned fNumAlwaysReadySockets; // e.g., files, which "epoll()" can't handle
+};
+#endif
+
 #endif
@@ -95,6 +95,9 @@ public:
 protected:
   BasicTaskScheduler0();
 
+  void handleEventTriggers();
+      // Calls the handler function for (at most) one event that has been triggered.
+
 protected:
   // To implement delayed operations:
   DelayQueue fDelayQueue;
@@ -147,17 +147,21 @@ protected: // abstract base class
 
 private:
   friend class DelayQueue;
-  DelayQueueEntry* fNext;
-  DelayQueueEntry* fPrev;
-  DelayInterval fDeltaTimeRemaining;
+  DelayInterval fDelay; // from the time that we're added to a queue
+  EventTime fDueTime; // set when we're added to a queue
+  unsigned fHeapIndex; // our position in the queue's heap; 0 iff we're not in a queue
+  unsigned long fSequenceNum; // orders entries that are due at the same time
 
-  long fToken;
-  static long tokenCounter;
+  long fToken; // assigned by the first queue that we're added to
 };
 
 ///// DelayQueue /////
 
-class DelayQueue: public DelayQueueEntry {
+class HashTable; // forward
+
+// The entries are kept in a binary heap, ordered by the time that they're due, so that
+// adding or removing an entry is O(log n).  A hash table maps tokens to entries.
+class DelayQueue {
 public:
   DelayQueue();
   virtual ~DelayQueue();
@@ -172,11 +176,24 @@ public:
   void handleAlarm();
 
 private:
-  DelayQueueEntry* head() { return fNext; }
+  DelayQueueEntry* head() { return fNumEntries > 0 ? fHeap[1] : NULL; }
   DelayQueueEntry* findEntryByToken(long token);
-  void synchronize(); // bring the 'time remaining' fields up-to-date
+  void synchronize(); // update "fLastSyncTime" (allowing for the clock going backwards)
+
+  int isEarlier(DelayQueueEntry const* entry1, DelayQueueEntry const* entry2) const;
+  void placeEntry(DelayQueueEntry* entry, unsigned index);
+  void siftUp(unsigned index);
+  void siftDown(unsigned index);
+
+  DelayQueueEntry** fHeap; // fHeap[1..fNumEntries]; fHeap[1] is due first
+  unsigned fHeapSize;
+  unsigned fNumEntries;
+  unsigned long fSequenceCounter;
+  long fTokenCounter; // per queue, so that schedulers in different threads don't share it
+  HashTable* fEntriesByToken;
 
   EventTime fLastSyncTime;
+  DelayInterval fTimeToNextAlarm; // the result of "timeToNextAlarm()"
 };
 
 #endif
@@ -30,7 +30,9 @@ class HashTable {
 
 	// The following must be implemented by a particular
 	// implementation (subclass):
-	static HashTable* create(int keyType);
+	static HashTable* create(int keyType, Boolean threadSafe = False);
+		// A "threadSafe" table may be used by several threads
+		// (e.g., several event loops) at once
 
 	virtual void* Add(char const* key, void* value) = 0;
 		// Returns the old value if different, otherwise 0
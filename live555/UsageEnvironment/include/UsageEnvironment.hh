@@ -131,6 +131,10 @@ public:
     #define SOCKET_READABLE    (1<<1)
     #define SOCKET_WRITABLE    (1<<2)
     #define SOCKET_EXCEPTION   (1<<3)
+    // Also possible in a "conditionSet": Ask for edge-triggered (rather than level-triggered) handling.
+    // The handler is then not called again until new data (or buffer space) arrives, so it must
+    // read (or write) until the socket would block.  (Schedulers that can't do this ignore this bit.)
+    #define SOCKET_EDGE_TRIGGERED (1<<4)
   virtual void setBackgroundHandling(int socketNum, int conditionSet, BackgroundHandlerProc* handlerProc, void* clientData) = 0;
   void disableBackgroundHandling(int socketNum) { setBackgroundHandling(socketNum, 0, NULL, NULL); }
   virtual void moveSocketHandling(int oldSocketNum, int newSocketNum) = 0;
@@ -70,6 +70,32 @@ Boolean OutputSocket::write(netAddressBits address, Port port, u_int8_t ttl,
   return True;
 }
 
+Boolean OutputSocket::writeBatch(u_int8_t ttl,
+				 DatagramBuffer* datagrams, unsigned numDatagrams) {
+  if (ttl == fLastSentTTL) {
+    // Optimization: So we don't do a 'set TTL' system call again
+    ttl = 0;
+  } else {
+    fLastSentTTL = ttl;
+  }
+  if (!writeSocketBatch(env(), socketNum(), ttl, datagrams, numDatagrams))
+    return False;
+
+  if (sourcePortNum() == 0) {
+    // Now that we've sent a packet, we can find out what the
+    // kernel chose as our ephemeral source port number:
+    if (!getSourcePort(env(), socketNum(), fSourcePort)) {
+      if (DebugLevel >= 1)
+	env() << *this
+	     << ": failed to get source port: "
+	     << env().getResultMsg() << "\n";
+      return False;
+    }
+  }
+
+  return True;
+}
+
 // By default, we don't do reads:
 Boolean OutputSocket
 ::handleRead(unsigned char* /*buffer*/, unsigned /*bufferMaxSize*/,
@@ -103,7 +129,12 @@ Groupsock::Groupsock(UsageEnvironment& env, struct in_addr const& groupAddr,
 		     Port port, u_int8_t ttl)
   : OutputSocket(env, port),
     deleteIfNoMembers(False), isSlave(False),
-    fIncomingGroupEId(groupAddr, port.num(), ttl), fDests(NULL), fTTL(ttl) {
+    fIncomingGroupEId(groupAddr, port.num(), ttl), fDests(NULL), fTTL(ttl),
+    fReadBatchSize(1), fReadAheadStorage(NULL), fReadAheadSlotSize(0),
+    fReadAheadNumSlots(0), fReadAheadPackets(NULL),
+    fNumReadAheadPackets(0), fNextReadAheadPacket(0),
+    fWriteBatchSize(1), fWriteStorage(NULL), fWriteStorageSize(0),
+    fWriteStorageUsed(0), fWriteQueue(NULL), fNumQueuedPackets(0), fQueuedTTL(0) {
   addDestination(groupAddr, port);
 
   if (!socketJoinGroup(env, socketNum(), groupAddr.s_addr)) {
@@ -131,7 +162,12 @@ Groupsock::Groupsock(UsageEnvironment& env, struct in_addr const& groupAddr,
   : OutputSocket(env, port),
     deleteIfNoMembers(False), isSlave(False),
     fIncomingGroupEId(groupAddr, sourceFilterAddr, port.num()),
-    fDests(NULL), fTTL(255) {
+    fDests(NULL), fTTL(255),
+    fReadBatchSize(1), fReadAheadStorage(NULL), fReadAheadSlotSize(0),
+    fReadAheadNumSlots(0), fReadAheadPackets(NULL),
+    fNumReadAheadPackets(0), fNextReadAheadPacket(0),
+    fWriteBatchSize(1), fWriteStorage(NULL), fWriteStorageSize(0),
+    fWriteStorageUsed(0), fWriteQueue(NULL), fNumQueuedPackets(0), fQueuedTTL(0) {
   addDestination(groupAddr, port);
 
   // First try a SSM join.  If that fails, try a regular join:
@@ -154,6 +190,10 @@ Groupsock::Groupsock(UsageEnvironment& env, struct in_addr const& groupAddr,
 }
 
 Groupsock::~Groupsock() {
+  flushOutput();
+  delete[] fWriteStorage; delete[] fWriteQueue;
+  delete[] fReadAheadStorage; delete[] fReadAheadPackets;
+
   if (isSSM()) {
     if (!socketLeaveGroupSSM(env(), socketNum(), groupAddress().s_addr,
 			     sourceFilterAddress().s_addr)) {
@@ -247,18 +287,120 @@ void Groupsock::multicastSendOnly() {
 #endif
 }
 
+void Groupsock::setReadBatchSize(unsigned numPackets) {
+  if (numPackets < 1) numPackets = 1;
+  else if (numPackets > MAX_DATAGRAM_BATCH) numPackets = MAX_DATAGRAM_BATCH;
+  fReadBatchSize = numPackets;
+}
+
+void Groupsock::setWriteBatchSize(unsigned numPackets) {
+  flushOutput();
+  if (numPackets < 1) numPackets = 1;
+  else if (numPackets > MAX_DATAGRAM_BATCH) numPackets = MAX_DATAGRAM_BATCH;
+  fWriteBatchSize = numPackets;
+
+  delete[] fWriteStorage; fWriteStorage = NULL;
+  fWriteStorageSize = fWriteStorageUsed = 0;
+  delete[] fWriteQueue;
+  fWriteQueue = numPackets > 1 ? new DatagramBuffer[numPackets] : NULL;
+}
+
+Boolean Groupsock::flushOutput() {
+  if (fNumQueuedPackets == 0) return True;
+
+  Boolean result = writeBatch(fQueuedTTL, fWriteQueue, fNumQueuedPackets);
+  fNumQueuedPackets = 0;
+  fWriteStorageUsed = 0;
+  return result;
+}
+
+Boolean Groupsock::queueOutput(u_int8_t ttl,
+			       unsigned char* buffer, unsigned bufferSize) {
+  unsigned numDests = 0;
+  destRecord* dests;
+  for (dests = fDests; dests != NULL; dests = dests->fNext) ++numDests;
+  if (numDests == 0) return True;
+
+  // Send whatever is already queued if this packet can't join it:
+  if (fNumQueuedPackets > 0
+      && (ttl != fQueuedTTL
+	  || fNumQueuedPackets + numDests > fWriteBatchSize
+	  || fWriteStorageUsed + bufferSize > fWriteStorageSize)) {
+    if (!flushOutput()) return False;
+  }
+
+  if (numDests > fWriteBatchSize) {
+    // Too many destinations to queue; send to all of them now:
+    return outputToAllDestinations(ttl, buffer, bufferSize);
+  }
+
+  if (bufferSize > fWriteStorageSize) {
+    // (The queue is empty at this point.)
+    delete[] fWriteStorage;
+    fWriteStorageSize = bufferSize*fWriteBatchSize;
+    fWriteStorage = new unsigned char[fWriteStorageSize];
+  }
+
+  // Copy the packet once, and queue it for each destination:
+  unsigned char* copy = &fWriteStorage[fWriteStorageUsed];
+  memmove(copy, buffer, bufferSize);
+  fWriteStorageUsed += bufferSize;
+  for (dests = fDests; dests != NULL; dests = dests->fNext) {
+    DatagramBuffer& d = fWriteQueue[fNumQueuedPackets++];
+    d.buffer = copy;
+    d.dataSize = bufferSize;
+    MAKE_SOCKADDR_IN(dest, dests->fGroupEId.groupAddress().s_addr,
+		     dests->fPort.num());
+    d.address = dest;
+  }
+  fQueuedTTL = ttl;
+
+  if (fNumQueuedPackets == fWriteBatchSize) return flushOutput();
+  return True;
+}
+
+Boolean Groupsock::outputToAllDestinations(u_int8_t ttl,
+					   unsigned char* buffer, unsigned bufferSize) {
+  if (fDests != NULL && fDests->fNext == NULL) {
+    // Common case: a single destination
+    return write(fDests->fGroupEId.groupAddress().s_addr, fDests->fPort, ttl,
+		 buffer, bufferSize);
+  }
+
+  // Send the same (uncopied) packet to each destination, using one system
+  // call for up to MAX_DATAGRAM_BATCH destinations (where possible):
+  DatagramBuffer datagrams[MAX_DATAGRAM_BATCH];
+  unsigned numDatagrams = 0;
+  for (destRecord* dests = fDests; dests != NULL; dests = dests->fNext) {
+    DatagramBuffer& d = datagrams[numDatagrams++];
+    d.buffer = buffer;
+    d.dataSize = bufferSize;
+    MAKE_SOCKADDR_IN(dest, dests->fGroupEId.groupAddress().s_addr,
+		     dests->fPort.num());
+    d.address = dest;
+
+    if (numDatagrams == MAX_DATAGRAM_BATCH) {
+      if (!writeBatch(ttl, datagrams, numDatagrams)) return False;
+      numDatagrams = 0;
+    }
+  }
+
+  return numDatagrams == 0 || writeBatch(ttl, datagrams, numDatagrams);
+}
+
 Boolean Groupsock::output(UsageEnvironment& env, u_int8_t ttlToSend,
 			  unsigned char* buffer, unsigned bufferSize,
 			  DirectedNetInterface* interfaceNotToFwdBackTo) {
   do {
     // First, do the datagram send, to each destination:
     Boolean writeSuccess = True;
-    for (destRecord* dests = fDests; dests != NULL; dests = dests->fNext) {
-      if (!write(dests->fGroupEId.groupAddress().s_addr, dests->fPort, ttlToSend,
-		 buffer, bufferSize)) {
-	writeSuccess = False;
-	break;
-      }
+    if (fWriteBatchSize > 1 && members().IsEmpty()) {
+      // Queue the packet, to be sent later along with others:
+      writeSuccess = queueOutput(ttlToSend, buffer, bufferSize);
+    } else {
+      // Anything already queued must go out first, to preserve packet order:
+      if (!flushOutput()) break;
+      writeSuccess = outputToAllDestinations(ttlToSend, buffer, bufferSize);
     }
     if (!writeSuccess) break;
     statsOutgoing.countPacket(bufferSize);
@@ -300,8 +442,19 @@ Boolean Groupsock::handleRead(unsigned char* buffer, unsigned bufferMaxSize,
   bytesRead = 0;
 
   int maxBytesToRead = bufferMaxSize - TunnelEncapsulationTrailerMaxSize;
-  int numBytes = readSocket(env(), socketNum(),
-			    buffer, maxBytesToRead, fromAddress);
+  int numBytes;
+  if (hasBufferedPackets()) {
+    // Use a datagram that an earlier batched read got for us:
+    DatagramBuffer& d = fReadAheadPackets[fNextReadAheadPacket++];
+    numBytes = (int)d.dataSize < maxBytesToRead ? (int)d.dataSize : maxBytesToRead;
+    memmove(buffer, d.buffer, numBytes);
+    fromAddress = d.address;
+  } else if (fReadBatchSize > 1) {
+    numBytes = readBatch(buffer, maxBytesToRead, fromAddress);
+  } else {
+    numBytes = readSocket(env(), socketNum(),
+			  buffer, maxBytesToRead, fromAddress);
+  }
   if (numBytes < 0) {
     if (DebugLevel >= 0) { // this is a fatal error
       env().setResultMsg("Groupsock read failed: ",
@@ -346,6 +499,42 @@ Boolean Groupsock::handleRead(unsigned char* buffer, unsigned bufferMaxSize,
   return True;
 }
 
+int Groupsock::readBatch(unsigned char* buffer, unsigned bufferSize,
+			 struct sockaddr_in& fromAddress) {
+  // The first datagram is read into the caller's buffer, and the rest (if any)
+  // into our read-ahead buffers, which are made as large as the caller's.
+  // (There are no read-ahead packets left at this point, so the buffers
+  // can be reallocated if the caller's buffer or the batch size grew.)
+  if (fReadAheadSlotSize < bufferSize || fReadAheadNumSlots < fReadBatchSize) {
+    delete[] fReadAheadStorage; delete[] fReadAheadPackets;
+    fReadAheadSlotSize = bufferSize;
+    fReadAheadNumSlots = fReadBatchSize;
+    fReadAheadStorage
+      = new unsigned char[(fReadAheadNumSlots-1)*fReadAheadSlotSize];
+    fReadAheadPackets = new DatagramBuffer[fReadAheadNumSlots];
+  }
+
+  DatagramBuffer* datagrams = fReadAheadPackets;
+  datagrams[0].buffer = buffer;
+  datagrams[0].bufferSize = bufferSize;
+  for (unsigned i = 1; i < fReadBatchSize; ++i) {
+    datagrams[i].buffer = &fReadAheadStorage[(i-1)*fReadAheadSlotSize];
+    datagrams[i].bufferSize = fReadAheadSlotSize;
+  }
+
+  int numRead = readSocketBatch(env(), socketNum(), datagrams, fReadBatchSize);
+  if (numRead <= 0) {
+    if (numRead == 0) fromAddress.sin_addr.s_addr = 0;
+    return numRead;
+  }
+
+  fromAddress = datagrams[0].address;
+  // The remaining datagrams get returned by subsequent calls to "handleRead()":
+  fNextReadAheadPacket = 1;
+  fNumReadAheadPackets = numRead;
+  return datagrams[0].dataSize;
+}
+
 Boolean Groupsock::wasLoopedBackFromUs(UsageEnvironment& env,
 				       struct sockaddr_in& fromAddress) {
   if (fromAddress.sin_addr.s_addr
@@ -27,6 +27,7 @@ extern "C" int initializeWinsockIfNecessary();
 #include <stdarg.h>
 #include <time.h>
 #include <fcntl.h>
+#include <netinet/tcp.h>
 #define initializeWinsockIfNecessary() 1
 #endif
 #include <stdio.h>
@@ -154,6 +155,11 @@ Boolean makeSocketBlocking(int sock) {
 #endif
 }
 
+Boolean makeSocketNoDelay(int sock) {
+  int arg = 1;
+  return setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char*)&arg, sizeof arg) == 0;
+}
+
 int setupStreamSocket(UsageEnvironment& env,
                       Port port, Boolean makeNonBlocking) {
   if (!initializeWinsockIfNecessary()) {
@@ -291,6 +297,172 @@ Boolean writeSocket(UsageEnvironment& env,
 	return False;
 }
 
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+// "recvmmsg()" and "sendmmsg()" are available (at least at compile time):
+#define USE_MMSG 1
+// Set if the running kernel turns out not to implement them:
+static Boolean mmsgUnsupported = False;
+#endif
+
+int readSocketBatch(UsageEnvironment& env, int socket,
+		    DatagramBuffer* datagrams, unsigned numDatagrams) {
+  if (numDatagrams == 0) return 0;
+
+#ifdef USE_MMSG
+  if (!mmsgUnsupported && numDatagrams > 1) {
+    if (numDatagrams > MAX_DATAGRAM_BATCH) numDatagrams = MAX_DATAGRAM_BATCH;
+
+    struct mmsghdr msgs[MAX_DATAGRAM_BATCH];
+    struct iovec iovs[MAX_DATAGRAM_BATCH];
+    memset(msgs, 0, numDatagrams*sizeof msgs[0]);
+    for (unsigned i = 0; i < numDatagrams; ++i) {
+      iovs[i].iov_base = datagrams[i].buffer;
+      iovs[i].iov_len = datagrams[i].bufferSize;
+      msgs[i].msg_hdr.msg_name = &datagrams[i].address;
+      msgs[i].msg_hdr.msg_namelen = sizeof datagrams[i].address;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // Don't block once the datagrams that are already queued have been read:
+    int numRead = recvmmsg(socket, msgs, numDatagrams, MSG_DONTWAIT, NULL);
+    if (numRead >= 0) {
+      for (int i = 0; i < numRead; ++i) {
+	datagrams[i].dataSize = msgs[i].msg_len;
+      }
+      return numRead;
+    }
+
+    int err = env.getErrno();
+    if (err == ENOSYS) {
+      mmsgUnsupported = True; // use the fallback below from now on
+    } else if (err == 111 /*ECONNREFUSED*/ || err == EAGAIN || err == 113 /*EHOSTUNREACH*/) {
+      // See the comments in "readSocket()"
+      return 0;
+    } else {
+      socketErr(env, "recvmmsg() error: ");
+      return -1;
+    }
+  }
+#endif
+
+  // Fallback: Read a single datagram:
+  int bytesRead = readSocket(env, socket, datagrams[0].buffer,
+			     datagrams[0].bufferSize, datagrams[0].address);
+  if (bytesRead < 0) return -1;
+  if (bytesRead == 0 && datagrams[0].address.sin_addr.s_addr == 0) return 0;
+  datagrams[0].dataSize = bytesRead;
+  return 1;
+}
+
+Boolean writeSocketBatch(UsageEnvironment& env, int socket, u_int8_t ttlArg,
+			 DatagramBuffer* datagrams, unsigned numDatagrams) {
+  unsigned numSent = 0;
+
+#ifdef USE_MMSG
+  if (!mmsgUnsupported && numDatagrams > 1) {
+    if (ttlArg != 0) {
+      u_int8_t ttl = ttlArg;
+      if (setsockopt(socket, IPPROTO_IP, IP_MULTICAST_TTL,
+		     (const char*)&ttl, sizeof ttl) < 0) {
+	socketErr(env, "setsockopt(IP_MULTICAST_TTL) error: ");
+	return False;
+      }
+      ttlArg = 0; // for the fallback below
+    }
+
+    struct mmsghdr msgs[MAX_DATAGRAM_BATCH];
+    struct iovec iovs[MAX_DATAGRAM_BATCH];
+    while (numSent < numDatagrams) {
+      unsigned num = numDatagrams - numSent;
+      if (num > MAX_DATAGRAM_BATCH) num = MAX_DATAGRAM_BATCH;
+
+      memset(msgs, 0, num*sizeof msgs[0]);
+      for (unsigned i = 0; i < num; ++i) {
+	DatagramBuffer& d = datagrams[numSent + i];
+	iovs[i].iov_base = d.buffer;
+	iovs[i].iov_len = d.dataSize;
+	msgs[i].msg_hdr.msg_name = &d.address;
+	msgs[i].msg_hdr.msg_namelen = sizeof d.address;
+	msgs[i].msg_hdr.msg_iov = &iovs[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+      }
+
+      int result = sendmmsg(socket, msgs, num, 0);
+      if (result < 0) {
+	if (env.getErrno() == ENOSYS) {
+	  mmsgUnsupported = True;
+	  break; // send the remaining datagrams one at a time
+	}
+	socketErr(env, "sendmmsg() error: ");
+	return False;
+      }
+      for (int i = 0; i < result; ++i) {
+	if (msgs[i].msg_len != datagrams[numSent + i].dataSize) {
+	  char tmpBuf[100];
+	  sprintf(tmpBuf, "writeSocketBatch(%d), sendmmsg() error: wrote %u bytes instead of %u: ", socket, msgs[i].msg_len, datagrams[numSent + i].dataSize);
+	  socketErr(env, tmpBuf);
+	  return False;
+	}
+      }
+      numSent += result;
+    }
+  }
+#endif
+
+  // Fallback: Send each remaining datagram separately:
+  for (; numSent < numDatagrams; ++numSent) {
+    DatagramBuffer& d = datagrams[numSent];
+    if (!writeSocket(env, socket, d.address.sin_addr,
+		     Port(ntohs(d.address.sin_port)), ttlArg,
+		     d.buffer, d.dataSize)) {
+      return False;
+    }
+    ttlArg = 0; // it has been set now
+  }
+
+  return True;
+}
+
+int writeSocketGather(UsageEnvironment& env, int socket,
+		      StreamOutputBuffer const* buffers, unsigned numBuffers) {
+  if (numBuffers > MAX_STREAM_GATHER) numBuffers = MAX_STREAM_GATHER;
+
+#if defined(__WIN32__) || defined(_WIN32)
+  WSABUF bufs[MAX_STREAM_GATHER];
+  for (unsigned i = 0; i < numBuffers; ++i) {
+    bufs[i].buf = (char*)buffers[i].data;
+    bufs[i].len = buffers[i].dataSize;
+  }
+  DWORD numBytesSent;
+  if (WSASend(socket, bufs, numBuffers, &numBytesSent, 0, NULL, NULL) == 0) {
+    return (int)numBytesSent;
+  }
+#else
+  struct iovec iovs[MAX_STREAM_GATHER];
+  for (unsigned i = 0; i < numBuffers; ++i) {
+    iovs[i].iov_base = (void*)buffers[i].data;
+    iovs[i].iov_len = buffers[i].dataSize;
+  }
+  struct msghdr msg;
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = iovs;
+  msg.msg_iovlen = numBuffers;
+#ifdef MSG_NOSIGNAL
+  int flags = MSG_NOSIGNAL; // report a closed connection as an error, rather than by "SIGPIPE"
+#else
+  int flags = 0;
+#endif
+  int bytesSent = sendmsg(socket, &msg, flags);
+  if (bytesSent >= 0) return bytesSent;
+#endif
+
+  int err = env.getErrno();
+  if (err == EAGAIN || err == EWOULDBLOCK || err == EINTR) return 0;
+  socketErr(env, "writeSocketGather() error: ");
+  return -1;
+}
+
 static unsigned getBufferSize(UsageEnvironment& env, int bufOptName,
 			      int socket) {
   unsigned curSize;
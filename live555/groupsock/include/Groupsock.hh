@@ -33,6 +33,8 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "GroupEId.hh"
 #endif
 
+struct DatagramBuffer; // forward
+
 // An "OutputSocket" is (by default) used only to send packets.
 // No packets are received on it (unless a subclass arranges this)
 
@@ -43,6 +45,9 @@ public:
 
   Boolean write(netAddressBits address, Port port, u_int8_t ttl,
 		unsigned char* buffer, unsigned bufferSize);
+  Boolean writeBatch(u_int8_t ttl,
+		     DatagramBuffer* datagrams, unsigned numDatagrams);
+      // sends several datagrams (each with its own destination) at once
 
 protected:
   OutputSocket(UsageEnvironment& env, Port port);
@@ -120,6 +125,23 @@ public:
 		 unsigned char* buffer, unsigned bufferSize,
 		 DirectedNetInterface* interfaceNotToFwdBackTo = NULL);
 
+  // Batched I/O (using "recvmmsg()"/"sendmmsg()" where available):
+  // With a read batch size > 1, "handleRead()" also reads ahead (with the
+  // same system call) up to that many datagrams that are already queued on
+  // the socket.  The socket will not become readable again for these, so
+  // the reader must keep calling "handleRead()" while
+  // "hasBufferedPackets()" is True.
+  // With a write batch size > 1, "output()" queues outgoing packets (copying
+  // them), and sends them together once the queue is full, or when
+  // "flushOutput()" is called.  (Packets to be relayed to tunnel members
+  // are never queued.)
+  void setReadBatchSize(unsigned numPackets);
+  void setWriteBatchSize(unsigned numPackets);
+  Boolean hasBufferedPackets() const {
+    return fNextReadAheadPacket < fNumReadAheadPackets;
+  }
+  Boolean flushOutput();
+
   DirectedNetInterfaceSet& members() { return fMembers; }
 
   Boolean deleteIfNoMembers;
@@ -147,12 +169,32 @@ private:
 			       u_int8_t ttlToFwd,
 			       unsigned char* data, unsigned size,
 			       netAddressBits sourceAddr);
+  int readBatch(unsigned char* buffer, unsigned bufferSize,
+		struct sockaddr_in& fromAddress);
+  Boolean queueOutput(u_int8_t ttl, unsigned char* buffer, unsigned bufferSize);
+  Boolean outputToAllDestinations(u_int8_t ttl,
+				  unsigned char* buffer, unsigned bufferSize);
 
 private:
   GroupEId fIncomingGroupEId;
   destRecord* fDests;
   u_int8_t fTTL;
   DirectedNetInterfaceSet fMembers;
+
+  // Read-ahead state:
+  unsigned fReadBatchSize;
+  unsigned char* fReadAheadStorage;
+  unsigned fReadAheadSlotSize, fReadAheadNumSlots;
+  DatagramBuffer* fReadAheadPackets;
+  unsigned fNumReadAheadPackets, fNextReadAheadPacket;
+
+  // Output queue state:
+  unsigned fWriteBatchSize;
+  unsigned char* fWriteStorage;
+  unsigned fWriteStorageSize, fWriteStorageUsed;
+  DatagramBuffer* fWriteQueue;
+  unsigned fNumQueuedPackets;
+  u_int8_t fQueuedTTL;
 };
 
 UsageEnvironment& operator<<(UsageEnvironment& s, const Groupsock& g);
@@ -38,6 +38,42 @@ Boolean writeSocket(UsageEnvironment& env,
 		    u_int8_t ttlArg,
 		    unsigned char* buffer, unsigned bufferSize);
 
+// Batched datagram I/O.  Where the OS provides "recvmmsg()"/"sendmmsg()",
+// several datagrams are transferred by a single system call; otherwise
+// (or if the running kernel lacks these calls), one datagram is read per
+// call, or each datagram is sent separately.
+#define MAX_DATAGRAM_BATCH 32
+
+struct DatagramBuffer {
+  unsigned char* buffer;
+  unsigned bufferSize; // used for reading
+  unsigned dataSize; // set by reading; used for writing
+  struct sockaddr_in address; // source (reading) or destination (writing)
+};
+
+int readSocketBatch(UsageEnvironment& env, int socket,
+		    DatagramBuffer* datagrams, unsigned numDatagrams);
+    // Reads datagrams that are already queued on the socket, without
+    // blocking once the first has been read.  Returns the number of
+    // datagrams read (possibly 0), or -1 on error.
+Boolean writeSocketBatch(UsageEnvironment& env, int socket, u_int8_t ttlArg,
+			 DatagramBuffer* datagrams, unsigned numDatagrams);
+
+// Gathered stream output: the buffers are sent, in order, by a single
+// system call ("sendmsg()", or "WSASend()" on Windows).
+#define MAX_STREAM_GATHER 64
+
+struct StreamOutputBuffer {
+  unsigned char const* data;
+  unsigned dataSize;
+};
+
+int writeSocketGather(UsageEnvironment& env, int socket,
+		      StreamOutputBuffer const* buffers, unsigned numBuffers);
+    // Returns the number of bytes sent - which may be fewer than the total,
+    // if the socket's send buffer has filled up - or 0 if the (non-blocking)
+    // socket would block, or -1 on error.
+
 unsigned getSendBufferSize(UsageEnvironment& env, int socket);
 unsigned getReceiveBufferSize(UsageEnvironment& env, int socket);
 unsigned setSendBufferTo(UsageEnvironment& env,
@@ -51,6 +87,9 @@ unsigned increaseReceiveBufferTo(UsageEnvironment& env,
 
 Boolean makeSocketNonBlocking(int sock);
 Boolean makeSocketBlocking(int sock);
+Boolean makeSocketNoDelay(int sock);
+    // disables the 'Nagle algorithm' on a TCP socket, so that small messages written back-to-back
+    // (e.g., pipelined RTSP requests or responses) don't wait for each other to be acknowledged
 
 Boolean socketJoinGroup(UsageEnvironment& env, int socket,
 			netAddressBits groupAddress);
@@ -101,8 +101,9 @@ AVIFileSink::AVIFileSink(UsageEnvironment& env,
 			 char const* outputFileName,
 			 unsigned bufferSize,
 			 unsigned short movieWidth, unsigned short movieHeight,
-			 unsigned movieFPS, Boolean packetLossCompensate)
-  : Medium(env), fInputSession(inputSession),
+			 unsigned movieFPS, Boolean packetLossCompensate,
+			 Boolean useDirectIO, u_int64_t preallocationSize)
+  : Medium(env), fInputSession(inputSession), fOutputWriter(NULL),
     fBufferSize(bufferSize), fPacketLossCompensate(packetLossCompensate),
     fAreCurrentlyBeingPlayed(False), fNumSubsessions(0), fNumBytesWritten(0),
     fHaveCompletedOutputFile(False),
@@ -144,6 +145,9 @@ AVIFileSink::AVIFileSink(UsageEnvironment& env,
 
   // Begin by writing an AVI header:
   addFileHeader_AVI();
+
+  // Frames will be written - while we're recording - by a separate thread:
+  fOutputWriter = new AsyncFileWriter(env, fOutFid, useDirectIO, preallocationSize);
 }
 
 AVIFileSink::~AVIFileSink() {
@@ -161,6 +165,7 @@ AVIFileSink::~AVIFileSink() {
   }
 
   // Finally, close our output file:
+  delete fOutputWriter;
   CloseOutputFile(fOutFid);
 }
 
@@ -169,10 +174,12 @@ AVIFileSink* AVIFileSink
 	    char const* outputFileName,
 	    unsigned bufferSize,
 	    unsigned short movieWidth, unsigned short movieHeight,
-	    unsigned movieFPS, Boolean packetLossCompensate) {
+	    unsigned movieFPS, Boolean packetLossCompensate,
+	    Boolean useDirectIO, u_int64_t preallocationSize) {
   AVIFileSink* newSink =
     new AVIFileSink(env, inputSession, outputFileName, bufferSize,
-		    movieWidth, movieHeight, movieFPS, packetLossCompensate);
+		    movieWidth, movieHeight, movieFPS, packetLossCompensate,
+		    useDirectIO, preallocationSize);
   if (newSink == NULL || newSink->fOutFid == NULL) {
     Medium::close(newSink);
     return NULL;
@@ -284,6 +291,9 @@ void AVIFileSink::onRTCPBye(void* clientData) {
 void AVIFileSink::completeOutputFile() {
   if (fHaveCompletedOutputFile || fOutFid == NULL) return;
 
+  // Wait for the frames to be written, before we seek back and forth to fill in the headers:
+  fOutputWriter->finish();
+
   // Update various AVI 'size' fields to take account of the codec data that
   // we've now written to the file:
   unsigned maxBytesPerSecond = 0;
@@ -472,7 +482,7 @@ void AVISubsessionIOState::useFrame(SubsessionBuffer& buffer) {
   // Write the data into the file:
   fOurSink.fNumBytesWritten += fOurSink.addWord(fAVISubsessionTag);
   fOurSink.fNumBytesWritten += fOurSink.addWord(frameSize);
-  fwrite(frameSource, 1, frameSize, fOurSink.fOutFid);
+  fOurSink.fOutputWriter->write(frameSource, frameSize);
   fOurSink.fNumBytesWritten += frameSize;
   // Pad to an even length:
   if (frameSize%2 != 0) fOurSink.fNumBytesWritten += fOurSink.addByte(0);
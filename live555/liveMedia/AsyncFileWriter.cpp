@@ -0,0 +1,373 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2011 Live Networks, Inc.  All rights reserved.
+// Writes a file (being recorded) from a separate thread, through large buffers,
+// so that slow disk I/O never blocks the event loop.
+// Implementation
+
+#include "AsyncFileWriter.hh"
+#include "InputFile.hh"
+#include <string.h>
+#ifdef USE_WRITER_THREAD
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+
+#ifdef USE_WRITER_THREAD
+
+#define WRITE_BUFFER_SIZE (1024*1024) // must be a multiple of WRITE_ALIGNMENT
+#define WRITE_ALIGNMENT 4096 // the alignment (of memory, file offsets and sizes) needed by O_DIRECT
+#define MAX_NUM_WRITE_BUFFERS 64 // limits the data queued for writing to 64 MBytes
+#define MAX_BUFFERING_TIME 1 // seconds; a partly-filled buffer is queued for writing after this long
+
+////////// AsyncWriteBuffer //////////
+
+// A buffer covers WRITE_BUFFER_SIZE bytes of the file, starting at an aligned file offset.
+// Only the bytes from "fStart" to "fLen" have been given to us, and are written.
+
+class AsyncWriteBuffer {
+public:
+  AsyncWriteBuffer()
+    : fNext(NULL), fFileOffset(0), fStart(0), fLen(0) {
+    void* data;
+    fData = posix_memalign(&data, WRITE_ALIGNMENT, WRITE_BUFFER_SIZE) == 0 ? (unsigned char*)data : NULL;
+  }
+  virtual ~AsyncWriteBuffer() { free(fData); }
+
+  AsyncWriteBuffer* fNext;
+  unsigned char* fData;
+  int64_t fFileOffset;
+  unsigned fStart, fLen;
+};
+
+#endif
+
+////////// AsyncFileWriter //////////
+
+AsyncFileWriter::AsyncFileWriter(UsageEnvironment& env, FILE* fid,
+				 Boolean useDirectIO, u_int64_t preallocationSize)
+  : fEnv(env), fFid(fid), fFinished(True), fPosition(0),
+    fCurData(NULL), fCurLen(0), fCurLimit(0),
+    fNumBytesQueued(0), fNumWrites(0), fTotWriteLatency(0.0), fMaxWriteLatency(0), fNumStalls(0) {
+#ifdef USE_WRITER_THREAD
+  fDirectFd = -1;
+  fCurBuffer = fQueueHead = fQueueTail = fFreeBuffers = NULL;
+  fNumBuffers = 0;
+  fExiting = False;
+  fWriteError = 0;
+
+  // From now on, we write to the file descriptor ourselves, so first flush anything that's buffered in "fid":
+  fflush(fFid);
+  fFd = fileno(fFid);
+  fPosition = TellFile64(fFid);
+  fSeekable = fPosition >= 0 && lseek(fFd, 0, SEEK_CUR) >= 0;
+  if (!fSeekable) fPosition = 0; // we'll write sequentially
+  fPreallocationSize = fSeekable ? preallocationSize : 0;
+  fPreallocatedTo = fPosition;
+
+#ifdef O_DIRECT
+  if (useDirectIO && fSeekable) {
+    // Open the file again - the same file, even if it has no name, or a name (e.g., "stdout") that we don't know.
+    // (We can't just set O_DIRECT on a "dup()" of "fFd", because the flag would then apply to "fid" as well.)
+    char fdPath[100];
+    sprintf(fdPath, "/proc/self/fd/%d", fFd);
+    fDirectFd = open(fdPath, O_WRONLY|O_DIRECT);
+  }
+#endif
+
+  pthread_mutex_init(&fMutex, NULL);
+  pthread_cond_init(&fWorkAvailable, NULL);
+  pthread_cond_init(&fBufferAvailable, NULL);
+  int err = pthread_create(&fThread, NULL, threadMain, this);
+  if (err != 0) {
+    fEnv.setResultErrMsg("AsyncFileWriter: pthread_create() failed: ", err);
+    if (fDirectFd >= 0) close(fDirectFd);
+    SeekFile64(fFid, fPosition, SEEK_SET);
+    return; // we'll write synchronously instead
+  }
+  fFinished = False;
+#endif
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  finish();
+#ifdef USE_WRITER_THREAD
+  pthread_cond_destroy(&fBufferAvailable);
+  pthread_cond_destroy(&fWorkAvailable);
+  pthread_mutex_destroy(&fMutex);
+#endif
+}
+
+void AsyncFileWriter::write(unsigned char const* data, unsigned size) {
+  if (fFinished) {
+    fwrite(data, 1, size, fFid);
+    return;
+  }
+
+#ifdef USE_WRITER_THREAD
+  while (size > 0) {
+    if (fCurBuffer == NULL) {
+      startNewBuffer();
+      if (fCurBuffer == NULL) { // we're out of memory; write synchronously from now on
+	finish();
+	fwrite(data, 1, size, fFid);
+	return;
+      }
+    }
+
+    unsigned numBytesToCopy = fCurLimit - fCurLen;
+    if (numBytesToCopy > size) numBytesToCopy = size;
+    memmove(&fCurData[fCurLen], data, numBytesToCopy);
+    fCurLen += numBytesToCopy;
+    fPosition += numBytesToCopy;
+    data += numBytesToCopy;
+    size -= numBytesToCopy;
+
+    if (fCurLen == fCurLimit) queueCurBuffer();
+  }
+
+  // Don't let a slowly-filling buffer hold on to data for too long:
+  if (fCurBuffer != NULL) {
+    struct timeval timeNow;
+    gettimeofday(&timeNow, NULL);
+    if (timeNow.tv_sec - fCurBufferStartTime >= MAX_BUFFERING_TIME) queueCurBuffer();
+  }
+#endif
+}
+
+int64_t AsyncFileWriter::tell() {
+  return fFinished ? TellFile64(fFid) : fPosition;
+}
+
+void AsyncFileWriter::finish() {
+  if (fFinished) return;
+  fFinished = True;
+
+#ifdef USE_WRITER_THREAD
+  if (fCurBuffer != NULL) queueCurBuffer();
+
+  // Tell the writer thread to exit once it has written everything, and wait for it:
+  pthread_mutex_lock(&fMutex);
+  fExiting = True;
+  pthread_cond_signal(&fWorkAvailable);
+  pthread_mutex_unlock(&fMutex);
+  pthread_join(fThread, NULL);
+
+  while (fFreeBuffers != NULL) {
+    AsyncWriteBuffer* buffer = fFreeBuffers;
+    fFreeBuffers = buffer->fNext;
+    delete buffer;
+  }
+  if (fDirectFd >= 0) {
+    close(fDirectFd);
+    fDirectFd = -1;
+  }
+
+  if (fPreallocatedTo > fPosition && fWriteError == 0) {
+    // Release the space that we allocated beyond the end of the data:
+    if (ftruncate(fFd, fPosition) != 0) fWriteError = errno;
+  }
+  if (fWriteError != 0) {
+    fEnv << "AsyncFileWriter: write failed (err " << fWriteError << ")\n";
+  }
+  if (fSeekable) SeekFile64(fFid, fPosition, SEEK_SET);
+#endif
+}
+
+u_int64_t AsyncFileWriter::numBytesQueued() {
+#ifdef USE_WRITER_THREAD
+  if (fFinished) return 0;
+
+  pthread_mutex_lock(&fMutex);
+  u_int64_t result = fNumBytesQueued + (fCurLen - (fCurBuffer == NULL ? 0 : fCurBuffer->fStart));
+  pthread_mutex_unlock(&fMutex);
+  return result;
+#else
+  return 0;
+#endif
+}
+
+unsigned AsyncFileWriter::numWrites() {
+#ifdef USE_WRITER_THREAD
+  pthread_mutex_lock(&fMutex);
+  unsigned result = fNumWrites;
+  pthread_mutex_unlock(&fMutex);
+  return result;
+#else
+  return 0;
+#endif
+}
+
+unsigned AsyncFileWriter::averageWriteLatency() {
+#ifdef USE_WRITER_THREAD
+  pthread_mutex_lock(&fMutex);
+  unsigned result = fNumWrites == 0 ? 0 : (unsigned)(fTotWriteLatency/fNumWrites);
+  pthread_mutex_unlock(&fMutex);
+  return result;
+#else
+  return 0;
+#endif
+}
+
+unsigned AsyncFileWriter::maxWriteLatency() {
+#ifdef USE_WRITER_THREAD
+  pthread_mutex_lock(&fMutex);
+  unsigned result = fMaxWriteLatency;
+  pthread_mutex_unlock(&fMutex);
+  return result;
+#else
+  return 0;
+#endif
+}
+
+unsigned AsyncFileWriter::numStalls() {
+  return fNumStalls; // changed only by our own (event loop) thread
+}
+
+#ifdef USE_WRITER_THREAD
+
+void AsyncFileWriter::startNewBuffer() {
+  pthread_mutex_lock(&fMutex);
+  if (fFreeBuffers == NULL && fNumBuffers >= MAX_NUM_WRITE_BUFFERS) {
+    // The disk isn't keeping up.  We have no choice but to wait for it:
+    ++fNumStalls;
+    while (fFreeBuffers == NULL) pthread_cond_wait(&fBufferAvailable, &fMutex);
+  }
+  AsyncWriteBuffer* buffer = fFreeBuffers;
+  if (buffer != NULL) fFreeBuffers = buffer->fNext;
+  pthread_mutex_unlock(&fMutex);
+
+  if (buffer == NULL) {
+    buffer = new AsyncWriteBuffer;
+    if (buffer->fData == NULL) {
+      fEnv << "AsyncFileWriter: failed to allocate a buffer\n";
+      delete buffer;
+      return;
+    }
+    ++fNumBuffers;
+  }
+
+  // Align the buffer within the file, so that (once filled) it can be written using O_DIRECT:
+  buffer->fNext = NULL;
+  buffer->fStart = (unsigned)(fPosition%WRITE_ALIGNMENT);
+  buffer->fFileOffset = fPosition - buffer->fStart;
+  buffer->fLen = buffer->fStart;
+
+  fCurBuffer = buffer;
+  fCurData = buffer->fData;
+  fCurLen = buffer->fStart;
+  fCurLimit = WRITE_BUFFER_SIZE;
+
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  fCurBufferStartTime = timeNow.tv_sec;
+}
+
+void AsyncFileWriter::queueCurBuffer() {
+  AsyncWriteBuffer* buffer = fCurBuffer;
+  buffer->fLen = fCurLen;
+  fCurBuffer = NULL;
+  fCurData = NULL;
+  fCurLen = fCurLimit = 0;
+
+  pthread_mutex_lock(&fMutex);
+  if (fQueueTail == NULL) {
+    fQueueHead = buffer;
+  } else {
+    fQueueTail->fNext = buffer;
+  }
+  fQueueTail = buffer;
+  fNumBytesQueued += buffer->fLen - buffer->fStart;
+  pthread_cond_signal(&fWorkAvailable);
+  pthread_mutex_unlock(&fMutex);
+}
+
+void* AsyncFileWriter::threadMain(void* writer) {
+  ((AsyncFileWriter*)writer)->runWriterThread();
+  return NULL;
+}
+
+void AsyncFileWriter::runWriterThread() {
+  pthread_mutex_lock(&fMutex);
+  while (1) {
+    while (fQueueHead == NULL && !fExiting) pthread_cond_wait(&fWorkAvailable, &fMutex);
+    AsyncWriteBuffer* buffer = fQueueHead;
+    if (buffer == NULL) break; // we've been told to exit, and there's nothing left to write
+    fQueueHead = buffer->fNext;
+    if (fQueueHead == NULL) fQueueTail = NULL;
+    pthread_mutex_unlock(&fMutex);
+
+    struct timeval startTime, endTime;
+    gettimeofday(&startTime, NULL);
+    writeBuffer(buffer);
+    gettimeofday(&endTime, NULL);
+    unsigned latency
+      = (endTime.tv_sec - startTime.tv_sec)*1000000 + (endTime.tv_usec - startTime.tv_usec);
+
+    pthread_mutex_lock(&fMutex);
+    ++fNumWrites;
+    fTotWriteLatency += latency;
+    if (latency > fMaxWriteLatency) fMaxWriteLatency = latency;
+    fNumBytesQueued -= buffer->fLen - buffer->fStart;
+    buffer->fNext = fFreeBuffers;
+    fFreeBuffers = buffer;
+    pthread_cond_signal(&fBufferAvailable);
+  }
+  pthread_mutex_unlock(&fMutex);
+}
+
+void AsyncFileWriter::writeBuffer(AsyncWriteBuffer* buffer) {
+  unsigned char const* data = &buffer->fData[buffer->fStart];
+  unsigned size = buffer->fLen - buffer->fStart;
+  int64_t fileOffset = buffer->fFileOffset + buffer->fStart;
+  if (size == 0 || fWriteError != 0) return;
+
+#ifdef FALLOC_FL_KEEP_SIZE
+  if (fPreallocationSize > 0 && fileOffset + size > fPreallocatedTo) {
+    // Allocate the next part of the file, without changing its size:
+    u_int64_t numBytesToAllocate = fileOffset + size - fPreallocatedTo + fPreallocationSize;
+    if (fallocate(fFd, FALLOC_FL_KEEP_SIZE, fPreallocatedTo, numBytesToAllocate) == 0) {
+      fPreallocatedTo += numBytesToAllocate;
+    } else {
+      fPreallocationSize = 0; // the file system doesn't support it; don't try again
+    }
+  }
+#endif
+
+  // Only a whole (aligned) buffer can be written using O_DIRECT:
+  int fd = fDirectFd >= 0 && buffer->fStart == 0 && buffer->fLen == WRITE_BUFFER_SIZE ? fDirectFd : fFd;
+  while (size > 0) {
+    ssize_t numBytesWritten = fSeekable ? pwrite(fd, data, size, fileOffset) : ::write(fd, data, size);
+    if (numBytesWritten < 0) {
+      if (errno == EINTR) continue;
+      if (fd == fDirectFd) { // the file system doesn't support O_DIRECT after all
+	fd = fFd;
+	continue;
+      }
+      fWriteError = errno;
+      return;
+    }
+    data += numBytesWritten;
+    size -= numBytesWritten;
+    fileOffset += numBytesWritten;
+  }
+}
+
+#endif
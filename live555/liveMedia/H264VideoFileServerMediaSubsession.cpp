@@ -82,6 +82,8 @@ char const* H264VideoFileServerMediaSubsession::getAuxSDPLine(RTPSink* rtpSink,
   checkForAuxSDPLine(this);
 
   envir().taskScheduler().doEventLoop(&fDoneFlag);
+  // Don't leave a (stale) 'checking' task token, which could be from another thread's scheduler:
+  envir().taskScheduler().unscheduleDelayedTask(nextTask());
 
   char const* auxSDPLine = fDummyRTPSink->auxSDPLine();
   return auxSDPLine;
@@ -577,6 +577,7 @@ unsigned H264VideoStreamParser::parse() {
         // Common case: 0x00000001 or 0x000001 definitely doesn't begin anywhere in "next4Bytes", so we save all of it:
         save4Bytes(next4Bytes);
 	skipBytes(4);
+	saveToPossibleCode();
       } else {
         // Save the first byte, and continue testing the rest:
         saveByte(next4Bytes>>24);
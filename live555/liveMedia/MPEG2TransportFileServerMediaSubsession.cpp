@@ -312,8 +312,9 @@ void ClientTrickPlayState::updateStateOnScaleChange() {
     fTrickModeFilter = NULL;
   }
   if (fNextScale != 1.0f) {
-    // Create a new trick play filter from the original Transport Stream source:
-    UsageEnvironment& env = fIndexFile->envir(); // alias
+    // Create a new trick play filter from the original Transport Stream source.
+    // (Use the environment of this client's stream, which may differ from the index file's.)
+    UsageEnvironment& env = fFramer->envir(); // alias
     fTrickModeFilter = MPEG2TransportStreamTrickModeFilter
       ::createNew(env, fOriginalTransportStreamSource, fIndexFile, int(fNextScale));
     fTrickModeFilter->seekTo(fTSRecordNum, fIxRecordNum);
@@ -23,12 +23,24 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 
 #include "MPEG2TransportStreamIndexFile.hh"
 #include "InputFile.hh"
+#include <string.h>
+#if !defined(__WIN32__) && !defined(_WIN32)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define USE_MMAP 1
+#endif
 
 MPEG2TransportStreamIndexFile
 ::MPEG2TransportStreamIndexFile(UsageEnvironment& env, char const* indexFileName)
   : Medium(env),
     fFileName(strDup(indexFileName)), fFid(NULL), fMPEGVersion(0), fCurrentIndexRecordNum(0),
-    fCachedPCR(0.0f), fCachedTSPacketNumber(0), fNumIndexRecords(0) {
+    fCachedPCR(0.0f), fCachedTSPacketNumber(0), fNumIndexRecords(0),
+    fMappedRecords(NULL), fMappedSize(0) {
+#ifdef USE_INDEX_FILE_LOCK
+  pthread_mutex_init(&fLock, NULL);
+#endif
+
   // Get the file size, to determine how many index records it contains:
   u_int64_t indexFileSize = GetFileSize(indexFileName, NULL);
   if (indexFileSize % INDEX_RECORD_SIZE != 0) {
@@ -38,6 +50,11 @@ MPEG2TransportStreamIndexFile
 	<< INDEX_RECORD_SIZE << ")\n";
   }
   fNumIndexRecords = (unsigned long)(indexFileSize/INDEX_RECORD_SIZE);
+
+  // Index lookups probe records all over the file, so - rather than seeking and reading for each probe -
+  // we map the file into memory once.  (The pages are shared by every session that streams the same file.)
+  fMappedSize = (u_int64_t)fNumIndexRecords*INDEX_RECORD_SIZE;
+  mapFile();
 }
 
 MPEG2TransportStreamIndexFile* MPEG2TransportStreamIndexFile
@@ -57,12 +74,75 @@ MPEG2TransportStreamIndexFile* MPEG2TransportStreamIndexFile
 
 MPEG2TransportStreamIndexFile::~MPEG2TransportStreamIndexFile() {
   closeFid();
+  unmapFile();
   delete[] fFileName;
+#ifdef USE_INDEX_FILE_LOCK
+  pthread_mutex_destroy(&fLock);
+#endif
 }
 
 void MPEG2TransportStreamIndexFile
 ::lookupTSPacketNumFromNPT(float& npt, unsigned long& tsPacketNumber,
 			   unsigned long& indexRecordNumber) {
+  lock();
+  lookupTSPacketNumFromNPT1(npt, tsPacketNumber, indexRecordNumber);
+  unlock();
+}
+
+void MPEG2TransportStreamIndexFile
+::lookupPCRFromTSPacketNum(unsigned long& tsPacketNumber, Boolean reverseToPreviousCleanPoint,
+			   float& pcr, unsigned long& indexRecordNumber) {
+  lock();
+  lookupPCRFromTSPacketNum1(tsPacketNumber, reverseToPreviousCleanPoint, pcr, indexRecordNumber);
+  unlock();
+}
+
+Boolean MPEG2TransportStreamIndexFile
+::readIndexRecordValues(unsigned long indexRecordNum,
+			unsigned long& transportPacketNum, u_int8_t& offset,
+			u_int8_t& size, float& pcr, u_int8_t& recordType) {
+  lock();
+  Boolean result
+    = readIndexRecordValues1(indexRecordNum, transportPacketNum, offset, size, pcr, recordType);
+  unlock();
+  return result;
+}
+
+float MPEG2TransportStreamIndexFile::getPlayingDuration() {
+  lock();
+  float result = getPlayingDuration1();
+  unlock();
+  return result;
+}
+
+int MPEG2TransportStreamIndexFile::mpegVersion() {
+  lock();
+  int result = mpegVersion1();
+  unlock();
+  return result;
+}
+
+void MPEG2TransportStreamIndexFile::stopReading() {
+  lock();
+  closeFid();
+  unlock();
+}
+
+void MPEG2TransportStreamIndexFile::lock() {
+#ifdef USE_INDEX_FILE_LOCK
+  pthread_mutex_lock(&fLock);
+#endif
+}
+
+void MPEG2TransportStreamIndexFile::unlock() {
+#ifdef USE_INDEX_FILE_LOCK
+  pthread_mutex_unlock(&fLock);
+#endif
+}
+
+void MPEG2TransportStreamIndexFile
+::lookupTSPacketNumFromNPT1(float& npt, unsigned long& tsPacketNumber,
+			    unsigned long& indexRecordNumber) {
   if (npt <= 0.0 || fNumIndexRecords == 0) { // Fast-track a common case:
     npt = 0.0f;
     tsPacketNumber = indexRecordNumber = 0;
@@ -126,8 +206,8 @@ void MPEG2TransportStreamIndexFile
 }
 
 void MPEG2TransportStreamIndexFile
-::lookupPCRFromTSPacketNum(unsigned long& tsPacketNumber, Boolean reverseToPreviousCleanPoint,
-			   float& pcr, unsigned long& indexRecordNumber) {
+::lookupPCRFromTSPacketNum1(unsigned long& tsPacketNumber, Boolean reverseToPreviousCleanPoint,
+			    float& pcr, unsigned long& indexRecordNumber) {
   if (tsPacketNumber == 0 || fNumIndexRecords == 0) { // Fast-track a common case:
     pcr = 0.0f;
     indexRecordNumber = 0;
@@ -155,7 +235,7 @@ void MPEG2TransportStreamIndexFile
 
     while (ixRight-ixLeft > 1 && tsLeft < tsPacketNumber && tsPacketNumber <= tsRight) {
       unsigned long ixNew = ixLeft
-	+ (unsigned long)(((tsPacketNumber-tsLeft)/(tsRight-tsLeft))*(ixRight-ixLeft));
+	+ (unsigned long)(((tsPacketNumber-tsLeft)/(double)(tsRight-tsLeft))*(ixRight-ixLeft));
       if (ixNew == ixLeft || ixNew == ixRight) {
 	// Use bisection instead:
 	ixNew = (ixLeft+ixRight)/2;
@@ -196,9 +276,9 @@ void MPEG2TransportStreamIndexFile
 }
 
 Boolean MPEG2TransportStreamIndexFile
-::readIndexRecordValues(unsigned long indexRecordNum,
-			unsigned long& transportPacketNum, u_int8_t& offset,
-			u_int8_t& size, float& pcr, u_int8_t& recordType) {
+::readIndexRecordValues1(unsigned long indexRecordNum,
+			 unsigned long& transportPacketNum, u_int8_t& offset,
+			 u_int8_t& size, float& pcr, u_int8_t& recordType) {
   if (!readIndexRecord(indexRecordNum)) return False;
 
   transportPacketNum = tsPacketNumFromBuf();
@@ -209,13 +289,13 @@ Boolean MPEG2TransportStreamIndexFile
   return True;
 }
 
-float MPEG2TransportStreamIndexFile::getPlayingDuration() {
+float MPEG2TransportStreamIndexFile::getPlayingDuration1() {
   if (fNumIndexRecords == 0 || !readOneIndexRecord(fNumIndexRecords-1)) return 0.0f;
 
   return pcrFromBuf();
 }
 
-int MPEG2TransportStreamIndexFile::mpegVersion() {
+int MPEG2TransportStreamIndexFile::mpegVersion1() {
   if (fMPEGVersion != 0) return fMPEGVersion; // we already know it
 
   // Read the first index record, and figure out the MPEG version from its type:
@@ -225,6 +305,30 @@ int MPEG2TransportStreamIndexFile::mpegVersion() {
   return fMPEGVersion;
 }
 
+void MPEG2TransportStreamIndexFile::mapFile() {
+#ifdef USE_MMAP
+  if (fMappedSize == 0 || fMappedSize != (size_t)fMappedSize) return;
+
+  int fd = open(fFileName, O_RDONLY);
+  if (fd < 0) return;
+
+  void* addr = mmap(NULL, (size_t)fMappedSize, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd); // the mapping remains valid
+  if (addr == MAP_FAILED) return; // we'll read the file instead
+
+  fMappedRecords = (unsigned char*)addr;
+#endif
+}
+
+void MPEG2TransportStreamIndexFile::unmapFile() {
+#ifdef USE_MMAP
+  if (fMappedRecords != NULL) {
+    munmap(fMappedRecords, (size_t)fMappedSize);
+    fMappedRecords = NULL;
+  }
+#endif
+}
+
 Boolean MPEG2TransportStreamIndexFile::openFid() {
   if (fFid == NULL && fFileName != NULL) {
     if ((fFid = OpenInputFile(envir(), fFileName)) != NULL) {
@@ -246,6 +350,13 @@ Boolean MPEG2TransportStreamIndexFile::seekToIndexRecord(unsigned long indexReco
 }
 
 Boolean MPEG2TransportStreamIndexFile::readIndexRecord(unsigned long indexRecordNum) {
+  if (fMappedRecords != NULL) {
+    if (indexRecordNum >= fNumIndexRecords) return False;
+
+    memmove(fBuf, &fMappedRecords[indexRecordNum*INDEX_RECORD_SIZE], INDEX_RECORD_SIZE);
+    return True;
+  }
+
   do {
     if (!seekToIndexRecord(indexRecordNum)) break;
     if (fread(fBuf, INDEX_RECORD_SIZE, 1, fFid) != 1) break;
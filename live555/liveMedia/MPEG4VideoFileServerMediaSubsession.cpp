@@ -88,6 +88,8 @@ char const* MPEG4VideoFileServerMediaSubsession
   checkForAuxSDPLine(this);
 
   envir().taskScheduler().doEventLoop(&fDoneFlag);
+  // Don't leave a (stale) 'checking' task token, which could be from another thread's scheduler:
+  envir().taskScheduler().unscheduleDelayedTask(nextTask());
 
   char const* auxSDPLine = fDummyRTPSink->auxSDPLine();
   return auxSDPLine;
@@ -66,6 +66,19 @@ protected:
     *fTo++ = word>>24; *fTo++ = word>>16; *fTo++ = word>>8; *fTo++ = word;
   }
 
+  // Record all of the data that we've already read, up until the next place where
+  // a sync word (0x000001xx) could begin:
+  void saveToPossibleCode() {
+    unsigned numBytes = numBytesBeforePossibleStartCode();
+    unsigned numBytesToSave = fTo < fLimit ? fLimit - fTo : 0;
+    if (numBytesToSave > numBytes) numBytesToSave = numBytes;
+
+    getBytes(fTo, numBytesToSave);
+    fTo += numBytesToSave;
+    skipBytes(numBytes - numBytesToSave);
+    fNumTruncatedBytes += numBytes - numBytesToSave;
+  }
+
   // Save data until we see a sync word (0x000001xx):
   void saveToNextCode(u_int32_t& curWord) {
     saveByte(curWord>>24);
@@ -74,6 +87,7 @@ protected:
       if ((unsigned)(curWord&0xFF) > 1) {
 	// a sync word definitely doesn't begin anywhere in "curWord"
 	save4Bytes(curWord);
+	saveToPossibleCode();
 	curWord = get4Bytes();
       } else {
 	// a sync word might begin in "curWord", although not at its start
@@ -90,6 +104,7 @@ protected:
     while ((curWord&0xFFFFFF00) != 0x00000100) {
       if ((unsigned)(curWord&0xFF) > 1) {
 	// a sync word definitely doesn't begin anywhere in "curWord"
+	skipBytes(numBytesBeforePossibleStartCode());
 	curWord = get4Bytes();
       } else {
 	// a sync word might begin in "curWord", although not at its start
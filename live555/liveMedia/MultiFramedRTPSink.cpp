@@ -46,6 +46,10 @@ MultiFramedRTPSink::MultiFramedRTPSink(UsageEnvironment& env,
   setPacketSizes(1000, 1448);
       // Default max packet size (1500, minus allowance for IP, UDP, UMTP headers)
       // (Also, make it a multiple of 4 bytes, just in case that matters.)
+
+  // Packets that are due to be sent at the same time (i.e., the fragments of
+  // a large frame) get queued, and sent using a single system call:
+  rtpGS->setWriteBatchSize(16);
 }
 
 MultiFramedRTPSink::~MultiFramedRTPSink() {
@@ -153,6 +157,7 @@ Boolean MultiFramedRTPSink::continuePlaying() {
 }
 
 void MultiFramedRTPSink::stopPlaying() {
+  fRTPInterface.gs()->flushOutput();
   fOutBuf->resetPacketStart();
   fOutBuf->resetOffset();
   fOutBuf->resetOverflowData();
@@ -381,6 +386,7 @@ void MultiFramedRTPSink::sendPacketIfNecessary() {
 
   if (fNoFramesLeft) {
     // We're done:
+    fRTPInterface.gs()->flushOutput();
     onSourceClosure(this);
   } else {
     // We have more frames left to send.  Figure out when the next frame
@@ -393,6 +399,11 @@ void MultiFramedRTPSink::sendPacketIfNecessary() {
     if (uSecondsToGo < 0 || secsDiff < 0) { // sanity check: Make sure that the time-to-delay is non-negative:
       uSecondsToGo = 0;
     }
+    if (uSecondsToGo > 0 || !fOutBuf->haveOverflowData()) {
+      // Unless the next packet is to be sent right away, from data that we
+      // already have, don't hold back any queued packets while we wait:
+      fRTPInterface.gs()->flushOutput();
+    }
 
     // Delay this amount of time:
     nextTask() = envir().taskScheduler().scheduleDelayedTask(uSecondsToGo, (TaskFunc*)sendNext, this);
@@ -27,34 +27,45 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 
 class ReorderingPacketBuffer {
 public:
-  ReorderingPacketBuffer(BufferedPacketFactory* packetFactory);
+  ReorderingPacketBuffer(MultiFramedRTPSource& ourSource, BufferedPacketFactory* packetFactory);
   virtual ~ReorderingPacketBuffer();
   void reset();
 
-  BufferedPacket* getFreePacket(MultiFramedRTPSource* ourSource);
+  BufferedPacket* getFreePacket();
   Boolean storePacket(BufferedPacket* bPacket);
   BufferedPacket* getNextCompletedPacket(Boolean& packetLossPreceded);
   void releaseUsedPacket(BufferedPacket* packet);
   void freePacket(BufferedPacket* packet) {
-    if (packet != fSavedPacket) {
-      delete packet;
-    } else {
-      fSavedPacketFree = True;
-    }
+    // Keep the packet, to be reused for a later incoming packet:
+    packet->nextPacket() = fFreePackets;
+    fFreePackets = packet;
   }
-  Boolean isEmpty() const { return fHeadPacket == NULL; }
+  Boolean isEmpty() const { return fNumStoredPackets == 0; }
 
   void setThresholdTime(unsigned uSeconds) { fThresholdTime = uSeconds; }
+  unsigned curThresholdTime() const;
+
+  unsigned fNumPacketsLost, fNumPacketsLate, fNumPacketsReordered, fNumPacketsDuplicated;
 
 private:
+  BufferedPacket*& slot(unsigned short seqNo) { return fSlots[seqNo&(fNumSlots-1)]; }
+  void growSlots(unsigned minNumSlots);
+
+  MultiFramedRTPSource& fOurSource;
   BufferedPacketFactory* fPacketFactory;
   unsigned fThresholdTime; // uSeconds
   Boolean fHaveSeenFirstPacket; // used to set initial "fNextExpectedSeqNo"
   unsigned short fNextExpectedSeqNo;
-  BufferedPacket* fHeadPacket;
-  BufferedPacket* fSavedPacket;
-      // to avoid calling new/free in the common case
-  Boolean fSavedPacketFree;
+  unsigned short fHighestSeqNo; // of all packets stored so far
+
+  // The stored packets, indexed by RTP sequence number (modulo "fNumSlots", a power of 2).
+  // They all have sequence numbers in [fNextExpectedSeqNo, fNextExpectedSeqNo+fNumSlots):
+  BufferedPacket** fSlots;
+  unsigned fNumSlots;
+  unsigned fNumStoredPackets;
+
+  BufferedPacket* fFreePackets; // linked using "nextPacket()"
+      // to avoid calling new/delete for each incoming packet
 };
 
 
@@ -67,10 +78,14 @@ MultiFramedRTPSource
 		       BufferedPacketFactory* packetFactory)
   : RTPSource(env, RTPgs, rtpPayloadFormat, rtpTimestampFrequency) {
   reset();
-  fReorderingBuffer = new ReorderingPacketBuffer(packetFactory);
+  fReorderingBuffer = new ReorderingPacketBuffer(*this, packetFactory);
 
   // Try to use a big receive buffer for RTP:
   increaseReceiveBufferTo(env, RTPgs->socketNum(), 50*1024);
+
+  // Also read (with the same system call) any further packets that are
+  // already waiting on the socket:
+  RTPgs->setReadBatchSize(8);
 }
 
 void MultiFramedRTPSource::reset() {
@@ -104,6 +119,7 @@ Boolean MultiFramedRTPSource
 
 void MultiFramedRTPSource::doStopGettingFrames() {
   fRTPInterface.stopNetworkReading();
+  if (fPacketReadInProgress != NULL) fReorderingBuffer->freePacket(fPacketReadInProgress);
   fReorderingBuffer->reset();
   reset();
 }
@@ -213,6 +229,26 @@ void MultiFramedRTPSource
   fReorderingBuffer->setThresholdTime(uSeconds);
 }
 
+unsigned MultiFramedRTPSource::numPacketsLost() const {
+  return fReorderingBuffer->fNumPacketsLost;
+}
+
+unsigned MultiFramedRTPSource::numPacketsLate() const {
+  return fReorderingBuffer->fNumPacketsLate;
+}
+
+unsigned MultiFramedRTPSource::numPacketsReordered() const {
+  return fReorderingBuffer->fNumPacketsReordered;
+}
+
+unsigned MultiFramedRTPSource::numPacketsDuplicated() const {
+  return fReorderingBuffer->fNumPacketsDuplicated;
+}
+
+unsigned MultiFramedRTPSource::curPacketReorderingThresholdTime() const {
+  return fReorderingBuffer->curThresholdTime();
+}
+
 #define ADVANCE(n) do { bPacket->skip(n); } while (0)
 
 void MultiFramedRTPSource::networkReadHandler(MultiFramedRTPSource* source, int /*mask*/) {
@@ -223,7 +259,7 @@ void MultiFramedRTPSource::networkReadHandler1() {
   BufferedPacket* bPacket = fPacketReadInProgress;
   if (bPacket == NULL) {
     // Normal case: Get a free BufferedPacket descriptor to hold the new network packet:
-    bPacket = fReorderingBuffer->getFreePacket(this);
+    bPacket = fReorderingBuffer->getFreePacket();
   }
 
   // Read the network packet, and perform sanity checks on the RTP header:
@@ -308,6 +344,13 @@ void MultiFramedRTPSource::networkReadHandler1() {
   } while (0);
   if (!readSuccess) fReorderingBuffer->freePacket(bPacket);
 
+  if (fRTPInterface.hasBufferedPackets()) {
+    // Our read also got further packets, which the socket won't tell us
+    // about again.  Store these too, before delivering a frame:
+    networkReadHandler1();
+    return;
+  }
+
   doGetNextFrame1();
   // If we didn't get proper data this time, we'll get another chance
 }
@@ -450,117 +493,175 @@ BufferedPacket* BufferedPacketFactory
 
 ////////// ReorderingPacketBuffer implementation //////////
 
+#define INITIAL_NUM_SLOTS 64 // must be a power of 2
+
+// Unless the incoming packets' jitter is large, we wait for a missing packet for
+// no longer than the following:
+#define MIN_THRESHOLD_TIME 20000 // uSeconds
+#define JITTER_MULTIPLE 4
+
 ReorderingPacketBuffer
-::ReorderingPacketBuffer(BufferedPacketFactory* packetFactory)
-  : fThresholdTime(100000) /* default reordering threshold: 100 ms */,
-    fHaveSeenFirstPacket(False), fHeadPacket(NULL), fSavedPacket(NULL), fSavedPacketFree(True) {
+::ReorderingPacketBuffer(MultiFramedRTPSource& ourSource, BufferedPacketFactory* packetFactory)
+  : fNumPacketsLost(0), fNumPacketsLate(0), fNumPacketsReordered(0), fNumPacketsDuplicated(0),
+    fOurSource(ourSource),
+    fThresholdTime(100000) /* default reordering threshold: 100 ms */,
+    fHaveSeenFirstPacket(False),
+    fNumSlots(INITIAL_NUM_SLOTS), fNumStoredPackets(0), fFreePackets(NULL) {
   fPacketFactory = (packetFactory == NULL)
     ? (new BufferedPacketFactory)
     : packetFactory;
+
+  fSlots = new BufferedPacket*[fNumSlots];
+  for (unsigned i = 0; i < fNumSlots; ++i) fSlots[i] = NULL;
 }
 
 ReorderingPacketBuffer::~ReorderingPacketBuffer() {
   reset();
+  while (fFreePackets != NULL) {
+    BufferedPacket* packet = fFreePackets;
+    fFreePackets = packet->nextPacket();
+    packet->nextPacket() = NULL; // so that we delete only this packet
+    delete packet;
+  }
+  delete[] fSlots;
   delete fPacketFactory;
 }
 
 void ReorderingPacketBuffer::reset() {
-  if (fSavedPacketFree) delete fSavedPacket; // because fSavedPacket is not in the list
-  delete fHeadPacket; // will also delete fSavedPacket if it's in the list
+  for (unsigned i = 0; fNumStoredPackets > 0 && i < fNumSlots; ++i) {
+    if (fSlots[i] != NULL) {
+      freePacket(fSlots[i]);
+      fSlots[i] = NULL;
+      --fNumStoredPackets;
+    }
+  }
   fHaveSeenFirstPacket = False;
-  fHeadPacket = NULL;
-  fSavedPacket = NULL;
 }
 
-BufferedPacket* ReorderingPacketBuffer::getFreePacket(MultiFramedRTPSource* ourSource) {
-  if (fSavedPacket == NULL) { // we're being called for the first time
-    fSavedPacket = fPacketFactory->createNewPacket(ourSource);
-    fSavedPacketFree = True;
+BufferedPacket* ReorderingPacketBuffer::getFreePacket() {
+  if (fFreePackets == NULL) {
+    return fPacketFactory->createNewPacket(&fOurSource);
   }
 
-  if (fSavedPacketFree == True) {
-    fSavedPacketFree = False;
-    return fSavedPacket;
-  } else {
-    return fPacketFactory->createNewPacket(ourSource);
-  }
+  BufferedPacket* packet = fFreePackets;
+  fFreePackets = packet->nextPacket();
+  packet->nextPacket() = NULL;
+  return packet;
 }
 
 Boolean ReorderingPacketBuffer::storePacket(BufferedPacket* bPacket) {
   unsigned short rtpSeqNo = bPacket->rtpSeqNo();
 
   if (!fHaveSeenFirstPacket) {
-    fNextExpectedSeqNo = rtpSeqNo; // initialization
+    fNextExpectedSeqNo = fHighestSeqNo = rtpSeqNo; // initialization
     bPacket->isFirstPacket() = True;
     fHaveSeenFirstPacket = True;
   }
 
   // Ignore this packet if its sequence number is less than the one
   // that we're looking for (in this case, it's been excessively delayed).
-  if (seqNumLT(rtpSeqNo, fNextExpectedSeqNo)) return False;
-
-  // Figure out where the new packet will be stored in the queue:
-  BufferedPacket* beforePtr = NULL;
-  BufferedPacket* afterPtr = fHeadPacket;
-  while (afterPtr != NULL) {
-    if (seqNumLT(rtpSeqNo, afterPtr->rtpSeqNo())) break; // it comes here
-    if (rtpSeqNo == afterPtr->rtpSeqNo()) {
-      // This is a duplicate packet - ignore it
-      return False;
-    }
+  if (seqNumLT(rtpSeqNo, fNextExpectedSeqNo)) {
+    ++fNumPacketsLate;
+    return False;
+  }
+
+  // Make sure that we have a slot for the new packet:
+  unsigned short distance = rtpSeqNo - fNextExpectedSeqNo; // < 32768, because of the check above
+  if (distance >= fNumSlots) growSlots(distance + 1);
 
-    beforePtr = afterPtr;
-    afterPtr = afterPtr->nextPacket();
+  BufferedPacket*& packetSlot = slot(rtpSeqNo);
+  if (packetSlot != NULL) {
+    // This is a duplicate packet - ignore it
+    ++fNumPacketsDuplicated;
+    return False;
   }
 
-  // Link our new packet between "beforePtr" and "afterPtr":
-  bPacket->nextPacket() = afterPtr;
-  if (beforePtr == NULL) {
-    fHeadPacket = bPacket;
+  packetSlot = bPacket;
+  ++fNumStoredPackets;
+  if (seqNumLT(rtpSeqNo, fHighestSeqNo)) {
+    ++fNumPacketsReordered;
   } else {
-    beforePtr->nextPacket() = bPacket;
+    fHighestSeqNo = rtpSeqNo;
   }
 
   return True;
 }
 
+void ReorderingPacketBuffer::growSlots(unsigned minNumSlots) {
+  unsigned newNumSlots = 2*fNumSlots;
+  while (newNumSlots < minNumSlots) newNumSlots *= 2;
+
+  BufferedPacket** newSlots = new BufferedPacket*[newNumSlots];
+  for (unsigned i = 0; i < newNumSlots; ++i) newSlots[i] = NULL;
+  for (unsigned i = 0; i < fNumSlots; ++i) {
+    BufferedPacket* packet = fSlots[i];
+    if (packet != NULL) newSlots[packet->rtpSeqNo()&(newNumSlots-1)] = packet;
+  }
+
+  delete[] fSlots;
+  fSlots = newSlots;
+  fNumSlots = newNumSlots;
+}
+
 void ReorderingPacketBuffer::releaseUsedPacket(BufferedPacket* packet) {
-  // ASSERT: packet == fHeadPacket
-  // ASSERT: fNextExpectedSeqNo == packet->rtpSeqNo()
+  // ASSERT: packet == slot(fNextExpectedSeqNo)
+  slot(fNextExpectedSeqNo) = NULL;
+  --fNumStoredPackets;
   ++fNextExpectedSeqNo; // because we're finished with this packet now
 
-  fHeadPacket = fHeadPacket->nextPacket();
-  packet->nextPacket() = NULL;
-
   freePacket(packet);
 }
 
+unsigned ReorderingPacketBuffer::curThresholdTime() const {
+  // Wait for a missing packet for some multiple of the incoming packets'
+  // (RTCP 'interarrival') jitter, but at least "MIN_THRESHOLD_TIME",
+  // and no longer than "fThresholdTime":
+  unsigned thresholdTime = MIN_THRESHOLD_TIME;
+  RTPReceptionStats* stats
+    = fOurSource.receptionStatsDB().lookup(fOurSource.lastReceivedSSRC());
+  unsigned timestampFrequency = fOurSource.timestampFrequency();
+  if (stats != NULL && timestampFrequency > 0) {
+    double jitterTime = JITTER_MULTIPLE*(stats->jitter()*1000000.0/timestampFrequency);
+    if (jitterTime > thresholdTime) {
+      thresholdTime = jitterTime > fThresholdTime ? fThresholdTime : (unsigned)jitterTime;
+    }
+  }
+
+  return thresholdTime > fThresholdTime ? fThresholdTime : thresholdTime;
+}
+
 BufferedPacket* ReorderingPacketBuffer
 ::getNextCompletedPacket(Boolean& packetLossPreceded) {
-  if (fHeadPacket == NULL) return NULL;
+  if (fNumStoredPackets == 0) return NULL;
 
-  // Check whether the next packet we want is already at the head
-  // of the queue:
-  // ASSERT: fHeadPacket->rtpSeqNo() >= fNextExpectedSeqNo
-  if (fHeadPacket->rtpSeqNo() == fNextExpectedSeqNo) {
-    packetLossPreceded = fHeadPacket->isFirstPacket();
+  // Check whether the next packet we want has already arrived:
+  BufferedPacket* packet = slot(fNextExpectedSeqNo);
+  if (packet != NULL) {
+    packetLossPreceded = packet->isFirstPacket();
         // (The very first packet is treated as if there was packet loss beforehand.)
-    return fHeadPacket;
+    return packet;
   }
 
-  // We're still waiting for our desired packet to arrive.  However, if
-  // our time threshold has been exceeded, then forget it, and return
-  // the head packet instead:
+  // We're still waiting for our desired packet to arrive.  Find the
+  // earliest packet that we do have:
+  unsigned short seqNo = fNextExpectedSeqNo;
+  do {
+    packet = slot(++seqNo);
+  } while (packet == NULL);
+
+  // If our time threshold has been exceeded, then forget about the missing
+  // packet(s), and return this one instead:
   struct timeval timeNow;
   gettimeofday(&timeNow, NULL);
   unsigned uSecondsSinceReceived
-    = (timeNow.tv_sec - fHeadPacket->timeReceived().tv_sec)*1000000
-    + (timeNow.tv_usec - fHeadPacket->timeReceived().tv_usec);
-  if (uSecondsSinceReceived > fThresholdTime) {
-    fNextExpectedSeqNo = fHeadPacket->rtpSeqNo();
+    = (timeNow.tv_sec - packet->timeReceived().tv_sec)*1000000
+    + (timeNow.tv_usec - packet->timeReceived().tv_usec);
+  if (uSecondsSinceReceived > curThresholdTime()) {
+    fNumPacketsLost += (unsigned short)(seqNo - fNextExpectedSeqNo);
+    fNextExpectedSeqNo = seqNo;
         // we've given up on earlier packets now
     packetLossPreceded = True;
-    return fHeadPacket;
+    return packet;
   }
 
   // Otherwise, keep waiting for our desired packet to arrive:
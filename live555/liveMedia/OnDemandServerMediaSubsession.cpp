@@ -29,8 +29,9 @@ OnDemandServerMediaSubsession
 				Boolean reuseFirstSource,
 				portNumBits initialPortNum)
   : ServerMediaSubsession(env),
-    fSDPLines(NULL), fReuseFirstSource(reuseFirstSource), fInitialPortNum(initialPortNum), fLastStreamToken(NULL) {
+    fSDPLines(NULL), fReuseFirstSource(reuseFirstSource), fInitialPortNum(initialPortNum) {
   fDestinationsHashTable = HashTable::create(ONE_WORD_HASH_KEYS);
+  fLastStreamTokens = HashTable::create(ONE_WORD_HASH_KEYS);
   gethostname(fCNAME, sizeof fCNAME);
   fCNAME[sizeof fCNAME-1] = '\0'; // just in case
 }
@@ -67,6 +68,7 @@ OnDemandServerMediaSubsession::~OnDemandServerMediaSubsession() {
     delete destinations;
   }
   delete fDestinationsHashTable;
+  delete fLastStreamTokens;
 }
 
 char const*
@@ -98,7 +100,7 @@ OnDemandServerMediaSubsession::sdpLines() {
 // A class that represents the state of an ongoing stream
 class StreamState {
 public:
-  StreamState(OnDemandServerMediaSubsession& master,
+  StreamState(OnDemandServerMediaSubsession& master, UsageEnvironment& env,
               Port const& serverRTPPort, Port const& serverRTCPPort,
 	      RTPSink* rtpSink, BasicUDPSink* udpSink,
 	      unsigned totalBW, FramedSource* mediaSource,
@@ -124,8 +126,12 @@ public:
 
   FramedSource* mediaSource() const { return fMediaSource; }
 
+  UsageEnvironment& envir() const { return fEnv; }
+  ServerMediaSession* session() const { return fMaster.fParentSession; }
+
 private:
   OnDemandServerMediaSubsession& fMaster;
+  UsageEnvironment& fEnv; // the one that our objects were created in
   Boolean fAreCurrentlyPlaying;
   unsigned fReferenceCount;
 
@@ -160,13 +166,15 @@ void OnDemandServerMediaSubsession
   struct in_addr destinationAddr; destinationAddr.s_addr = destinationAddress;
   isMulticast = False;
 
-  if (fLastStreamToken != NULL && fReuseFirstSource) {
+  StreamState* lastStreamState
+    = fReuseFirstSource ? (StreamState*)(fLastStreamTokens->Lookup((char const*)&envir())) : NULL;
+  if (lastStreamState != NULL) {
     // Special case: Rather than creating a new 'StreamState',
-    // we reuse the one that we've already created:
-    serverRTPPort = ((StreamState*)fLastStreamToken)->serverRTPPort();
-    serverRTCPPort = ((StreamState*)fLastStreamToken)->serverRTCPPort();
-    ++((StreamState*)fLastStreamToken)->referenceCount();
-    streamToken = fLastStreamToken;
+    // we reuse the one that we've already created (in this environment):
+    serverRTPPort = lastStreamState->serverRTPPort();
+    serverRTCPPort = lastStreamState->serverRTCPPort();
+    ++lastStreamState->referenceCount();
+    streamToken = lastStreamState;
   } else {
     // Normal case: Create a new media source:
     unsigned streamBitrate;
@@ -238,10 +246,11 @@ void OnDemandServerMediaSubsession
     }
 
     // Set up the state of the stream.  The stream will get started later:
-    streamToken = fLastStreamToken
-      = new StreamState(*this, serverRTPPort, serverRTCPPort, rtpSink, udpSink,
+    streamToken
+      = new StreamState(*this, envir(), serverRTPPort, serverRTCPPort, rtpSink, udpSink,
 			streamBitrate, mediaSource,
 			rtpGroupsock, rtcpGroupsock);
+    fLastStreamTokens->Add((char const*)&envir(), streamToken);
   }
 
   // Record these destinations as being for this client session id:
@@ -413,19 +422,23 @@ static void afterPlayingStreamState(void* clientData) {
     // to be sent to each client, teling it that the stream has ended.
     // (Because the stream didn't have a known duration, there was no other
     //  way for clients to know when the stream ended.)
+    // We're called by the stream's event loop - not for a client - so we lock the session ourself:
+    ServerMediaSession* session = streamState->session();
+    if (session != NULL) session->lock(streamState->envir());
     streamState->reclaim();
+    if (session != NULL) session->unlock();
   }
   // Otherwise, keep the stream alive, in case a client wants to
   // subsequently re-play the stream starting from somewhere other than the end.
   // (This can be done only on streams that have a known duration.)
 }
 
-StreamState::StreamState(OnDemandServerMediaSubsession& master,
+StreamState::StreamState(OnDemandServerMediaSubsession& master, UsageEnvironment& env,
                          Port const& serverRTPPort, Port const& serverRTCPPort,
 			 RTPSink* rtpSink, BasicUDPSink* udpSink,
 			 unsigned totalBW, FramedSource* mediaSource,
 			 Groupsock* rtpGS, Groupsock* rtcpGS)
-  : fMaster(master), fAreCurrentlyPlaying(False), fReferenceCount(1),
+  : fMaster(master), fEnv(env), fAreCurrentlyPlaying(False), fReferenceCount(1),
     fServerRTPPort(serverRTPPort), fServerRTCPPort(serverRTCPPort),
     fRTPSink(rtpSink), fUDPSink(udpSink), fStreamDuration(master.duration()),
     fTotalBW(totalBW), fRTCPInstance(NULL) /* created later */,
@@ -519,7 +532,9 @@ void StreamState::reclaim() {
   Medium::close(fUDPSink); fUDPSink = NULL;
 
   fMaster.closeStreamSource(fMediaSource); fMediaSource = NULL;
-  if (fMaster.fLastStreamToken == this) fMaster.fLastStreamToken = NULL;
+  if (fMaster.fLastStreamTokens->Lookup((char const*)&fEnv) == this) {
+    fMaster.fLastStreamTokens->Remove((char const*)&fEnv);
+  }
 
   delete fRTPgs; fRTPgs = NULL;
   delete fRTCPgs; fRTCPgs = NULL;
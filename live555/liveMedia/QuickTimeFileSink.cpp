@@ -228,8 +228,10 @@ QuickTimeFileSink::QuickTimeFileSink(UsageEnvironment& env,
 				     Boolean packetLossCompensate,
 				     Boolean syncStreams,
 				     Boolean generateHintTracks,
-				     Boolean generateMP4Format)
-  : Medium(env), fInputSession(inputSession),
+				     Boolean generateMP4Format,
+				     Boolean useDirectIO,
+				     u_int64_t preallocationSize)
+  : Medium(env), fInputSession(inputSession), fOutputWriter(NULL),
     fBufferSize(bufferSize), fPacketLossCompensate(packetLossCompensate),
     fSyncStreams(syncStreams), fGenerateMP4Format(generateMP4Format),
     fAreCurrentlyBeingPlayed(False),
@@ -311,6 +313,9 @@ QuickTimeFileSink::QuickTimeFileSink(UsageEnvironment& env,
   addAtomHeader64("mdat");
   // add 64Bit offset
   fMDATposition += 8;
+
+  // Frames will be written - while we're recording - by a separate thread:
+  fOutputWriter = new AsyncFileWriter(env, fOutFid, useDirectIO, preallocationSize);
 }
 
 QuickTimeFileSink::~QuickTimeFileSink() {
@@ -329,6 +334,7 @@ QuickTimeFileSink::~QuickTimeFileSink() {
   }
 
   // Finally, close our output file:
+  delete fOutputWriter;
   CloseOutputFile(fOutFid);
 }
 
@@ -343,10 +349,13 @@ QuickTimeFileSink::createNew(UsageEnvironment& env,
 			     Boolean packetLossCompensate,
 			     Boolean syncStreams,
 			     Boolean generateHintTracks,
-			     Boolean generateMP4Format) {
+			     Boolean generateMP4Format,
+			     Boolean useDirectIO,
+			     u_int64_t preallocationSize) {
   QuickTimeFileSink* newSink = 
     new QuickTimeFileSink(env, inputSession, outputFileName, bufferSize, movieWidth, movieHeight, movieFPS,
-			  packetLossCompensate, syncStreams, generateHintTracks, generateMP4Format);
+			  packetLossCompensate, syncStreams, generateHintTracks, generateMP4Format,
+			  useDirectIO, preallocationSize);
   if (newSink == NULL || newSink->fOutFid == NULL) {
     Medium::close(newSink);
     return NULL;
@@ -470,6 +479,9 @@ static Boolean timevalGE(struct timeval const& tv1,
 void QuickTimeFileSink::completeOutputFile() {
   if (fHaveCompletedOutputFile || fOutFid == NULL) return;
 
+  // Wait for the frames to be written, before we seek back and forth to fill in the headers:
+  fOutputWriter->finish();
+
   // Begin by filling in the initial "mdat" atom with the current
   // file size:
   int64_t curFileSize = TellFile64(fOutFid);
@@ -768,7 +780,7 @@ void SubsessionIOState::useFrame(SubsessionBuffer& buffer) {
   unsigned char* const frameSource = buffer.dataStart();
   unsigned const frameSize = buffer.bytesInUse();
   struct timeval const& presentationTime = buffer.presentationTime();
-  int64_t const destFileOffset = TellFile64(fOurSink.fOutFid);
+  int64_t const destFileOffset = fOurSink.fOutputWriter->tell();
   unsigned sampleNumberOfFrameStart = fQTTotNumSamples + 1;
   Boolean avcHack = fQTMediaDataAtomCreator == &QuickTimeFileSink::addAtom_avc1;
 
@@ -821,7 +833,7 @@ void SubsessionIOState::useFrame(SubsessionBuffer& buffer) {
   if (avcHack) fOurSink.addWord(frameSize);
 
   // Write the data into the file:
-  fwrite(frameSource, 1, frameSize, fOurSink.fOutFid);
+  fOurSink.fOutputWriter->write(frameSource, frameSize);
 
   // If we have a hint track, then write to it also:
   if (hasHintTrack()) {
@@ -882,7 +894,7 @@ void SubsessionIOState::useFrameForHinting(unsigned frameSize,
       }
     }
 
-    int64_t const hintSampleDestFileOffset = TellFile64(fOurSink.fOutFid);
+    int64_t const hintSampleDestFileOffset = fOurSink.fOutputWriter->tell();
 
     unsigned const maxPacketSize = 1450;
     unsigned short numPTEntries
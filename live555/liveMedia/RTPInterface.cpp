@@ -29,8 +29,12 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 // Helper routines and data structures, used to implement
 // sending/receiving RTP/RTCP over a TCP socket:
 
-static void sendRTPOverTCP(unsigned char* packet, unsigned packetSize,
-			   int socketNum, unsigned char streamChannelId);
+class TCPOutputPacket; // forward
+
+static void sendRTPOverTCP(UsageEnvironment& env,
+			   unsigned char* packet, unsigned packetSize,
+			   int socketNum, unsigned char streamChannelId,
+			   TCPOutputPacket*& queuedCopy);
 
 // Reading RTP-over-TCP is implemented using two levels of hash tables.
 // The top-level hash table maps TCP socket numbers to a
@@ -48,11 +52,58 @@ static HashTable* socketHashTable(UsageEnvironment& env, Boolean createIfNotPres
   return (HashTable*)(ourTables->socketTable);
 }
 
+// A copy of a packet that's waiting to be sent over one or more TCP sockets.
+// (When a packet is sent to several clients over TCP, all the sockets that
+// can't take it right away share the same copy.)
+class TCPOutputPacket {
+public:
+  TCPOutputPacket(unsigned char const* data, unsigned dataSize);
+
+  TCPOutputPacket* ref() { ++fRefCount; return this; }
+  void unref() { if (--fRefCount == 0) delete this; }
+
+private:
+  virtual ~TCPOutputPacket(); // deleted only by "unref()"
+
+public:
+  unsigned char* fData;
+  unsigned fSize;
+
+private:
+  unsigned fRefCount;
+};
+
+// Data that is waiting to be sent over a TCP socket: an (optional) RTP-over-TCP
+// header of our own, followed by a (shared) packet:
+class TCPOutputChunk {
+public:
+  TCPOutputChunk(unsigned char const* header, unsigned headerSize,
+		 TCPOutputPacket* packet, Boolean isDroppable);
+  virtual ~TCPOutputChunk();
+
+public:
+  TCPOutputChunk* fNext;
+  unsigned char fHeader[4];
+  unsigned fHeaderSize;
+  TCPOutputPacket* fPacket;
+  unsigned fSize; // header + packet
+  Boolean fIsDroppable; // True for a RTP/RTCP packet that hasn't started to be sent
+};
+
 class SocketDescriptor {
 public:
   SocketDescriptor(UsageEnvironment& env, int socketNum);
   virtual ~SocketDescriptor();
 
+  void registerWriter() { ++fNumWriters; }
+  void deregisterWriter();
+      // Note: This may delete "this", if no more interfaces are using this socket
+  void sendRTPPacket(unsigned char streamChannelId,
+		     unsigned char* packet, unsigned packetSize,
+		     TCPOutputPacket*& queuedCopy);
+      // If the packet has to be queued, it uses (or sets) "queuedCopy"
+  void sendOtherData(unsigned char const* data, unsigned dataSize);
+
   void registerRTPInterface(unsigned char streamChannelId,
 			    RTPInterface* rtpInterface);
   RTPInterface* lookupRTPInterface(unsigned char streamChannelId);
@@ -67,6 +118,14 @@ private:
   static void tcpReadHandler(SocketDescriptor*, int mask);
   void tcpReadHandler1(int mask);
 
+  void enqueueOutput(unsigned char const* header, unsigned headerSize,
+		     TCPOutputPacket* packet, Boolean isDroppable);
+  Boolean makeRoomInOutputQueue(unsigned size);
+  void drainOutputQueue();
+  void discardOutputQueue();
+  void socketFailed();
+  void updateBackgroundHandling();
+
 private:
   UsageEnvironment& fEnv;
   int fOurSocketNum;
@@ -75,6 +134,16 @@ private:
   void* fServerRequestAlternativeByteHandlerClientData;
   u_int8_t fStreamChannelId, fSizeByte1;
   enum { AWAITING_DOLLAR, AWAITING_STREAM_CHANNEL_ID, AWAITING_SIZE1, AWAITING_SIZE2, AWAITING_PACKET_DATA } fTCPReadingState;
+
+  // Output:
+  unsigned fNumWriters; // the number of (interface, channel) pairs that send over this socket
+  TCPOutputChunk* fOutputQueueHead;
+  TCPOutputChunk* fOutputQueueTail;
+  unsigned fOutputQueueHeadOffset; // how much of the head chunk has already been sent
+  unsigned fOutputQueueSize; // the number of bytes in the queue that haven't been sent yet
+  unsigned fNumDroppedPackets;
+  Boolean fSocketFailed;
+  int fConditionSet; // the conditions that we're currently handling on our socket
 };
 
 static SocketDescriptor* lookupSocketDescriptor(UsageEnvironment& env, int sockNum, Boolean createIfNotFound = True) {
@@ -108,6 +177,9 @@ static void removeSocketDescription(UsageEnvironment& env, int sockNum) {
 
 ////////// RTPInterface - Implementation //////////
 
+unsigned RTPInterface::tcpOutputQueueMaxSize = 256*1024;
+Boolean RTPInterface::tcpOutputQueueDropOldest = True;
+
 RTPInterface::RTPInterface(Medium* owner, Groupsock* gs)
   : fOwner(owner), fGS(gs),
     fTCPStreams(NULL),
@@ -123,6 +195,12 @@ RTPInterface::RTPInterface(Medium* owner, Groupsock* gs)
 }
 
 RTPInterface::~RTPInterface() {
+  for (tcpStreamRecord* streams = fTCPStreams; streams != NULL;
+       streams = streams->fNext) {
+    SocketDescriptor* socketDescriptor
+      = lookupSocketDescriptor(envir(), streams->fStreamSocketNum, False);
+    if (socketDescriptor != NULL) socketDescriptor->deregisterWriter();
+  }
   delete fTCPStreams;
 }
 
@@ -145,6 +223,7 @@ void RTPInterface::addStreamSocket(int sockNum,
   }
 
   fTCPStreams = new tcpStreamRecord(sockNum, streamChannelId, fTCPStreams);
+  lookupSocketDescriptor(envir(), sockNum)->registerWriter();
 }
 
 static void deregisterSocket(UsageEnvironment& env, int sockNum, unsigned char streamChannelId) {
@@ -163,6 +242,8 @@ void RTPInterface::removeStreamSocket(int sockNum,
     if ((*streamsPtr)->fStreamSocketNum == sockNum
 	&& (*streamsPtr)->fStreamChannelId == streamChannelId) {
       deregisterSocket(envir(), sockNum, streamChannelId);
+      SocketDescriptor* socketDescriptor = lookupSocketDescriptor(envir(), sockNum, False);
+      if (socketDescriptor != NULL) socketDescriptor->deregisterWriter();
 
       // Then remove the record pointed to by *streamsPtr :
       tcpStreamRecord* next = (*streamsPtr)->fNext;
@@ -186,11 +267,26 @@ void RTPInterface::sendPacket(unsigned char* packet, unsigned packetSize) {
   // Normal case: Send as a UDP packet:
   fGS->output(envir(), fGS->ttl(), packet, packetSize);
 
-  // Also, send over each of our TCP sockets:
+  // Also, send over each of our TCP sockets.  (The packet is copied - once -
+  // only if it has to be queued for some of them.)
+  TCPOutputPacket* queuedCopy = NULL;
   for (tcpStreamRecord* streams = fTCPStreams; streams != NULL;
        streams = streams->fNext) {
-    sendRTPOverTCP(packet, packetSize,
-		   streams->fStreamSocketNum, streams->fStreamChannelId);
+    sendRTPOverTCP(envir(), packet, packetSize,
+		   streams->fStreamSocketNum, streams->fStreamChannelId,
+		   queuedCopy);
+  }
+  if (queuedCopy != NULL) queuedCopy->unref();
+}
+
+void RTPInterface::sendOtherDataOverTCP(UsageEnvironment& env, int socketNum,
+					unsigned char const* data, unsigned dataSize) {
+  SocketDescriptor* socketDescriptor = lookupSocketDescriptor(env, socketNum, False);
+  if (socketDescriptor != NULL) {
+    socketDescriptor->sendOtherData(data, dataSize);
+  } else {
+    // No RTP/RTCP uses this socket, so just send the data:
+    send(socketNum, (char const*)data, dataSize, 0);
   }
 }
 
@@ -253,6 +349,10 @@ Boolean RTPInterface::handleRead(unsigned char* buffer, unsigned bufferMaxSize,
   return readSuccess;
 }
 
+Boolean RTPInterface::hasBufferedPackets() const {
+  return fNextTCPReadStreamSocketNum < 0 && fGS->hasBufferedPackets();
+}
+
 void RTPInterface::stopNetworkReading() {
   // Normal case
   envir().taskScheduler().turnOffBackgroundReadHandling(fGS->socketNum());
@@ -267,49 +367,272 @@ void RTPInterface::stopNetworkReading() {
 
 ////////// Helper Functions - Implementation /////////
 
-void sendRTPOverTCP(unsigned char* packet, unsigned packetSize,
-                    int socketNum, unsigned char streamChannelId) {
+void sendRTPOverTCP(UsageEnvironment& env,
+		    unsigned char* packet, unsigned packetSize,
+		    int socketNum, unsigned char streamChannelId,
+		    TCPOutputPacket*& queuedCopy) {
 #ifdef DEBUG
   fprintf(stderr, "sendRTPOverTCP: %d bytes over channel %d (socket %d)\n",
 	  packetSize, streamChannelId, socketNum); fflush(stderr);
 #endif
-  // Send RTP over TCP, using the encoding defined in
-  // RFC 2326, section 10.12:
-  do {
-    char const dollar = '$';
-    if (send(socketNum, &dollar, 1, 0) != 1) break;
-    if (send(socketNum, (char*)&streamChannelId, 1, 0) != 1) break;
-
-    char netPacketSize[2];
-    netPacketSize[0] = (char) ((packetSize&0xFF00)>>8);
-    netPacketSize[1] = (char) (packetSize&0xFF);
-    if (send(socketNum, netPacketSize, 2, 0) != 2) break;
+  SocketDescriptor* socketDescriptor = lookupSocketDescriptor(env, socketNum);
+  socketDescriptor->sendRTPPacket(streamChannelId, packet, packetSize, queuedCopy);
+}
 
-    if (send(socketNum, (char*)packet, packetSize, 0) != (int)packetSize) break;
+TCPOutputPacket::TCPOutputPacket(unsigned char const* data, unsigned dataSize)
+  : fSize(dataSize), fRefCount(1) {
+  fData = new unsigned char[dataSize];
+  memmove(fData, data, dataSize);
+}
 
-#ifdef DEBUG
-    fprintf(stderr, "sendRTPOverTCP: completed\n"); fflush(stderr);
-#endif
+TCPOutputPacket::~TCPOutputPacket() {
+  delete[] fData;
+}
 
-    return;
-  } while (0);
+TCPOutputChunk::TCPOutputChunk(unsigned char const* header, unsigned headerSize,
+			       TCPOutputPacket* packet, Boolean isDroppable)
+  : fNext(NULL), fHeaderSize(headerSize), fPacket(packet->ref()),
+    fSize(headerSize + packet->fSize), fIsDroppable(isDroppable) {
+  if (headerSize > 0) memmove(fHeader, header, headerSize);
+}
 
-#ifdef DEBUG
-  fprintf(stderr, "sendRTPOverTCP: failed!\n"); fflush(stderr);
-#endif
+TCPOutputChunk::~TCPOutputChunk() {
+  fPacket->unref();
 }
 
 SocketDescriptor::SocketDescriptor(UsageEnvironment& env, int socketNum)
   :fEnv(env), fOurSocketNum(socketNum),
     fSubChannelHashTable(HashTable::create(ONE_WORD_HASH_KEYS)),
    fServerRequestAlternativeByteHandler(NULL), fServerRequestAlternativeByteHandlerClientData(NULL),
-   fTCPReadingState(AWAITING_DOLLAR) {
+   fTCPReadingState(AWAITING_DOLLAR),
+   fNumWriters(0), fOutputQueueHead(NULL), fOutputQueueTail(NULL),
+   fOutputQueueHeadOffset(0), fOutputQueueSize(0), fNumDroppedPackets(0),
+   fSocketFailed(False), fConditionSet(0) {
 }
 
 SocketDescriptor::~SocketDescriptor() {
+  discardOutputQueue();
   delete fSubChannelHashTable;
 }
 
+void SocketDescriptor::deregisterWriter() {
+  if (fNumWriters > 0) --fNumWriters;
+
+  if (fNumWriters == 0 && fSubChannelHashTable->IsEmpty()) {
+    // No more interfaces are using us.  Send what we can of any queued data
+    // (so that a packet that has been started is completed, if possible),
+    // then it's curtains for us:
+    if (fOutputQueueHead != NULL) drainOutputQueue();
+#ifdef DEBUG
+    if (fOutputQueueHead != NULL || fNumDroppedPackets > 0) {
+      fprintf(stderr, "SocketDescriptor(socket %d): %d queued bytes discarded, %d packets dropped\n", fOurSocketNum, fOutputQueueSize, fNumDroppedPackets);
+    }
+#endif
+    removeSocketDescription(fEnv, fOurSocketNum);
+    delete this;
+  }
+}
+
+void SocketDescriptor::sendRTPPacket(unsigned char streamChannelId,
+				     unsigned char* packet, unsigned packetSize,
+				     TCPOutputPacket*& queuedCopy) {
+  if (fSocketFailed) return;
+
+  // Send RTP over TCP, using the encoding defined in
+  // RFC 2326, section 10.12:
+  unsigned char header[4];
+  header[0] = '$';
+  header[1] = streamChannelId;
+  header[2] = (unsigned char)((packetSize&0xFF00)>>8);
+  header[3] = (unsigned char)(packetSize&0xFF);
+
+  // Any older queued data must be sent first:
+  if (fOutputQueueHead != NULL) drainOutputQueue();
+
+  if (fOutputQueueHead == NULL && !fSocketFailed) {
+    // Send the header and the packet together, with a single system call:
+    StreamOutputBuffer buffers[2];
+    buffers[0].data = header; buffers[0].dataSize = sizeof header;
+    buffers[1].data = packet; buffers[1].dataSize = packetSize;
+    int bytesSent = writeSocketGather(fEnv, fOurSocketNum, buffers, 2);
+    if (bytesSent < 0) {
+      socketFailed();
+      return;
+    }
+    if ((unsigned)bytesSent == sizeof header + packetSize) return;
+
+    if (bytesSent > 0) {
+      // The rest of the packet must be sent before anything else on this socket,
+      // so it's queued regardless of the queue's limits:
+      if (queuedCopy == NULL) queuedCopy = new TCPOutputPacket(packet, packetSize);
+      enqueueOutput(header, sizeof header, queuedCopy, False);
+      fOutputQueueHeadOffset = bytesSent;
+      fOutputQueueSize -= bytesSent;
+      updateBackgroundHandling();
+      return;
+    }
+  }
+  if (fSocketFailed) return;
+
+  // The socket can't take the packet now, so queue it (if there's room):
+  if (!makeRoomInOutputQueue(sizeof header + packetSize)) {
+    ++fNumDroppedPackets;
+    return;
+  }
+  if (queuedCopy == NULL) queuedCopy = new TCPOutputPacket(packet, packetSize);
+  enqueueOutput(header, sizeof header, queuedCopy, True);
+  updateBackgroundHandling();
+}
+
+void SocketDescriptor::sendOtherData(unsigned char const* data, unsigned dataSize) {
+  if (fSocketFailed) return;
+
+  if (fOutputQueueHead != NULL) drainOutputQueue();
+
+  if (fOutputQueueHead == NULL && !fSocketFailed) {
+    StreamOutputBuffer buffer;
+    buffer.data = data; buffer.dataSize = dataSize;
+    int bytesSent = writeSocketGather(fEnv, fOurSocketNum, &buffer, 1);
+    if (bytesSent < 0) {
+      socketFailed();
+      return;
+    }
+    data += bytesSent;
+    dataSize -= bytesSent;
+  }
+  if (fSocketFailed || dataSize == 0) return;
+
+  TCPOutputPacket* copy = new TCPOutputPacket(data, dataSize);
+  enqueueOutput(NULL, 0, copy, False);
+  copy->unref();
+  updateBackgroundHandling();
+}
+
+void SocketDescriptor
+::enqueueOutput(unsigned char const* header, unsigned headerSize,
+		TCPOutputPacket* packet, Boolean isDroppable) {
+  TCPOutputChunk* chunk
+    = new TCPOutputChunk(header, headerSize, packet, isDroppable);
+  if (fOutputQueueTail == NULL) {
+    fOutputQueueHead = fOutputQueueTail = chunk;
+  } else {
+    fOutputQueueTail->fNext = chunk;
+    fOutputQueueTail = chunk;
+  }
+  fOutputQueueSize += chunk->fSize;
+}
+
+Boolean SocketDescriptor::makeRoomInOutputQueue(unsigned size) {
+  unsigned const maxSize = RTPInterface::tcpOutputQueueMaxSize;
+  if (size > maxSize) return False;
+
+  while (fOutputQueueSize + size > maxSize) {
+    if (!RTPInterface::tcpOutputQueueDropOldest) return False;
+
+    // Drop the oldest packet that hasn't started to be sent:
+    TCPOutputChunk* prev = NULL;
+    TCPOutputChunk* chunk = fOutputQueueHead;
+    while (chunk != NULL && !chunk->fIsDroppable) {
+      prev = chunk;
+      chunk = chunk->fNext;
+    }
+    if (chunk == NULL) return False; // nothing can be dropped
+
+    if (prev == NULL) {
+      fOutputQueueHead = chunk->fNext;
+    } else {
+      prev->fNext = chunk->fNext;
+    }
+    if (fOutputQueueTail == chunk) fOutputQueueTail = prev;
+    fOutputQueueSize -= chunk->fSize;
+    delete chunk;
+    ++fNumDroppedPackets;
+  }
+
+  return True;
+}
+
+void SocketDescriptor::drainOutputQueue() {
+  while (fOutputQueueHead != NULL) {
+    // Send as many queued chunks as possible, with a single system call:
+    StreamOutputBuffer buffers[MAX_STREAM_GATHER];
+    unsigned numBuffers = 0, numBytes = 0;
+    for (TCPOutputChunk* chunk = fOutputQueueHead;
+	 chunk != NULL && numBuffers + 2 <= MAX_STREAM_GATHER; chunk = chunk->fNext) {
+      unsigned offset = chunk == fOutputQueueHead ? fOutputQueueHeadOffset : 0;
+      if (offset < chunk->fHeaderSize) {
+	buffers[numBuffers].data = &chunk->fHeader[offset];
+	buffers[numBuffers].dataSize = chunk->fHeaderSize - offset;
+	numBytes += buffers[numBuffers++].dataSize;
+	offset = chunk->fHeaderSize;
+      }
+      buffers[numBuffers].data = &chunk->fPacket->fData[offset - chunk->fHeaderSize];
+      buffers[numBuffers].dataSize = chunk->fSize - offset;
+      numBytes += buffers[numBuffers++].dataSize;
+    }
+
+    int bytesSent = writeSocketGather(fEnv, fOurSocketNum, buffers, numBuffers);
+    if (bytesSent < 0) {
+      socketFailed();
+      return;
+    }
+
+    // Remove the data that was sent from the queue:
+    unsigned numLeft = bytesSent;
+    fOutputQueueSize -= numLeft;
+    while (numLeft > 0) {
+      TCPOutputChunk* head = fOutputQueueHead;
+      unsigned headSize = head->fSize - fOutputQueueHeadOffset;
+      if (numLeft < headSize) {
+	fOutputQueueHeadOffset += numLeft;
+	head->fIsDroppable = False; // it has been started now
+	break;
+      }
+      numLeft -= headSize;
+      fOutputQueueHead = head->fNext;
+      if (fOutputQueueHead == NULL) fOutputQueueTail = NULL;
+      fOutputQueueHeadOffset = 0;
+      delete head;
+    }
+
+    if ((unsigned)bytesSent < numBytes) break; // the socket's send buffer is full
+  }
+
+  updateBackgroundHandling();
+}
+
+void SocketDescriptor::discardOutputQueue() {
+  while (fOutputQueueHead != NULL) {
+    TCPOutputChunk* head = fOutputQueueHead;
+    fOutputQueueHead = head->fNext;
+    delete head;
+  }
+  fOutputQueueTail = NULL;
+  fOutputQueueHeadOffset = fOutputQueueSize = 0;
+}
+
+void SocketDescriptor::socketFailed() {
+  // The connection is probably gone, so there's no point in keeping (or sending) any more data:
+  discardOutputQueue();
+  fSocketFailed = True;
+  updateBackgroundHandling();
+}
+
+void SocketDescriptor::updateBackgroundHandling() {
+  // We handle events on our socket only while we're reading from it.  Otherwise, its handler
+  // belongs to someone else (e.g., the RTSP server), so we don't get told when the socket
+  // becomes writable; instead, our queue gets drained when more data is sent.
+  if (fSubChannelHashTable->IsEmpty() || fConditionSet == 0) return;
+
+  int conditionSet = SOCKET_READABLE;
+  if (fOutputQueueHead != NULL) conditionSet |= SOCKET_WRITABLE;
+  if (conditionSet == fConditionSet) return;
+
+  fConditionSet = conditionSet;
+  fEnv.taskScheduler().setBackgroundHandling(fOurSocketNum, fConditionSet,
+     (TaskScheduler::BackgroundHandlerProc*)&tcpReadHandler, this);
+}
+
 void SocketDescriptor::registerRTPInterface(unsigned char streamChannelId,
 					    RTPInterface* rtpInterface) {
   Boolean isFirstRegistration = fSubChannelHashTable->IsEmpty();
@@ -317,11 +640,13 @@ void SocketDescriptor::registerRTPInterface(unsigned char streamChannelId,
 			    rtpInterface);
 
   if (isFirstRegistration) {
-    // Arrange to handle reads on this TCP socket:
+    // Arrange to handle reads (and, if we have queued output, writes) on this TCP socket:
+    fConditionSet = SOCKET_READABLE;
+    if (fOutputQueueHead != NULL) fConditionSet |= SOCKET_WRITABLE;
     TaskScheduler::BackgroundHandlerProc* handler
       = (TaskScheduler::BackgroundHandlerProc*)&tcpReadHandler;
     fEnv.taskScheduler().
-      turnOnBackgroundReadHandling(fOurSocketNum, handler, this);
+      setBackgroundHandling(fOurSocketNum, fConditionSet, handler, this);
   }
 }
 
@@ -336,10 +661,15 @@ void SocketDescriptor
   fSubChannelHashTable->Remove((char const*)(long)streamChannelId);
 
   if (fSubChannelHashTable->IsEmpty()) {
-    // No more interfaces are using us, so it's curtains for us now
+    // No more interfaces are reading from us:
     fEnv.taskScheduler().turnOffBackgroundReadHandling(fOurSocketNum);
-    removeSocketDescription(fEnv, fOurSocketNum);
-    delete this;
+    fConditionSet = 0;
+
+    if (fNumWriters == 0) {
+      // Nor writing, so it's curtains for us now
+      removeSocketDescription(fEnv, fOurSocketNum);
+      delete this;
+    }
   }
 }
 
@@ -356,6 +686,12 @@ void SocketDescriptor::tcpReadHandler1(int mask) {
   //   the packet data.
   // However, because the socket is being read asynchronously, this data might arrive in pieces.
   
+  if (mask&SOCKET_WRITABLE) {
+    // There's room for (some of) our queued output:
+    drainOutputQueue();
+    if (!(mask&SOCKET_READABLE)) return;
+  }
+
   u_int8_t c;
   struct sockaddr_in fromAddress;
   if (fTCPReadingState != AWAITING_PACKET_DATA) {
@@ -363,6 +699,8 @@ void SocketDescriptor::tcpReadHandler1(int mask) {
     if (result != 1) { // error reading TCP socket, or no more data available
       if (result < 0) { // error
 	fEnv.taskScheduler().turnOffBackgroundReadHandling(fOurSocketNum); // stops further calls to us
+	fConditionSet = 0;
+	socketFailed();
       }
       return;
     }
@@ -143,7 +143,8 @@ Boolean RTSPClient::changeResponseHandler(unsigned cseq, responseHandler* newRes
   RequestRecord* request;
   if ((request = fRequestsAwaitingConnection.findByCSeq(cseq)) != NULL
       || (request = fRequestsAwaitingHTTPTunneling.findByCSeq(cseq)) != NULL
-      || (request = fRequestsAwaitingResponse.findByCSeq(cseq)) != NULL) {
+      || (request = fRequestsAwaitingResponse.findByCSeq(cseq)) != NULL
+      || (request = fRequestsAwaitingSessionId.findByCSeq(cseq)) != NULL) {
     request->handler() = newResponseHandler;
     return True;
   }
@@ -286,7 +287,7 @@ RTSPClient::RTSPClient(UsageEnvironment& env, char const* rtspURL,
     fVerbosityLevel(verbosityLevel), fTunnelOverHTTPPortNum(tunnelOverHTTPPortNum),
     fUserAgentHeaderStr(NULL), fUserAgentHeaderStrLen(0), fInputSocketNum(-1), fOutputSocketNum(-1), fServerAddress(0), fCSeq(1),
     fBaseURL(NULL), fTCPStreamIdCount(0), fLastSessionId(NULL), fSessionTimeoutParameter(0),
-    fSessionCookieCounter(0), fHTTPTunnelingConnectionIsPending(False) {
+    fNextResponseTask(NULL), fSessionCookieCounter(0), fHTTPTunnelingConnectionIsPending(False) {
   setBaseURL(rtspURL);
 
   fResponseBuffer = new char[responseBufferSize+1];
@@ -346,6 +347,7 @@ void RTSPClient::resetTCPSockets() {
 }
 
 void RTSPClient::resetResponseBuffer() {
+  envir().taskScheduler().unscheduleDelayedTask(fNextResponseTask);
   fResponseBytesAlreadySeen = 0;
   fResponseBufferBytesLeft = responseBufferSize;
 }
@@ -374,6 +376,7 @@ int RTSPClient::openConnection() {
     // We don't yet have a TCP socket (or we used to have one, but it got closed).  Set it up now.
     fInputSocketNum = fOutputSocketNum = setupStreamSocket(envir(), 0);
     if (fInputSocketNum < 0) break;
+    makeSocketNoDelay(fInputSocketNum);
       
     // Connect to the remote endpoint:
     fServerAddress = *(unsigned*)(destAddress.data());
@@ -521,6 +524,12 @@ unsigned RTSPClient::sendRequest(RequestRecord* request) {
       return request->cseq();
     }
 
+    // If this request needs the session id that the response to an earlier "SETUP" will give us, send it once we have that:
+    if (requestMustAwaitSessionId(request)) {
+      fRequestsAwaitingSessionId.enqueue(request);
+      return request->cseq();
+    }
+
     // Construct and send the command:
 
     // First, construct command-specific headers that we need:
@@ -777,6 +786,33 @@ unsigned RTSPClient::sendRequest(RequestRecord* request) {
   return 0;
 }
 
+Boolean RTSPClient::requestMustAwaitSessionId(RequestRecord* request) {
+  // HTTP requests (used to set up RTSP-over-HTTP tunneling) never wait:
+  char const* cmdName = request->commandName();
+  if (strcmp(cmdName, "GET") == 0 || strcmp(cmdName, "POST") == 0) return False;
+
+  // Otherwise, keep requests in order behind any that are already waiting:
+  if (!fRequestsAwaitingSessionId.isEmpty()) return True;
+
+  if (fLastSessionId != NULL
+      || strcmp(cmdName, "DESCRIBE") == 0 || strcmp(cmdName, "OPTIONS") == 0 || strcmp(cmdName, "ANNOUNCE") == 0) return False;
+  return fRequestsAwaitingResponse.findByCommandName("SETUP") != NULL;
+}
+
+void RTSPClient::sendRequestsAwaitingSessionId() {
+  // Move all waiting requests into a new, temporary queue, so that "sendRequest()" doesn't just enqueue them all over again.
+  // (If we still have no session id - because the "SETUP" failed - then the next "SETUP", if any, will make the rest wait again.)
+  RequestQueue tmpRequestQueue;
+  RequestRecord* request;
+  while ((request = fRequestsAwaitingSessionId.dequeue()) != NULL) {
+    tmpRequestQueue.enqueue(request);
+  }
+
+  while ((request = tmpRequestQueue.dequeue()) != NULL) {
+    sendRequest(request);
+  }
+}
+
 void RTSPClient::handleRequestError(RequestRecord* request) {
   int resultCode = -envir().getErrno();
   if (resultCode == 0) {
@@ -1211,6 +1247,7 @@ void RTSPClient::responseHandlerForHTTP_GET1(int responseCode, char* responseStr
     // (to the same server & port as before) for the client->server link.  All future output will be to this new socket.
     fOutputSocketNum = setupStreamSocket(envir(), 0);
     if (fOutputSocketNum < 0) break;
+    makeSocketNoDelay(fOutputSocketNum);
 
     fHTTPTunnelingConnectionIsPending = True;
     int connectResult = connectToServer(fOutputSocketNum, fTunnelOverHTTPPortNum);
@@ -1347,7 +1384,16 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
       if (newBytesRead > 0) break; // The "RTSP response was truncated" error is applied to the first response handler only
     }
 
-    if (newBytesRead <= 0) resetTCPSockets();
+    if (newBytesRead <= 0) {
+      // Any requests that are waiting for a session id will now never get one:
+      while ((request = fRequestsAwaitingSessionId.dequeue()) != NULL) {
+	handleRequestError(request);
+	delete request;
+      }
+      resetTCPSockets();
+    } else if (fRequestsAwaitingResponse.findByCommandName("SETUP") == NULL) {
+      sendRequestsAwaitingSessionId();
+    }
     resetResponseBuffer();
     return;    
   } while (0);
@@ -1356,8 +1402,12 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
   fResponseBytesAlreadySeen += newBytesRead;
   fResponseBuffer[fResponseBytesAlreadySeen] = '\0';
   if (fVerbosityLevel >= 1 && newBytesRead > 1) envir() << "Received " << newBytesRead << " new bytes of response data.\n";
-  
-  // Data was read OK.  Look through the data that we've read so far, to see if it contains <CR><LF><CR><LF>.
+
+  handleBufferedResponse();
+}
+
+void RTSPClient::handleBufferedResponse() {
+  // Look through the data that we've read so far, to see if it contains <CR><LF><CR><LF>.
   // (If not, wait for more data to arrive.)
   Boolean endOfHeaders = False;
   if (fResponseBytesAlreadySeen > 3) {
@@ -1390,6 +1440,7 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
   char const* publicParamsStr = NULL;
   char* bodyStart = NULL;
   unsigned numBodyBytes = 0;
+  unsigned responseSize = 0; // until we know that the buffer also contains (the start of) a subsequent response
   Boolean responseSuccess = False; // by default
   do {
     headerDataCopy = new char[responseBufferSize];
@@ -1474,7 +1525,7 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
 
     // If we saw a "Content-Length:" header, then make sure that we have the amount of data that it specified:
     unsigned bodyOffset = nextLineStart - headerDataCopy;
-    bodyStart = &fResponseBuffer[bodyOffset];
+    bodyStart = &headerDataCopy[bodyOffset]; // not in "fResponseBuffer", because that may get reused for the next response
     numBodyBytes = fResponseBytesAlreadySeen - bodyOffset;
     if (contentLength > numBodyBytes) {
       // We need to read more data.  First, make sure we have enough space for it:
@@ -1499,6 +1550,13 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
     }
 
     // We now have a complete response (including all bytes specified by the "Content-Length:" header, if any).
+    // If the server has also sent (the start of) the response to a later - pipelined - request, then set that aside:
+    unsigned numExtraBytes = numBodyBytes - contentLength;
+    if (numExtraBytes > 0 && strncmp(&fResponseBuffer[bodyOffset+contentLength], "RTSP/", numExtraBytes < 5 ? numExtraBytes : 5) == 0) {
+      responseSize = bodyOffset + contentLength;
+      numBodyBytes = contentLength;
+      bodyStart[numBodyBytes] = '\0';
+    }
     if (fVerbosityLevel >= 1) {
       envir() << "Received a complete "
 	      << (foundRequest != NULL ? foundRequest->commandName() : "(unknown)")
@@ -1534,7 +1592,7 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
       }
 
       if (needToResendCommand) {
-	resetResponseBuffer();
+	setAsideNextResponse(responseSize);
 	if (!resendCommand(foundRequest)) break;
 	delete[] headerDataCopy;
 	return; // without calling our response handler; the response to the resent command will do that
@@ -1545,7 +1603,11 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
   } while (0);
 
   // If we have a handler function for this response, call it:
-  resetResponseBuffer(); // in preparation for our next response.  Do this now, in case the handler function goes to the event loop.
+  setAsideNextResponse(responseSize); // in preparation for our next response.  Do this now, in case the handler function goes to the event loop.
+  if (foundRequest != NULL && strcmp(foundRequest->commandName(), "SETUP") == 0) {
+    // Send any requests that were waiting for this response's session id:
+    sendRequestsAwaitingSessionId();
+  }
   if (foundRequest != NULL && foundRequest->handler() != NULL) {
     int resultCode;
     char* resultString;
@@ -1569,6 +1631,30 @@ void RTSPClient::handleResponseBytes(int newBytesRead) {
   delete[] headerDataCopy;
 }
 
+void RTSPClient::setAsideNextResponse(unsigned responseSize) {
+  if (responseSize == 0 || fInputSocketNum < 0) {
+    resetResponseBuffer();
+    return;
+  }
+
+  // Move the next response to the start of our buffer.  We handle it only after returning to the event loop, because the
+  // handler function for the current response might delete us:
+  unsigned numExtraBytes = fResponseBytesAlreadySeen - responseSize;
+  memmove(fResponseBuffer, &fResponseBuffer[responseSize], numExtraBytes);
+  fResponseBytesAlreadySeen = numExtraBytes;
+  fResponseBufferBytesLeft = responseBufferSize - numExtraBytes;
+  fResponseBuffer[fResponseBytesAlreadySeen] = '\0';
+
+  envir().taskScheduler().unscheduleDelayedTask(fNextResponseTask);
+  fNextResponseTask = envir().taskScheduler().scheduleDelayedTask(0, (TaskFunc*)handleNextResponse, this);
+}
+
+void RTSPClient::handleNextResponse(void* rtspClient) {
+  RTSPClient* client = (RTSPClient*)rtspClient;
+  client->fNextResponseTask = NULL;
+  client->handleBufferedResponse();
+}
+
 
 ////////// RTSPClient::RequestRecord implementation //////////
 
@@ -1634,6 +1720,14 @@ RTSPClient::RequestRecord* RTSPClient::RequestQueue::findByCSeq(unsigned cseq) {
   return NULL;
 }
 
+RTSPClient::RequestRecord* RTSPClient::RequestQueue::findByCommandName(char const* commandName) {
+  RequestRecord* request;
+  for (request = fHead; request != NULL; request = request->next()) {
+    if (strcmp(request->commandName(), commandName) == 0) return request;
+  }
+  return NULL;
+}
+
 
 #ifdef RTSPCLIENT_SYNCHRONOUS_INTERFACE
 // Implementation of the old (synchronous) "RTSPClient" interface, using the new (asynchronous) interface:
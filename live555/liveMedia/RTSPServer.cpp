@@ -30,6 +30,47 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #endif
 #include <time.h> // for "strftime()" and "gmtime()"
 
+////////// RTSPServerWorker definition //////////
+
+// A thread - with its own event loop - that handles the RTSP connections that a server has accepted, and handed to it:
+
+class RTSPServerWorker {
+public:
+  static RTSPServerWorker* createNew(RTSPServer& mainServer, UsageEnvironment& workerEnv);
+  virtual ~RTSPServerWorker(); // stops the thread (called only from the main server's thread)
+
+  Boolean handOffConnection(int clientSocket, unsigned sessionId, struct sockaddr_in const& clientAddr);
+      // called from the main server's thread
+
+private:
+  RTSPServerWorker(UsageEnvironment& workerEnv, RTSPServer* workerServer);
+      // called only by createNew();
+
+  Boolean startThread();
+#ifdef USE_WORKER_THREADS
+  static void* threadMain(void* worker);
+#endif
+  static void incomingConnectionsHandler(void* worker, int /*mask*/);
+  void incomingConnectionsHandler1();
+
+private:
+  // What the main server's thread writes into our pipe, for each connection:
+  struct handedOffConnection {
+    int clientSocket; // -1 tells us to stop
+    unsigned sessionId;
+    struct sockaddr_in clientAddr;
+  };
+
+  UsageEnvironment& fEnv;
+  RTSPServer* fServer; // our own server object, created in "fEnv"
+  int fPipeFds[2]; // [0]: read by our thread; [1]: written by the main server's thread
+  char fStopFlag;
+  Boolean fThreadIsRunning;
+#ifdef USE_WORKER_THREADS
+  pthread_t fThread;
+#endif
+};
+
 ////////// RTSPServer implementation //////////
 
 RTSPServer*
@@ -72,23 +113,33 @@ void RTSPServer::addServerMediaSession(ServerMediaSession* serverMediaSession) {
 
   char const* sessionName = serverMediaSession->streamName();
   if (sessionName == NULL) sessionName = "";
+  lockServerMediaSessions();
   ServerMediaSession* existingSession
     = (ServerMediaSession*)(fServerMediaSessions->Add(sessionName, (void*)serverMediaSession));
+  unlockServerMediaSessions();
   removeServerMediaSession(existingSession); // if any
 }
 
 ServerMediaSession* RTSPServer::lookupServerMediaSession(char const* streamName) {
-  return (ServerMediaSession*)(fServerMediaSessions->Lookup(streamName));
+  // (A worker's server uses the table of the server that created it; see "createWorkerServer()".)
+  return (ServerMediaSession*)(sessionOwner().fServerMediaSessions->Lookup(streamName));
 }
 
 void RTSPServer::removeServerMediaSession(ServerMediaSession* serverMediaSession) {
   if (serverMediaSession == NULL) return;
 
+  lockServerMediaSessions();
   fServerMediaSessions->Remove(serverMediaSession->streamName());
-  if (serverMediaSession->referenceCount() == 0) {
+  Boolean isUnreferenced = serverMediaSession->referenceCount() == 0;
+  if (!isUnreferenced) serverMediaSession->deleteWhenUnreferenced() = True;
+  unlockServerMediaSessions();
+
+  if (isUnreferenced) {
     Medium::close(serverMediaSession);
-  } else {
-    serverMediaSession->deleteWhenUnreferenced() = True;
+  } else if (fNumWorkers > 0) {
+    // The session may be released by a worker thread, which can't delete it, so check for this ourself:
+    fSessionsAwaitingDeletion->Add((char const*)serverMediaSession, serverMediaSession);
+    if (fSessionDeletionTask == NULL) deleteUnreferencedSessions1();
   }
 }
 
@@ -188,6 +239,97 @@ int RTSPServer::setUpOurSocket(UsageEnvironment& env, Port& ourPort) {
   return -1;
 }
 
+Boolean RTSPServer::addWorkerThread(UsageEnvironment& workerEnv) {
+  RTSPServerWorker* worker = RTSPServerWorker::createNew(*this, workerEnv);
+  if (worker == NULL) return False;
+
+  RTSPServerWorker** newWorkers = new RTSPServerWorker*[fNumWorkers+1];
+  for (unsigned i = 0; i < fNumWorkers; ++i) newWorkers[i] = fWorkers[i];
+  newWorkers[fNumWorkers++] = worker;
+  delete[] fWorkers; fWorkers = newWorkers;
+
+  return True;
+}
+
+RTSPServer* RTSPServer
+::createWorkerServer(UsageEnvironment& workerEnv, Port ourPort,
+		     UserAuthenticationDatabase* authDatabase, unsigned reclamationTestSeconds) {
+  // default implementation: The new server uses our "ServerMediaSession"s
+  RTSPServer* workerServer = new RTSPServer(workerEnv, -1, ourPort, authDatabase, reclamationTestSeconds);
+  workerServer->fMainServer = this;
+  return workerServer;
+}
+
+ServerMediaSession* RTSPServer::lookupAndReferenceServerMediaSession(char const* streamName) {
+  // Do this with the session table locked, so that the session can't be deleted before we reference it:
+  RTSPServer& owner = sessionOwner();
+  owner.lockServerMediaSessions();
+  ServerMediaSession* session = lookupServerMediaSession(streamName);
+  if (session != NULL) session->incrementReferenceCount();
+  owner.unlockServerMediaSessions();
+
+  return session;
+}
+
+void RTSPServer::releaseServerMediaSession(ServerMediaSession* serverMediaSession) {
+  if (serverMediaSession == NULL) return;
+
+  RTSPServer& owner = sessionOwner();
+  owner.lockServerMediaSessions();
+  serverMediaSession->decrementReferenceCount();
+  Boolean deleteNow = serverMediaSession->referenceCount() == 0
+    && serverMediaSession->deleteWhenUnreferenced()
+    && &serverMediaSession->envir() == &envir();
+      // (Otherwise, the session's own server deletes it later, from its own thread; see "deleteUnreferencedSessions()".)
+  owner.unlockServerMediaSessions();
+
+  if (deleteNow) {
+    owner.fSessionsAwaitingDeletion->Remove((char const*)serverMediaSession);
+    Medium::close(serverMediaSession);
+  }
+}
+
+void RTSPServer::lockServerMediaSessions() {
+#ifdef USE_WORKER_THREADS
+  pthread_mutex_lock(&fServerMediaSessionsLock);
+#endif
+}
+
+void RTSPServer::unlockServerMediaSessions() {
+#ifdef USE_WORKER_THREADS
+  pthread_mutex_unlock(&fServerMediaSessionsLock);
+#endif
+}
+
+void RTSPServer::deleteUnreferencedSessions(void* server) {
+  ((RTSPServer*)server)->deleteUnreferencedSessions1();
+}
+
+void RTSPServer::deleteUnreferencedSessions1() {
+  fSessionDeletionTask = NULL;
+
+  HashTable::Iterator* iter = HashTable::Iterator::create(*fSessionsAwaitingDeletion);
+  ServerMediaSession* session;
+  char const* key;
+  while ((session = (ServerMediaSession*)(iter->next(key))) != NULL) {
+    lockServerMediaSessions();
+    Boolean isUnreferenced = session->referenceCount() == 0;
+    unlockServerMediaSessions();
+
+    if (isUnreferenced) {
+      fSessionsAwaitingDeletion->Remove(key);
+      Medium::close(session);
+    }
+  }
+  delete iter;
+
+  // Check again later, if there are still sessions in use:
+  if (!fSessionsAwaitingDeletion->IsEmpty()) {
+    fSessionDeletionTask
+      = envir().taskScheduler().scheduleDelayedTask(1000000, (TaskFunc*)deleteUnreferencedSessions, this);
+  }
+}
+
 Boolean RTSPServer
 ::specialClientAccessCheck(int /*clientSocket*/, struct sockaddr_in& /*clientAddr*/, char const* /*urlSuffix*/) {
   // default implementation
@@ -202,7 +344,12 @@ RTSPServer::RTSPServer(UsageEnvironment& env,
     fRTSPServerSocket(ourSocket), fRTSPServerPort(ourPort),
     fHTTPServerSocket(-1), fHTTPServerPort(0), fClientSessionsForHTTPTunneling(NULL),
     fAuthDB(authDatabase), fReclamationTestSeconds(reclamationTestSeconds),
-    fServerMediaSessions(HashTable::create(STRING_HASH_KEYS)) {
+    fServerMediaSessions(HashTable::create(STRING_HASH_KEYS)),
+    fWorkers(NULL), fNumWorkers(0), fNextWorker(0), fMainServer(NULL),
+    fSessionsAwaitingDeletion(HashTable::create(ONE_WORD_HASH_KEYS)), fSessionDeletionTask(NULL) {
+#ifdef USE_WORKER_THREADS
+  pthread_mutex_init(&fServerMediaSessionsLock, NULL);
+#endif
 #ifdef USE_SIGNALS
   // Ignore the SIGPIPE signal, so that clients on the same host that are killed
   // don't also kill us:
@@ -219,11 +366,23 @@ RTSPServer::~RTSPServer() {
   envir().taskScheduler().turnOffBackgroundReadHandling(fRTSPServerSocket);
   ::closeSocket(fRTSPServerSocket);
 
+  // Stop any worker threads (this also deletes their server objects):
+  for (unsigned i = 0; i < fNumWorkers; ++i) delete fWorkers[i];
+  delete[] fWorkers;
+
   envir().taskScheduler().turnOffBackgroundReadHandling(fHTTPServerSocket);
   ::closeSocket(fHTTPServerSocket);
 
   delete fClientSessionsForHTTPTunneling;
 
+  // Our worker threads have stopped (and released the sessions that they used), so delete any sessions that
+  // were waiting for this:
+  envir().taskScheduler().unscheduleDelayedTask(fSessionDeletionTask);
+  fNumWorkers = 0;
+  deleteUnreferencedSessions1();
+  envir().taskScheduler().unscheduleDelayedTask(fSessionDeletionTask);
+  delete fSessionsAwaitingDeletion;
+
   // Remove all server media sessions (they'll get deleted when they're finished):
   while (1) {
     ServerMediaSession* serverMediaSession
@@ -234,6 +393,9 @@ RTSPServer::~RTSPServer() {
 
   // Finally, delete the session table itself:
   delete fServerMediaSessions;
+#ifdef USE_WORKER_THREADS
+  pthread_mutex_destroy(&fServerMediaSessionsLock);
+#endif
 }
 
 Boolean RTSPServer::isRTSPServer() const {
@@ -268,6 +430,7 @@ void RTSPServer::incomingConnectionHandler(int serverSocket) {
     return;
   }
   makeSocketNonBlocking(clientSocket);
+  makeSocketNoDelay(clientSocket);
   increaseSendBufferTo(envir(), clientSocket, 50*1024);
 
 #ifdef DEBUG
@@ -278,10 +441,142 @@ void RTSPServer::incomingConnectionHandler(int serverSocket) {
   // (Choose a random 32-bit integer for the session id (it will be encoded as a 8-digit hex number).  We don't bother checking for
   //  a collision; the probability of two concurrent sessions getting the same session id is very low.)
   unsigned sessionId = (unsigned)our_random();
+
+  // If we have worker threads, then hand new RTSP connections to them, in turn.
+  // (RTSP-over-HTTP tunneling connections stay with us; see "addWorkerThread()".)
+  if (fNumWorkers > 0 && serverSocket == fRTSPServerSocket) {
+    RTSPServerWorker* worker = fWorkers[fNextWorker];
+    fNextWorker = (fNextWorker+1)%fNumWorkers;
+    if (!worker->handOffConnection(clientSocket, sessionId, clientAddr)) ::closeSocket(clientSocket);
+    return;
+  }
+
   (void)createNewClientSession(sessionId, clientSocket, clientAddr);
 }
 
 
+////////// RTSPServerWorker implementation //////////
+
+RTSPServerWorker* RTSPServerWorker::createNew(RTSPServer& mainServer, UsageEnvironment& workerEnv) {
+#ifdef USE_WORKER_THREADS
+  // Make sure that our IP address - which is cached on first use - has been computed before any worker needs it:
+  (void)ourIPAddress(mainServer.envir());
+
+  RTSPServer* workerServer
+    = mainServer.createWorkerServer(workerEnv, mainServer.fRTSPServerPort,
+				    mainServer.fAuthDB, mainServer.fReclamationTestSeconds);
+  if (workerServer == NULL) {
+    mainServer.envir().setResultMsg("failed to create a worker server: ", workerEnv.getResultMsg());
+    return NULL;
+  }
+
+  RTSPServerWorker* worker = new RTSPServerWorker(workerEnv, workerServer);
+  if (!worker->startThread()) {
+    mainServer.envir().setResultMsg(workerEnv.getResultMsg());
+    delete worker;
+    return NULL;
+  }
+  return worker;
+#else
+  mainServer.envir().setResultMsg("worker threads are not supported on this platform");
+  return NULL;
+#endif
+}
+
+RTSPServerWorker::RTSPServerWorker(UsageEnvironment& workerEnv, RTSPServer* workerServer)
+  : fEnv(workerEnv), fServer(workerServer), fStopFlag(0), fThreadIsRunning(False) {
+  fPipeFds[0] = fPipeFds[1] = -1;
+}
+
+RTSPServerWorker::~RTSPServerWorker() {
+#ifdef USE_WORKER_THREADS
+  if (fThreadIsRunning) {
+    // Tell our thread to stop, and wait for it to do so:
+    handOffConnection(-1, 0, sockaddr_in());
+    pthread_join(fThread, NULL);
+  }
+
+  if (fPipeFds[0] >= 0) {
+    fEnv.taskScheduler().turnOffBackgroundReadHandling(fPipeFds[0]);
+
+    // Close any connections that were handed to us, but not yet handled:
+    handedOffConnection connection;
+    while (read(fPipeFds[0], &connection, sizeof connection) == (int)sizeof connection) {
+      if (connection.clientSocket >= 0) ::closeSocket(connection.clientSocket);
+    }
+    close(fPipeFds[0]);
+    close(fPipeFds[1]);
+  }
+#endif
+
+  Medium::close(fServer);
+}
+
+Boolean RTSPServerWorker::startThread() {
+#ifdef USE_WORKER_THREADS
+  if (pipe(fPipeFds) < 0) {
+    fEnv.setResultErrMsg("pipe() failed: ");
+    fPipeFds[0] = fPipeFds[1] = -1;
+    return False;
+  }
+  makeSocketNonBlocking(fPipeFds[0]);
+  fEnv.taskScheduler().turnOnBackgroundReadHandling(fPipeFds[0],
+     (TaskScheduler::BackgroundHandlerProc*)&incomingConnectionsHandler, this);
+
+  int err = pthread_create(&fThread, NULL, threadMain, this);
+  if (err != 0) {
+    fEnv.setResultErrMsg("pthread_create() failed: ", err);
+    return False;
+  }
+  fThreadIsRunning = True;
+  return True;
+#else
+  return False;
+#endif
+}
+
+#ifdef USE_WORKER_THREADS
+void* RTSPServerWorker::threadMain(void* worker) {
+  RTSPServerWorker* ourWorker = (RTSPServerWorker*)worker;
+  ourWorker->fEnv.taskScheduler().doEventLoop(&ourWorker->fStopFlag);
+  return NULL;
+}
+#endif
+
+Boolean RTSPServerWorker
+::handOffConnection(int clientSocket, unsigned sessionId, struct sockaddr_in const& clientAddr) {
+#ifdef USE_WORKER_THREADS
+  handedOffConnection connection;
+  connection.clientSocket = clientSocket;
+  connection.sessionId = sessionId;
+  connection.clientAddr = clientAddr;
+
+  // This is smaller than PIPE_BUF, so it gets written in one piece, even if our thread is reading at the same time:
+  return write(fPipeFds[1], &connection, sizeof connection) == (int)sizeof connection;
+#else
+  return False;
+#endif
+}
+
+void RTSPServerWorker::incomingConnectionsHandler(void* worker, int /*mask*/) {
+  ((RTSPServerWorker*)worker)->incomingConnectionsHandler1();
+}
+
+void RTSPServerWorker::incomingConnectionsHandler1() {
+#ifdef USE_WORKER_THREADS
+  handedOffConnection connection;
+  while (read(fPipeFds[0], &connection, sizeof connection) == (int)sizeof connection) {
+    if (connection.clientSocket < 0) {
+      // We've been told to stop:
+      fStopFlag = 1;
+      return;
+    }
+    (void)fServer->createNewClientSession(connection.sessionId, connection.clientSocket, connection.clientAddr);
+  }
+#endif
+}
+
+
 ////////// RTSPServer::RTSPClientSession implementation //////////
 
 RTSPServer::RTSPClientSession
@@ -316,23 +611,19 @@ RTSPServer::RTSPClientSession::~RTSPClientSession() {
   }
 
   reclaimStreamStates();
-
-  if (fOurServerMediaSession != NULL) {
-    fOurServerMediaSession->decrementReferenceCount();
-    if (fOurServerMediaSession->referenceCount() == 0
-	&& fOurServerMediaSession->deleteWhenUnreferenced()) {
-      fOurServer.removeServerMediaSession(fOurServerMediaSession);
-    }
-  }
+  fOurServer.releaseServerMediaSession(fOurServerMediaSession);
 }
 
 void RTSPServer::RTSPClientSession::reclaimStreamStates() {
+  // (Our stream states are for the subsessions of "fOurServerMediaSession", which may be shared with other threads.)
+  if (fOurServerMediaSession != NULL) fOurServerMediaSession->lock(envir());
   for (unsigned i = 0; i < fNumStreamStates; ++i) {
     if (fStreamStates[i].subsession != NULL) {
       fStreamStates[i].subsession->deleteStream(fOurSessionId,
 						fStreamStates[i].streamToken);
     }
   }
+  if (fOurServerMediaSession != NULL) fOurServerMediaSession->unlock();
   delete[] fStreamStates; fStreamStates = NULL;
   fNumStreamStates = 0;
 }
@@ -381,7 +672,6 @@ void RTSPServer::RTSPClientSession::handleRequestBytes(int newBytesRead) {
     return;
   }
 
-  Boolean endOfMsg = False;
   unsigned char* ptr = &fRequestBuffer[fRequestBytesAlreadySeen];
 #ifdef DEBUG
   ptr[newBytesRead] = '\0';
@@ -418,6 +708,25 @@ void RTSPServer::RTSPClientSession::handleRequestBytes(int newBytesRead) {
     if (fBase64RemainderCount > 0) return; // because we know that we have more input bytes still to receive
   }
 
+  handleDecodedRequestBytes(newBytesRead);
+}
+
+// Returns the value of a "Content-Length:" header (or 0, if there is none) in the request headers "buf":
+static unsigned contentLengthOfRequest(char const* buf, unsigned bufSize) {
+  for (unsigned i = 0; i + 15 < bufSize; ++i) {
+    if ((i == 0 || buf[i-1] == '\n') && _strncasecmp(&buf[i], "Content-Length:", 15) == 0) {
+      unsigned contentLength;
+      if (sscanf(&buf[i+15], " %u", &contentLength) == 1) return contentLength;
+    }
+  }
+
+  return 0;
+}
+
+void RTSPServer::RTSPClientSession::handleDecodedRequestBytes(int newBytesRead) {
+  Boolean endOfMsg = False;
+  unsigned char* ptr = &fRequestBuffer[fRequestBytesAlreadySeen];
+
   // Look for the end of the message: <CR><LF><CR><LF>
   unsigned char *tmpPtr = ptr;
   if (fRequestBytesAlreadySeen > 0) --tmpPtr;
@@ -438,6 +747,15 @@ void RTSPServer::RTSPClientSession::handleRequestBytes(int newBytesRead) {
 
   if (!endOfMsg) return; // subsequent reads will be needed to complete the request
 
+  // The client may have sent further requests without waiting for our response ('pipelining'), so the buffer may
+  // also contain (the start of) those.  Set them aside - after this request's body, if any - until we've handled it:
+  unsigned requestSize = fLastCRLF+4 - fRequestBuffer;
+  requestSize += contentLengthOfRequest((char const*)fRequestBuffer, requestSize);
+  if (requestSize > fRequestBytesAlreadySeen) requestSize = fRequestBytesAlreadySeen;
+  unsigned numPipelinedBytes = fRequestBytesAlreadySeen - requestSize;
+  unsigned char firstPipelinedByte = fRequestBuffer[requestSize];
+  fRequestBytesAlreadySeen = requestSize;
+
   // Parse the request string into command name and 'CSeq', then handle the command:
   fRequestBuffer[fRequestBytesAlreadySeen] = '\0';
   char cmdName[RTSP_PARAM_STRING_MAX];
@@ -463,8 +781,12 @@ void RTSPServer::RTSPClientSession::handleRequestBytes(int newBytesRead) {
 	       || strcmp(cmdName, "PAUSE") == 0
 	       || strcmp(cmdName, "GET_PARAMETER") == 0
 	       || strcmp(cmdName, "SET_PARAMETER") == 0) {
+      // (Our session may be shared with other threads, so lock it while the command uses it:)
+      ServerMediaSession* session = fOurServerMediaSession;
+      if (session != NULL) session->lock(envir());
       handleCmd_withinSession(cmdName, urlPreSuffix, urlSuffix, cseq,
 			      (char const*)fRequestBuffer);
+      if (session != NULL) session->unlock();
     } else {
       handleCmd_notSupported(cseq);
     }
@@ -521,17 +843,31 @@ void RTSPServer::RTSPClientSession::handleRequestBytes(int newBytesRead) {
 #ifdef DEBUG
   fprintf(stderr, "sending response: %s", fResponseBuffer);
 #endif
-  send(fClientOutputSocket, (char const*)fResponseBuffer, strlen((char*)fResponseBuffer), 0);
+  // (The socket may also be carrying RTP/RTCP packets, so don't send the response in the middle of one:)
+  RTPInterface::sendOtherDataOverTCP(envir(), fClientOutputSocket, fResponseBuffer, strlen((char*)fResponseBuffer));
 
   if (strcmp(cmdName, "SETUP") == 0 && fStreamAfterSETUP) {
     // The client has asked for streaming to commence now, rather than after a
     // subsequent "PLAY" command.  So, simulate the effect of a "PLAY" command:
+    ServerMediaSession* session = fOurServerMediaSession;
+    if (session != NULL) session->lock(envir());
     handleCmd_withinSession("PLAY", urlPreSuffix, urlSuffix, cseq,
 			    (char const*)fRequestBuffer);
+    if (session != NULL) session->unlock();
   }
 
   resetRequestBuffer(); // to prepare for any subsequent request
-  if (!fSessionIsActive) delete this;
+  if (!fSessionIsActive) {
+    delete this;
+    return;
+  }
+
+  if (numPipelinedBytes > 0) {
+    // Move the next request to the start of the buffer, and handle it:
+    fRequestBuffer[requestSize] = firstPipelinedByte;
+    memmove(fRequestBuffer, &fRequestBuffer[requestSize], numPipelinedBytes);
+    handleDecodedRequestBytes(numPipelinedBytes);
+  }
 }
 
 // Handler routines for specific RTSP commands:
@@ -603,6 +939,7 @@ void RTSPServer::RTSPClientSession::handleCmd_OPTIONS(char const* cseq) {
 void RTSPServer::RTSPClientSession
 ::handleCmd_DESCRIBE(char const* cseq, char const* urlSuffix,
 		     char const* fullRequestStr) {
+  ServerMediaSession* session = NULL;
   char* sdpDescription = NULL;
   char* rtspURL = NULL;
   do {
@@ -614,14 +951,16 @@ void RTSPServer::RTSPClientSession
 
     // Begin by looking up the "ServerMediaSession" object for the
     // specified "urlSuffix":
-    ServerMediaSession* session = fOurServer.lookupServerMediaSession(urlSuffix);
+    session = fOurServer.lookupAndReferenceServerMediaSession(urlSuffix);
     if (session == NULL) {
       handleCmd_notFound(cseq);
       break;
     }
 
     // Then, assemble a SDP description for this session:
+    session->lock(envir());
     sdpDescription = session->generateSDPDescription();
+    session->unlock();
     if (sdpDescription == NULL) {
       // This usually means that a file name that was specified for a
       // "ServerMediaSubsession" does not exist.
@@ -654,6 +993,7 @@ void RTSPServer::RTSPClientSession
 	     sdpDescription);
   } while (0);
 
+  fOurServer.releaseServerMediaSession(session);
   delete[] sdpDescription;
   delete[] rtspURL;
 }
@@ -751,26 +1091,28 @@ void RTSPServer::RTSPClientSession
   // support more than one concurrent session on the same client connection.) #####
   if (fOurServerMediaSession != NULL
       && strcmp(streamName, fOurServerMediaSession->streamName()) != 0) {
+    reclaimStreamStates();
+    fOurServer.releaseServerMediaSession(fOurServerMediaSession);
     fOurServerMediaSession = NULL;
   }
   if (fOurServerMediaSession == NULL) {
     // Set up this session's state.
 
     // Look up the "ServerMediaSession" object for the specified stream:
+    ServerMediaSession* unnamedSession = NULL;
     if (streamName[0] != '\0' ||
-	fOurServer.lookupServerMediaSession("") != NULL) { // normal case
+	(unnamedSession = fOurServer.lookupAndReferenceServerMediaSession("")) != NULL) { // normal case
+      fOurServer.releaseServerMediaSession(unnamedSession);
     } else { // weird case: there was no track id in the URL
       streamName = urlSuffix;
       trackId = NULL;
     }
-    fOurServerMediaSession = fOurServer.lookupServerMediaSession(streamName);
+    fOurServerMediaSession = fOurServer.lookupAndReferenceServerMediaSession(streamName);
     if (fOurServerMediaSession == NULL) {
       handleCmd_notFound(cseq);
       return;
     }
 
-    fOurServerMediaSession->incrementReferenceCount();
-
     // Set up our array of states for this session's subsessions (tracks):
     reclaimStreamStates();
     ServerMediaSubsessionIterator iter(*fOurServerMediaSession);
@@ -786,6 +1128,8 @@ void RTSPServer::RTSPClientSession
   }
 
   // Look up information for the specified subsession (track):
+  // (The session may be shared with other threads, so lock it while we use its subsessions.)
+  fOurServerMediaSession->lock(envir());
   ServerMediaSubsession* subsession = NULL;
   unsigned streamNum;
   if (trackId != NULL && trackId[0] != '\0') { // normal case
@@ -795,6 +1139,7 @@ void RTSPServer::RTSPClientSession
     }
     if (streamNum >= fNumStreamStates) {
       // The specified track id doesn't exist, so this request fails:
+      fOurServerMediaSession->unlock();
       handleCmd_notFound(cseq);
       return;
     }
@@ -802,6 +1147,7 @@ void RTSPServer::RTSPClientSession
     // Weird case: there was no track id in the URL.
     // This works only if we have only one subsession:
     if (fNumStreamStates != 1) {
+      fOurServerMediaSession->unlock();
       handleCmd_bad(cseq);
       return;
     }
@@ -877,6 +1223,7 @@ void RTSPServer::RTSPClientSession
 				  destinationAddress, destinationTTL, fIsMulticast,
 				  serverRTPPort, serverRTCPPort,
 				  fStreamStates[streamNum].streamToken);
+  fOurServerMediaSession->unlock();
   SendingInterfaceAddr = origSendingInterfaceAddr;
   ReceivingInterfaceAddr = origReceivingInterfaceAddr;
 
@@ -63,6 +63,17 @@ ServerMediaSession::ServerMediaSession(UsageEnvironment& env,
   : Medium(env), fIsSSM(isSSM), fSubsessionsHead(NULL),
     fSubsessionsTail(NULL), fSubsessionCounter(0),
     fReferenceCount(0), fDeleteWhenUnreferenced(False) {
+#ifdef USE_SESSION_LOCKS
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&fLock, &attr);
+  pthread_mutexattr_destroy(&attr);
+#else
+  fLockDepth = 0;
+  fStreamEnv = NULL;
+#endif
+
   fStreamName = strDup(streamName == NULL ? "" : streamName);
   fInfoSDPString = strDup(info == NULL ? libNameStr : info);
   fDescriptionSDPString
@@ -78,6 +89,9 @@ ServerMediaSession::~ServerMediaSession() {
   delete[] fInfoSDPString;
   delete[] fDescriptionSDPString;
   delete[] fMiscSDPLines;
+#ifdef USE_SESSION_LOCKS
+  pthread_mutex_destroy(&fLock);
+#endif
 }
 
 Boolean
@@ -182,6 +196,83 @@ Boolean ServerMediaSession::isServerMediaSession() const {
   return True;
 }
 
+#ifdef USE_SESSION_LOCKS
+// Each thread keeps a list of the sessions that it has locked, so that "streamEnvir()" need not look at
+// another thread's state:
+class SessionLockRecord {
+public:
+  SessionLockRecord(ServerMediaSession const* session, SessionLockRecord* next)
+    : fSession(session), fDepth(0), fStreamEnv(NULL), fNext(next) {}
+
+  ServerMediaSession const* fSession;
+  unsigned fDepth;
+  UsageEnvironment* fStreamEnv;
+  SessionLockRecord* fNext;
+};
+
+static pthread_key_t lockRecordsKey;
+static pthread_once_t lockRecordsKeyOnce = PTHREAD_ONCE_INIT;
+
+static void createLockRecordsKey() {
+  pthread_key_create(&lockRecordsKey, NULL);
+}
+
+static SessionLockRecord* lookupLockRecord(ServerMediaSession const* session) {
+  pthread_once(&lockRecordsKeyOnce, createLockRecordsKey);
+  SessionLockRecord* record = (SessionLockRecord*)pthread_getspecific(lockRecordsKey);
+  while (record != NULL && record->fSession != session) record = record->fNext;
+  return record;
+}
+#endif
+
+void ServerMediaSession::lock(UsageEnvironment& streamEnv) {
+#ifdef USE_SESSION_LOCKS
+  pthread_mutex_lock(&fLock);
+  SessionLockRecord* record = lookupLockRecord(this);
+  if (record == NULL) {
+    record = new SessionLockRecord(this, (SessionLockRecord*)pthread_getspecific(lockRecordsKey));
+    pthread_setspecific(lockRecordsKey, record);
+  }
+  ++record->fDepth;
+  record->fStreamEnv = &streamEnv;
+#else
+  ++fLockDepth;
+  fStreamEnv = &streamEnv;
+#endif
+}
+
+void ServerMediaSession::unlock() {
+#ifdef USE_SESSION_LOCKS
+  SessionLockRecord* record = lookupLockRecord(this);
+  if (record == NULL) return; // we're not locked by this thread
+  if (--record->fDepth == 0) {
+    // Remove the record from this thread's list:
+    SessionLockRecord* head = (SessionLockRecord*)pthread_getspecific(lockRecordsKey);
+    if (head == record) {
+      pthread_setspecific(lockRecordsKey, record->fNext);
+    } else {
+      SessionLockRecord* prev = head;
+      while (prev->fNext != record) prev = prev->fNext;
+      prev->fNext = record->fNext;
+    }
+    delete record;
+  }
+  pthread_mutex_unlock(&fLock);
+#else
+  if (fLockDepth == 0) return; // we're not locked
+  if (--fLockDepth == 0) fStreamEnv = NULL;
+#endif
+}
+
+UsageEnvironment* ServerMediaSession::streamEnvir() const {
+#ifdef USE_SESSION_LOCKS
+  SessionLockRecord* record = lookupLockRecord(this);
+  return record == NULL ? NULL : record->fStreamEnv;
+#else
+  return fLockDepth == 0 ? NULL : fStreamEnv;
+#endif
+}
+
 char* ServerMediaSession::generateSDPDescription() {
   struct in_addr ipAddress;
   ipAddress.s_addr = ourIPAddress(envir());
@@ -323,6 +414,11 @@ ServerMediaSubsession::~ServerMediaSubsession() {
   Medium::close(fNext);
 }
 
+UsageEnvironment& ServerMediaSubsession::envir() const {
+  UsageEnvironment* streamEnv = fParentSession == NULL ? NULL : fParentSession->streamEnvir();
+  return streamEnv != NULL ? *streamEnv : Medium::envir();
+}
+
 char const* ServerMediaSubsession::trackId() {
   if (fTrackNumber == 0) return NULL; // not yet in a ServerMediaSession
 
@@ -22,8 +22,64 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 
 #include <string.h>
 #include <stdlib.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef SYS_memfd_create
+#define USE_MIRRORED_BUFFER 1
+#endif
+#endif
 
-#define BANK_SIZE 150000
+#define INITIAL_BUFFER_SIZE 150000
+
+// Allocates a buffer of at least "size" bytes - mirrored, if possible - and updates "size" to its actual size:
+static unsigned char* allocateBuffer(unsigned& size, Boolean& isMirrored) {
+#ifdef USE_MIRRORED_BUFFER
+  unsigned const pageSize = (unsigned)sysconf(_SC_PAGESIZE);
+  unsigned const mirroredSize = (size + pageSize - 1)/pageSize*pageSize;
+
+  int fd = (int)syscall(SYS_memfd_create, "StreamParser", 0);
+  if (fd >= 0) {
+    unsigned char* result = NULL;
+    if (ftruncate(fd, mirroredSize) == 0) {
+      // Reserve space for two copies, then map the same memory into each half:
+      void* area = mmap(NULL, 2*mirroredSize, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+      if (area != MAP_FAILED) {
+	unsigned char* first = (unsigned char*)area;
+	if (mmap(first, mirroredSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == first
+	    && mmap(first + mirroredSize, mirroredSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0)
+	       == first + mirroredSize) {
+	  result = first;
+	} else {
+	  munmap(area, 2*mirroredSize);
+	}
+      }
+    }
+    close(fd); // the mappings keep the memory
+
+    if (result != NULL) {
+      size = mirroredSize;
+      isMirrored = True;
+      return result;
+    }
+  }
+#endif
+
+  // Use an ordinary buffer instead:
+  isMirrored = False;
+  return new unsigned char[size];
+}
+
+static void freeBuffer(unsigned char* buffer, unsigned size, Boolean isMirrored) {
+#ifdef USE_MIRRORED_BUFFER
+  if (isMirrored) {
+    munmap(buffer, 2*size);
+    return;
+  }
+#endif
+  delete[] buffer;
+}
 
 StreamParser::StreamParser(FramedSource* inputSource,
 			   FramedSource::onCloseFunc* onInputCloseFunc,
@@ -34,17 +90,15 @@ StreamParser::StreamParser(FramedSource* inputSource,
     fOnInputCloseClientData(onInputCloseClientData),
     fClientContinueFunc(clientContinueFunc),
     fClientContinueClientData(clientContinueClientData),
+    fBufferSize(INITIAL_BUFFER_SIZE),
     fSavedParserIndex(0), fSavedRemainingUnparsedBits(0),
     fCurParserIndex(0), fRemainingUnparsedBits(0),
     fTotNumValidBytes(0) {
-  fBank[0] = new unsigned char[BANK_SIZE];
-  fBank[1] = new unsigned char[BANK_SIZE];
-  fCurBankNum = 0;
-  fCurBank = fBank[fCurBankNum];
+  fBuffer = allocateBuffer(fBufferSize, fBufferIsMirrored);
 }
 
 StreamParser::~StreamParser() {
-  delete[] fBank[0]; delete[] fBank[1];
+  freeBuffer(fBuffer, fBufferSize, fBufferIsMirrored);
 }
 
 #define NO_MORE_BUFFERED_INPUT 1
@@ -55,43 +109,61 @@ void StreamParser::ensureValidBytes1(unsigned numBytesNeeded) {
   unsigned maxInputFrameSize = fInputSource->maxFrameSize();
   if (maxInputFrameSize > numBytesNeeded) numBytesNeeded = maxInputFrameSize;
 
-  // First, check whether these new bytes would overflow the current
-  // bank.  If so, start using a new bank now.
-  if (fCurParserIndex + numBytesNeeded > BANK_SIZE) {
-    // Swap banks, but save any still-needed bytes from the old bank:
-    unsigned numBytesToSave = fTotNumValidBytes - fSavedParserIndex;
-    unsigned char const* from = &curBank()[fSavedParserIndex];
-
-    fCurBankNum = (fCurBankNum + 1)%2;
-    fCurBank = fBank[fCurBankNum];
-    memmove(curBank(), from, numBytesToSave);
-    fCurParserIndex = fCurParserIndex - fSavedParserIndex;
-    fSavedParserIndex = 0;
-    fTotNumValidBytes = numBytesToSave;
-  }
+  makeRoomForBytes(numBytesNeeded);
 
-  // ASSERT: fCurParserIndex + numBytesNeeded > fTotNumValidBytes
-  //      && fCurParserIndex + numBytesNeeded <= BANK_SIZE
-  if (fCurParserIndex + numBytesNeeded > BANK_SIZE) {
-    // If this happens, it means that we have too much saved parser state.
-    // To fix this, increase BANK_SIZE as appropriate.
-    fInputSource->envir() << "StreamParser internal error ("
-			  << fCurParserIndex << "+ "
-			  << numBytesNeeded << " > "
-			  << BANK_SIZE << ")\n";
-    fInputSource->envir().internalError();
-  }
-
-  // Try to read as many new bytes as will fit in the current bank:
-  unsigned maxNumBytesToRead = BANK_SIZE - fTotNumValidBytes;
-  fInputSource->getNextFrame(&curBank()[fTotNumValidBytes],
-			     maxNumBytesToRead,
+  // Try to read as many new bytes as will fit in the buffer:
+  fInputSource->getNextFrame(&fBuffer[fTotNumValidBytes],
+			     numFreeBytes(),
 			     afterGettingBytes, this,
 			     fOnInputCloseFunc, fOnInputCloseClientData);
 
   throw NO_MORE_BUFFERED_INPUT;
 }
 
+void StreamParser::makeRoomForBytes(unsigned numBytesNeeded) {
+  // We must keep all bytes from the saved parser position onwards:
+  unsigned numBytesToSave = fTotNumValidBytes - fSavedParserIndex;
+  unsigned numBytesRequired = fCurParserIndex - fSavedParserIndex + numBytesNeeded;
+
+  if (numBytesRequired > fBufferSize) {
+    // What we're parsing (e.g., a very large frame) doesn't fit in our buffer; move to a bigger one:
+    unsigned newBufferSize = 2*fBufferSize;
+    while (newBufferSize < numBytesRequired) newBufferSize *= 2;
+    Boolean newBufferIsMirrored;
+    unsigned char* newBuffer = allocateBuffer(newBufferSize, newBufferIsMirrored);
+
+    memmove(newBuffer, &fBuffer[fSavedParserIndex], numBytesToSave);
+    freeBuffer(fBuffer, fBufferSize, fBufferIsMirrored);
+    fBuffer = newBuffer;
+    fBufferSize = newBufferSize;
+    fBufferIsMirrored = newBufferIsMirrored;
+  } else if (fBufferIsMirrored) {
+    // Nothing needs to be moved.  Just keep our indices within the first copy of the buffer
+    // (so that reads, which may continue into the second copy, stay within the mapping):
+    if (fSavedParserIndex < fBufferSize) return;
+
+    fSavedParserIndex -= fBufferSize;
+    fCurParserIndex -= fBufferSize;
+    fTotNumValidBytes -= fBufferSize;
+    return;
+  } else {
+    if (fCurParserIndex + numBytesNeeded <= fBufferSize) return;
+
+    // Move the bytes that we still need to the start of the buffer:
+    memmove(fBuffer, &fBuffer[fSavedParserIndex], numBytesToSave);
+  }
+
+  fCurParserIndex -= fSavedParserIndex;
+  fSavedParserIndex = 0;
+  fTotNumValidBytes = numBytesToSave;
+}
+
+unsigned StreamParser::numFreeBytes() const {
+  return fBufferIsMirrored
+    ? fSavedParserIndex + fBufferSize - fTotNumValidBytes
+    : fBufferSize - fTotNumValidBytes;
+}
+
 void StreamParser::afterGettingBytes(void* clientData,
 				     unsigned numBytesRead,
 				     unsigned /*numTruncatedBytes*/,
@@ -99,15 +171,15 @@ void StreamParser::afterGettingBytes(void* clientData,
 				     unsigned /*durationInMicroseconds*/){
   StreamParser* buffer = (StreamParser*)clientData;
 
-  // Sanity check: Make sure we didn't get too many bytes for our bank:
-  if (buffer->fTotNumValidBytes + numBytesRead > BANK_SIZE) {
+  // Sanity check: Make sure we didn't get too many bytes for our buffer:
+  if (numBytesRead > buffer->numFreeBytes()) {
     buffer->fInputSource->envir()
       << "StreamParser::afterGettingBytes() warning: read "
       << numBytesRead << " bytes; expected no more than "
-      << BANK_SIZE - buffer->fTotNumValidBytes << "\n";
+      << buffer->numFreeBytes() << "\n";
   }
 
-  unsigned char* ptr = &buffer->curBank()[buffer->fTotNumValidBytes];
+  unsigned char* ptr = &buffer->fBuffer[buffer->fTotNumValidBytes];
   buffer->fTotNumValidBytes += numBytesRead;
 
   // Continue our original calling source where it left off:
@@ -175,6 +247,21 @@ unsigned StreamParser::getBits(unsigned numBits) {
   }
 }
 
+unsigned StreamParser::numBytesBeforePossibleStartCode() {
+  // A start code begins with two zero bytes (or with a zero byte at the end of
+  // the data that we have so far).  "memchr()" is usually the fastest way to find
+  // zero bytes, because most C libraries use the CPU's vector instructions for it:
+  unsigned char const* start = nextToParse();
+  unsigned char const* end = &fBuffer[fTotNumValidBytes];
+  unsigned char const* p = start;
+  while (p < end && (p = (unsigned char const*)memchr(p, 0, end - p)) != NULL) {
+    if (p+1 == end || p[1] == 0) return p - start;
+    p += 2; // a lone zero byte
+  }
+
+  return end - start;
+}
+
 void StreamParser::flushInput() {
   fCurParserIndex = fSavedParserIndex = 0;
   fSavedRemainingUnparsedBits = fRemainingUnparsedBits = 0;
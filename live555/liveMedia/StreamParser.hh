@@ -72,7 +72,7 @@ protected: // we're a virtual base class
   u_int8_t get1Byte() { // byte-aligned
     ensureValidBytes(1);
     fRemainingUnparsedBits = 0;
-    return curBank()[fCurParserIndex++];
+    return fBuffer[fCurParserIndex++];
   }
 
   void getBytes(u_int8_t* to, unsigned numBytes) {
@@ -95,12 +95,16 @@ protected: // we're a virtual base class
 
   unsigned curOffset() const { return fCurParserIndex; }
 
+  // Returns how many of the bytes that have already been read - starting at the
+  // current (byte-aligned) parse position - come before the next place where a
+  // start code (0x000001) could begin:
+  unsigned numBytesBeforePossibleStartCode();
+
   unsigned& totNumValidBytes() { return fTotNumValidBytes; }
 
 private:
-  unsigned char* curBank() { return fCurBank; }
-  unsigned char* nextToParse() { return &curBank()[fCurParserIndex]; }
-  unsigned char* lastParsed() { return &curBank()[fCurParserIndex-1]; }
+  unsigned char* nextToParse() { return &fBuffer[fCurParserIndex]; }
+  unsigned char* lastParsed() { return &fBuffer[fCurParserIndex-1]; }
 
   // makes sure that at least "numBytes" valid bytes remain:
   void ensureValidBytes(unsigned numBytesNeeded) {
@@ -110,6 +114,8 @@ private:
     ensureValidBytes1(numBytesNeeded);
   }
   void ensureValidBytes1(unsigned numBytesNeeded);
+  void makeRoomForBytes(unsigned numBytesNeeded);
+  unsigned numFreeBytes() const; // how many new bytes can be read into the buffer
 
   static void afterGettingBytes(void* clientData, unsigned numBytesRead,
 				unsigned numTruncatedBytes,
@@ -123,21 +129,26 @@ private:
   clientContinueFunc* fClientContinueFunc;
   void* fClientContinueClientData;
 
-  // Use a pair of 'banks', and swap between them as they fill up:
-  unsigned char* fBank[2];
-  unsigned char fCurBankNum;
-  unsigned char* fCurBank;
+  // Our input is stored in a single buffer, which grows if a frame doesn't fit.
+  // If possible, this is a 'mirrored' ring buffer: Its memory is mapped twice,
+  // back to back, so that "fBuffer[i]" and "fBuffer[i+fBufferSize]" are the same byte,
+  // and data that wraps around the end of the buffer can still be parsed in place.
+  // Otherwise, the bytes that are still needed get moved to the start of the buffer
+  // when it fills up.
+  unsigned char* fBuffer;
+  unsigned fBufferSize;
+  Boolean fBufferIsMirrored;
 
   // The most recent 'saved' parse position:
   unsigned fSavedParserIndex; // <= fCurParserIndex
   unsigned char fSavedRemainingUnparsedBits;
 
-  // The current position of the parser within the current bank:
+  // The current position of the parser within the buffer:
   unsigned fCurParserIndex; // <= fTotNumValidBytes
   unsigned char fRemainingUnparsedBits; // in previous byte: [0,7]
 
-  // The total number of valid bytes stored in the current bank:
-  unsigned fTotNumValidBytes; // <= BANK_SIZE
+  // The end of the valid bytes stored in the buffer:
+  unsigned fTotNumValidBytes; // <= fSavedParserIndex + fBufferSize
 };
 
 #endif
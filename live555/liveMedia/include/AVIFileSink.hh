@@ -24,6 +24,9 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #ifndef _MEDIA_SESSION_HH
 #include "MediaSession.hh"
 #endif
+#ifndef _ASYNC_FILE_WRITER_HH
+#include "AsyncFileWriter.hh"
+#endif
 
 class AVIFileSink: public Medium {
 public:
@@ -34,19 +37,25 @@ public:
 				unsigned short movieWidth = 240,
 				unsigned short movieHeight = 180,
 				unsigned movieFPS = 15,
-				Boolean packetLossCompensate = False);
+				Boolean packetLossCompensate = False,
+				Boolean useDirectIO = False,
+				u_int64_t preallocationSize = 0);
+      // The file is written by a separate thread.  "useDirectIO" and "preallocationSize" are passed to
+      // its "AsyncFileWriter".
 
   typedef void (afterPlayingFunc)(void* clientData);
   Boolean startPlaying(afterPlayingFunc* afterFunc,
                        void* afterClientData);
 
   unsigned numActiveSubsessions() const { return fNumSubsessions; }
+  AsyncFileWriter* outputWriter() const { return fOutputWriter; } // e.g., for statistics
 
 private:
   AVIFileSink(UsageEnvironment& env, MediaSession& inputSession,
 	      char const* outputFileName, unsigned bufferSize,
 	      unsigned short movieWidth, unsigned short movieHeight,
-	      unsigned movieFPS, Boolean packetLossCompensate);
+	      unsigned movieFPS, Boolean packetLossCompensate,
+	      Boolean useDirectIO, u_int64_t preallocationSize);
       // called only by createNew()
   virtual ~AVIFileSink();
 
@@ -64,6 +73,7 @@ private:
   friend class AVISubsessionIOState;
   MediaSession& fInputSession;
   FILE* fOutFid;
+  AsyncFileWriter* fOutputWriter; // writes "fOutFid" while we're recording
   unsigned fBufferSize;
   Boolean fPacketLossCompensate;
   Boolean fAreCurrentlyBeingPlayed;
@@ -80,7 +90,7 @@ private:
   unsigned addWord(unsigned word); // outputs "word" in little-endian order
   unsigned addHalfWord(unsigned short halfWord);
   unsigned addByte(unsigned char byte) {
-    putc(byte, fOutFid);
+    if (fOutputWriter != NULL) fOutputWriter->writeByte(byte); else putc(byte, fOutFid);
     return 1;
   }
   unsigned addZeroWords(unsigned numWords);
@@ -0,0 +1,107 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2011 Live Networks, Inc.  All rights reserved.
+// Writes a file (being recorded) from a separate thread, through large buffers,
+// so that slow disk I/O never blocks the event loop.
+// C++ header
+
+#ifndef _ASYNC_FILE_WRITER_HH
+#define _ASYNC_FILE_WRITER_HH
+
+#include <UsageEnvironment.hh>
+#include <stdio.h>
+#if !defined(__WIN32__) && !defined(_WIN32)
+#include <pthread.h>
+#define USE_WRITER_THREAD 1
+#endif
+
+class AsyncFileWriter {
+public:
+  AsyncFileWriter(UsageEnvironment& env, FILE* fid,
+		  Boolean useDirectIO = False, u_int64_t preallocationSize = 0);
+      // Takes over writing to "fid", from its current position.  Until "finish()" is called,
+      // "fid" must not be used directly.
+      // If "useDirectIO" is True, whole buffers are written with O_DIRECT (bypassing the page cache), through
+      // a second descriptor for the same open file (from "/proc/self/fd"; if that's not available, we don't use O_DIRECT).
+      // If "preallocationSize" is non-zero, disk space is allocated ahead of the data, this many bytes at a time.
+  virtual ~AsyncFileWriter(); // calls "finish()"
+
+  void write(unsigned char const* data, unsigned size);
+  void writeByte(unsigned char byte) {
+    if (fCurLen < fCurLimit) {
+      fCurData[fCurLen++] = byte;
+      ++fPosition;
+    } else {
+      write(&byte, 1);
+    }
+  }
+  int64_t tell(); // the file position of the next byte to be written
+
+  void finish();
+      // Waits until all data has been written, and then leaves "fid" positioned after it.
+      // (Any subsequent writes go directly to "fid".)
+      // This blocks, so should be called only when the recording is being completed.
+
+  // Statistics:
+  u_int64_t numBytesQueued(); // bytes given to us that have not yet been written to the file
+  unsigned numWrites();
+  unsigned averageWriteLatency(); // in microseconds
+  unsigned maxWriteLatency(); // in microseconds
+  unsigned numStalls(); // # of times that "write()" had to wait for the disk, because too much data was queued
+
+private:
+#ifdef USE_WRITER_THREAD
+  static void* threadMain(void* writer);
+  void runWriterThread();
+  void writeBuffer(class AsyncWriteBuffer* buffer);
+  void startNewBuffer();
+  void queueCurBuffer();
+#endif
+
+private:
+  UsageEnvironment& fEnv;
+  FILE* fFid;
+  Boolean fFinished;
+  int64_t fPosition;
+  unsigned char* fCurData;
+  unsigned fCurLen, fCurLimit;
+#ifdef USE_WRITER_THREAD
+  int fFd, fDirectFd;
+  Boolean fSeekable;
+  u_int64_t fPreallocationSize;
+  int64_t fPreallocatedTo;
+  class AsyncWriteBuffer* fCurBuffer;
+  long fCurBufferStartTime;
+  pthread_t fThread;
+  pthread_mutex_t fMutex;
+  pthread_cond_t fWorkAvailable, fBufferAvailable; // both use "fMutex"
+  class AsyncWriteBuffer* fQueueHead;
+  class AsyncWriteBuffer* fQueueTail;
+  class AsyncWriteBuffer* fFreeBuffers;
+  unsigned fNumBuffers;
+  Boolean fExiting;
+  int fWriteError;
+#endif
+  // Statistics (protected by "fMutex"):
+  u_int64_t fNumBytesQueued;
+  unsigned fNumWrites;
+  double fTotWriteLatency;
+  unsigned fMaxWriteLatency;
+  unsigned fNumStalls;
+};
+
+#endif
@@ -28,6 +28,11 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "Media.hh"
 #endif
 
+#if !defined(__WIN32__) && !defined(_WIN32) && !defined(_QNX4)
+#include <pthread.h>
+#define USE_INDEX_FILE_LOCK 1
+#endif
+
 #define INDEX_RECORD_SIZE 11
 
 class MPEG2TransportStreamIndexFile: public Medium {
@@ -57,15 +62,34 @@ public:
 				unsigned long& transportPacketNum, u_int8_t& offset,
 				u_int8_t& size, float& pcr, u_int8_t& recordType);
   float getPlayingDuration();
-  void stopReading() { closeFid(); }
+  void stopReading();
 
   int mpegVersion();
       // returns the best guess for the version of MPEG being used for data within the underlying Transport Stream file.
       // (1,2,4, or 5 (representing H.264).  0 means 'don't know' (usually because the index file is empty))
 
+  // Note: The functions above may be called from several threads (e.g., for clients of a "RTSPServer"s worker threads),
+  // because each of them locks the index file while it uses the current record and the cached lookup result.
+
 private:
   MPEG2TransportStreamIndexFile(UsageEnvironment& env, char const* indexFileName);
 
+  // Implementations of the public functions above, called with the index file locked:
+  void lookupTSPacketNumFromNPT1(float& npt, unsigned long& tsPacketNumber,
+				 unsigned long& indexRecordNumber);
+  void lookupPCRFromTSPacketNum1(unsigned long& tsPacketNumber, Boolean reverseToPreviousCleanPoint,
+				 float& pcr, unsigned long& indexRecordNumber);
+  Boolean readIndexRecordValues1(unsigned long indexRecordNum,
+				 unsigned long& transportPacketNum, u_int8_t& offset,
+				 u_int8_t& size, float& pcr, u_int8_t& recordType);
+  float getPlayingDuration1();
+  int mpegVersion1();
+
+  void lock();
+  void unlock();
+
+  void mapFile();
+  void unmapFile();
   Boolean openFid();
   Boolean seekToIndexRecord(unsigned long indexRecordNumber);
   Boolean readIndexRecord(unsigned long indexRecordNum); // into "fBuf"
@@ -90,7 +114,12 @@ private:
   float fCachedPCR;
   unsigned long fCachedTSPacketNumber, fCachedIndexRecordNumber;
   unsigned long fNumIndexRecords;
+  unsigned char* fMappedRecords; // the whole index file, if it could be mapped into memory
+  u_int64_t fMappedSize;
   unsigned char fBuf[INDEX_RECORD_SIZE]; // used for reading index records from file
+#ifdef USE_INDEX_FILE_LOCK
+  pthread_mutex_t fLock;
+#endif
 };
 
 #endif
@@ -30,6 +30,20 @@ class BufferedPacket; // forward
 class BufferedPacketFactory; // forward
 
 class MultiFramedRTPSource: public RTPSource {
+public:
+  // Statistics about the incoming packets that have passed through our
+  // reordering ('jitter') buffer:
+  unsigned numPacketsLost() const;
+      // packets that we gave up waiting for
+  unsigned numPacketsLate() const;
+      // packets that arrived after we'd given up on them (or had already used them)
+  unsigned numPacketsReordered() const;
+      // packets that arrived out of order, but in time to be used
+  unsigned numPacketsDuplicated() const;
+  unsigned curPacketReorderingThresholdTime() const;
+      // in uSeconds: how long we currently wait for a missing packet.  This adapts to the
+      // jitter of the incoming packets, up to the time set by "setPacketReorderingThresholdTime()".
+
 protected:
   MultiFramedRTPSource(UsageEnvironment& env, Groupsock* RTPgs,
 		       unsigned char rtpPayloadFormat,
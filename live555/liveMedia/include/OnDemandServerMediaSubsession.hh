@@ -90,7 +90,8 @@ private:
   Boolean fReuseFirstSource;
   portNumBits fInitialPortNum;
   HashTable* fDestinationsHashTable; // indexed by client session id
-  void* fLastStreamToken;
+  HashTable* fLastStreamTokens; // indexed by the environment that each stream was created in
+      // (so that, with "reuseFirstSource", each thread that streams us has its own source)
   char fCNAME[100]; // for RTCP
   friend class StreamState;
 };
@@ -24,6 +24,9 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #ifndef _MEDIA_SESSION_HH
 #include "MediaSession.hh"
 #endif
+#ifndef _ASYNC_FILE_WRITER_HH
+#include "AsyncFileWriter.hh"
+#endif
 
 class QuickTimeFileSink: public Medium {
 public:
@@ -37,13 +40,18 @@ public:
 				      Boolean packetLossCompensate = False,
 				      Boolean syncStreams = False,
 				      Boolean generateHintTracks = False,
-				      Boolean generateMP4Format = False);
+				      Boolean generateMP4Format = False,
+				      Boolean useDirectIO = False,
+				      u_int64_t preallocationSize = 0);
+      // The file is written by a separate thread.  "useDirectIO" and "preallocationSize" are passed to
+      // its "AsyncFileWriter".
 
   typedef void (afterPlayingFunc)(void* clientData);
   Boolean startPlaying(afterPlayingFunc* afterFunc,
                        void* afterClientData);
 
   unsigned numActiveSubsessions() const { return fNumSubsessions; }
+  AsyncFileWriter* outputWriter() const { return fOutputWriter; } // e.g., for statistics
 
 private:
   QuickTimeFileSink(UsageEnvironment& env, MediaSession& inputSession,
@@ -51,7 +59,8 @@ private:
 		    unsigned short movieWidth, unsigned short movieHeight,
 		    unsigned movieFPS, Boolean packetLossCompensate,
 		    Boolean syncStreams, Boolean generateHintTracks,
-		    Boolean generateMP4Format);
+		    Boolean generateMP4Format, Boolean useDirectIO,
+		    u_int64_t preallocationSize);
       // called only by createNew()
   virtual ~QuickTimeFileSink();
 
@@ -69,6 +78,7 @@ private:
   friend class SubsessionIOState;
   MediaSession& fInputSession;
   FILE* fOutFid;
+  AsyncFileWriter* fOutputWriter; // writes "fOutFid" while we're recording
   unsigned fBufferSize;
   Boolean fPacketLossCompensate;
   Boolean fSyncStreams, fGenerateMP4Format;
@@ -89,7 +99,7 @@ private:
   unsigned addWord(unsigned word);
   unsigned addHalfWord(unsigned short halfWord);
   unsigned addByte(unsigned char byte) {
-    putc(byte, fOutFid);
+    if (fOutputWriter != NULL) fOutputWriter->writeByte(byte); else putc(byte, fOutFid);
     return 1;
   }
   unsigned addZeroWords(unsigned numWords);
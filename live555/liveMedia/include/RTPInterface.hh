@@ -69,6 +69,9 @@ public:
                            handlerProc);
   Boolean handleRead(unsigned char* buffer, unsigned bufferMaxSize,
 		     unsigned& bytesRead, struct sockaddr_in& fromAddress, Boolean& packetReadWasIncomplete);
+  Boolean hasBufferedPackets() const;
+      // True if a previous (batched) UDP read also got packets that
+      // haven't yet been returned by "handleRead()"
   void stopNetworkReading();
 
   UsageEnvironment& envir() const { return fOwner->envir(); }
@@ -83,6 +86,22 @@ public:
   int nextTCPReadStreamSocketNum() const { return fNextTCPReadStreamSocketNum; }
   unsigned char nextTCPReadStreamChannelId() const { return fNextTCPReadStreamChannelId; }
 
+  // RTP/RTCP packets sent over a TCP connection are queued while the connection is
+  // not writable (e.g., because the client is not reading fast enough), and sent when
+  // it becomes writable again.  These parameters limit the size of each queue:
+  static unsigned tcpOutputQueueMaxSize;
+      // the maximum number of bytes queued for a connection (default: 256 kBytes).
+      // If 0, packets that cannot be sent at once are dropped.
+  static Boolean tcpOutputQueueDropOldest;
+      // What to do with a packet that doesn't fit in a full queue: if True (the default),
+      // the oldest queued packets are dropped to make room for it; otherwise it is dropped.
+
+  static void sendOtherDataOverTCP(UsageEnvironment& env, int socketNum,
+				   unsigned char const* data, unsigned dataSize);
+      // Sends other data (e.g., a RTSP response) on a TCP connection that may also be
+      // carrying RTP/RTCP packets, after any packet data that is still queued for it,
+      // so that the packet framing is preserved.  This data is never dropped.
+
 private:
   friend class SocketDescriptor;
   Medium* fOwner;
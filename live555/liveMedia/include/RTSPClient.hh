@@ -85,6 +85,9 @@ public:
 			    Authenticator* authenticator = NULL);
       // Issues a RTSP "SETUP" command, then returns the "CSeq" sequence number that was used in the command.
       // (The "responseHandler" and "authenticator" parameters are as described for "sendDescribeCommand".)
+      // Note that you don't need to wait for the response before issuing the "SETUP" commands for the other subsessions, and
+      // the "PLAY" command: These are sent as soon as the first "SETUP" response has given us a session id, without waiting for
+      // each other's responses.
 
   unsigned sendPlayCommand(MediaSession& session, responseHandler* responseHandler,
 			   double start = 0.0f, double end = -1.0f, float scale = 1.0f,
@@ -207,6 +210,7 @@ private:
     RequestRecord* dequeue();
     void putAtHead(RequestRecord* request); // "request" must not be NULL
     RequestRecord* findByCSeq(unsigned cseq);
+    RequestRecord* findByCommandName(char const* commandName);
     Boolean isEmpty() const { return fHead == NULL; }
 
   private:
@@ -222,6 +226,8 @@ private:
   int connectToServer(int socketNum, portNumBits remotePortNum); // used to implement "openConnection()"; result values are the same
   char* createAuthenticatorString(char const* cmd, char const* url);
   unsigned sendRequest(RequestRecord* request);
+  Boolean requestMustAwaitSessionId(RequestRecord* request);
+  void sendRequestsAwaitingSessionId();
   void handleRequestError(RequestRecord* request);
   Boolean parseResponseCode(char const* line, unsigned& responseCode, char const*& responseString);
   void handleIncomingRequest();
@@ -261,6 +267,9 @@ private:
   static void incomingDataHandler(void*, int /*mask*/);
   void incomingDataHandler1();
   void handleResponseBytes(int newBytesRead);
+  void handleBufferedResponse();
+  void setAsideNextResponse(unsigned responseSize);
+  static void handleNextResponse(void* rtspClient);
 
 private:
   int fVerbosityLevel;
@@ -278,6 +287,8 @@ private:
   char* fResponseBuffer;
   unsigned fResponseBytesAlreadySeen, fResponseBufferBytesLeft;
   RequestQueue fRequestsAwaitingConnection, fRequestsAwaitingHTTPTunneling, fRequestsAwaitingResponse;
+  RequestQueue fRequestsAwaitingSessionId; // pipelined requests that can't be sent until the first "SETUP" returns a session id
+  TaskToken fNextResponseTask; // handles a response that arrived along with the previous one
 
   // Support for tunneling RTSP-over-HTTP:
   char fSessionCookie[33];
@@ -30,6 +30,11 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #ifndef _DIGEST_AUTHENTICATION_HH
 #include "DigestAuthentication.hh"
 #endif
+#if defined(__WIN32__) || defined(_WIN32) || defined(_QNX4)
+#else
+#include <pthread.h>
+#define USE_WORKER_THREADS 1
+#endif
 
 // A data structure used for optional user/password authentication:
 
@@ -59,6 +64,8 @@ protected:
 
 #define RTSP_BUFFER_SIZE 10000 // for incoming requests, and outgoing responses
 
+class RTSPServerWorker; // forward
+
 class RTSPServer: public Medium {
 public:
   static RTSPServer* createNew(UsageEnvironment& env, Port ourPort = 554,
@@ -101,6 +108,22 @@ public:
       // Note: RTSP-over-HTTP tunneling is described in http://developer.apple.com/quicktime/icefloe/dispatch028.html
   portNumBits httpServerPortNum() const; // in host byte order.  (Returns 0 if not present.)
 
+  Boolean addWorkerThread(UsageEnvironment& workerEnv);
+      // (Attempts to) start a thread that runs the event loop of "workerEnv" (which must not be used by any other thread),
+      // and - once this has been done - hands each new RTSP connection that we accept to one of our worker threads, in turn.
+      // Each worker handles its connections using its own server object (see "createWorkerServer()" below), which
+      // looks up streams in our own "ServerMediaSession" table, but owns its client sessions, and creates their
+      // sources and sinks in "workerEnv", so that they run on that thread.  (Each "ServerMediaSession" is locked - see
+      // "ServerMediaSession::lock()" - while a client's command uses it.)
+      // Returns False iff threads are not supported on this platform, or the thread could not be started.
+      // Note: "PassiveServerMediaSubsession"s, and the subsessions of a "MPEG1or2FileServerDemux", use objects that are
+      // shared by all of their clients, and so can't be streamed by worker threads (except using sessions that each
+      // worker creates for itself).
+      // Note: Connections on our separate HTTP port (for RTSP-over-HTTP tunneling) are still handled by our own thread,
+      // because each tunnel uses two connections, which must be handled by the same server object.
+      // Note: The worker threads are stopped, and their server objects deleted, when we are deleted; "workerEnv"s are not.
+  unsigned numWorkerThreads() const { return fNumWorkers; }
+
 protected:
   RTSPServer(UsageEnvironment& env,
 	     int ourSocket, Port ourPort,
@@ -116,6 +139,16 @@ protected:
       // on each client (e.g., based on client IP address), without using
       // digest authentication.
 
+  virtual RTSPServer* createWorkerServer(UsageEnvironment& workerEnv, Port ourPort,
+					 UserAuthenticationDatabase* authDatabase,
+					 unsigned reclamationTestSeconds);
+      // Called by "addWorkerThread()" to create the server object that handles the connections given to a worker thread.
+      // The default implementation creates a "RTSPServer" that uses our "ServerMediaSession"s (as added by
+      // "addServerMediaSession()").  You need to redefine this only if you subclass "RTSPServer" to provide streams
+      // in some other way (e.g., by redefining "lookupServerMediaSession()" to create "ServerMediaSession"s on demand).
+      // The object must then be created in "workerEnv", without a listening socket (i.e., with "ourSocket" == -1),
+      // and it looks up (and creates) its streams itself, in "workerEnv".
+
 private: // redefined virtual functions
   virtual Boolean isRTSPServer() const;
 
@@ -173,6 +206,7 @@ protected:
     static void handleAlternativeRequestByte(void*, u_int8_t requestByte);
     void handleAlternativeRequestByte1(u_int8_t requestByte);
     void handleRequestBytes(int newBytesRead);
+    void handleDecodedRequestBytes(int newBytesRead); // after any Base64-decoding
     void noteLiveness();
     static void noteClientLiveness(RTSPClientSession* clientSession);
     static void livenessTimeoutTask(RTSPClientSession* clientSession);
@@ -216,6 +250,16 @@ protected:
     ServerMediaSession* fNextPtr;
   };
 
+private:
+  // Used by our client sessions, because - with worker threads - they may share our "ServerMediaSession"s with other threads:
+  ServerMediaSession* lookupAndReferenceServerMediaSession(char const* streamName);
+  void releaseServerMediaSession(ServerMediaSession* serverMediaSession);
+  RTSPServer& sessionOwner() { return fMainServer != NULL ? *fMainServer : *this; }
+  void lockServerMediaSessions();
+  void unlockServerMediaSessions();
+  static void deleteUnreferencedSessions(void* server);
+  void deleteUnreferencedSessions1();
+
 private:
   static void incomingConnectionHandlerRTSP(void*, int /*mask*/);
   void incomingConnectionHandlerRTSP1();
@@ -228,6 +272,7 @@ private:
 private:
   friend class RTSPClientSession;
   friend class ServerMediaSessionIterator;
+  friend class RTSPServerWorker;
   int fRTSPServerSocket;
   Port fRTSPServerPort;
   int fHTTPServerSocket; // for optional RTSP-over-HTTP tunneling
@@ -236,6 +281,14 @@ private:
   UserAuthenticationDatabase* fAuthDB;
   unsigned fReclamationTestSeconds;
   HashTable* fServerMediaSessions;
+  RTSPServerWorker** fWorkers; // for optional worker threads
+  unsigned fNumWorkers, fNextWorker; // ditto
+  RTSPServer* fMainServer; // for a worker's server: the server whose "ServerMediaSession"s we use (if not our own)
+#ifdef USE_WORKER_THREADS
+  pthread_mutex_t fServerMediaSessionsLock; // held while changing our session table, or a session's reference count
+#endif
+  HashTable* fSessionsAwaitingDeletion; // sessions that were removed while a worker's clients were still using them
+  TaskToken fSessionDeletionTask; // checks "fSessionsAwaitingDeletion" periodically
 };
 
 #endif
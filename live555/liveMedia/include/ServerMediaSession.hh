@@ -33,6 +33,10 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #ifndef _RTP_INTERFACE_HH
 #include "RTPInterface.hh" // for ServerRequestAlternativeByteHandler
 #endif
+#if !defined(__WIN32__) && !defined(_WIN32) && !defined(_QNX4)
+#include <pthread.h>
+#define USE_SESSION_LOCKS 1
+#endif
 
 class ServerMediaSubsession; // forward
 
@@ -68,6 +72,16 @@ public:
   void incrementReferenceCount() { ++fReferenceCount; }
   void decrementReferenceCount() { if (fReferenceCount > 0) --fReferenceCount; }
   Boolean& deleteWhenUnreferenced() { return fDeleteWhenUnreferenced; }
+      // Note: If the session is shared by several threads (e.g., by a "RTSPServer"s worker threads), then these are
+      // used only while holding the server's lock on its session table.
+
+  void lock(UsageEnvironment& streamEnv);
+  void unlock();
+      // Used around any use of our subsessions by a thread that may share us with others (e.g., a "RTSPServer"s
+      // worker thread).  While we are locked, our subsessions create the objects for each client's stream in
+      // "streamEnv" (which must be the caller's own environment), rather than in ours.
+      // (Calls may be nested, within one thread.)
+  UsageEnvironment* streamEnvir() const; // "streamEnv", if the calling thread has us locked; otherwise NULL
 
 protected:
   ServerMediaSession(UsageEnvironment& env, char const* streamName,
@@ -94,6 +108,14 @@ private:
   struct timeval fCreationTime;
   unsigned fReferenceCount;
   Boolean fDeleteWhenUnreferenced;
+
+  // Our lock.  The environment of the thread that holds it is kept by that thread (see "streamEnvir()"):
+#ifdef USE_SESSION_LOCKS
+  pthread_mutex_t fLock; // recursive
+#else
+  unsigned fLockDepth;
+  UsageEnvironment* fStreamEnv;
+#endif
 };
 
 
@@ -115,6 +137,10 @@ class ServerMediaSubsession: public Medium {
 public:
   virtual ~ServerMediaSubsession();
 
+  UsageEnvironment& envir() const;
+      // Redefines "Medium::envir()": the environment in which the objects for each client's stream are created.
+      // This is our own, except while the calling thread has our session locked (see "ServerMediaSession::lock()").
+
   unsigned trackNumber() const { return fTrackNumber; }
   char const* trackId();
   virtual char const* sdpLines() = 0;
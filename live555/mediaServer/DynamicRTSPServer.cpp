@@ -48,6 +48,13 @@ DynamicRTSPServer::DynamicRTSPServer(UsageEnvironment& env, int ourSocket,
 DynamicRTSPServer::~DynamicRTSPServer() {
 }
 
+RTSPServer* DynamicRTSPServer
+::createWorkerServer(UsageEnvironment& workerEnv, Port ourPort,
+		     UserAuthenticationDatabase* authDatabase, unsigned reclamationTestSeconds) {
+  // Each worker looks up (and creates) its own "ServerMediaSession"s, from the same files:
+  return new DynamicRTSPServer(workerEnv, -1, ourPort, authDatabase, reclamationTestSeconds);
+}
+
 static ServerMediaSession* createNewSMS(UsageEnvironment& env,
 					char const* fileName, FILE* fid); // forward
 
@@ -39,6 +39,9 @@ private:
 
 private: // redefined virtual functions
   virtual ServerMediaSession* lookupServerMediaSession(char const* streamName);
+  virtual RTSPServer* createWorkerServer(UsageEnvironment& workerEnv, Port ourPort,
+					 UserAuthenticationDatabase* authDatabase,
+					 unsigned reclamationTestSeconds);
 };
 
 #endif
@@ -21,10 +21,28 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "DynamicRTSPServer.hh"
 #include "version.hh"
 
+static UsageEnvironment* createEnvironment() {
+  TaskScheduler* scheduler = NULL;
+#if defined(__linux__)
+  // Use "epoll()", so that we're not limited to FD_SETSIZE sockets:
+  scheduler = EpollTaskScheduler::createNew();
+#endif
+  if (scheduler == NULL) scheduler = BasicTaskScheduler::createNew();
+  return BasicUsageEnvironment::createNew(*scheduler);
+}
+
 int main(int argc, char** argv) {
   // Begin by setting up our usage environment:
-  TaskScheduler* scheduler = BasicTaskScheduler::createNew();
-  UsageEnvironment* env = BasicUsageEnvironment::createNew(*scheduler);
+  UsageEnvironment* env = createEnvironment();
+
+  // "-w <num-worker-threads>" spreads the RTSP clients over that many threads, each with its own event loop:
+  unsigned numWorkerThreads = 0;
+  if (argc == 3 && strcmp(argv[1], "-w") == 0) {
+    numWorkerThreads = atoi(argv[2]);
+  } else if (argc != 1) {
+    *env << "Usage: " << argv[0] << " [-w <num-worker-threads>]\n";
+    exit(1);
+  }
 
   UserAuthenticationDatabase* authDB = NULL;
 #ifdef ACCESS_CONTROL
@@ -49,11 +67,22 @@ int main(int argc, char** argv) {
     exit(1);
   }
 
+  for (unsigned i = 0; i < numWorkerThreads; ++i) {
+    if (!rtspServer->addWorkerThread(*createEnvironment())) {
+      *env << "Failed to start a worker thread: " << env->getResultMsg() << "\n";
+      break;
+    }
+  }
+
   *env << "LIVE555 Media Server\n";
   *env << "\tversion " << MEDIA_SERVER_VERSION_STRING
        << " (LIVE555 Streaming Media library version "
        << LIVEMEDIA_LIBRARY_VERSION_STRING << ").\n";
 
+  if (rtspServer->numWorkerThreads() > 0) {
+    *env << "\t(using " << rtspServer->numWorkerThreads() << " worker threads)\n";
+  }
+
   char* urlPrefix = rtspServer->rtspURLPrefix();
   *env << "Play streams from this server using the URL\n\t"
        << urlPrefix << "<filename>\nwhere <filename> is a file present in the current directory.\n";
@@ -18,73 +18,197 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 // and generates a separate index file that can be used - by our RTSP server
 // implementation - to support 'trick play' operations when streaming the
 // Transport Stream file.
+// Several files may be given; they are indexed in parallel, by "-j" threads.
 // main program
 
 #include <liveMedia.hh>
 #include <BasicUsageEnvironment.hh>
+#if !defined(__WIN32__) && !defined(_WIN32)
+#include <pthread.h>
+#define USE_THREADS 1
+#endif
 
-void afterPlaying(void* clientData); // forward
-
-UsageEnvironment* env;
 char const* programName;
+char const** inputFileNames;
+unsigned numInputFiles;
+unsigned numThreads = 1;
+
+// Each thread has its own usage environment, and indexes every "numThreads"th input file, one after another.
+// The threads share no scheduler state; in particular, delayed-task tokens are allocated by each thread's own "DelayQueue":
+class IndexerThread {
+public:
+  IndexerThread(unsigned firstFileIndex);
+  virtual ~IndexerThread();
+
+  void run();
+  unsigned numFailures() const { return fNumFailures; }
+
+private:
+  Boolean startNextFile();
+  static void afterPlaying(void* clientData);
+  static void finishFile(void* clientData);
+  void finishFile1();
+  void closeMedia();
+
+public:
+#ifdef USE_THREADS
+  pthread_t fThread;
+#endif
+
+private:
+  UsageEnvironment* fEnv;
+  unsigned fFileIndex;
+  char* fOutputFileName;
+  FramedSource* fIndexer;
+  MediaSink* fOutput;
+  unsigned fNumFailures;
+  char fDoneFlag;
+};
 
 void usage() {
-  *env << "usage: " << programName << " <transport-stream-file-name>\n";
-  *env << "\twhere <transport-stream-file-name> ends with \".ts\"\n";
+  fprintf(stderr, "usage: %s [-j <num-threads>] <transport-stream-file-name> ...\n", programName);
+  fprintf(stderr, "\twhere each <transport-stream-file-name> ends with \".ts\"\n");
   exit(1);
 }
 
-int main(int argc, char const** argv) {
-  // Begin by setting up our usage environment:
-  TaskScheduler* scheduler = BasicTaskScheduler::createNew();
-  env = BasicUsageEnvironment::createNew(*scheduler);
+#ifdef USE_THREADS
+static void* threadMain(void* thread) {
+  ((IndexerThread*)thread)->run();
+  return NULL;
+}
+#endif
 
+int main(int argc, char const** argv) {
   // Parse the command line:
   programName = argv[0];
-  if (argc != 2) usage();
-
-  char const* inputFileName = argv[1];
-  // Check whether the input file name ends with ".ts":
-  int len = strlen(inputFileName);
-  if (len < 4 || strcmp(&inputFileName[len-3], ".ts") != 0) {
-    *env << "ERROR: input file name \"" << inputFileName
-	 << "\" does not end with \".ts\"\n";
-    usage();
+  if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+    if (sscanf(argv[2], "%u", &numThreads) != 1 || numThreads == 0) usage();
+    argv += 2; argc -= 2;
+  }
+  if (argc < 2) usage();
+  inputFileNames = &argv[1];
+  numInputFiles = argc - 1;
+
+  for (unsigned i = 0; i < numInputFiles; ++i) {
+    // Check whether the input file name ends with ".ts":
+    char const* inputFileName = inputFileNames[i];
+    int len = strlen(inputFileName);
+    if (len < 4 || strcmp(&inputFileName[len-3], ".ts") != 0) {
+      fprintf(stderr, "ERROR: input file name \"%s\" does not end with \".ts\"\n", inputFileName);
+      usage();
+    }
   }
 
-  // Open the input file (as a 'byte stream file source'):
-  FramedSource* input
-    = ByteStreamFileSource::createNew(*env, inputFileName, TRANSPORT_PACKET_SIZE);
-  if (input == NULL) {
-    *env << "Failed to open input file \"" << inputFileName << "\" (does it exist?)\n";
-    exit(1);
+#ifndef USE_THREADS
+  numThreads = 1;
+#endif
+  if (numThreads > numInputFiles) numThreads = numInputFiles;
+
+  IndexerThread** threads = new IndexerThread*[numThreads];
+  unsigned t;
+  for (t = 0; t < numThreads; ++t) threads[t] = new IndexerThread(t);
+
+  // Run the first thread's indexing in this thread, and the others' in threads of their own:
+#ifdef USE_THREADS
+  for (t = 1; t < numThreads; ++t) {
+    if (pthread_create(&threads[t]->fThread, NULL, threadMain, threads[t]) != 0) {
+      fprintf(stderr, "Failed to create thread\n");
+      exit(1);
+    }
+  }
+#endif
+  threads[0]->run();
+
+  unsigned numFailures = 0;
+  for (t = 0; t < numThreads; ++t) {
+#ifdef USE_THREADS
+    if (t > 0) pthread_join(threads[t]->fThread, NULL);
+#endif
+    numFailures += threads[t]->numFailures();
+    delete threads[t];
   }
+  delete[] threads;
+
+  return numFailures == 0 ? 0 : 1;
+}
+
+IndexerThread::IndexerThread(unsigned firstFileIndex)
+  : fFileIndex(firstFileIndex), fOutputFileName(NULL), fIndexer(NULL), fOutput(NULL),
+    fNumFailures(0), fDoneFlag(0) {
+  TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+  fEnv = BasicUsageEnvironment::createNew(*scheduler);
+}
 
-  // Create a filter that indexes the input Transport Stream data:
-  FramedSource* indexer
-    = MPEG2IFrameIndexFromTransportStream::createNew(*env, input);
+IndexerThread::~IndexerThread() {
+  closeMedia();
 
-  // The output file name is the same as the input file name, except with suffix ".tsx":
-  char* outputFileName = new char[len+2]; // allow for trailing x\0
-  sprintf(outputFileName, "%sx", inputFileName);
+  TaskScheduler* scheduler = &fEnv->taskScheduler();
+  fEnv->reclaim();
+  delete scheduler;
+}
+
+void IndexerThread::run() {
+  if (startNextFile()) fEnv->taskScheduler().doEventLoop(&fDoneFlag);
+}
 
-  // Open the output file (for writing), as a 'file sink':
-  MediaSink* output = FileSink::createNew(*env, outputFileName);
-  if (output == NULL) {
-    *env << "Failed to open output file \"" << outputFileName << "\"\n";
-    exit(1);
+Boolean IndexerThread::startNextFile() {
+  for (; fFileIndex < numInputFiles; fFileIndex += numThreads) {
+    char const* inputFileName = inputFileNames[fFileIndex];
+
+    // Open the input file (as a 'byte stream file source'):
+    FramedSource* input
+      = ByteStreamFileSource::createNew(*fEnv, inputFileName, TRANSPORT_PACKET_SIZE);
+    if (input == NULL) {
+      *fEnv << "Failed to open input file \"" << inputFileName << "\" (does it exist?)\n";
+      ++fNumFailures;
+      continue;
+    }
+
+    // Create a filter that indexes the input Transport Stream data:
+    fIndexer = MPEG2IFrameIndexFromTransportStream::createNew(*fEnv, input);
+
+    // The output file name is the same as the input file name, except with suffix ".tsx":
+    fOutputFileName = new char[strlen(inputFileName)+2]; // allow for trailing x\0
+    sprintf(fOutputFileName, "%sx", inputFileName);
+
+    // Open the output file (for writing), as a 'file sink':
+    fOutput = FileSink::createNew(*fEnv, fOutputFileName);
+    if (fOutput == NULL) {
+      *fEnv << "Failed to open output file \"" << fOutputFileName << "\"\n";
+      ++fNumFailures;
+      closeMedia();
+      continue;
+    }
+
+    // Start playing, to generate the output index file:
+    fprintf(stderr, "Writing index file \"%s\"...\n", fOutputFileName);
+    fOutput->startPlaying(*fIndexer, afterPlaying, this);
+    return True;
   }
 
-  // Start playing, to generate the output index file:
-  *env << "Writing index file \"" << outputFileName << "\"...";
-  output->startPlaying(*indexer, afterPlaying, NULL);
+  return False; // no more input files
+}
+
+void IndexerThread::afterPlaying(void* clientData) {
+  // We're being called from within the indexer, so close it (and move on to the next file) only after it returns:
+  IndexerThread* thread = (IndexerThread*)clientData;
+  thread->fEnv->taskScheduler().scheduleDelayedTask(0, finishFile, thread);
+}
+
+void IndexerThread::finishFile(void* clientData) {
+  ((IndexerThread*)clientData)->finishFile1();
+}
 
-  env->taskScheduler().doEventLoop(); // does not return
+void IndexerThread::finishFile1() {
+  fprintf(stderr, "...done writing \"%s\"\n", fOutputFileName);
+  closeMedia();
 
-  return 0; // only to prevent compiler warning
+  fFileIndex += numThreads;
+  if (!startNextFile()) fDoneFlag = ~0;
 }
 
-void afterPlaying(void* /*clientData*/) {
-  *env << "...done\n";
-  exit(0);
+void IndexerThread::closeMedia() {
+  Medium::close(fOutput); fOutput = NULL;
+  Medium::close(fIndexer); fIndexer = NULL; // also closes the input file source
+  delete[] fOutputFileName; fOutputFileName = NULL;
 }
@@ -101,6 +101,8 @@ unsigned socketInputBufferSize = 0;
 Boolean packetLossCompensate = False;
 Boolean syncStreams = False;
 Boolean generateHintTracks = False;
+Boolean useDirectIO = False;
+unsigned preallocationSizeKB = 0;
 unsigned qosMeasurementIntervalMS = 0; // 0 means: Don't output QOS data
 
 struct timeval startTime;
@@ -113,7 +115,7 @@ void usage() {
 	   << (allowProxyServers ? " [<proxy-server> [<proxy-server-port>]]" : "")
        << "]" << (supportCodecSelection ? " [-A <audio-codec-rtp-payload-format-code>|-M <mime-subtype-name>]" : "")
        << " [-s <initial-seek-time>] [-z <scale>]"
-       << " [-w <width> -h <height>] [-f <frames-per-second>] [-y] [-H] [-Q [<measurement-interval>]] [-F <filename-prefix>] [-b <file-sink-buffer-size>] [-B <input-socket-buffer-size>] [-I <input-interface-ip-address>] [-m] <url> (or " << progName << " -o [-V] <url>)\n";
+       << " [-w <width> -h <height>] [-f <frames-per-second>] [-y] [-H] [-W] [-P <preallocation-size-in-kbytes>] [-Q [<measurement-interval>]] [-F <filename-prefix>] [-b <file-sink-buffer-size>] [-B <input-socket-buffer-size>] [-I <input-interface-ip-address>] [-m] <url> (or " << progName << " -o [-V] <url>)\n";
   shutdown();
 }
 
@@ -397,6 +399,19 @@ int main(int argc, char** argv) {
       break;
     }
 
+    case 'W': { // write the output QuickTime or AVI file with O_DIRECT (if it's a seekable file)
+      useDirectIO = True;
+      break;
+    }
+
+    case 'P': { // allocate disk space ahead of the output QuickTime or AVI file
+      if (sscanf(argv[2], "%u", &preallocationSizeKB) != 1) {
+	usage();
+      }
+      ++argv; --argc;
+      break;
+    }
+
     case 'Q': { // output QOS measurements
       qosMeasurementIntervalMS = 1000; // default: 1 second
 
@@ -673,7 +688,9 @@ void setupStreams() {
 					   packetLossCompensate,
 					   syncStreams,
 					   generateHintTracks,
-					   generateMP4Format);
+					   generateMP4Format,
+					   useDirectIO,
+					   (u_int64_t)preallocationSizeKB*1024);
       if (qtOut == NULL) {
 	*env << "Failed to create QuickTime file sink for stdout: " << env->getResultMsg();
 	shutdown();
@@ -686,7 +703,9 @@ void setupStreams() {
 				      fileSinkBufferSize,
 				      movieWidth, movieHeight,
 				      movieFPS,
-				      packetLossCompensate);
+				      packetLossCompensate,
+				      useDirectIO,
+				      (u_int64_t)preallocationSizeKB*1024);
       if (aviOut == NULL) {
 	*env << "Failed to create AVI file sink for stdout: " << env->getResultMsg();
 	shutdown();
@@ -0,0 +1,220 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// Copyright (c) 1996-2011, Live Networks, Inc.  All rights reserved
+// A microbenchmark for "DelayQueue": With N timers pending (e.g., one per
+// session), repeatedly cancels a timer and schedules it again (as
+// "rescheduleDelayedTask()" does).  For comparison, the same is done with
+// a copy of the linked list of delta times that "DelayQueue" used to be.
+// main program
+
+#include <BasicUsageEnvironment.hh>
+#include "GroupsockHelper.hh"
+#include <stdio.h>
+
+char const* progName;
+UsageEnvironment* env;
+
+void usage() {
+  *env << "Usage: " << progName << " [-n <num-timers>] [-o <num-operations>]\n";
+  exit(1);
+}
+
+static DelayInterval randomDelay() {
+  // Between 1 and 60 seconds (so that nothing comes due during the test):
+  unsigned uSeconds = 1000000 + our_random()%59000000;
+  return DelayInterval(uSeconds/1000000, uSeconds%1000000);
+}
+
+static double secondsSince(struct timeval const& startTime) {
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  return (timeNow.tv_sec - startTime.tv_sec) + (timeNow.tv_usec - startTime.tv_usec)/1000000.0;
+}
+
+////////// The old implementation: a linked list of delta times //////////
+
+class ListEntry {
+public:
+  ListEntry(DelayInterval delay) : fNext(this), fPrev(this), fDeltaTimeRemaining(delay) {}
+
+  ListEntry* fNext;
+  ListEntry* fPrev;
+  DelayInterval fDeltaTimeRemaining;
+};
+
+class ListDelayQueue: public ListEntry {
+public:
+  ListDelayQueue() : ListEntry(DelayInterval(0x7FFFFFFF, 999999)) {
+    fLastSyncTime = TimeNow();
+  }
+
+  void addEntry(ListEntry* newEntry) {
+    synchronize();
+
+    ListEntry* cur = fNext;
+    while (newEntry->fDeltaTimeRemaining >= cur->fDeltaTimeRemaining) {
+      newEntry->fDeltaTimeRemaining -= cur->fDeltaTimeRemaining;
+      cur = cur->fNext;
+    }
+    cur->fDeltaTimeRemaining -= newEntry->fDeltaTimeRemaining;
+
+    newEntry->fNext = cur;
+    newEntry->fPrev = cur->fPrev;
+    cur->fPrev = newEntry->fPrev->fNext = newEntry;
+  }
+
+  void removeEntry(ListEntry* entry) {
+    entry->fNext->fDeltaTimeRemaining += entry->fDeltaTimeRemaining;
+    entry->fPrev->fNext = entry->fNext;
+    entry->fNext->fPrev = entry->fPrev;
+    entry->fNext = entry->fPrev = NULL;
+  }
+
+  ListEntry* findEntry(unsigned index) {
+    // "DelayQueue" looked up tokens by walking the list; do the same:
+    ListEntry* cur = fNext;
+    while (cur != this && cur != (ListEntry*)fEntries[index]) cur = cur->fNext;
+    return cur;
+  }
+
+  ListEntry** fEntries; // indexed by 'token'
+
+private:
+  void synchronize() {
+    // (The "DelayQueue" implementation also did this on each "addEntry()".)
+    EventTime timeNow = TimeNow();
+    DelayInterval timeSinceLastSync = timeNow - fLastSyncTime;
+    fLastSyncTime = timeNow;
+
+    ListEntry* curEntry = fNext;
+    while (timeSinceLastSync >= curEntry->fDeltaTimeRemaining) {
+      timeSinceLastSync -= curEntry->fDeltaTimeRemaining;
+      curEntry->fDeltaTimeRemaining = DELAY_ZERO;
+      curEntry = curEntry->fNext;
+    }
+    curEntry->fDeltaTimeRemaining -= timeSinceLastSync;
+  }
+
+  EventTime fLastSyncTime;
+};
+
+static double benchmarkList(unsigned numTimers, unsigned numOperations) {
+  ListDelayQueue queue;
+  queue.fEntries = new ListEntry*[numTimers];
+  for (unsigned i = 0; i < numTimers; ++i) {
+    queue.fEntries[i] = new ListEntry(randomDelay());
+    queue.addEntry(queue.fEntries[i]);
+  }
+
+  struct timeval startTime;
+  gettimeofday(&startTime, NULL);
+  for (unsigned i = 0; i < numOperations; ++i) {
+    ListEntry* entry = queue.findEntry(our_random()%numTimers);
+    queue.removeEntry(entry);
+    entry->fDeltaTimeRemaining = randomDelay();
+    queue.addEntry(entry);
+  }
+  double elapsed = secondsSince(startTime);
+
+  for (unsigned i = 0; i < numTimers; ++i) {
+    queue.removeEntry(queue.fEntries[i]);
+    delete queue.fEntries[i];
+  }
+  delete[] queue.fEntries;
+  return elapsed;
+}
+
+////////// The current implementation //////////
+
+class Timer: public DelayQueueEntry {
+public:
+  Timer(DelayInterval delay) : DelayQueueEntry(delay) {}
+};
+
+static double benchmarkDelayQueue(unsigned numTimers, unsigned numOperations) {
+  DelayQueue queue;
+  long* tokens = new long[numTimers];
+  for (unsigned i = 0; i < numTimers; ++i) {
+    Timer* timer = new Timer(randomDelay());
+    queue.addEntry(timer);
+    tokens[i] = timer->token();
+  }
+
+  struct timeval startTime;
+  gettimeofday(&startTime, NULL);
+  for (unsigned i = 0; i < numOperations; ++i) {
+    // This is what "rescheduleDelayedTask()" does:
+    unsigned index = our_random()%numTimers;
+    DelayQueueEntry* timer = queue.removeEntry(tokens[index]);
+    delete timer;
+    timer = new Timer(randomDelay());
+    queue.addEntry(timer);
+    tokens[index] = timer->token();
+  }
+  double elapsed = secondsSince(startTime);
+
+  for (unsigned i = 0; i < numTimers; ++i) delete queue.removeEntry(tokens[i]);
+  delete[] tokens;
+  return elapsed;
+}
+
+int main(int argc, char** argv) {
+  // Begin by setting up our usage environment:
+  TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+  env = BasicUsageEnvironment::createNew(*scheduler);
+
+  unsigned numTimers = 0; // means: several different numbers
+  unsigned numOperations = 100000;
+  progName = argv[0];
+  while (argc > 2) {
+    char* const opt = argv[1];
+    if (opt[0] != '-') usage();
+    unsigned value;
+    if (sscanf(argv[2], "%u", &value) != 1 || value == 0) usage();
+    switch (opt[1]) {
+    case 'n': numTimers = value; break;
+    case 'o': numOperations = value; break;
+    default: usage();
+    }
+    argv += 2; argc -= 2;
+  }
+  if (argc != 1) usage();
+
+  unsigned const defaultNumTimers[] = { 10, 100, 1000, 10000, 100000 };
+  unsigned const numRuns = numTimers == 0 ? sizeof defaultNumTimers/sizeof defaultNumTimers[0] : 1;
+  for (unsigned run = 0; run < numRuns; ++run) {
+    unsigned n = numTimers == 0 ? defaultNumTimers[run] : numTimers;
+    // The list is slow with many timers; do fewer operations on it:
+    unsigned numListOperations = numOperations;
+    if (n > 1000) numListOperations = numOperations/(n/1000);
+    if (numListOperations == 0) numListOperations = 1;
+
+    our_srandom(n);
+    double listTime = benchmarkList(n, numListOperations);
+    our_srandom(n);
+    double heapTime = benchmarkDelayQueue(n, numOperations);
+
+    char line[200];
+    sprintf(line, "%7u timers: list %9.3f us/reschedule, heap %7.3f us/reschedule (%.1fx)\n",
+	    n, listTime*1e6/numListOperations, heapTime*1e6/numOperations,
+	    (listTime/numListOperations)/(heapTime/numOperations));
+    *env << line;
+  }
+
+  env->reclaim();
+  delete scheduler;
+  return 0;
+}
@@ -0,0 +1,245 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// Copyright (c) 1996-2011, Live Networks, Inc.  All rights reserved
+// A benchmark for "HashTable": Adds many entries (with string keys - like
+// RTSP session ids and stream names - or one-word keys), looks each of them
+// up (and as many keys that are not present), iterates through them, then
+// removes them - both by key, and using "RemoveNext()" - and reports the
+// time taken per operation, and the longest time taken by any one "Add()".
+// With "-t", several threads do this at once, each with its own keys, in
+// one thread-safe table.  (The results are checked along the way.)
+// main program
+
+#include <BasicUsageEnvironment.hh>
+#include "GroupsockHelper.hh"
+#include <stdio.h>
+#include <string.h>
+#if !defined(__WIN32__) && !defined(_WIN32)
+#include <pthread.h>
+#define USE_THREADS 1
+#endif
+
+char const* progName;
+UsageEnvironment* env;
+
+unsigned numEntries = 100000;
+unsigned numThreads = 1;
+Boolean useStringKeys = True;
+
+void usage() {
+  *env << "Usage: " << progName << " [-n <num-entries>] [-t <num-threads>] [-w]\n"
+       << "\t-w: use one-word keys, rather than string keys\n";
+  exit(1);
+}
+
+static double secondsSince(struct timeval const& startTime) {
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  return (timeNow.tv_sec - startTime.tv_sec) + (timeNow.tv_usec - startTime.tv_usec)/1000000.0;
+}
+
+#define NUM_PHASES 6
+static char const* const phaseNames[NUM_PHASES]
+  = { "add", "lookup (present)", "lookup (absent)", "iterate", "remove", "add+RemoveNext" };
+
+class BenchmarkThread {
+public:
+  BenchmarkThread(HashTable& table, unsigned threadNum)
+    : fMaxAddTime(0.0), fNumErrors(0), fTable(table), fThreadNum(threadNum) {
+    for (unsigned i = 0; i < NUM_PHASES; ++i) fPhaseTime[i] = 0.0;
+
+    // Make all of our keys in advance, so that we time only the table operations:
+    fKeys = new char const*[numEntries];
+    fAbsentKeys = new char const*[numEntries];
+    for (unsigned i = 0; i < numEntries; ++i) {
+      unsigned scrambled = i*2654435761U; // a different value for each "i"
+      if (useStringKeys) {
+	char buf[30];
+	sprintf(buf, "%08X-%u", scrambled, threadNum);
+	fKeys[i] = strDup(buf);
+	sprintf(buf, "%08X+%u", scrambled, threadNum);
+	fAbsentKeys[i] = strDup(buf);
+      } else {
+	fKeys[i] = (char const*)(((unsigned long)scrambled*numThreads + threadNum)*2 + 2);
+	fAbsentKeys[i] = (char const*)((unsigned long)fKeys[i] + 1);
+      }
+    }
+  }
+
+  virtual ~BenchmarkThread() {
+    if (useStringKeys) {
+      for (unsigned i = 0; i < numEntries; ++i) {
+	delete[] (char*)fKeys[i];
+	delete[] (char*)fAbsentKeys[i];
+      }
+    }
+    delete[] fKeys; delete[] fAbsentKeys;
+  }
+
+  void run();
+#ifdef USE_THREADS
+  static void* runThread(void* thread) { ((BenchmarkThread*)thread)->run(); return NULL; }
+  pthread_t fThread;
+#endif
+
+  double fPhaseTime[NUM_PHASES];
+  double fMaxAddTime;
+  unsigned fNumErrors;
+
+private:
+  void* valueFor(unsigned i) const { return (void*)((unsigned long)i + 1); }
+
+private:
+  HashTable& fTable;
+  unsigned fThreadNum;
+  char const** fKeys;
+  char const** fAbsentKeys;
+};
+
+void BenchmarkThread::run() {
+  struct timeval startTime, addStartTime;
+  unsigned i;
+
+  gettimeofday(&startTime, NULL);
+  for (i = 0; i < numEntries; ++i) {
+    gettimeofday(&addStartTime, NULL);
+    if (fTable.Add(fKeys[i], valueFor(i)) != NULL) ++fNumErrors;
+    double addTime = secondsSince(addStartTime);
+    if (addTime > fMaxAddTime) fMaxAddTime = addTime;
+  }
+  fPhaseTime[0] = secondsSince(startTime);
+
+  gettimeofday(&startTime, NULL);
+  for (i = 0; i < numEntries; ++i) {
+    if (fTable.Lookup(fKeys[i]) != valueFor(i)) ++fNumErrors;
+  }
+  fPhaseTime[1] = secondsSince(startTime);
+
+  gettimeofday(&startTime, NULL);
+  for (i = 0; i < numEntries; ++i) {
+    if (fTable.Lookup(fAbsentKeys[i]) != NULL) ++fNumErrors;
+  }
+  fPhaseTime[2] = secondsSince(startTime);
+
+  if (numThreads == 1) { // (with several threads, the table would be changing while we iterate)
+    gettimeofday(&startTime, NULL);
+    HashTable::Iterator* iter = HashTable::Iterator::create(fTable);
+    char const* key;
+    unsigned numFound = 0;
+    while (iter->next(key) != NULL) ++numFound;
+    delete iter;
+    fPhaseTime[3] = secondsSince(startTime);
+    if (numFound != numEntries) ++fNumErrors;
+  }
+
+  gettimeofday(&startTime, NULL);
+  for (i = 0; i < numEntries; ++i) {
+    if (!fTable.Remove(fKeys[i])) ++fNumErrors;
+  }
+  fPhaseTime[4] = secondsSince(startTime);
+
+  if (numThreads == 1) { // ("RemoveNext()" would remove other threads' entries)
+    gettimeofday(&startTime, NULL);
+    for (i = 0; i < numEntries; ++i) fTable.Add(fKeys[i], valueFor(i));
+    unsigned numRemoved = 0;
+    while (fTable.RemoveNext() != NULL) ++numRemoved;
+    fPhaseTime[5] = secondsSince(startTime);
+    if (numRemoved != numEntries) ++fNumErrors;
+  }
+}
+
+int main(int argc, char** argv) {
+  // Begin by setting up our usage environment:
+  TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+  env = BasicUsageEnvironment::createNew(*scheduler);
+
+  progName = argv[0];
+  while (argc > 1) {
+    char* const opt = argv[1];
+    if (strcmp(opt, "-w") == 0) {
+      useStringKeys = False;
+      ++argv; --argc;
+      continue;
+    }
+    unsigned value;
+    if (argc < 3 || opt[0] != '-' || sscanf(argv[2], "%u", &value) != 1 || value == 0) usage();
+    switch (opt[1]) {
+    case 'n': numEntries = value; break;
+    case 't': numThreads = value; break;
+    default: usage();
+    }
+    argv += 2; argc -= 2;
+  }
+#ifndef USE_THREADS
+  if (numThreads > 1) {
+    *env << "Threads are not supported on this platform\n";
+    exit(1);
+  }
+#endif
+
+  HashTable* table = HashTable::create(useStringKeys ? STRING_HASH_KEYS : ONE_WORD_HASH_KEYS, numThreads > 1);
+  BenchmarkThread** threads = new BenchmarkThread*[numThreads];
+  unsigned t;
+  for (t = 0; t < numThreads; ++t) threads[t] = new BenchmarkThread(*table, t);
+
+  struct timeval startTime;
+  gettimeofday(&startTime, NULL);
+#ifdef USE_THREADS
+  if (numThreads > 1) {
+    for (t = 0; t < numThreads; ++t) {
+      pthread_create(&threads[t]->fThread, NULL, BenchmarkThread::runThread, threads[t]);
+    }
+    for (t = 0; t < numThreads; ++t) pthread_join(threads[t]->fThread, NULL);
+  } else
+#endif
+  threads[0]->run();
+  double elapsed = secondsSince(startTime);
+
+  *env << numEntries << (useStringKeys ? " string" : " one-word") << " keys";
+  if (numThreads > 1) *env << " in each of " << numThreads << " threads (using a thread-safe table)";
+  *env << ":\n";
+
+  char result[200];
+  unsigned numErrors = 0;
+  double maxAddTime = 0.0;
+  for (t = 0; t < numThreads; ++t) {
+    numErrors += threads[t]->fNumErrors;
+    if (threads[t]->fMaxAddTime > maxAddTime) maxAddTime = threads[t]->fMaxAddTime;
+  }
+  for (unsigned phase = 0; phase < NUM_PHASES; ++phase) {
+    double totTime = 0.0;
+    for (t = 0; t < numThreads; ++t) totTime += threads[t]->fPhaseTime[phase];
+    if (totTime == 0.0) continue; // this phase was skipped
+
+    unsigned opsPerEntry = phase == NUM_PHASES-1 ? 2 : 1;
+    sprintf(result, "%-18s %8.1f ns/op", phaseNames[phase], totTime*1e9/numThreads/numEntries/opsPerEntry);
+    *env << result;
+    if (phase == 0) {
+      sprintf(result, " (longest: %.1f us)", maxAddTime*1e6);
+      *env << result;
+    }
+    *env << "\n";
+  }
+  sprintf(result, "total: %.3f s, %.2f million operations/s", elapsed,
+	  (numThreads > 1 ? 4.0 : 7.0)*numEntries*numThreads/elapsed/1e6);
+  *env << result << "\n";
+  if (numErrors > 0) *env << numErrors << " ERRORS!\n";
+
+  for (t = 0; t < numThreads; ++t) delete threads[t];
+  delete[] threads;
+  delete table;
+  return numErrors > 0 ? 1 : 0;
+}
@@ -0,0 +1,363 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// Copyright (c) 1996-2011, Live Networks, Inc.  All rights reserved
+// A load test for RTSP servers: Many RTSP client sessions - each of which
+// does "DESCRIBE", "SETUP", "PLAY", receives RTP packets for a while, then
+// does "TEARDOWN" - are run concurrently against a server, and the rate of
+// completed sessions, and of received RTP packets, is reported - along with
+// the time taken to set up each session (from "DESCRIBE" until the response
+// to "PLAY"), with or without pipelining the "SETUP"s and "PLAY".
+// The server is either a "RTSPServer" (with optional worker threads) that
+// this program runs itself, streaming a MPEG Transport Stream file (with
+// a separate source for each session, or one shared source), or else an
+// external server, given by its "rtsp://" URL.
+// main program
+
+#include <liveMedia.hh>
+#include <BasicUsageEnvironment.hh>
+#include <stdio.h>
+#if !defined(__WIN32__) && !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+char const* progName;
+UsageEnvironment* env;
+
+unsigned numWorkerThreads = 0;
+unsigned numConcurrentSessions = 10;
+unsigned numSessions = 100;
+unsigned sessionDurationMs = 1000;
+Boolean reuseFirstSource = False;
+Boolean streamUsingTCP = False;
+Boolean pipelineRequests = False;
+unsigned numStreams = 1;
+
+char const* streamName = "loadTest";
+unsigned numSessionsStarted, numSessionsCompleted, numSessionsFailed;
+unsigned numSessionsRunning;
+unsigned numPacketsReceived;
+unsigned numSessionsSetUp;
+double totSetupTime, maxSetupTime;
+char doneFlag;
+
+void usage() {
+  *env << "Usage: " << progName
+       << " [-w <num-worker-threads>] [-c <num-concurrent-sessions>] [-n <num-sessions>] [-d <session-duration-ms>]"
+       << " [-s <num-streams>] [-r] [-t] [-p] <transport-stream-file>|<rtsp-url>\n"
+       << "\t-s: our own server streams the file as this many streams (i.e., subsessions) in each session\n"
+       << "\t-r: our own server streams one source to all (concurrent) sessions (i.e., uses \"reuseFirstSource\")\n"
+       << "\t-t: stream RTP and RTCP over the RTSP TCP connection\n"
+       << "\t-p: send all \"SETUP\"s, and the \"PLAY\", without waiting for each other's responses\n";
+  exit(1);
+}
+
+static UsageEnvironment* createEnvironment() {
+  TaskScheduler* scheduler = NULL;
+#if defined(__linux__)
+  scheduler = EpollTaskScheduler::createNew();
+#endif
+  if (scheduler == NULL) scheduler = BasicTaskScheduler::createNew();
+  return BasicUsageEnvironment::createNew(*scheduler);
+}
+
+static double cpuSeconds() {
+#if !defined(__WIN32__) && !defined(_WIN32)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+      + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)/1000000.0;
+  }
+#endif
+  return 0.0;
+}
+
+////////// The server that we run ourself //////////
+
+// (Our worker servers - if any - use our "ServerMediaSession" for the file.)
+class LoadTestServer: public RTSPServer {
+public:
+  static LoadTestServer* createNew(UsageEnvironment& env, char const* fileName) {
+    Port ourPort(0); // choose any port
+    int ourSocket = setUpOurSocket(env, ourPort);
+    if (ourSocket == -1) return NULL;
+    return new LoadTestServer(env, ourSocket, ourPort, NULL, fileName);
+  }
+
+private:
+  LoadTestServer(UsageEnvironment& env, int ourSocket, Port ourPort,
+		 UserAuthenticationDatabase* authDatabase, char const* fileName)
+    : RTSPServer(env, ourSocket, ourPort, authDatabase, 0) {
+    ServerMediaSession* sms
+      = ServerMediaSession::createNew(env, streamName, streamName, "Session streamed by \"testRTSPServerLoad\"");
+    for (unsigned i = 0; i < numStreams; ++i) {
+      sms->addSubsession(MPEG2TransportFileServerMediaSubsession::createNew(env, fileName, NULL, reuseFirstSource));
+    }
+    addServerMediaSession(sms);
+  }
+};
+
+////////// The client sessions //////////
+
+// Counts - and discards - each frame (i.e., the payload of each RTP packet) that it receives:
+class CountingSink: public MediaSink {
+public:
+  CountingSink(UsageEnvironment& env) : MediaSink(env) {}
+
+private: // redefined virtual functions
+  virtual Boolean continuePlaying() {
+    if (fSource == NULL) return False;
+    fSource->getNextFrame(fBuffer, sizeof fBuffer, afterGettingFrame, this, onSourceClosure, this);
+    return True;
+  }
+
+  static void afterGettingFrame(void* clientData, unsigned /*frameSize*/, unsigned /*numTruncatedBytes*/,
+				struct timeval /*presentationTime*/, unsigned /*durationInMicroseconds*/) {
+    ++numPacketsReceived;
+    ((CountingSink*)clientData)->continuePlaying();
+  }
+
+private:
+  unsigned char fBuffer[100000];
+};
+
+class LoadTestClient: public RTSPClient {
+public:
+  static void startSession(char const* url);
+
+private:
+  LoadTestClient(UsageEnvironment& env, char const* url)
+    : RTSPClient(env, url, 0, progName, 0), fSession(NULL), fIter(NULL), fEndTask(NULL), fFinished(False) {
+    gettimeofday(&fStartTime, NULL);
+  }
+  virtual ~LoadTestClient() { delete fIter; }
+
+  static void continueAfterDESCRIBE(RTSPClient* client, int resultCode, char* resultString);
+  static void continueAfterSETUP(RTSPClient* client, int resultCode, char* resultString);
+  static void continueAfterPLAY(RTSPClient* client, int resultCode, char* resultString);
+  static void continueAfterTEARDOWN(RTSPClient* client, int resultCode, char* resultString);
+  static void endSession(void* client);
+  static void reclaim(void* client);
+
+  void setupNextSubsession();
+  void finish(Boolean succeeded);
+
+private:
+  MediaSession* fSession;
+  MediaSubsessionIterator* fIter;
+  TaskToken fEndTask;
+  struct timeval fStartTime;
+  Boolean fFinished;
+};
+
+char const* serverURL;
+
+void LoadTestClient::startSession(char const* url) {
+  ++numSessionsStarted; ++numSessionsRunning;
+  LoadTestClient* client = new LoadTestClient(*env, url);
+  client->sendDescribeCommand(continueAfterDESCRIBE);
+}
+
+void LoadTestClient::continueAfterDESCRIBE(RTSPClient* client, int resultCode, char* resultString) {
+  LoadTestClient* ourClient = (LoadTestClient*)client;
+  if (resultCode == 0) ourClient->fSession = MediaSession::createNew(*env, resultString);
+  delete[] resultString;
+  if (ourClient->fSession == NULL || !ourClient->fSession->hasSubsessions()) {
+    ourClient->finish(False);
+    return;
+  }
+
+  ourClient->fIter = new MediaSubsessionIterator(*ourClient->fSession);
+  ourClient->setupNextSubsession();
+}
+
+void LoadTestClient::setupNextSubsession() {
+  MediaSubsession* subsession;
+  while ((subsession = fIter->next()) != NULL) {
+    if (subsession->initiate()) {
+      sendSetupCommand(*subsession, continueAfterSETUP, False, streamUsingTCP);
+      if (!pipelineRequests) return; // we'll continue after the response
+    }
+  }
+
+  // We've set up all of the subsessions; start playing:
+  sendPlayCommand(*fSession, continueAfterPLAY);
+}
+
+void LoadTestClient::continueAfterSETUP(RTSPClient* client, int resultCode, char* resultString) {
+  LoadTestClient* ourClient = (LoadTestClient*)client;
+  delete[] resultString;
+  if (resultCode != 0) {
+    ourClient->finish(False);
+    return;
+  }
+  if (!pipelineRequests) ourClient->setupNextSubsession();
+}
+
+void LoadTestClient::continueAfterPLAY(RTSPClient* client, int resultCode, char* resultString) {
+  LoadTestClient* ourClient = (LoadTestClient*)client;
+  delete[] resultString;
+  if (resultCode != 0 || ourClient->fFinished) { // (we may have already failed a pipelined "SETUP")
+    ourClient->finish(False);
+    return;
+  }
+
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  double setupTime = (timeNow.tv_sec - ourClient->fStartTime.tv_sec)
+    + (timeNow.tv_usec - ourClient->fStartTime.tv_usec)/1000000.0;
+  ++numSessionsSetUp;
+  totSetupTime += setupTime;
+  if (setupTime > maxSetupTime) maxSetupTime = setupTime;
+
+  MediaSubsessionIterator iter(*ourClient->fSession);
+  MediaSubsession* subsession;
+  while ((subsession = iter.next()) != NULL) {
+    if (subsession->readSource() == NULL) continue;
+    subsession->sink = new CountingSink(*env);
+    subsession->sink->startPlaying(*subsession->readSource(), NULL, NULL);
+  }
+  ourClient->fEndTask = env->taskScheduler().scheduleDelayedTask(sessionDurationMs*1000, endSession, ourClient);
+}
+
+void LoadTestClient::endSession(void* client) {
+  LoadTestClient* ourClient = (LoadTestClient*)client;
+  ourClient->fEndTask = NULL;
+  ourClient->sendTeardownCommand(*ourClient->fSession, continueAfterTEARDOWN);
+}
+
+void LoadTestClient::continueAfterTEARDOWN(RTSPClient* client, int resultCode, char* resultString) {
+  delete[] resultString;
+  ((LoadTestClient*)client)->finish(resultCode == 0);
+}
+
+void LoadTestClient::finish(Boolean succeeded) {
+  if (fFinished) return;
+  fFinished = True;
+  if (succeeded) ++numSessionsCompleted; else ++numSessionsFailed;
+
+  // We're called from within one of our own response handlers, so delete ourself later:
+  env->taskScheduler().scheduleDelayedTask(0, reclaim, this);
+}
+
+void LoadTestClient::reclaim(void* client) {
+  LoadTestClient* ourClient = (LoadTestClient*)client;
+  if (ourClient->fSession != NULL) {
+    MediaSubsessionIterator iter(*ourClient->fSession);
+    MediaSubsession* subsession;
+    while ((subsession = iter.next()) != NULL) {
+      Medium::close(subsession->sink);
+      subsession->sink = NULL;
+    }
+    Medium::close(ourClient->fSession);
+  }
+  Medium::close(ourClient);
+  --numSessionsRunning;
+
+  // Keep the number of concurrent sessions up, until we've started them all:
+  if (numSessionsStarted < numSessions) {
+    startSession(serverURL);
+  } else if (numSessionsRunning == 0) {
+    doneFlag = 1;
+  }
+}
+
+int main(int argc, char** argv) {
+  // Begin by setting up our usage environment:
+  env = createEnvironment();
+
+  progName = argv[0];
+  while (argc > 2) {
+    char* const opt = argv[1];
+    if (opt[0] != '-') break;
+    if (strcmp(opt, "-r") == 0 || strcmp(opt, "-t") == 0 || strcmp(opt, "-p") == 0) {
+      if (opt[1] == 'r') reuseFirstSource = True; else if (opt[1] == 't') streamUsingTCP = True; else pipelineRequests = True;
+      ++argv; --argc;
+      continue;
+    }
+    unsigned value;
+    if (sscanf(argv[2], "%u", &value) != 1) usage();
+    switch (opt[1]) {
+    case 'w': numWorkerThreads = value; break;
+    case 'c': numConcurrentSessions = value; break;
+    case 'n': numSessions = value; break;
+    case 'd': sessionDurationMs = value; break;
+    case 's': numStreams = value; break;
+    default: usage();
+    }
+    argv += 2; argc -= 2;
+  }
+  if (argc != 2 || numConcurrentSessions == 0 || numSessions == 0 || numStreams == 0) usage();
+
+  char* ourURL = NULL;
+  RTSPServer* server = NULL;
+  if (strncmp(argv[1], "rtsp://", 7) == 0) {
+    serverURL = argv[1];
+  } else {
+    server = LoadTestServer::createNew(*env, argv[1]);
+    if (server == NULL) {
+      *env << "Failed to create RTSP server: " << env->getResultMsg() << "\n";
+      exit(1);
+    }
+    for (unsigned i = 0; i < numWorkerThreads; ++i) {
+      if (!server->addWorkerThread(*createEnvironment())) {
+	*env << "Failed to start a worker thread: " << env->getResultMsg() << "\n";
+	exit(1);
+      }
+    }
+    ServerMediaSession* sms = server->lookupServerMediaSession(streamName);
+    serverURL = ourURL = server->rtspURL(sms);
+  }
+  *env << "Running " << numSessions << " sessions (" << numConcurrentSessions << " at a time, "
+       << sessionDurationMs << " ms each" << (streamUsingTCP ? ", RTP-over-TCP" : "")
+       << (reuseFirstSource ? ", one shared source" : "") << (pipelineRequests ? ", pipelined requests" : "")
+       << ") against " << serverURL << "\n";
+
+  struct timeval startTime, endTime;
+  gettimeofday(&startTime, NULL);
+  double startCPU = cpuSeconds();
+  for (unsigned i = 0; i < numConcurrentSessions && i < numSessions; ++i) {
+    LoadTestClient::startSession(serverURL);
+  }
+  env->taskScheduler().doEventLoop(&doneFlag);
+  gettimeofday(&endTime, NULL);
+  double cpu = cpuSeconds() - startCPU;
+
+  double elapsed = (endTime.tv_sec - startTime.tv_sec)
+    + (endTime.tv_usec - startTime.tv_usec)/1000000.0;
+  unsigned numServerThreads = server == NULL ? 0 : numWorkerThreads > 0 ? numWorkerThreads : 1;
+
+  *env << numSessionsCompleted << " sessions completed";
+  if (numSessionsFailed > 0) *env << " (" << numSessionsFailed << " failed)";
+  *env << " in " << elapsed << " seconds: " << numSessionsCompleted/elapsed << " sessions/sec, "
+       << numPacketsReceived/elapsed << " packets/sec\n";
+  if (numSessionsSetUp > 0) {
+    *env << "session setup (\"DESCRIBE\" until \"PLAY\" response): " << totSetupTime/numSessionsSetUp*1000.0
+	 << " ms on average, " << maxSetupTime*1000.0 << " ms at most\n";
+  }
+  if (numServerThreads > 0) {
+    // Our server (and clients) run in this process, so its CPU time tells how many cores have been kept busy:
+    double coresUsed = cpu/elapsed;
+    *env << numServerThreads << " server event loop(s), " << coresUsed << " cores used: "
+	 << numSessionsCompleted/elapsed/numServerThreads << " sessions/sec and "
+	 << numPacketsReceived/elapsed/numServerThreads << " packets/sec per server thread; "
+	 << (cpu > 0.0 ? numSessionsCompleted/cpu : 0.0) << " sessions/sec and "
+	 << (cpu > 0.0 ? numPacketsReceived/cpu : 0.0) << " packets/sec per core\n";
+  }
+
+  delete[] ourURL;
+  Medium::close(server);
+  return numSessionsFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// Copyright (c) 1996-2011, Live Networks, Inc.  All rights reserved
+// A benchmark for "StreamParser": Reads an elementary stream file (H.264,
+// MPEG-4 or MPEG-1/2 video) through the corresponding "*StreamFramer"
+// several times - as fast as possible, discarding the resulting frames -
+// and reports the parsing speed (in MB/s of input).
+// main program
+
+#include <liveMedia.hh>
+#include <BasicUsageEnvironment.hh>
+#include "GroupsockHelper.hh"
+#include <stdio.h>
+#include <string.h>
+
+char const* progName;
+UsageEnvironment* env;
+
+unsigned numRuns = 5;
+unsigned maxFrameSize = 2000000;
+
+void usage() {
+  *env << "Usage: " << progName << " [-n <num-runs>] [-b <max-frame-size>] <input-file>\n"
+       << "\t(The input file name must end with \".264\" (H.264), \".m4e\" (MPEG-4), or\n"
+       << "\t \".mpg\", \".m1v\", \".m2v\", \".mpv\" (MPEG-1 or 2 video elementary stream).)\n";
+  exit(1);
+}
+
+static double secondsSince(struct timeval const& startTime) {
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  return (timeNow.tv_sec - startTime.tv_sec) + (timeNow.tv_usec - startTime.tv_usec)/1000000.0;
+}
+
+// A sink that just counts (and throws away) the frames that it receives:
+class DiscardSink: public MediaSink {
+public:
+  DiscardSink(UsageEnvironment& env, unsigned bufferSize)
+    : MediaSink(env), fBufferSize(bufferSize),
+      fNumFrames(0), fNumBytes(0), fMaxFrameSize(0), fNumTruncatedFrames(0) {
+    fBuffer = new unsigned char[bufferSize];
+  }
+  virtual ~DiscardSink() { delete[] fBuffer; }
+
+  unsigned fBufferSize;
+  unsigned fNumFrames;
+  double fNumBytes;
+  unsigned fMaxFrameSize;
+  unsigned fNumTruncatedFrames;
+
+private:
+  virtual Boolean continuePlaying() {
+    if (fSource == NULL) return False;
+
+    fSource->getNextFrame(fBuffer, fBufferSize,
+			  afterGettingFrame, this,
+			  onSourceClosure, this);
+    return True;
+  }
+
+  static void afterGettingFrame(void* clientData, unsigned frameSize,
+				unsigned numTruncatedBytes,
+				struct timeval /*presentationTime*/,
+				unsigned /*durationInMicroseconds*/) {
+    DiscardSink* sink = (DiscardSink*)clientData;
+    ++sink->fNumFrames;
+    sink->fNumBytes += frameSize;
+    if (frameSize + numTruncatedBytes > sink->fMaxFrameSize) {
+      sink->fMaxFrameSize = frameSize + numTruncatedBytes;
+    }
+    if (numTruncatedBytes > 0) ++sink->fNumTruncatedFrames;
+
+    sink->continuePlaying();
+  }
+
+  unsigned char* fBuffer;
+};
+
+static Boolean hasSuffix(char const* fileName, char const* suffix) {
+  unsigned fileNameLen = strlen(fileName), suffixLen = strlen(suffix);
+  return fileNameLen >= suffixLen && strcmp(&fileName[fileNameLen - suffixLen], suffix) == 0;
+}
+
+static FramedSource* createFramer(char const* fileName, ByteStreamFileSource* fileSource) {
+  if (hasSuffix(fileName, ".264") || hasSuffix(fileName, ".h264")) {
+    return H264VideoStreamFramer::createNew(*env, fileSource);
+  } else if (hasSuffix(fileName, ".m4e")) {
+    return MPEG4VideoStreamFramer::createNew(*env, fileSource);
+  } else if (hasSuffix(fileName, ".mpg") || hasSuffix(fileName, ".m1v")
+	     || hasSuffix(fileName, ".m2v") || hasSuffix(fileName, ".mpv")) {
+    return MPEG1or2VideoStreamFramer::createNew(*env, fileSource);
+  }
+  return NULL;
+}
+
+char doneFlag;
+
+void afterPlaying(void* /*clientData*/) {
+  doneFlag = ~0;
+}
+
+int main(int argc, char** argv) {
+  // Begin by setting up our usage environment:
+  TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+  env = BasicUsageEnvironment::createNew(*scheduler);
+
+  progName = argv[0];
+  while (argc > 3) {
+    char* const opt = argv[1];
+    if (opt[0] != '-') usage();
+    unsigned value;
+    if (sscanf(argv[2], "%u", &value) != 1 || value == 0) usage();
+    switch (opt[1]) {
+    case 'n': numRuns = value; break;
+    case 'b': maxFrameSize = value; break;
+    default: usage();
+    }
+    argv += 2; argc -= 2;
+  }
+  if (argc != 2) usage();
+  char const* inputFileName = argv[1];
+
+  double totNumInputBytes = 0.0, totElapsed = 0.0;
+  DiscardSink* sink = new DiscardSink(*env, maxFrameSize);
+  for (unsigned run = 0; run < numRuns; ++run) {
+    ByteStreamFileSource* fileSource = ByteStreamFileSource::createNew(*env, inputFileName);
+    if (fileSource == NULL) {
+      *env << "Unable to open file \"" << inputFileName << "\" as a byte-stream file source\n";
+      exit(1);
+    }
+    totNumInputBytes += (double)(int64_t)fileSource->fileSize();
+
+    FramedSource* framer = createFramer(inputFileName, fileSource);
+    if (framer == NULL) {
+      Medium::close(fileSource);
+      usage();
+    }
+
+    struct timeval startTime;
+    gettimeofday(&startTime, NULL);
+    doneFlag = 0;
+    sink->startPlaying(*framer, afterPlaying, NULL);
+    env->taskScheduler().doEventLoop(&doneFlag);
+    totElapsed += secondsSince(startTime);
+
+    sink->stopPlaying();
+    Medium::close(framer); // also closes "fileSource"
+  }
+  if (totElapsed <= 0.0) totElapsed = 1e-6;
+
+  char result[200];
+  sprintf(result, "runs=%u input=%.1fMB frames=%u output=%.1fMB time=%.3fs speed=%.1fMB/s (%.0f frames/s)",
+	  numRuns, totNumInputBytes/1000000.0, sink->fNumFrames, sink->fNumBytes/1000000.0, totElapsed,
+	  totNumInputBytes/1000000.0/totElapsed, sink->fNumFrames/totElapsed);
+  *env << result << "\n";
+  *env << "largest frame: " << sink->fMaxFrameSize << " bytes";
+  if (sink->fNumTruncatedFrames > 0) {
+    *env << " (" << sink->fNumTruncatedFrames << " frames were truncated; use a larger \"-b\")";
+  }
+  *env << "\n";
+
+  Medium::close(sink);
+  return 0;
+}
@@ -0,0 +1,225 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// Copyright (c) 1996-2011, Live Networks, Inc.  All rights reserved
+// A benchmark for task schedulers: In each 'round', one datagram is sent
+// to each of a set of 'active' sockets, and is read by that socket's
+// background handler.  Meanwhile, a (possibly much larger) set of 'idle'
+// sockets - which never receive anything - is also being handled.
+// main program
+
+#include <BasicUsageEnvironment.hh>
+#include "GroupsockHelper.hh"
+#include <stdio.h>
+#if !defined(__WIN32__) && !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+char const* progName;
+UsageEnvironment* env;
+
+unsigned numIdleSockets = 10000;
+unsigned numActiveSockets = 1000;
+unsigned numRounds = 100;
+
+portNumBits* activePortNums; // in host order
+int senderSocket;
+unsigned numRoundsSent, numDatagramsReceived, numDatagramsLost;
+TaskToken roundTimeoutTask;
+char doneFlag;
+
+void usage() {
+  *env << "Usage: " << progName
+       << " [-i <num-idle-sockets>] [-a <num-active-sockets>] [-r <num-rounds>] [select|epoll]\n";
+  exit(1);
+}
+
+void readHandler(void* clientData, int /*mask*/); // forward
+void sendRound(void* clientData); // forward
+void roundTimedOut(void* clientData); // forward
+
+static void raiseDescriptorLimit(unsigned numDescriptors) {
+#if !defined(__WIN32__) && !defined(_WIN32)
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < numDescriptors) {
+    limit.rlim_cur = numDescriptors;
+    if (limit.rlim_max != RLIM_INFINITY && limit.rlim_cur > limit.rlim_max) {
+      limit.rlim_cur = limit.rlim_max;
+    }
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+#endif
+}
+
+// Runs the benchmark using the task scheduler of "env":
+static void runBenchmark(char const* schedulerName, Boolean isSelectBased) {
+  TaskScheduler& scheduler = env->taskScheduler();
+
+  unsigned const numSockets = numIdleSockets + numActiveSockets;
+  int* sockets = new int[numSockets];
+  activePortNums = new portNumBits[numActiveSockets];
+  unsigned numCreated;
+  int maxSocketNum = senderSocket = setupDatagramSocket(*env, 0);
+  Boolean success = senderSocket >= 0;
+  for (numCreated = 0; success && numCreated < numSockets; ++numCreated) {
+    int sock = setupDatagramSocket(*env, 0);
+    if (sock < 0) {
+      *env << schedulerName << ": failed to create socket #" << numCreated << ": "
+	   << env->getResultMsg() << "\n";
+      success = False;
+      break;
+    }
+    sockets[numCreated] = sock;
+    if (sock > maxSocketNum) maxSocketNum = sock;
+    if (numCreated >= numIdleSockets) {
+      Port port(0);
+      getSourcePort(*env, sock, port);
+      activePortNums[numCreated - numIdleSockets] = ntohs(port.num());
+    }
+  }
+
+  if (success && isSelectBased && maxSocketNum >= FD_SETSIZE) {
+    *env << schedulerName << ": skipped: socket numbers reach " << maxSocketNum
+	 << ", but \"select()\" can handle only " << FD_SETSIZE << " sockets\n";
+    success = False;
+  }
+
+  if (success) {
+    for (unsigned i = 0; i < numSockets; ++i) {
+      scheduler.turnOnBackgroundReadHandling(sockets[i], readHandler, (void*)(long)sockets[i]);
+    }
+
+    numRoundsSent = numDatagramsReceived = numDatagramsLost = 0;
+    doneFlag = 0;
+    struct timeval startTime, endTime;
+    gettimeofday(&startTime, NULL);
+    sendRound(NULL);
+    scheduler.doEventLoop(&doneFlag);
+    gettimeofday(&endTime, NULL);
+
+    double elapsed = (endTime.tv_sec - startTime.tv_sec)
+      + (endTime.tv_usec - startTime.tv_usec)/1000000.0;
+    *env << schedulerName << ": " << numActiveSockets << " active + "
+	 << numIdleSockets << " idle sockets, " << numRounds << " rounds: "
+	 << numDatagramsReceived << " datagrams handled in " << elapsed << " seconds ("
+	 << (unsigned)(numDatagramsReceived/elapsed) << " per second, "
+	 << (elapsed*1000000.0/(numDatagramsReceived > 0 ? numDatagramsReceived : 1))
+	 << " us each)";
+    if (numDatagramsLost > 0) *env << "; " << numDatagramsLost << " lost";
+    *env << "\n";
+
+    for (unsigned i = 0; i < numSockets; ++i) {
+      scheduler.turnOffBackgroundReadHandling(sockets[i]);
+    }
+  }
+
+  for (unsigned i = 0; i < numCreated; ++i) closeSocket(sockets[i]);
+  if (senderSocket >= 0) closeSocket(senderSocket);
+  delete[] sockets; delete[] activePortNums;
+}
+
+void sendRound(void* /*clientData*/) {
+  if (numRoundsSent == numRounds) {
+    doneFlag = 1;
+    return;
+  }
+  ++numRoundsSent;
+
+  struct in_addr loopback;
+  loopback.s_addr = our_inet_addr("127.0.0.1");
+  unsigned char datagram[100];
+  memset(datagram, numRoundsSent&0xFF, sizeof datagram);
+  for (unsigned i = 0; i < numActiveSockets; ++i) {
+    writeSocket(*env, senderSocket, loopback, Port(activePortNums[i]), 0, datagram, sizeof datagram);
+  }
+
+  // In case some datagrams get dropped, don't wait forever for this round to complete:
+  roundTimeoutTask = env->taskScheduler().scheduleDelayedTask(1000000, roundTimedOut, NULL);
+}
+
+void roundTimedOut(void* /*clientData*/) {
+  roundTimeoutTask = NULL;
+  unsigned numExpected = numRoundsSent*numActiveSockets;
+  numDatagramsLost += numExpected - numDatagramsReceived - numDatagramsLost;
+  sendRound(NULL);
+}
+
+void readHandler(void* clientData, int /*mask*/) {
+  int sock = (int)(long)clientData;
+  unsigned char buffer[1000];
+  struct sockaddr_in fromAddress;
+  if (readSocket(*env, sock, buffer, sizeof buffer, fromAddress) <= 0) return;
+
+  if (++numDatagramsReceived + numDatagramsLost == numRoundsSent*numActiveSockets) {
+    // This round is complete; begin the next one:
+    env->taskScheduler().unscheduleDelayedTask(roundTimeoutTask);
+    sendRound(NULL);
+  }
+}
+
+int main(int argc, char** argv) {
+  // Begin by setting up our usage environment:
+  TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+  env = BasicUsageEnvironment::createNew(*scheduler);
+
+  progName = argv[0];
+  while (argc > 2) {
+    char* const opt = argv[1];
+    if (opt[0] != '-') usage();
+    unsigned value;
+    if (sscanf(argv[2], "%u", &value) != 1) usage();
+    switch (opt[1]) {
+    case 'i': numIdleSockets = value; break;
+    case 'a': numActiveSockets = value; break;
+    case 'r': numRounds = value; break;
+    default: usage();
+    }
+    argv += 2; argc -= 2;
+  }
+  char const* schedulerToTest = NULL; // means: all of them
+  if (argc == 2) {
+    schedulerToTest = argv[1];
+    if (strcmp(schedulerToTest, "select") != 0 && strcmp(schedulerToTest, "epoll") != 0) usage();
+  } else if (argc > 2) {
+    usage();
+  }
+  if (numActiveSockets == 0 || numRounds == 0) usage();
+
+  raiseDescriptorLimit(numIdleSockets + numActiveSockets + 100);
+
+  if (schedulerToTest == NULL || strcmp(schedulerToTest, "select") == 0) {
+    runBenchmark("select", True);
+  }
+  if (schedulerToTest == NULL || strcmp(schedulerToTest, "epoll") == 0) {
+    TaskScheduler* epollScheduler = NULL;
+#if defined(__linux__)
+    epollScheduler = EpollTaskScheduler::createNew();
+#endif
+    if (epollScheduler == NULL) {
+      *env << "epoll: not available\n";
+    } else {
+      UsageEnvironment* basicEnv = env;
+      env = BasicUsageEnvironment::createNew(*epollScheduler);
+      runBenchmark("epoll", False);
+      env->reclaim();
+      delete epollScheduler;
+      env = basicEnv;
+    }
+  }
+
+  env->reclaim();
+  delete scheduler;
+  return 0;
+}